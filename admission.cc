@@ -0,0 +1,44 @@
+#include "admission.h"
+
+void AdmissionController::on_dequeue(uint64_t queued_ns, uint64_t now_ns) {
+    uint64_t sojourn = now_ns > queued_ns ? now_ns - queued_ns : 0;
+    uint64_t current = min_sojourn_ns.load(std::memory_order_relaxed);
+    while (sojourn < current &&
+           !min_sojourn_ns.compare_exchange_weak(current, sojourn, std::memory_order_relaxed)) {
+    }
+}
+
+bool AdmissionController::update(size_t queue_depth, uint64_t now_ns) {
+    if (!config.enabled()) {
+        return false;
+    }
+
+    // Hysteresis: once over the bound, stay saturated until a quarter of it has drained, so
+    // a queue hovering at the bound does not flip the listener on and off every iteration
+    bool over_bound = false;
+    if (config.max_queue_depth != 0) {
+        size_t resume_depth = config.max_queue_depth - config.max_queue_depth / 4;
+        over_bound = queue_depth >= (saturated ? resume_depth : config.max_queue_depth);
+    }
+    if (config.policy == AdmissionPolicy::Static) {
+        saturated = over_bound;
+        return saturated;
+    }
+
+    uint64_t interval_ns = config.interval_ms * 1000000;
+    if (interval_end_ns == 0) {
+        interval_end_ns = now_ns + interval_ns;
+    }
+    if (now_ns >= interval_end_ns) {
+        uint64_t min_sojourn = min_sojourn_ns.exchange(UINT64_MAX, std::memory_order_relaxed);
+        if (min_sojourn == UINT64_MAX) {
+            // Nothing was picked up for a whole interval: a standing queue if anything is waiting
+            standing_queue = queue_depth > 0;
+        } else {
+            standing_queue = min_sojourn > config.target_ms * 1000000;
+        }
+        interval_end_ns = now_ns + interval_ns;
+    }
+    saturated = over_bound || standing_queue;
+    return saturated;
+}
@@ -0,0 +1,70 @@
+#ifndef ADMISSION_H
+#define ADMISSION_H
+
+#include "ring-buffer.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// How the ThreadPool master decides it has more work queued than the workers can absorb
+enum class AdmissionPolicy {
+    Off,    // Every ready client is queued, however deep the queue gets
+    Static, // Saturated while max_queue_depth tasks or more are waiting
+    CoDel,  // Saturated while queued tasks have waited over target_ms for a whole interval_ms
+};
+
+// ThreadPool mode only: reactors have no shared queue to overflow
+struct AdmissionConfig {
+    AdmissionPolicy policy = AdmissionPolicy::Off;
+
+    // Static: the bound itself. CoDel: a hard cap on top of the sojourn test (0 = none).
+    size_t max_queue_depth = 1024;
+
+    // CoDel: a standing queue is one whose shortest wait over interval_ms stayed above target_ms
+    uint64_t target_ms = 5;
+    uint64_t interval_ms = 100;
+
+    bool enabled() const { return policy != AdmissionPolicy::Off; }
+};
+
+// Serialized once: shedding a request builds nothing, it only copies these bytes to the socket
+inline constexpr std::string_view OVERLOADED_RESPONSE = "HTTP/1.1 503 Service Unavailable\r\n"
+                                                        "Content-Length: 0\r\n"
+                                                        "Retry-After: 1\r\n"
+                                                        "Connection: close\r\n\r\n";
+
+/**
+ * @brief Tracks whether the ThreadPool queue is saturated. Workers report how long each task
+ * waited (on_dequeue(), a relaxed compare-exchange on one shared minimum); the master thread
+ * folds that and the queue depth into one decision per loop iteration (update()), so no
+ * worker ever blocks on it. CoDel judges by the minimum wait of an interval rather than the
+ * depth: a burst that drains quickly never counts, a standing queue does whatever its length.
+ */
+class AdmissionController {
+  private:
+    AdmissionConfig config;
+
+    alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> min_sojourn_ns{UINT64_MAX}; // This interval, from workers
+
+    // Master thread only
+    uint64_t interval_end_ns = 0;
+    bool standing_queue = false; // CoDel verdict of the last full interval
+    bool saturated = false;
+
+  public:
+    explicit AdmissionController(const AdmissionConfig &admission_config = AdmissionConfig())
+        : config(admission_config) {}
+
+    bool enabled() const { return config.enabled(); }
+
+    // Worker side: a task queued at queued_ns has just been picked up
+    void on_dequeue(uint64_t queued_ns, uint64_t now_ns);
+
+    // Master side: re-evaluates the state from the current queue depth and returns it
+    bool update(size_t queue_depth, uint64_t now_ns);
+
+    bool is_saturated() const { return saturated; }
+};
+
+#endif // ADMISSION_H
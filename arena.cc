@@ -0,0 +1,239 @@
+#include "arena.h"
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <utility>
+
+// --- BufferSlab ---
+
+static std::atomic<size_t> default_max_cached{256}; // 4 MiB of blocks per worker
+
+// Every live slab, for buffer_slab_stats(); slabs of exited threads leave their totals behind
+struct SlabRegistry {
+    std::mutex mutex;
+    std::vector<const BufferSlab *> slabs;
+    SlabStats retired;
+};
+
+static SlabRegistry &registry() {
+    static SlabRegistry instance; // Constructed before, so destroyed after, any thread's slab
+    return instance;
+}
+
+BufferSlab::BufferSlab(size_t max_cached_blocks) : max_cached(max_cached_blocks) {
+    SlabRegistry &slabs = registry();
+    std::lock_guard<std::mutex> lock(slabs.mutex);
+    slabs.slabs.push_back(this);
+}
+
+BufferSlab::~BufferSlab() {
+    for (char *block : free_blocks) {
+        delete[] block;
+    }
+    free_blocks.clear();
+    counters.cached.store(0, std::memory_order_relaxed);
+
+    SlabRegistry &slabs = registry();
+    std::lock_guard<std::mutex> lock(slabs.mutex);
+    slabs.slabs.erase(std::remove(slabs.slabs.begin(), slabs.slabs.end(), this), slabs.slabs.end());
+    add_to(slabs.retired);
+}
+
+char *BufferSlab::acquire() {
+    bump(counters.acquired);
+    raise(counters.peak_in_use, ++in_use);
+    if (free_blocks.empty()) {
+        return new char[BLOCK_SIZE];
+    }
+    char *block = free_blocks.back();
+    free_blocks.pop_back();
+    bump(counters.reused);
+    counters.cached.store(free_blocks.size(), std::memory_order_relaxed);
+    return block;
+}
+
+void BufferSlab::release(char *block) {
+    bump(counters.released);
+    if (in_use > 0) {
+        --in_use; // Blocks acquired on another thread are not counted here
+    }
+    if (free_blocks.size() >= max_cached) {
+        delete[] block;
+        bump(counters.freed);
+        return;
+    }
+    free_blocks.push_back(block);
+    counters.cached.store(free_blocks.size(), std::memory_order_relaxed);
+}
+
+void BufferSlab::add_to(SlabStats &total) const {
+    auto load = [](const std::atomic<uint64_t> &counter) { return counter.load(std::memory_order_relaxed); };
+    total.acquired += load(counters.acquired);
+    total.reused += load(counters.reused);
+    total.released += load(counters.released);
+    total.freed += load(counters.freed);
+    total.cached += load(counters.cached);
+    total.peak_in_use += load(counters.peak_in_use);
+    total.arena_resets += load(counters.arena_resets);
+    total.arena_peak_bytes = std::max(total.arena_peak_bytes, load(counters.arena_peak_bytes));
+    total.arena_oversize += load(counters.arena_oversize);
+    total.input_spills += load(counters.input_spills);
+}
+
+BufferSlab &BufferSlab::local() {
+    static thread_local BufferSlab slab(default_max_cached.load(std::memory_order_relaxed));
+    return slab;
+}
+
+void BufferSlab::set_default_max_cached(size_t blocks) { default_max_cached.store(blocks, std::memory_order_relaxed); }
+
+SlabStats buffer_slab_stats() {
+    SlabRegistry &slabs = registry();
+    std::lock_guard<std::mutex> lock(slabs.mutex);
+    SlabStats total = slabs.retired;
+    for (const BufferSlab *slab : slabs.slabs) {
+        slab->add_to(total);
+    }
+    return total;
+}
+
+// --- Arena ---
+
+Arena::Arena(Arena &&other) noexcept
+    : blocks(std::move(other.blocks)), oversize(std::move(other.oversize)), block_used(other.block_used),
+      total(other.total) {
+    other.blocks.clear();
+    other.oversize.clear();
+    other.block_used = other.total = 0;
+}
+
+Arena &Arena::operator=(Arena &&other) noexcept {
+    if (this != &other) {
+        reset();
+        blocks = std::move(other.blocks);
+        oversize = std::move(other.oversize);
+        block_used = other.block_used;
+        total = other.total;
+        other.blocks.clear();
+        other.oversize.clear();
+        other.block_used = other.total = 0;
+    }
+    return *this;
+}
+
+char *Arena::allocate(size_t length) {
+    total += length;
+    if (length > BufferSlab::BLOCK_SIZE) {
+        BufferSlab::local().note_arena_oversize();
+        oversize.emplace_back(new char[length]);
+        return oversize.back().get();
+    }
+    if (blocks.empty() || BufferSlab::BLOCK_SIZE - block_used < length) {
+        blocks.push_back(BufferSlab::local().acquire());
+        block_used = 0;
+    }
+    char *result = blocks.back() + block_used;
+    block_used += length;
+    return result;
+}
+
+std::string_view Arena::copy(std::string_view data) {
+    if (data.empty()) {
+        return {};
+    }
+    char *bytes = allocate(data.size());
+    std::memcpy(bytes, data.data(), data.size());
+    return {bytes, data.size()};
+}
+
+void Arena::reset() {
+    if (total == 0) {
+        return;
+    }
+    BufferSlab &slab = BufferSlab::local();
+    slab.note_arena_reset(total);
+    for (char *block : blocks) {
+        slab.release(block);
+    }
+    blocks.clear(); // Keeps its capacity for the next batch
+    oversize.clear();
+    block_used = total = 0;
+}
+
+// --- InputBuffer ---
+
+InputBuffer::InputBuffer(InputBuffer &&other) noexcept
+    : storage(std::exchange(other.storage, nullptr)), capacity(std::exchange(other.capacity, 0)),
+      start(std::exchange(other.start, 0)), end(std::exchange(other.end, 0)),
+      on_heap(std::exchange(other.on_heap, false)) {}
+
+InputBuffer &InputBuffer::operator=(InputBuffer &&other) noexcept {
+    if (this != &other) {
+        release();
+        storage = std::exchange(other.storage, nullptr);
+        capacity = std::exchange(other.capacity, 0);
+        start = std::exchange(other.start, 0);
+        end = std::exchange(other.end, 0);
+        on_heap = std::exchange(other.on_heap, false);
+    }
+    return *this;
+}
+
+void InputBuffer::release() {
+    if (storage) {
+        if (on_heap) {
+            delete[] storage;
+        } else {
+            BufferSlab::local().release(storage);
+        }
+    }
+    storage = nullptr;
+    capacity = start = end = 0;
+    on_heap = false;
+}
+
+char *InputBuffer::prepare(size_t min_space) {
+    if (!storage) {
+        storage = BufferSlab::local().acquire();
+        capacity = BufferSlab::BLOCK_SIZE;
+    }
+    if (capacity - end >= min_space) {
+        return storage + end;
+    }
+
+    size_t length = end - start;
+    if (capacity - length >= min_space) {
+        std::memmove(storage, storage + start, length); // Room enough once the consumed front is gone
+    } else {
+        size_t grown = std::max(capacity * 2, length + min_space);
+        char *larger = new char[grown];
+        std::memcpy(larger, storage + start, length);
+        if (on_heap) {
+            delete[] storage;
+        } else {
+            BufferSlab::local().release(storage);
+            BufferSlab::local().note_input_spill();
+        }
+        storage = larger;
+        capacity = grown;
+        on_heap = true;
+    }
+    start = 0;
+    end = length;
+    return storage + end;
+}
+
+void InputBuffer::append(const char *bytes, size_t length) {
+    if (length == 0) {
+        return;
+    }
+    std::memcpy(prepare(length), bytes, length);
+    end += length;
+}
+
+void InputBuffer::consume(size_t length) {
+    start += length;
+    if (start == end) {
+        release();
+    }
+}
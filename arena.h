@@ -0,0 +1,179 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+// Reuse counters of every worker's BufferSlab, summed by buffer_slab_stats()
+struct SlabStats {
+    uint64_t acquired = 0;    // Blocks handed out
+    uint64_t reused = 0;      // ... of which came off a free list rather than the allocator
+    uint64_t released = 0;    // Blocks handed back
+    uint64_t freed = 0;       // ... of which went back to the allocator: the free list was full
+    uint64_t cached = 0;      // Blocks sitting on free lists now
+    uint64_t peak_in_use = 0; // Most blocks each worker had out at once, summed
+
+    uint64_t arena_resets = 0;
+    uint64_t arena_peak_bytes = 0; // Most bytes one arena handed out between resets
+    uint64_t arena_oversize = 0;   // Arena allocations larger than a block, taken from the heap
+    uint64_t input_spills = 0;     // Input buffers that outgrew their block and moved to the heap
+
+    uint64_t in_use() const { return acquired - released; }
+};
+
+/**
+ * @brief Per-thread free list of fixed-size blocks for connection buffers and arenas.
+ * Every worker thread gets its own slab on first use (local()), so acquire() and release()
+ * are a vector pop and push with no lock; a block released on another thread simply joins
+ * that thread's list. Counters are written by the owning thread only and read with relaxed
+ * loads by buffer_slab_stats(), so keeping them costs no atomic read-modify-write.
+ */
+class BufferSlab {
+  public:
+    static constexpr size_t BLOCK_SIZE = 16 * 1024;
+
+  private:
+    struct Counters {
+        std::atomic<uint64_t> acquired{0};
+        std::atomic<uint64_t> reused{0};
+        std::atomic<uint64_t> released{0};
+        std::atomic<uint64_t> freed{0};
+        std::atomic<uint64_t> cached{0};
+        std::atomic<uint64_t> peak_in_use{0};
+        std::atomic<uint64_t> arena_resets{0};
+        std::atomic<uint64_t> arena_peak_bytes{0};
+        std::atomic<uint64_t> arena_oversize{0};
+        std::atomic<uint64_t> input_spills{0};
+    };
+
+    std::vector<char *> free_blocks;
+    size_t max_cached;
+    uint64_t in_use = 0;
+    Counters counters;
+
+    static void bump(std::atomic<uint64_t> &counter, uint64_t n = 1) {
+        counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+    static void raise(std::atomic<uint64_t> &counter, uint64_t value) {
+        if (value > counter.load(std::memory_order_relaxed)) {
+            counter.store(value, std::memory_order_relaxed);
+        }
+    }
+
+  public:
+    explicit BufferSlab(size_t max_cached_blocks);
+    ~BufferSlab();
+
+    BufferSlab(const BufferSlab &) = delete;
+    BufferSlab &operator=(const BufferSlab &) = delete;
+
+    // A BLOCK_SIZE block, from the free list when it has one
+    char *acquire();
+    void release(char *block);
+
+    void note_arena_reset(size_t bytes_used) {
+        bump(counters.arena_resets);
+        raise(counters.arena_peak_bytes, bytes_used);
+    }
+    void note_arena_oversize() { bump(counters.arena_oversize); }
+    void note_input_spill() { bump(counters.input_spills); }
+
+    void add_to(SlabStats &total) const;
+
+    // The calling thread's slab, created on first use
+    static BufferSlab &local();
+
+    // Free-list bound for slabs created from now on (ServerConfig::slab_cached_blocks)
+    static void set_default_max_cached(size_t blocks);
+};
+
+// Totals over every live slab plus those of threads that have exited
+SlabStats buffer_slab_stats();
+
+/**
+ * @brief Bump allocator over slab blocks, for bytes that live exactly as long as a batch of
+ * output. Allocation is a pointer bump; reset() hands every block back at once, so an empty
+ * arena holds no memory. Requests larger than a block get their own heap allocation.
+ */
+class Arena {
+  private:
+    std::vector<char *> blocks; // The last one is being filled
+    std::vector<std::unique_ptr<char[]>> oversize;
+    size_t block_used = 0; // Bytes of blocks.back() handed out
+    size_t total = 0;      // Bytes handed out since the last reset
+
+  public:
+    Arena() = default;
+    Arena(Arena &&other) noexcept;
+    Arena &operator=(Arena &&other) noexcept;
+    ~Arena() { reset(); }
+
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+
+    // length bytes of unaligned storage, valid until reset()
+    char *allocate(size_t length);
+
+    std::string_view copy(std::string_view data);
+
+    size_t size() const { return total; }
+    void reset();
+};
+
+/**
+ * @brief A connection's unconsumed input, stored in a slab block.
+ * Bytes are received straight into the free space after the buffered ones (prepare(), then
+ * commit()) and dropped from the front by moving an offset, not the bytes. Input larger than
+ * a block moves to a heap buffer that grows by doubling. Once empty, the buffer returns its
+ * storage (consume(), trim()), so an idle keep-alive connection holds no block at all.
+ */
+class InputBuffer {
+  private:
+    char *storage = nullptr;
+    size_t capacity = 0;
+    size_t start = 0; // Consumed bytes at the front
+    size_t end = 0;   // End of the buffered bytes
+    bool on_heap = false;
+
+    void release();
+
+  public:
+    InputBuffer() = default;
+    InputBuffer(InputBuffer &&other) noexcept;
+    InputBuffer &operator=(InputBuffer &&other) noexcept;
+    ~InputBuffer() { release(); }
+
+    InputBuffer(const InputBuffer &) = delete;
+    InputBuffer &operator=(const InputBuffer &) = delete;
+
+    const char *data() const { return storage + start; }
+    size_t size() const { return end - start; }
+    bool empty() const { return start == end; }
+    std::string_view view() const { return {storage + start, end - start}; }
+
+    // Makes room for at least min_space more bytes and returns where they go; writable()
+    // bytes may be written there before commit()
+    char *prepare(size_t min_space);
+    size_t writable() const { return capacity - end; }
+    void commit(size_t length) { end += length; }
+
+    void append(const char *bytes, size_t length);
+
+    // Drops length bytes from the front
+    void consume(size_t length);
+
+    // Returns the storage to the slab or the heap if nothing is buffered
+    void trim() {
+        if (start == end) {
+            release();
+        }
+    }
+
+    void clear() { release(); }
+};
+
+#endif // ARENA_H
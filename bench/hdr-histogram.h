@@ -0,0 +1,104 @@
+#ifndef HDR_HISTOGRAM_H
+#define HDR_HISTOGRAM_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief Log-linear latency histogram in the style of HdrHistogram.
+ * Values below 2048 get a bucket each; above that every power of two is split into 1024
+ * buckets, so any recorded value is reported within 0.1% (three significant digits) while
+ * the whole range up to MAX_VALUE fits in ~28k counters. Recording is an index computation
+ * and an increment. Not thread-safe: keep one per thread and merge() them afterwards.
+ */
+class HdrHistogram {
+  public:
+    static constexpr int SUB_BITS = 11;
+    static constexpr uint64_t SUB_COUNT = uint64_t(1) << SUB_BITS; // 2048
+    static constexpr uint64_t SUB_HALF = SUB_COUNT / 2;
+    static constexpr int MAX_SHIFT = 26;
+    static constexpr uint64_t MAX_VALUE = (SUB_COUNT << MAX_SHIFT) - 1; // ~38 hours in microseconds
+
+  private:
+    std::vector<uint64_t> counts;
+    uint64_t total = 0;
+    uint64_t min_value = UINT64_MAX;
+    uint64_t max_value = 0;
+
+    static size_t index_of(uint64_t value) {
+        if (value < SUB_COUNT) {
+            return static_cast<size_t>(value);
+        }
+        // Shift that brings value into [SUB_HALF, SUB_COUNT)
+        int shift = (63 - __builtin_clzll(value)) - (SUB_BITS - 1);
+        return static_cast<size_t>(SUB_COUNT + (shift - 1) * SUB_HALF + ((value >> shift) - SUB_HALF));
+    }
+
+    // Highest value that lands in bucket index
+    static uint64_t value_at(size_t index) {
+        if (index < SUB_COUNT) {
+            return index;
+        }
+        uint64_t shift = (index - SUB_COUNT) / SUB_HALF + 1;
+        uint64_t sub = (index - SUB_COUNT) % SUB_HALF + SUB_HALF;
+        return ((sub + 1) << shift) - 1;
+    }
+
+  public:
+    HdrHistogram() : counts(SUB_COUNT + MAX_SHIFT * SUB_HALF, 0) {}
+
+    void record(uint64_t value, uint64_t count = 1) {
+        value = std::min(value, MAX_VALUE);
+        counts[index_of(value)] += count;
+        total += count;
+        min_value = std::min(min_value, value);
+        max_value = std::max(max_value, value);
+    }
+
+    void merge(const HdrHistogram &other) {
+        for (size_t i = 0; i < counts.size(); ++i) {
+            counts[i] += other.counts[i];
+        }
+        total += other.total;
+        min_value = std::min(min_value, other.min_value);
+        max_value = std::max(max_value, other.max_value);
+    }
+
+    // Smallest recorded value v such that percentile% of the recorded values are <= v
+    uint64_t value_at_percentile(double percentile) const {
+        if (total == 0) {
+            return 0;
+        }
+        uint64_t wanted = static_cast<uint64_t>(percentile / 100.0 * static_cast<double>(total) + 0.5);
+        wanted = std::clamp<uint64_t>(wanted, 1, total);
+        uint64_t seen = 0;
+        for (size_t i = 0; i < counts.size(); ++i) {
+            seen += counts[i];
+            if (seen >= wanted) {
+                return std::min(value_at(i), max_value);
+            }
+        }
+        return max_value;
+    }
+
+    double mean() const {
+        if (total == 0) {
+            return 0;
+        }
+        double sum = 0;
+        for (size_t i = 0; i < counts.size(); ++i) {
+            if (counts[i] != 0) {
+                sum += static_cast<double>(counts[i]) * static_cast<double>(std::min(value_at(i), max_value));
+            }
+        }
+        return sum / static_cast<double>(total);
+    }
+
+    uint64_t count() const { return total; }
+    uint64_t min() const { return total ? min_value : 0; }
+    uint64_t max() const { return max_value; }
+};
+
+#endif // HDR_HISTOGRAM_H
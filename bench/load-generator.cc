@@ -0,0 +1,432 @@
+// HTTP/1.1 load generator for HybridHttpServer. Closed loop (each connection sends its next
+// request as soon as the last answer is in) or open loop (--rate: requests are scheduled at
+// a fixed rate whether or not the server keeps up). In open loop latency is measured from the
+// time a request was scheduled, not from when it could finally be sent, so a stalled server
+// is charged for the requests it delayed (no coordinated omission).
+
+#include "hdr-histogram.h"
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <iostream>
+#include <memory>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string>
+#include <string_view>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+struct Options {
+    std::string host = "127.0.0.1";
+    int port = 8080;
+    std::string path = "/status";
+    size_t connections = 64;
+    size_t threads = 4;
+    double duration_s = 10;
+    double warmup_s = 0;  // Requests completing before this are not recorded
+    double rate = 0;      // Requests per second over all connections; 0 = closed loop
+    uint64_t timeout_ms = 2000;
+};
+
+static uint64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+struct Client {
+    int fd = -1;
+    std::string in;
+    size_t request_sent = 0; // Bytes of the request written; == size once it is all out
+    bool in_flight = false;
+    uint64_t intended_ns = 0; // When the request in flight was due
+    uint64_t sent_ns = 0;     // When it actually went out
+    uint64_t next_ns = 0;     // Open loop: when the next request is due
+};
+
+struct ThreadResult {
+    HdrHistogram latency;     // Corrected: from the intended send time, in microseconds
+    HdrHistogram uncorrected; // From the actual send time
+    uint64_t requests = 0;
+    uint64_t non_2xx = 0;
+    uint64_t errors = 0;
+    uint64_t timeouts = 0;
+    uint64_t reconnects = 0;
+    uint64_t bytes_read = 0;
+};
+
+class LoadThread {
+  private:
+    const Options &options;
+    const struct sockaddr_in &address;
+    const std::string &request;
+    std::vector<Client> clients;
+    int epoll_fd = -1;
+    uint64_t interval_ns = 0; // Open loop: per-connection gap between requests
+    uint64_t record_after_ns = 0;
+    ThreadResult result;
+
+    bool connect_client(Client &client, size_t index) {
+        client.fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (client.fd == -1) {
+            perror("socket");
+            return false;
+        }
+        // Blocking connect keeps the loop simple; fine for a server on the same network
+        if (connect(client.fd, reinterpret_cast<const struct sockaddr *>(&address), sizeof(address)) == -1) {
+            perror("connect");
+            close(client.fd);
+            client.fd = -1;
+            return false;
+        }
+        int one = 1;
+        setsockopt(client.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        fcntl(client.fd, F_SETFL, fcntl(client.fd, F_GETFL, 0) | O_NONBLOCK);
+
+        struct epoll_event event;
+        event.events = EPOLLIN | EPOLLOUT | EPOLLET;
+        event.data.u64 = index;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client.fd, &event);
+        client.in.clear();
+        client.in_flight = false;
+        return true;
+    }
+
+    void reconnect(Client &client, size_t index) {
+        close(client.fd); // Also drops it from the epoll set
+        client.fd = -1;
+        result.reconnects++;
+        connect_client(client, index);
+    }
+
+    void fail(Client &client, size_t index) {
+        result.errors++;
+        reconnect(client, index);
+    }
+
+    void write_request(Client &client, size_t index) {
+        while (client.request_sent < request.size()) {
+            ssize_t n = send(client.fd, request.data() + client.request_sent, request.size() - client.request_sent,
+                             MSG_NOSIGNAL);
+            if (n > 0) {
+                client.request_sent += static_cast<size_t>(n);
+                continue;
+            }
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                return; // EPOLLOUT finishes it
+            fail(client, index);
+            return;
+        }
+    }
+
+    void start_request(Client &client, size_t index, uint64_t now) {
+        client.in_flight = true;
+        client.request_sent = 0;
+        client.sent_ns = now;
+        if (interval_ns != 0) {
+            client.intended_ns = client.next_ns;
+            client.next_ns += interval_ns;
+        } else {
+            client.intended_ns = now;
+        }
+        write_request(client, index);
+    }
+
+    // Consumes one complete response from client.in if there is one; false if more is needed.
+    // close_after is set when the server announced it closes the connection.
+    bool take_response(Client &client, uint64_t now, bool &close_after) {
+        size_t head_end = client.in.find("\r\n\r\n");
+        if (head_end == std::string::npos) {
+            return false;
+        }
+        std::string_view head(client.in.data(), head_end);
+        size_t content_length = 0;
+        size_t line = head.find("\r\n");
+        while (line != std::string_view::npos && line < head.size()) {
+            size_t next = head.find("\r\n", line + 2);
+            std::string_view header = head.substr(line + 2, (next == std::string_view::npos ? head.size() : next) - line - 2);
+            if (header.size() > 15 && strncasecmp(header.data(), "content-length:", 15) == 0) {
+                content_length = std::strtoull(std::string(header.substr(15)).c_str(), nullptr, 10);
+            } else if (header.size() > 11 && strncasecmp(header.data(), "connection:", 11) == 0 &&
+                       header.find("close") != std::string_view::npos) {
+                close_after = true;
+            }
+            line = next;
+        }
+        size_t total = head_end + 4 + content_length;
+        if (client.in.size() < total) {
+            return false;
+        }
+
+        int status = head.size() >= 12 ? std::atoi(std::string(head.substr(9, 3)).c_str()) : 0;
+        if (status < 200 || status >= 300) {
+            result.non_2xx++;
+        }
+        if (now >= record_after_ns) {
+            result.requests++;
+            result.latency.record((now - client.intended_ns) / 1000);
+            result.uncorrected.record((now - client.sent_ns) / 1000);
+        }
+        client.in.erase(0, total);
+        client.in_flight = false;
+        return true;
+    }
+
+    void on_readable(Client &client, size_t index, uint64_t now) {
+        char buffer[16384];
+        bool closed = false;
+        while (true) {
+            ssize_t n = recv(client.fd, buffer, sizeof(buffer), 0);
+            if (n > 0) {
+                client.in.append(buffer, static_cast<size_t>(n));
+                result.bytes_read += static_cast<uint64_t>(n);
+                continue;
+            }
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                break;
+            closed = true;
+            break;
+        }
+        // The last response may arrive together with the close that follows it
+        bool close_after = false;
+        if (client.in_flight) {
+            take_response(client, now, close_after);
+        }
+        if (closed || close_after) {
+            if (client.in_flight) {
+                fail(client, index); // Closed or reset mid-response
+            } else {
+                reconnect(client, index);
+            }
+        }
+    }
+
+  public:
+    LoadThread(const Options &opts, const struct sockaddr_in &addr, const std::string &req, size_t connections,
+               double rate)
+        : options(opts), address(addr), request(req), clients(connections) {
+        if (rate > 0 && connections > 0) {
+            interval_ns = static_cast<uint64_t>(1e9 * static_cast<double>(connections) / rate);
+        }
+    }
+
+    ~LoadThread() {
+        for (Client &client : clients) {
+            if (client.fd != -1) {
+                close(client.fd);
+            }
+        }
+        if (epoll_fd != -1) {
+            close(epoll_fd);
+        }
+    }
+
+    void run(uint64_t start_ns, uint64_t end_ns) {
+        epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (epoll_fd == -1) {
+            perror("epoll_create1");
+            return;
+        }
+        record_after_ns = start_ns + static_cast<uint64_t>(options.warmup_s * 1e9);
+        for (size_t i = 0; i < clients.size(); ++i) {
+            if (!connect_client(clients[i], i)) {
+                return;
+            }
+            // Spread the connections' schedules over one interval instead of firing in bursts
+            clients[i].next_ns = start_ns + (clients.size() ? interval_ns * i / clients.size() : 0);
+        }
+
+        struct epoll_event events[256];
+        uint64_t timeout_ns = options.timeout_ms * 1000000;
+        while (true) {
+            uint64_t now = now_ns();
+            if (now >= end_ns) {
+                break;
+            }
+
+            // Start whatever is due and find the next deadline to sleep until
+            uint64_t wake_ns = end_ns;
+            for (size_t i = 0; i < clients.size(); ++i) {
+                Client &client = clients[i];
+                if (client.fd == -1 && !connect_client(client, i)) {
+                    continue;
+                }
+                if (client.in_flight) {
+                    if (now - client.sent_ns > timeout_ns) {
+                        result.timeouts++;
+                        fail(client, i);
+                    } else {
+                        wake_ns = std::min(wake_ns, client.sent_ns + timeout_ns);
+                        continue;
+                    }
+                }
+                if (interval_ns == 0 || client.next_ns <= now) {
+                    start_request(client, i, now);
+                } else {
+                    wake_ns = std::min(wake_ns, client.next_ns);
+                }
+            }
+
+            // Rounded down and the rest spun off: a send that goes out late would be charged
+            // to the server as latency
+            int timeout_ms = wake_ns > now ? static_cast<int>((wake_ns - now) / 1000000) : 0;
+            int n = epoll_wait(epoll_fd, events, 256, timeout_ms);
+            now = now_ns();
+            for (int e = 0; e < n; ++e) {
+                size_t index = events[e].data.u64;
+                Client &client = clients[index];
+                if (client.fd == -1) {
+                    continue;
+                }
+                if ((events[e].events & EPOLLOUT) && client.in_flight && client.request_sent < request.size()) {
+                    write_request(client, index);
+                }
+                if (client.fd != -1 && (events[e].events & (EPOLLIN | EPOLLERR | EPOLLHUP))) {
+                    on_readable(client, index, now);
+                }
+            }
+        }
+    }
+
+    const ThreadResult &results() const { return result; }
+};
+
+static void print_usage(const char *program) {
+    std::cerr << "Usage: " << program
+              << " [--host=ADDR] [--port=N] [--path=/status] [--connections=N] [--threads=N]"
+                 " [--duration=SECONDS] [--warmup=SECONDS] [--rate=REQ_PER_SEC] [--timeout-ms=N]"
+              << std::endl;
+}
+
+static bool parse_args(int argc, char *argv[], Options &options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        size_t eq = arg.find('=');
+        if (arg.rfind("--", 0) != 0 || eq == std::string::npos) {
+            return false;
+        }
+        std::string name = arg.substr(2, eq - 2);
+        std::string value = arg.substr(eq + 1);
+        if (name == "host") {
+            options.host = value;
+        } else if (name == "port") {
+            options.port = std::atoi(value.c_str());
+        } else if (name == "path") {
+            options.path = value;
+        } else if (name == "connections") {
+            options.connections = std::strtoul(value.c_str(), nullptr, 10);
+        } else if (name == "threads") {
+            options.threads = std::strtoul(value.c_str(), nullptr, 10);
+        } else if (name == "duration") {
+            options.duration_s = std::atof(value.c_str());
+        } else if (name == "warmup") {
+            options.warmup_s = std::atof(value.c_str());
+        } else if (name == "rate") {
+            options.rate = std::atof(value.c_str());
+        } else if (name == "timeout-ms") {
+            options.timeout_ms = std::strtoull(value.c_str(), nullptr, 10);
+        } else {
+            return false;
+        }
+    }
+    return options.connections > 0 && options.threads > 0 && options.duration_s > 0;
+}
+
+static void print_latency(const char *label, const HdrHistogram &histogram) {
+    std::printf("%s (us): mean %.1f  min %lu\n", label, histogram.mean(), static_cast<unsigned long>(histogram.min()));
+    const double percentiles[] = {50, 75, 90, 99, 99.9, 99.99, 100};
+    for (double p : percentiles) {
+        std::printf("  %7.3f%%  %10lu\n", p, static_cast<unsigned long>(histogram.value_at_percentile(p)));
+    }
+}
+
+int main(int argc, char *argv[]) {
+    Options options;
+    if (!parse_args(argc, argv, options)) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    options.threads = std::min(options.threads, options.connections);
+
+    struct sockaddr_in address;
+    std::memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(static_cast<uint16_t>(options.port));
+    if (inet_pton(AF_INET, options.host.c_str(), &address.sin_addr) != 1) {
+        struct hostent *host = gethostbyname(options.host.c_str());
+        if (!host || host->h_addrtype != AF_INET) {
+            std::cerr << "Cannot resolve " << options.host << std::endl;
+            return 1;
+        }
+        std::memcpy(&address.sin_addr, host->h_addr_list[0], sizeof(address.sin_addr));
+    }
+    std::string request = "GET " + options.path + " HTTP/1.1\r\nHost: " + options.host + ":" +
+                          std::to_string(options.port) + "\r\n\r\n";
+
+    std::printf("Running %.1fs test @ http://%s:%d%s\n", options.duration_s, options.host.c_str(), options.port,
+                options.path.c_str());
+    if (options.rate > 0) {
+        std::printf("  %zu threads, %zu connections, open loop at %.0f req/s\n", options.threads, options.connections,
+                    options.rate);
+    } else {
+        std::printf("  %zu threads, %zu connections, closed loop\n", options.threads, options.connections);
+    }
+
+    std::vector<std::unique_ptr<LoadThread>> loaders;
+    for (size_t t = 0; t < options.threads; ++t) {
+        // Connections and rate split evenly; the first threads take the remainder
+        size_t connections = options.connections / options.threads + (t < options.connections % options.threads);
+        double rate = options.rate * static_cast<double>(connections) / static_cast<double>(options.connections);
+        loaders.push_back(std::make_unique<LoadThread>(options, address, request, connections, rate));
+    }
+
+    uint64_t start_ns = now_ns();
+    uint64_t end_ns = start_ns + static_cast<uint64_t>((options.warmup_s + options.duration_s) * 1e9);
+    std::vector<std::thread> threads;
+    for (auto &loader : loaders) {
+        threads.emplace_back([&loader, start_ns, end_ns] { loader->run(start_ns, end_ns); });
+    }
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+
+    ThreadResult total;
+    for (auto &loader : loaders) {
+        const ThreadResult &r = loader->results();
+        total.latency.merge(r.latency);
+        total.uncorrected.merge(r.uncorrected);
+        total.requests += r.requests;
+        total.non_2xx += r.non_2xx;
+        total.errors += r.errors;
+        total.timeouts += r.timeouts;
+        total.reconnects += r.reconnects;
+        total.bytes_read += r.bytes_read;
+    }
+
+    std::printf("Requests: %lu in %.1fs, %.0f req/s, %.2f MB read\n", static_cast<unsigned long>(total.requests),
+                options.duration_s, static_cast<double>(total.requests) / options.duration_s,
+                static_cast<double>(total.bytes_read) / 1e6);
+    std::printf("Errors: %lu (timeouts %lu), non-2xx: %lu, reconnects: %lu\n", static_cast<unsigned long>(total.errors),
+                static_cast<unsigned long>(total.timeouts), static_cast<unsigned long>(total.non_2xx),
+                static_cast<unsigned long>(total.reconnects));
+    if (options.rate > 0) {
+        print_latency("Latency from intended send", total.latency);
+        print_latency("Latency from actual send (uncorrected)", total.uncorrected);
+    } else {
+        print_latency("Latency", total.latency);
+    }
+    return 0;
+}
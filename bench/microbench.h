@@ -0,0 +1,90 @@
+#ifndef MICROBENCH_H
+#define MICROBENCH_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+/**
+ * @brief A minimal stand-in for Google Benchmark, so the bench target needs no dependency.
+ * A benchmark is a function taking a BenchState and looping on keep_running(); the runner
+ * grows the iteration count until one run lasts at least MIN_TIME and reports the time per
+ * iteration of that run. Register with BENCHMARK(function).
+ */
+class BenchState {
+  private:
+    uint64_t remaining;
+    uint64_t total_iterations;
+    uint64_t items = 0;
+
+  public:
+    explicit BenchState(uint64_t iterations) : remaining(iterations), total_iterations(iterations) {}
+
+    bool keep_running() { return remaining-- != 0; }
+    uint64_t iterations() const { return total_iterations; }
+
+    // Work units done per iteration (requests parsed, tasks run), for the items/s column
+    void set_items_processed(uint64_t count) { items = count; }
+    uint64_t items_processed() const { return items; }
+};
+
+using BenchFunction = void (*)(BenchState &);
+
+struct BenchEntry {
+    const char *name;
+    BenchFunction function;
+};
+
+inline std::vector<BenchEntry> &bench_registry() {
+    static std::vector<BenchEntry> entries;
+    return entries;
+}
+
+struct BenchRegistration {
+    BenchRegistration(const char *name, BenchFunction function) { bench_registry().push_back({name, function}); }
+};
+
+#define BENCHMARK(function) static BenchRegistration bench_registration_##function(#function, function)
+
+// Keeps the compiler from discarding a result that is otherwise unused
+template <class T> inline void do_not_optimize(const T &value) { asm volatile("" : : "r,m"(value) : "memory"); }
+
+inline void clobber_memory() { asm volatile("" : : : "memory"); }
+
+// Runs every registered benchmark whose name contains filter (all when it is empty)
+inline int run_benchmarks(const char *filter) {
+    using namespace std::chrono;
+    constexpr auto MIN_TIME = milliseconds(500);
+
+    std::printf("%-36s %15s %15s %15s\n", "Benchmark", "Time/iter", "Iterations", "Items/s");
+    for (const BenchEntry &entry : bench_registry()) {
+        if (filter && *filter && std::strstr(entry.name, filter) == nullptr) {
+            continue;
+        }
+        uint64_t iterations = 1;
+        while (true) {
+            BenchState state(iterations);
+            auto start = steady_clock::now();
+            entry.function(state);
+            auto elapsed = steady_clock::now() - start;
+            if (elapsed >= MIN_TIME || iterations >= (uint64_t(1) << 40)) {
+                double ns = duration<double, std::nano>(elapsed).count() / static_cast<double>(iterations);
+                double items_per_s = state.items_processed() * 1e9 / ns;
+                std::printf("%-36s %12.1f ns %15lu %15.0f\n", entry.name, ns, static_cast<unsigned long>(iterations),
+                            items_per_s);
+                break;
+            }
+            // Aim just past MIN_TIME from what this run took, growing at most 10x per step
+            double ratio = elapsed.count() > 0 ? duration<double>(MIN_TIME).count() / duration<double>(elapsed).count() : 10;
+            iterations = static_cast<uint64_t>(static_cast<double>(iterations) * std::min(10.0, std::max(2.0, ratio * 1.2)));
+        }
+    }
+    return 0;
+}
+
+#endif // MICROBENCH_H
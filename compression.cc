@@ -0,0 +1,535 @@
+#include "compression.h"
+#include "http-parser.h"
+#include "http-response.h"
+#include "metrics.h"
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <unistd.h>
+#include <utility>
+#include <zlib.h>
+
+#ifdef COMPRESSION_BROTLI
+#include <brotli/encode.h>
+#endif
+#ifdef COMPRESSION_ZSTD
+#include <zstd.h>
+#endif
+
+// Output is produced into the coder's buffer, then appended: no zero-filled growth of out
+static constexpr size_t CODER_BUFFER_SIZE = 64 * 1024;
+
+// Idle coders a thread keeps per coding; more streams than this at once allocate their own
+static constexpr size_t MAX_POOLED_CODERS = 4;
+
+bool accepts_encoding(std::string_view header, std::string_view coding) {
+    while (!header.empty()) {
+        size_t comma = header.find(',');
+        std::string_view item = header.substr(0, comma);
+        header = comma == std::string_view::npos ? std::string_view() : header.substr(comma + 1);
+
+        size_t semicolon = item.find(';');
+        std::string_view name = item.substr(0, semicolon);
+        while (!name.empty() && name.front() == ' ')
+            name.remove_prefix(1);
+        while (!name.empty() && name.back() == ' ')
+            name.remove_suffix(1);
+        if (!equals_ignore_case(name, coding)) {
+            continue;
+        }
+        if (semicolon == std::string_view::npos) {
+            return true;
+        }
+        std::string_view params = item.substr(semicolon + 1);
+        size_t q = params.find("q=");
+        if (q == std::string_view::npos) {
+            return true;
+        }
+        // "q=0", "q=0.0", "q=0.000" all mean "not acceptable"
+        std::string_view value = params.substr(q + 2);
+        size_t end = value.find_first_not_of("0.");
+        return end == 0 || (end != std::string_view::npos && value[end] >= '1' && value[end] <= '9');
+    }
+    return false;
+}
+
+uint8_t accepted_codings(std::string_view accept_encoding) {
+    if (accept_encoding.empty()) {
+        return 0;
+    }
+    uint8_t accepted = 0;
+    if (accepts_encoding(accept_encoding, "gzip")) {
+        accepted |= static_cast<uint8_t>(ContentCoding::Gzip);
+    }
+#ifdef COMPRESSION_BROTLI
+    if (accepts_encoding(accept_encoding, "br")) {
+        accepted |= static_cast<uint8_t>(ContentCoding::Brotli);
+    }
+#endif
+#ifdef COMPRESSION_ZSTD
+    if (accepts_encoding(accept_encoding, "zstd")) {
+        accepted |= static_cast<uint8_t>(ContentCoding::Zstd);
+    }
+#endif
+    return accepted;
+}
+
+static bool starts_with_ignore_case(std::string_view value, std::string_view prefix) {
+    return value.size() >= prefix.size() && equals_ignore_case(value.substr(0, prefix.size()), prefix);
+}
+
+static bool contains_ignore_case(std::string_view value, std::string_view part) {
+    for (size_t i = 0; i + part.size() <= value.size(); ++i) {
+        if (equals_ignore_case(value.substr(i, part.size()), part)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool compressible_type(std::string_view content_type) {
+    std::string_view type = content_type.substr(0, content_type.find(';'));
+    while (!type.empty() && type.back() == ' ') {
+        type.remove_suffix(1);
+    }
+    if (starts_with_ignore_case(type, "text/")) {
+        return true;
+    }
+    if (starts_with_ignore_case(type, "application/") || starts_with_ignore_case(type, "image/svg")) {
+        static constexpr std::string_view TEXT_LIKE[] = {"json", "javascript", "ecmascript", "xml", "wasm",
+                                                         "x-www-form-urlencoded", "x-ndjson", "yaml", "toml"};
+        for (std::string_view part : TEXT_LIKE) {
+            if (contains_ignore_case(type, part)) {
+                return true;
+            }
+        }
+        return equals_ignore_case(type, "application/vnd.ms-fontobject");
+    }
+    return equals_ignore_case(type, "font/ttf") || equals_ignore_case(type, "font/otf");
+}
+
+// --- Coders ---
+
+#ifdef COMPRESSION_BROTLI
+/**
+ * @brief Memory for Brotli encoders. The API has no reset, so each stream creates an encoder,
+ * but through these functions its tables are the blocks the previous stream on this coder
+ * freed: the encoder's allocations repeat from stream to stream, so none reaches malloc.
+ */
+struct BrotliBlocks {
+    static constexpr size_t MAX_BLOCKS = 32;
+    static constexpr size_t HEADER = alignof(std::max_align_t); // Holds the block's size
+
+    std::vector<std::pair<size_t, void *>> free_blocks;
+
+    ~BrotliBlocks() {
+        for (auto &block : free_blocks) {
+            std::free(block.second);
+        }
+    }
+
+    static void *allocate(void *opaque, size_t size) {
+        auto *blocks = static_cast<BrotliBlocks *>(opaque);
+        for (size_t i = 0; i < blocks->free_blocks.size(); ++i) {
+            if (blocks->free_blocks[i].first == size) {
+                void *base = blocks->free_blocks[i].second;
+                blocks->free_blocks[i] = blocks->free_blocks.back();
+                blocks->free_blocks.pop_back();
+                return static_cast<char *>(base) + HEADER;
+            }
+        }
+        void *base = std::malloc(size + HEADER);
+        if (!base) {
+            return nullptr;
+        }
+        *static_cast<size_t *>(base) = size;
+        return static_cast<char *>(base) + HEADER;
+    }
+
+    static void release(void *opaque, void *address) {
+        if (!address) {
+            return;
+        }
+        auto *blocks = static_cast<BrotliBlocks *>(opaque);
+        void *base = static_cast<char *>(address) - HEADER;
+        if (blocks->free_blocks.size() < MAX_BLOCKS) {
+            blocks->free_blocks.emplace_back(*static_cast<size_t *>(base), base);
+        } else {
+            std::free(base);
+        }
+    }
+};
+#endif
+
+struct CompressionStream::Coder {
+    ContentCoding coding;
+    std::unique_ptr<char[]> buffer{new char[CODER_BUFFER_SIZE]};
+
+    z_stream zlib{};
+    bool zlib_ready = false;
+    int zlib_level = 0;
+
+#ifdef COMPRESSION_BROTLI
+    BrotliBlocks brotli_blocks;
+    BrotliEncoderState *brotli = nullptr; // Per stream
+#endif
+#ifdef COMPRESSION_ZSTD
+    ZSTD_CCtx *zstd = nullptr;
+#endif
+
+    explicit Coder(ContentCoding kind) : coding(kind) {}
+
+    ~Coder() {
+        if (zlib_ready) {
+            deflateEnd(&zlib);
+        }
+#ifdef COMPRESSION_BROTLI
+        if (brotli) {
+            BrotliEncoderDestroyInstance(brotli);
+        }
+#endif
+#ifdef COMPRESSION_ZSTD
+        ZSTD_freeCCtx(zstd);
+#endif
+    }
+
+    Coder(const Coder &) = delete;
+    Coder &operator=(const Coder &) = delete;
+
+    // Prepares the coder for a new stream of size_hint bytes (0: unknown)
+    bool begin(const CompressionConfig &config, size_t size_hint);
+
+    // The stream is over, completed or not
+    void end() {
+#ifdef COMPRESSION_BROTLI
+        if (brotli) {
+            BrotliEncoderDestroyInstance(brotli);
+            brotli = nullptr;
+        }
+#endif
+    }
+
+    bool run(std::string_view input, bool last, std::string &out);
+};
+
+bool CompressionStream::Coder::begin(const CompressionConfig &config, size_t size_hint) {
+    switch (coding) {
+    case ContentCoding::Gzip:
+        if (!zlib_ready) {
+            // windowBits 15 + 16: a gzip wrapper rather than zlib's
+            if (deflateInit2(&zlib, config.gzip_level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+                return false;
+            }
+            zlib_ready = true;
+            zlib_level = config.gzip_level;
+            return true;
+        }
+        if (deflateReset(&zlib) != Z_OK) {
+            return false;
+        }
+        if (zlib_level != config.gzip_level) {
+            zlib_level = config.gzip_level;
+            return deflateParams(&zlib, zlib_level, Z_DEFAULT_STRATEGY) == Z_OK;
+        }
+        return true;
+#ifdef COMPRESSION_BROTLI
+    case ContentCoding::Brotli:
+        brotli = BrotliEncoderCreateInstance(&BrotliBlocks::allocate, &BrotliBlocks::release, &brotli_blocks);
+        if (!brotli) {
+            return false;
+        }
+        BrotliEncoderSetParameter(brotli, BROTLI_PARAM_QUALITY, static_cast<uint32_t>(config.brotli_quality));
+        BrotliEncoderSetParameter(brotli, BROTLI_PARAM_MODE, BROTLI_MODE_TEXT);
+        if (size_hint != 0) {
+            // A window no larger than the body keeps the tables (and their clearing) small
+            uint32_t window = BROTLI_MIN_WINDOW_BITS;
+            while (window < BROTLI_MAX_WINDOW_BITS && (size_t(1) << window) < size_hint) {
+                window++;
+            }
+            BrotliEncoderSetParameter(brotli, BROTLI_PARAM_LGWIN, window);
+            BrotliEncoderSetParameter(brotli, BROTLI_PARAM_SIZE_HINT,
+                                      static_cast<uint32_t>(std::min<size_t>(size_hint, UINT32_MAX)));
+        }
+        return true;
+#endif
+#ifdef COMPRESSION_ZSTD
+    case ContentCoding::Zstd:
+        if (!zstd && !(zstd = ZSTD_createCCtx())) {
+            return false;
+        }
+        ZSTD_CCtx_reset(zstd, ZSTD_reset_session_and_parameters);
+        ZSTD_CCtx_setParameter(zstd, ZSTD_c_compressionLevel, config.zstd_level);
+        // Sizes the window and tables to the body; the hint is exact, as zstd requires
+        return size_hint == 0 || !ZSTD_isError(ZSTD_CCtx_setPledgedSrcSize(zstd, size_hint));
+#endif
+    default:
+        return false;
+    }
+}
+
+bool CompressionStream::Coder::run(std::string_view input, bool last, std::string &out) {
+    char *space = buffer.get();
+    switch (coding) {
+    case ContentCoding::Gzip: {
+        int flush = last ? Z_FINISH : Z_NO_FLUSH;
+        zlib.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(input.data()));
+        zlib.avail_in = static_cast<uInt>(input.size());
+        while (true) {
+            zlib.next_out = reinterpret_cast<Bytef *>(space);
+            zlib.avail_out = CODER_BUFFER_SIZE;
+            int result = deflate(&zlib, flush);
+            if (result == Z_STREAM_ERROR) {
+                return false;
+            }
+            out.append(space, CODER_BUFFER_SIZE - zlib.avail_out);
+            if (last ? result == Z_STREAM_END : zlib.avail_in == 0 && zlib.avail_out != 0) {
+                return true;
+            }
+        }
+    }
+#ifdef COMPRESSION_BROTLI
+    case ContentCoding::Brotli: {
+        BrotliEncoderOperation operation = last ? BROTLI_OPERATION_FINISH : BROTLI_OPERATION_PROCESS;
+        size_t available_in = input.size();
+        const uint8_t *next_in = reinterpret_cast<const uint8_t *>(input.data());
+        while (true) {
+            size_t available_out = CODER_BUFFER_SIZE;
+            uint8_t *next_out = reinterpret_cast<uint8_t *>(space);
+            if (!BrotliEncoderCompressStream(brotli, operation, &available_in, &next_in, &available_out, &next_out,
+                                             nullptr)) {
+                return false;
+            }
+            out.append(space, CODER_BUFFER_SIZE - available_out);
+            bool done = last ? BrotliEncoderIsFinished(brotli) : available_in == 0;
+            if (done && !BrotliEncoderHasMoreOutput(brotli)) {
+                return true;
+            }
+        }
+    }
+#endif
+#ifdef COMPRESSION_ZSTD
+    case ContentCoding::Zstd: {
+        ZSTD_inBuffer in_buffer = {input.data(), input.size(), 0};
+        while (true) {
+            ZSTD_outBuffer out_buffer = {space, CODER_BUFFER_SIZE, 0};
+            size_t remaining = ZSTD_compressStream2(zstd, &out_buffer, &in_buffer, last ? ZSTD_e_end : ZSTD_e_continue);
+            if (ZSTD_isError(remaining)) {
+                return false;
+            }
+            out.append(space, out_buffer.pos);
+            if (last ? remaining == 0 : in_buffer.pos == in_buffer.size) {
+                return true;
+            }
+        }
+    }
+#endif
+    default:
+        return false;
+    }
+}
+
+/**
+ * @brief A thread's idle coders, one free list per coding. Coders are not tied to a thread:
+ * one released on another thread (a stream destroyed elsewhere) joins that thread's pool.
+ */
+struct CoderPool {
+    std::array<std::vector<CompressionStream::Coder *>, 3> idle;
+
+    static size_t slot(ContentCoding coding) {
+        return coding == ContentCoding::Gzip ? 0 : coding == ContentCoding::Brotli ? 1 : 2;
+    }
+
+    ~CoderPool() {
+        for (auto &coders : idle) {
+            for (CompressionStream::Coder *coder : coders) {
+                delete coder;
+            }
+        }
+    }
+
+    static CoderPool &local() {
+        static thread_local CoderPool pool;
+        return pool;
+    }
+
+    CompressionStream::Coder *acquire(ContentCoding coding) {
+        std::vector<CompressionStream::Coder *> &coders = idle[slot(coding)];
+        if (coders.empty()) {
+            return new CompressionStream::Coder(coding);
+        }
+        CompressionStream::Coder *coder = coders.back();
+        coders.pop_back();
+        return coder;
+    }
+
+    void release(CompressionStream::Coder *coder) {
+        coder->end();
+        std::vector<CompressionStream::Coder *> &coders = idle[slot(coder->coding)];
+        if (coders.size() < MAX_POOLED_CODERS) {
+            coders.push_back(coder);
+        } else {
+            delete coder;
+        }
+    }
+};
+
+// --- CompressionStream ---
+
+static bool coding_available(ContentCoding coding) {
+    switch (coding) {
+    case ContentCoding::Gzip:
+        return true;
+#ifdef COMPRESSION_BROTLI
+    case ContentCoding::Brotli:
+        return true;
+#endif
+#ifdef COMPRESSION_ZSTD
+    case ContentCoding::Zstd:
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
+
+CompressionStream::CompressionStream(ContentCoding body_coding, const CompressionConfig &config, size_t size_hint)
+    : coding(body_coding) {
+    if (!coding_available(coding)) {
+        return;
+    }
+    coder = CoderPool::local().acquire(coding);
+    if (!coder->begin(config, size_hint)) {
+        // Whatever state it is in, the coder is not reused
+        delete coder;
+        coder = nullptr;
+    }
+}
+
+CompressionStream::~CompressionStream() {
+    if (coder) {
+        CoderPool::local().release(coder);
+    }
+}
+
+CompressionStream::CompressionStream(CompressionStream &&other) noexcept
+    : coding(other.coding), coder(std::exchange(other.coder, nullptr)) {}
+
+CompressionStream &CompressionStream::operator=(CompressionStream &&other) noexcept {
+    if (this != &other) {
+        if (coder) {
+            CoderPool::local().release(coder);
+        }
+        coding = other.coding;
+        coder = std::exchange(other.coder, nullptr);
+    }
+    return *this;
+}
+
+bool CompressionStream::write(std::string_view chunk, std::string &out) {
+    if (!coder) {
+        return false;
+    }
+    if (!coder->run(chunk, false, out)) {
+        delete coder;
+        coder = nullptr;
+        return false;
+    }
+    return true;
+}
+
+bool CompressionStream::finish(std::string &out) {
+    if (!coder) {
+        return false;
+    }
+    bool ok = coder->run({}, true, out);
+    if (!ok) {
+        delete coder;
+        coder = nullptr;
+        return false;
+    }
+    CoderPool::local().release(coder);
+    coder = nullptr;
+    return true;
+}
+
+// --- The response stage ---
+
+static ContentCoding choose_coding(uint8_t accepted) {
+    // zstd and br both beat gzip by a wide margin on text; zstd is the cheaper of the two
+    for (ContentCoding coding : {ContentCoding::Zstd, ContentCoding::Brotli, ContentCoding::Gzip}) {
+        if ((accepted & static_cast<uint8_t>(coding)) && coding_available(coding)) {
+            return coding;
+        }
+    }
+    return ContentCoding::Identity;
+}
+
+// A file body through the stream, read a buffer at a time
+static bool compress_file(CompressionStream &stream, int fd, off_t offset, size_t length, std::string &out) {
+    static thread_local std::unique_ptr<char[]> chunk(new char[CODER_BUFFER_SIZE]);
+    while (length > 0) {
+        ssize_t bytes = pread(fd, chunk.get(), std::min(length, CODER_BUFFER_SIZE), offset);
+        if (bytes <= 0) {
+            return false; // Includes a file that shrank under us
+        }
+        if (!stream.write(std::string_view(chunk.get(), static_cast<size_t>(bytes)), out)) {
+            return false;
+        }
+        offset += bytes;
+        length -= static_cast<size_t>(bytes);
+    }
+    return true;
+}
+
+bool compress_response(HttpResponse &response, uint8_t accepted, const CompressionConfig &config) {
+    if (!config.enabled || response.raw_response() || response.prepared_response() || response.body_streamed() ||
+        response.status_code_value() != 200) {
+        return false;
+    }
+    int file_fd = response.body_file();
+    size_t size = response.body_size();
+    size_t limit = file_fd >= 0 ? std::min(config.max_file_size, config.max_size) : config.max_size;
+    if (size < config.min_size || size > limit || !compressible_type(response.header("Content-Type")) ||
+        !response.header("Content-Encoding").empty() ||
+        contains_ignore_case(response.header("Cache-Control"), "no-transform")) {
+        return false;
+    }
+
+    // From here on the coding depends on Accept-Encoding, including for clients given none
+    if (!contains_ignore_case(response.header("Vary"), "accept-encoding")) {
+        response.add_header_line(HEADER_VARY_ENCODING);
+    }
+    ContentCoding coding = choose_coding(accepted);
+    if (coding == ContentCoding::Identity || response.body_omitted()) {
+        // A HEAD answer describes the identity body: compressing only to learn a length is not worth it
+        return false;
+    }
+
+    CompressionStream stream(coding, config, size);
+    std::string compressed;
+    compressed.reserve(size / 4);
+    bool ok = file_fd >= 0 ? compress_file(stream, file_fd, response.body_file_offset(), size, compressed)
+                           : stream.write(response.body(), compressed);
+    if (!ok || !stream.finish(compressed) || compressed.size() >= size) {
+        return false; // Incompressible after all: the original goes out
+    }
+
+    ThreadMetrics &metrics = ThreadMetrics::local();
+    metrics.compressed.add();
+    metrics.compressed_bytes_in.add(size);
+    metrics.compressed_bytes_out.add(compressed.size());
+
+    response.set_body(std::move(compressed));
+    switch (coding) {
+    case ContentCoding::Gzip:
+        response.add_header_line(HEADER_ENCODING_GZIP);
+        break;
+    case ContentCoding::Brotli:
+        response.add_header_line(HEADER_ENCODING_BROTLI);
+        break;
+    default:
+        response.add_header_line(HEADER_ENCODING_ZSTD);
+        break;
+    }
+    return true;
+}
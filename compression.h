@@ -0,0 +1,89 @@
+#ifndef COMPRESSION_H
+#define COMPRESSION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class HttpResponse;
+
+constexpr std::string_view HEADER_VARY_ENCODING = "Vary: Accept-Encoding\r\n";
+constexpr std::string_view HEADER_ENCODING_GZIP = "Content-Encoding: gzip\r\n";
+constexpr std::string_view HEADER_ENCODING_BROTLI = "Content-Encoding: br\r\n";
+constexpr std::string_view HEADER_ENCODING_ZSTD = "Content-Encoding: zstd\r\n";
+
+// One bit per coding, so a request's acceptable codings fit in a byte (see accepted_codings())
+enum class ContentCoding : uint8_t { Identity = 0, Gzip = 1, Brotli = 2, Zstd = 4 };
+
+// ServerConfig::compression
+struct CompressionConfig {
+    bool enabled = true;
+    size_t min_size = 1024;        // Smaller bodies gain less than the header costs
+    size_t max_size = 8u << 20;    // Larger ones are sent as they are instead of held up
+    size_t max_file_size = 0;      // File bodies up to this size are compressed too, read a chunk at a time
+                                   // (which gives up sendfile()); 0 leaves them alone
+    int gzip_level = 6;
+    int brotli_quality = 4;        // Brotli's 11 is for precompressing, far too slow per response
+    int zstd_level = 3;
+};
+
+// True if coding is listed in Accept-Encoding without q=0
+bool accepts_encoding(std::string_view accept_encoding, std::string_view coding);
+
+// ContentCoding bits for the codings this build supports that accept_encoding allows
+uint8_t accepted_codings(std::string_view accept_encoding);
+
+// Text-like media types: text/*, JSON, JavaScript, XML, SVG and friends. Images, video,
+// archives and fonts other than the uncompressed formats are left alone.
+bool compressible_type(std::string_view content_type);
+
+/**
+ * @brief One compressed body produced a chunk at a time. The coder state comes from the
+ * calling thread's pool and goes back to it when the stream is destroyed, so only the first
+ * response of each coding on a thread pays for allocating and initializing one; after that
+ * a stream is a reset. Streams are independent: a thread may have any number open at once
+ * (one per suspended coroutine, say), each holding a coder of its own until it ends.
+ */
+class CompressionStream {
+  public:
+    struct Coder; // Pooled per thread, defined in compression.cc
+
+  private:
+    ContentCoding coding = ContentCoding::Identity;
+    Coder *coder = nullptr;
+
+  public:
+    CompressionStream() = default;
+    // size_hint, when not 0, must be the exact total of the chunks to come (zstd relies on it)
+    CompressionStream(ContentCoding body_coding, const CompressionConfig &config, size_t size_hint = 0);
+    ~CompressionStream();
+
+    CompressionStream(CompressionStream &&other) noexcept;
+    CompressionStream &operator=(CompressionStream &&other) noexcept;
+    CompressionStream(const CompressionStream &) = delete;
+    CompressionStream &operator=(const CompressionStream &) = delete;
+
+    // False if the coding is not available or the coder could not be set up
+    explicit operator bool() const { return coder != nullptr; }
+
+    // Appends to out whatever the coder emits for chunk; finish() flushes the rest and ends
+    // the stream. Both return false if the coder fails, after which the stream is unusable.
+    bool write(std::string_view chunk, std::string &out);
+    bool finish(std::string &out);
+};
+
+/**
+ * @brief The server's compression stage, run on every response before it is queued. A
+ * memory body (or, with max_file_size, a file body) of a compressible type between min_size
+ * and max_size is replaced by its compressed form in the first of zstd, br, gzip that
+ * accepted allows. Responses that already have a Content-Encoding, say Cache-Control:
+ * no-transform, are not 200, are answers to HEAD, are streamed (proxied), or are serialized
+ * already (legacy string handlers, cache hits) are left as they are. Vary: Accept-Encoding
+ * is added whenever the coding depended on the request. Returns true if the body was compressed.
+ */
+bool compress_response(HttpResponse &response, uint8_t accepted, const CompressionConfig &config);
+
+#endif // COMPRESSION_H
@@ -0,0 +1,113 @@
+#include "coroutine.h"
+#include <errno.h>
+#include <poll.h>
+#include <thread>
+#include <unistd.h>
+
+static thread_local Scheduler *current_scheduler = nullptr;
+
+Scheduler *Scheduler::current() { return current_scheduler; }
+
+void Scheduler::set_current(Scheduler *scheduler) { current_scheduler = scheduler; }
+
+int SleepQueue::next_timeout_ms(uint64_t now_ms) const {
+    if (sleepers.empty()) {
+        return -1;
+    }
+    uint64_t deadline = sleepers.top().deadline_ms;
+    return deadline <= now_ms ? 0 : static_cast<int>(deadline - now_ms);
+}
+
+void SleepQueue::resume_due(uint64_t now_ms) {
+    while (!sleepers.empty() && sleepers.top().deadline_ms <= now_ms) {
+        std::coroutine_handle<> handle = sleepers.top().handle;
+        sleepers.pop();
+        handle.resume();
+    }
+}
+
+bool SleepAwaiter::await_suspend(std::coroutine_handle<> handle) const {
+    if (Scheduler *scheduler = Scheduler::current()) {
+        scheduler->resume_after(handle, delay_ms);
+        return true;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(delay_ms));
+    return false;
+}
+
+bool ReadyAwaiter::await_suspend(std::coroutine_handle<> handle) const {
+    if (Scheduler *scheduler = Scheduler::current()) {
+        scheduler->resume_when_ready(handle, fd, writable);
+        return true;
+    }
+    struct pollfd entry = {fd, static_cast<short>(writable ? POLLOUT : POLLIN), 0};
+    while (poll(&entry, 1, -1) == -1 && errno == EINTR) {
+    }
+    return false; // Errors and hangups surface in the read or write that follows
+}
+
+Task<ssize_t> async_read(int fd, void *buffer, size_t length) {
+    while (true) {
+        ssize_t n = read(fd, buffer, length);
+        if (n >= 0) {
+            co_return n;
+        }
+        if (errno == EINTR)
+            continue;
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            co_return -static_cast<ssize_t>(errno);
+        }
+        co_await wait_readable(fd);
+    }
+}
+
+Task<ssize_t> async_write_all(int fd, const void *data, size_t length) {
+    const char *next = static_cast<const char *>(data);
+    size_t left = length;
+    while (left > 0) {
+        // send() for its MSG_NOSIGNAL; anything that is not a socket takes write()
+        ssize_t n = send(fd, next, left, MSG_NOSIGNAL);
+        if (n < 0 && errno == ENOTSOCK) {
+            n = write(fd, next, left);
+        }
+        if (n >= 0) {
+            next += n;
+            left -= static_cast<size_t>(n);
+            continue;
+        }
+        if (errno == EINTR)
+            continue;
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            co_return -static_cast<ssize_t>(errno);
+        }
+        co_await wait_writable(fd);
+    }
+    co_return static_cast<ssize_t>(length);
+}
+
+Task<int> async_connect(const struct sockaddr *address, socklen_t address_length) {
+    int fd = socket(address->sa_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        co_return -errno;
+    }
+
+    if (connect(fd, address, address_length) == -1) {
+        if (errno != EINPROGRESS) {
+            int error = errno;
+            close(fd);
+            co_return -error;
+        }
+        co_await wait_writable(fd);
+
+        int error = 0;
+        socklen_t error_length = sizeof(error);
+        if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &error_length) == -1) {
+            error = errno;
+        }
+        if (error != 0) {
+            close(fd);
+            co_return -error;
+        }
+    }
+    co_return fd;
+}
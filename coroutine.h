@@ -0,0 +1,181 @@
+#ifndef COROUTINE_H
+#define COROUTINE_H
+
+#include <chrono>
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <optional>
+#include <queue>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Resumes suspended coroutines from an event loop. Each loop installs itself for its
+ * own thread (set_current()), so a handler that co_awaits a timer or a socket parks its
+ * frame there instead of blocking the thread; the loop resumes it on the same thread.
+ * Without one (ThreadPool workers) the awaitables below block the calling thread instead.
+ */
+class Scheduler {
+  public:
+    virtual ~Scheduler() = default;
+
+    // Resume handle once delay_ms have passed
+    virtual void resume_after(std::coroutine_handle<> handle, uint64_t delay_ms) = 0;
+
+    // Resume handle once fd is readable (or writable). One waiter per fd at a time.
+    virtual void resume_when_ready(std::coroutine_handle<> handle, int fd, bool writable) = 0;
+
+    // The scheduler of the calling thread, or nullptr
+    static Scheduler *current();
+    static void set_current(Scheduler *scheduler);
+};
+
+/**
+ * @brief Coroutines sleeping until a deadline, for a Scheduler's resume_after(). A binary
+ * heap rather than a TimerWheel: sleeps are few and want their exact deadline, not the
+ * wheel's tick. Frames still queued when the owner goes away are abandoned, not destroyed.
+ */
+class SleepQueue {
+  private:
+    struct Sleeper {
+        uint64_t deadline_ms;
+        std::coroutine_handle<> handle;
+        bool operator>(const Sleeper &other) const { return deadline_ms > other.deadline_ms; }
+    };
+    std::priority_queue<Sleeper, std::vector<Sleeper>, std::greater<Sleeper>> sleepers;
+
+  public:
+    void add(std::coroutine_handle<> handle, uint64_t deadline_ms) { sleepers.push({deadline_ms, handle}); }
+
+    // Milliseconds until the earliest deadline (0 if one is due), or -1 if none is queued
+    int next_timeout_ms(uint64_t now_ms) const;
+
+    // Resumes every coroutine due by now_ms; they may queue new sleeps meanwhile
+    void resume_due(uint64_t now_ms);
+};
+
+// The shorter of two epoll-style timeouts, where -1 means none
+inline int earliest_timeout(int a, int b) {
+    if (a < 0)
+        return b;
+    if (b < 0)
+        return a;
+    return a < b ? a : b;
+}
+
+/**
+ * @brief A lazily started coroutine producing a T. Nothing runs until it is co_awaited;
+ * the awaiting coroutine then resumes right where the task finishes (symmetric transfer),
+ * and the task's exception, if any, is rethrown in it. Move-only; owns its frame.
+ */
+template <class T> class Task {
+  public:
+    struct promise_type {
+        std::optional<T> value;
+        std::exception_ptr error;
+        std::coroutine_handle<> continuation = std::noop_coroutine();
+
+        Task get_return_object() { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+
+        struct FinalAwaiter {
+            bool await_ready() noexcept { return false; }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept {
+                return handle.promise().continuation;
+            }
+            void await_resume() noexcept {}
+        };
+        FinalAwaiter final_suspend() noexcept { return {}; }
+
+        template <class U> void return_value(U &&result) { value.emplace(std::forward<U>(result)); }
+        void unhandled_exception() { error = std::current_exception(); }
+    };
+
+    Task() = default;
+    Task(Task &&other) noexcept : handle(std::exchange(other.handle, {})) {}
+    Task &operator=(Task &&other) noexcept {
+        if (this != &other) {
+            if (handle) {
+                handle.destroy();
+            }
+            handle = std::exchange(other.handle, {});
+        }
+        return *this;
+    }
+    ~Task() {
+        if (handle) {
+            handle.destroy();
+        }
+    }
+
+    explicit operator bool() const { return static_cast<bool>(handle); }
+
+    bool await_ready() const noexcept { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+        handle.promise().continuation = awaiting;
+        return handle;
+    }
+    T await_resume() {
+        if (handle.promise().error) {
+            std::rethrow_exception(handle.promise().error);
+        }
+        return std::move(*handle.promise().value);
+    }
+
+  private:
+    explicit Task(std::coroutine_handle<promise_type> h) : handle(h) {}
+    std::coroutine_handle<promise_type> handle;
+};
+
+/**
+ * @brief Fire-and-forget coroutine: starts at once and frees its own frame when done.
+ * Used to drive a Task from plain code; it must not let an exception escape.
+ */
+struct DetachedTask {
+    struct promise_type {
+        DetachedTask get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+// --- Awaitables. Without a Scheduler on the thread they block instead of suspending. ---
+
+struct SleepAwaiter {
+    uint64_t delay_ms;
+
+    bool await_ready() const noexcept { return delay_ms == 0; }
+    bool await_suspend(std::coroutine_handle<> handle) const;
+    void await_resume() const noexcept {}
+};
+
+struct ReadyAwaiter {
+    int fd;
+    bool writable;
+
+    bool await_ready() const noexcept { return false; }
+    bool await_suspend(std::coroutine_handle<> handle) const;
+    void await_resume() const noexcept {}
+};
+
+inline SleepAwaiter sleep_for(std::chrono::milliseconds delay) {
+    return {delay.count() > 0 ? static_cast<uint64_t>(delay.count()) : 0};
+}
+inline ReadyAwaiter wait_readable(int fd) { return {fd, false}; }
+inline ReadyAwaiter wait_writable(int fd) { return {fd, true}; }
+
+// Non-blocking fds only. Bytes read (0 at EOF), or -errno; never -EAGAIN.
+Task<ssize_t> async_read(int fd, void *buffer, size_t length);
+
+// Writes all of data unless an error comes first: length, or -errno
+Task<ssize_t> async_write_all(int fd, const void *data, size_t length);
+
+// Connects a new non-blocking stream socket: its fd, or -errno
+Task<int> async_connect(const struct sockaddr *address, socklen_t address_length);
+
+#endif // COROUTINE_H
@@ -0,0 +1,49 @@
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include "util.h"
+#include <cstdint>
+#include <span>
+
+/**
+ * @brief One reactor thread as HttpServer drives it: it owns the connections handed to
+ * it (or accepted on its own listener) and serves them without blocking. ReactorWorker
+ * implements it on epoll, UringWorker on io_uring; ServerConfig::io_backend picks one.
+ */
+class EventLoop {
+  public:
+    virtual ~EventLoop() = default;
+
+    // ReusePort mode: takes ownership of a listening socket. Must be called before start().
+    virtual void set_listener(int fd) = 0;
+
+    virtual void start() = 0;
+    virtual void stop() = 0;
+
+    // Graceful stop, from any thread: the worker closes its listener (if any), closes each
+    // connection once it is idle and ends its loop when none are left or at deadline_ms
+    // (monotonic_ms()), whichever comes first. join() waits for that.
+    virtual void drain(uint64_t deadline_ms) = 0;
+    virtual void join() = 0;
+
+    // Single producer: only the master thread may call this, after accept(). The whole batch
+    // is signalled with one eventfd write.
+    virtual void hand_off(std::span<const int> client_fds) = 0;
+
+    // Must be called before start(): the worker thread runs on cpu only (-1 = anywhere)
+    void set_cpu(int worker_cpu) { cpu = worker_cpu; }
+    int pinned_cpu() const { return cpu; }
+
+  protected:
+    int cpu = -1;
+
+    // First thing on the worker thread, so that everything it allocates is node-local
+    void enter_thread() const {
+        if (cpu >= 0) {
+            pin_to_cpu_core(cpu);
+            prefer_local_memory();
+        }
+    }
+};
+
+#endif // EVENT_LOOP_H
@@ -0,0 +1,489 @@
+#include "hpack.h"
+#include <algorithm>
+#include <array>
+
+// --- Static table (RFC 7541 Appendix A), HPACK indices 1 to 61 ---
+
+struct StaticField {
+    std::string_view name;
+    std::string_view value;
+};
+
+static constexpr std::array<StaticField, 61> STATIC_TABLE = {{
+    {":authority", ""},
+    {":method", "GET"},
+    {":method", "POST"},
+    {":path", "/"},
+    {":path", "/index.html"},
+    {":scheme", "http"},
+    {":scheme", "https"},
+    {":status", "200"},
+    {":status", "204"},
+    {":status", "206"},
+    {":status", "304"},
+    {":status", "400"},
+    {":status", "404"},
+    {":status", "500"},
+    {"accept-charset", ""},
+    {"accept-encoding", "gzip, deflate"},
+    {"accept-language", ""},
+    {"accept-ranges", ""},
+    {"accept", ""},
+    {"access-control-allow-origin", ""},
+    {"age", ""},
+    {"allow", ""},
+    {"authorization", ""},
+    {"cache-control", ""},
+    {"content-disposition", ""},
+    {"content-encoding", ""},
+    {"content-language", ""},
+    {"content-length", ""},
+    {"content-location", ""},
+    {"content-range", ""},
+    {"content-type", ""},
+    {"cookie", ""},
+    {"date", ""},
+    {"etag", ""},
+    {"expect", ""},
+    {"expires", ""},
+    {"from", ""},
+    {"host", ""},
+    {"if-match", ""},
+    {"if-modified-since", ""},
+    {"if-none-match", ""},
+    {"if-range", ""},
+    {"if-unmodified-since", ""},
+    {"last-modified", ""},
+    {"link", ""},
+    {"location", ""},
+    {"max-forwards", ""},
+    {"proxy-authenticate", ""},
+    {"proxy-authorization", ""},
+    {"range", ""},
+    {"referer", ""},
+    {"refresh", ""},
+    {"retry-after", ""},
+    {"server", ""},
+    {"set-cookie", ""},
+    {"strict-transport-security", ""},
+    {"transfer-encoding", ""},
+    {"user-agent", ""},
+    {"vary", ""},
+    {"via", ""},
+    {"www-authenticate", ""},
+}};
+
+// --- Huffman code (RFC 7541 Appendix B): code and bit length per symbol, EOS last ---
+
+struct HuffmanCode {
+    uint32_t code;
+    uint8_t bits;
+};
+
+static constexpr std::array<HuffmanCode, 257> HUFFMAN_CODES = {{
+    {0x1ff8, 13}, {0x7fffd8, 23}, {0xfffffe2, 28}, {0xfffffe3, 28}, {0xfffffe4, 28}, {0xfffffe5, 28}, {0xfffffe6, 28},
+    {0xfffffe7, 28}, {0xfffffe8, 28}, {0xffffea, 24}, {0x3ffffffc, 30}, {0xfffffe9, 28}, {0xfffffea, 28},
+    {0x3ffffffd, 30}, {0xfffffeb, 28}, {0xfffffec, 28}, {0xfffffed, 28}, {0xfffffee, 28}, {0xfffffef, 28},
+    {0xffffff0, 28}, {0xffffff1, 28}, {0xffffff2, 28}, {0x3ffffffe, 30}, {0xffffff3, 28}, {0xffffff4, 28},
+    {0xffffff5, 28}, {0xffffff6, 28}, {0xffffff7, 28}, {0xffffff8, 28}, {0xffffff9, 28}, {0xffffffa, 28},
+    {0xffffffb, 28}, {0x14, 6}, {0x3f8, 10}, {0x3f9, 10}, {0xffa, 12}, {0x1ff9, 13}, {0x15, 6}, {0xf8, 8}, {0x7fa, 11},
+    {0x3fa, 10}, {0x3fb, 10}, {0xf9, 8}, {0x7fb, 11}, {0xfa, 8}, {0x16, 6}, {0x17, 6}, {0x18, 6}, {0x0, 5}, {0x1, 5},
+    {0x2, 5}, {0x19, 6}, {0x1a, 6}, {0x1b, 6}, {0x1c, 6}, {0x1d, 6}, {0x1e, 6}, {0x1f, 6}, {0x5c, 7}, {0xfb, 8},
+    {0x7ffc, 15}, {0x20, 6}, {0xffb, 12}, {0x3fc, 10}, {0x1ffa, 13}, {0x21, 6}, {0x5d, 7}, {0x5e, 7}, {0x5f, 7},
+    {0x60, 7}, {0x61, 7}, {0x62, 7}, {0x63, 7}, {0x64, 7}, {0x65, 7}, {0x66, 7}, {0x67, 7}, {0x68, 7}, {0x69, 7},
+    {0x6a, 7}, {0x6b, 7}, {0x6c, 7}, {0x6d, 7}, {0x6e, 7}, {0x6f, 7}, {0x70, 7}, {0x71, 7}, {0x72, 7}, {0xfc, 8},
+    {0x73, 7}, {0xfd, 8}, {0x1ffb, 13}, {0x7fff0, 19}, {0x1ffc, 13}, {0x3ffc, 14}, {0x22, 6}, {0x7ffd, 15}, {0x3, 5},
+    {0x23, 6}, {0x4, 5}, {0x24, 6}, {0x5, 5}, {0x25, 6}, {0x26, 6}, {0x27, 6}, {0x6, 5}, {0x74, 7}, {0x75, 7},
+    {0x28, 6}, {0x29, 6}, {0x2a, 6}, {0x7, 5}, {0x2b, 6}, {0x76, 7}, {0x2c, 6}, {0x8, 5}, {0x9, 5}, {0x2d, 6},
+    {0x77, 7}, {0x78, 7}, {0x79, 7}, {0x7a, 7}, {0x7b, 7}, {0x7ffe, 15}, {0x7fc, 11}, {0x3ffd, 14}, {0x1ffd, 13},
+    {0xffffffc, 28}, {0xfffe6, 20}, {0x3fffd2, 22}, {0xfffe7, 20}, {0xfffe8, 20}, {0x3fffd3, 22}, {0x3fffd4, 22},
+    {0x3fffd5, 22}, {0x7fffd9, 23}, {0x3fffd6, 22}, {0x7fffda, 23}, {0x7fffdb, 23}, {0x7fffdc, 23}, {0x7fffdd, 23},
+    {0x7fffde, 23}, {0xffffeb, 24}, {0x7fffdf, 23}, {0xffffec, 24}, {0xffffed, 24}, {0x3fffd7, 22}, {0x7fffe0, 23},
+    {0xffffee, 24}, {0x7fffe1, 23}, {0x7fffe2, 23}, {0x7fffe3, 23}, {0x7fffe4, 23}, {0x1fffdc, 21}, {0x3fffd8, 22},
+    {0x7fffe5, 23}, {0x3fffd9, 22}, {0x7fffe6, 23}, {0x7fffe7, 23}, {0xffffef, 24}, {0x3fffda, 22}, {0x1fffdd, 21},
+    {0xfffe9, 20}, {0x3fffdb, 22}, {0x3fffdc, 22}, {0x7fffe8, 23}, {0x7fffe9, 23}, {0x1fffde, 21}, {0x7fffea, 23},
+    {0x3fffdd, 22}, {0x3fffde, 22}, {0xfffff0, 24}, {0x1fffdf, 21}, {0x3fffdf, 22}, {0x7fffeb, 23}, {0x7fffec, 23},
+    {0x1fffe0, 21}, {0x1fffe1, 21}, {0x3fffe0, 22}, {0x1fffe2, 21}, {0x7fffed, 23}, {0x3fffe1, 22}, {0x7fffee, 23},
+    {0x7fffef, 23}, {0xfffea, 20}, {0x3fffe2, 22}, {0x3fffe3, 22}, {0x3fffe4, 22}, {0x7ffff0, 23}, {0x3fffe5, 22},
+    {0x3fffe6, 22}, {0x7ffff1, 23}, {0x3ffffe0, 26}, {0x3ffffe1, 26}, {0xfffeb, 20}, {0x7fff1, 19}, {0x3fffe7, 22},
+    {0x7ffff2, 23}, {0x3fffe8, 22}, {0x1ffffec, 25}, {0x3ffffe2, 26}, {0x3ffffe3, 26}, {0x3ffffe4, 26}, {0x7ffffde, 27},
+    {0x7ffffdf, 27}, {0x3ffffe5, 26}, {0xfffff1, 24}, {0x1ffffed, 25}, {0x7fff2, 19}, {0x1fffe3, 21}, {0x3ffffe6, 26},
+    {0x7ffffe0, 27}, {0x7ffffe1, 27}, {0x3ffffe7, 26}, {0x7ffffe2, 27}, {0xfffff2, 24}, {0x1fffe4, 21}, {0x1fffe5, 21},
+    {0x3ffffe8, 26}, {0x3ffffe9, 26}, {0xffffffd, 28}, {0x7ffffe3, 27}, {0x7ffffe4, 27}, {0x7ffffe5, 27}, {0xfffec, 20},
+    {0xfffff3, 24}, {0xfffed, 20}, {0x1fffe6, 21}, {0x3fffe9, 22}, {0x1fffe7, 21}, {0x1fffe8, 21}, {0x7ffff3, 23},
+    {0x3fffea, 22}, {0x3fffeb, 22}, {0x1ffffee, 25}, {0x1ffffef, 25}, {0xfffff4, 24}, {0xfffff5, 24}, {0x3ffffea, 26},
+    {0x7ffff4, 23}, {0x3ffffeb, 26}, {0x7ffffe6, 27}, {0x3ffffec, 26}, {0x3ffffed, 26}, {0x7ffffe7, 27},
+    {0x7ffffe8, 27}, {0x7ffffe9, 27}, {0x7ffffea, 27}, {0x7ffffeb, 27}, {0xffffffe, 28}, {0x7ffffec, 27},
+    {0x7ffffed, 27}, {0x7ffffee, 27}, {0x7ffffef, 27}, {0x7fffff0, 27}, {0x3ffffee, 26}, {0x3fffffff, 30}
+}};
+
+static constexpr int HUFFMAN_EOS = 256;
+
+// Binary decoding tree: leaves hold a symbol, inner nodes the index of each child
+struct HuffmanNode {
+    int16_t next[2] = {-1, -1};
+    int16_t symbol = -1;
+};
+
+static std::vector<HuffmanNode> build_huffman_tree() {
+    std::vector<HuffmanNode> tree(1);
+    tree.reserve(2 * HUFFMAN_CODES.size());
+    for (int symbol = 0; symbol < static_cast<int>(HUFFMAN_CODES.size()); ++symbol) {
+        const HuffmanCode &code = HUFFMAN_CODES[symbol];
+        size_t node = 0;
+        for (int bit = code.bits - 1; bit >= 0; --bit) {
+            int branch = (code.code >> bit) & 1;
+            if (tree[node].next[branch] < 0) {
+                tree[node].next[branch] = static_cast<int16_t>(tree.size());
+                tree.emplace_back();
+            }
+            node = tree[node].next[branch];
+        }
+        tree[node].symbol = static_cast<int16_t>(symbol);
+    }
+    return tree;
+}
+
+bool huffman_decode(std::string_view in, std::string &out) {
+    static const std::vector<HuffmanNode> tree = build_huffman_tree();
+
+    size_t node = 0;
+    int pending_bits = 0; // Bits read since the last symbol
+    bool all_ones = true;
+    for (unsigned char byte : in) {
+        for (int bit = 7; bit >= 0; --bit) {
+            int branch = (byte >> bit) & 1;
+            int16_t next = tree[node].next[branch];
+            if (next < 0) {
+                return false;
+            }
+            node = next;
+            if (tree[node].symbol < 0) {
+                ++pending_bits;
+                all_ones &= branch == 1;
+                continue;
+            }
+            if (tree[node].symbol == HUFFMAN_EOS) {
+                return false;
+            }
+            out += static_cast<char>(tree[node].symbol);
+            node = 0;
+            pending_bits = 0;
+            all_ones = true;
+        }
+    }
+    // Padding is the most significant bits of EOS: at most 7, all ones
+    return pending_bits <= 7 && all_ones;
+}
+
+size_t huffman_encoded_size(std::string_view in) {
+    size_t bits = 0;
+    for (unsigned char c : in) {
+        bits += HUFFMAN_CODES[c].bits;
+    }
+    return (bits + 7) / 8;
+}
+
+void huffman_encode(std::string_view in, std::string &out) {
+    uint64_t buffer = 0;
+    int buffered = 0;
+    for (unsigned char c : in) {
+        const HuffmanCode &code = HUFFMAN_CODES[c];
+        buffer = (buffer << code.bits) | code.code;
+        buffered += code.bits;
+        while (buffered >= 8) {
+            buffered -= 8;
+            out += static_cast<char>(buffer >> buffered);
+        }
+    }
+    if (buffered > 0) {
+        out += static_cast<char>((buffer << (8 - buffered)) | (0xff >> buffered));
+    }
+}
+
+// --- Primitive representations (RFC 7541 section 5) ---
+
+static void encode_integer(std::string &out, uint8_t flags, int prefix_bits, uint64_t value) {
+    uint64_t max_prefix = (uint64_t(1) << prefix_bits) - 1;
+    if (value < max_prefix) {
+        out += static_cast<char>(flags | value);
+        return;
+    }
+    out += static_cast<char>(flags | max_prefix);
+    value -= max_prefix;
+    while (value >= 0x80) {
+        out += static_cast<char>((value & 0x7f) | 0x80);
+        value >>= 7;
+    }
+    out += static_cast<char>(value);
+}
+
+static bool decode_integer(std::string_view in, size_t &pos, int prefix_bits, uint64_t &value) {
+    if (pos >= in.size()) {
+        return false;
+    }
+    uint64_t max_prefix = (uint64_t(1) << prefix_bits) - 1;
+    value = static_cast<uint8_t>(in[pos++]) & max_prefix;
+    if (value < max_prefix) {
+        return true;
+    }
+    for (int shift = 0; pos < in.size() && shift <= 28; shift += 7) {
+        uint8_t byte = static_cast<uint8_t>(in[pos++]);
+        value += static_cast<uint64_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false; // Truncated, or larger than any length or index we accept
+}
+
+static void encode_string(std::string &out, std::string_view value) {
+    size_t huffman_size = huffman_encoded_size(value);
+    if (huffman_size < value.size()) {
+        encode_integer(out, 0x80, 7, huffman_size);
+        huffman_encode(value, out);
+    } else {
+        encode_integer(out, 0x00, 7, value.size());
+        out.append(value);
+    }
+}
+
+static bool decode_string(std::string_view in, size_t &pos, std::string &out) {
+    if (pos >= in.size()) {
+        return false;
+    }
+    bool huffman = (in[pos] & 0x80) != 0;
+    uint64_t length = 0;
+    if (!decode_integer(in, pos, 7, length) || length > in.size() - pos) {
+        return false;
+    }
+    std::string_view bytes = in.substr(pos, length);
+    pos += length;
+    out.clear();
+    if (huffman) {
+        return huffman_decode(bytes, out);
+    }
+    out.assign(bytes);
+    return true;
+}
+
+// --- HpackTable ---
+
+void HpackTable::evict_to(size_t size) {
+    while (used > size && !entries.empty()) {
+        used -= entries.back().name.size() + entries.back().value.size() + ENTRY_OVERHEAD;
+        entries.pop_back();
+    }
+}
+
+void HpackTable::add(std::string_view name, std::string_view value) {
+    size_t size = name.size() + value.size() + ENTRY_OVERHEAD;
+    if (size > limit) {
+        // Not an error: the table just ends up empty
+        evict_to(0);
+        return;
+    }
+    evict_to(limit - size);
+    entries.push_front(HpackField{std::string(name), std::string(value)});
+    used += size;
+}
+
+void HpackTable::set_limit(size_t size) {
+    limit = size;
+    evict_to(size);
+}
+
+// --- HpackDecoder ---
+
+HpackDecoder::HpackDecoder(size_t table_size) : max_table_size(table_size) { table.set_limit(table_size); }
+
+bool HpackDecoder::field_at(uint64_t index, const HpackField *&field) const {
+    if (index == 0 || index > STATIC_TABLE.size() + table.count()) {
+        return false;
+    }
+    if (index > STATIC_TABLE.size()) {
+        field = &table.at(index - STATIC_TABLE.size() - 1);
+    } else {
+        field = nullptr; // Caller reads STATIC_TABLE
+    }
+    return true;
+}
+
+HpackDecoder::Status HpackDecoder::decode(std::string_view block, std::vector<HpackField> &fields,
+                                          size_t max_list_size) {
+    fields.clear();
+    size_t list_size = 0;
+    bool too_large = false;
+    bool field_seen = false; // Table size updates must come first
+    std::string name;
+    std::string value;
+
+    size_t pos = 0;
+    while (pos < block.size()) {
+        uint8_t first = static_cast<uint8_t>(block[pos]);
+        uint64_t index = 0;
+
+        if ((first & 0xe0) == 0x20) {
+            // Dynamic table size update
+            if (field_seen || !decode_integer(block, pos, 5, index) || index > max_table_size) {
+                return Status::Error;
+            }
+            table.set_limit(index);
+            continue;
+        }
+        field_seen = true;
+
+        if (first & 0x80) {
+            // Indexed field
+            const HpackField *field = nullptr;
+            if (!decode_integer(block, pos, 7, index) || !field_at(index, field)) {
+                return Status::Error;
+            }
+            if (field) {
+                name = field->name;
+                value = field->value;
+            } else {
+                name = STATIC_TABLE[index - 1].name;
+                value = STATIC_TABLE[index - 1].value;
+            }
+        } else {
+            // Literal: with incremental indexing (6-bit name index), or without / never indexed (4-bit)
+            bool indexing = (first & 0x40) != 0;
+            if (!decode_integer(block, pos, indexing ? 6 : 4, index)) {
+                return Status::Error;
+            }
+            if (index == 0) {
+                if (!decode_string(block, pos, name)) {
+                    return Status::Error;
+                }
+            } else {
+                const HpackField *field = nullptr;
+                if (!field_at(index, field)) {
+                    return Status::Error;
+                }
+                name = field ? std::string_view(field->name) : STATIC_TABLE[index - 1].name;
+            }
+            if (!decode_string(block, pos, value)) {
+                return Status::Error;
+            }
+            if (indexing) {
+                table.add(name, value);
+            }
+        }
+
+        list_size += name.size() + value.size() + HpackTable::ENTRY_OVERHEAD;
+        if (list_size > max_list_size) {
+            too_large = true; // Keep decoding for the table's sake, but stop storing
+        }
+        if (!too_large) {
+            fields.push_back(HpackField{std::move(name), std::move(value)});
+        }
+    }
+    return too_large ? Status::TooLarge : Status::Ok;
+}
+
+// --- HpackEncoder ---
+
+void HpackEncoder::set_peer_table_size(size_t size) {
+    size = std::min<size_t>(size, HPACK_DEFAULT_TABLE_SIZE);
+    if (size == table.size_limit() && !size_update_due) {
+        return;
+    }
+    if (!size_update_due || size < smallest_limit) {
+        smallest_limit = std::min(size, size_update_due ? smallest_limit : table.size_limit());
+    }
+    table.set_limit(size);
+    size_update_due = true;
+}
+
+void HpackEncoder::begin_block(std::string &out) {
+    if (!size_update_due) {
+        return;
+    }
+    // A shrink followed by a grow must both be signalled, or the peer would keep entries we evicted
+    if (smallest_limit < table.size_limit()) {
+        encode_integer(out, 0x20, 5, smallest_limit);
+    }
+    encode_integer(out, 0x20, 5, table.size_limit());
+    size_update_due = false;
+}
+
+uint64_t HpackEncoder::find(std::string_view name, std::string_view value, bool &value_match) const {
+    uint64_t name_index = 0;
+    value_match = false;
+    for (size_t i = 0; i < STATIC_TABLE.size(); ++i) {
+        if (STATIC_TABLE[i].name != name) {
+            continue;
+        }
+        if (STATIC_TABLE[i].value == value) {
+            value_match = true;
+            return i + 1;
+        }
+        if (name_index == 0) {
+            name_index = i + 1;
+        }
+    }
+    for (size_t i = 0; i < table.count(); ++i) {
+        const HpackField &field = table.at(i);
+        if (field.name != name) {
+            continue;
+        }
+        if (field.value == value) {
+            value_match = true;
+            return STATIC_TABLE.size() + 1 + i;
+        }
+        if (name_index == 0) {
+            name_index = STATIC_TABLE.size() + 1 + i;
+        }
+    }
+    return name_index;
+}
+
+void HpackEncoder::encode_status(std::string &out, int status) {
+    switch (status) {
+    case 200:
+        encode_integer(out, 0x80, 7, 8);
+        return;
+    case 204:
+        encode_integer(out, 0x80, 7, 9);
+        return;
+    case 206:
+        encode_integer(out, 0x80, 7, 10);
+        return;
+    case 304:
+        encode_integer(out, 0x80, 7, 11);
+        return;
+    case 400:
+        encode_integer(out, 0x80, 7, 12);
+        return;
+    case 404:
+        encode_integer(out, 0x80, 7, 13);
+        return;
+    case 500:
+        encode_integer(out, 0x80, 7, 14);
+        return;
+    default:
+        encode(out, ":status", std::to_string(status));
+    }
+}
+
+void HpackEncoder::encode(std::string &out, std::string_view name, std::string_view value, bool index) {
+    bool value_match = false;
+    uint64_t found = find(name, value, value_match);
+    if (value_match) {
+        encode_integer(out, 0x80, 7, found);
+        return;
+    }
+
+    size_t size = name.size() + value.size() + HpackTable::ENTRY_OVERHEAD;
+    if (index && size <= table.size_limit() / 4) {
+        encode_integer(out, 0x40, 6, found);
+        table.add(name, value);
+    } else {
+        encode_integer(out, 0x00, 4, found);
+    }
+    if (found == 0) {
+        encode_string(out, name);
+    }
+    encode_string(out, value);
+}
@@ -0,0 +1,99 @@
+#ifndef HPACK_H
+#define HPACK_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// SETTINGS_HEADER_TABLE_SIZE both ways until a peer says otherwise
+#define HPACK_DEFAULT_TABLE_SIZE 4096
+
+struct HpackField {
+    std::string name;
+    std::string value;
+};
+
+/**
+ * @brief The dynamic half of an HPACK (RFC 7541) index space. Index 0 here is the newest
+ * entry, i.e. HPACK index 62; adding an entry evicts the oldest ones until the table fits
+ * its size limit, counted as name + value + 32 bytes per entry.
+ */
+class HpackTable {
+  private:
+    std::deque<HpackField> entries; // Newest first
+    size_t used = 0;
+    size_t limit = HPACK_DEFAULT_TABLE_SIZE;
+
+    void evict_to(size_t size);
+
+  public:
+    static constexpr size_t ENTRY_OVERHEAD = 32;
+
+    void add(std::string_view name, std::string_view value);
+    void set_limit(size_t size);
+
+    size_t size_limit() const { return limit; }
+    size_t count() const { return entries.size(); }
+    const HpackField &at(size_t index) const { return entries[index]; }
+};
+
+/**
+ * @brief Decodes the header blocks of one connection's requests. Blocks must be fed in the
+ * order they arrived, including those of streams that are refused, since each may change
+ * the dynamic table.
+ */
+class HpackDecoder {
+  private:
+    HpackTable table;
+    size_t max_table_size; // What we advertised; size updates may not exceed it
+
+    bool field_at(uint64_t index, const HpackField *&field) const;
+
+  public:
+    enum class Status { Ok, TooLarge, Error };
+
+    explicit HpackDecoder(size_t table_size = HPACK_DEFAULT_TABLE_SIZE);
+
+    // Replaces fields with the block's header list. TooLarge (the list exceeds max_list_size,
+    // counted as in SETTINGS_MAX_HEADER_LIST_SIZE) still decodes the whole block so the table
+    // stays in step; Error is a COMPRESSION_ERROR and ends the connection.
+    Status decode(std::string_view block, std::vector<HpackField> &fields, size_t max_list_size);
+};
+
+/**
+ * @brief Encodes response header blocks. Fields found in the static or dynamic table go
+ * out as one index; others are added to the dynamic table so the next response on the
+ * connection can refer to them. Strings are Huffman coded when that is shorter.
+ */
+class HpackEncoder {
+  private:
+    HpackTable table;
+    bool size_update_due = false;
+    size_t smallest_limit = HPACK_DEFAULT_TABLE_SIZE; // Lowest limit since the last size update
+
+    // Full match (index, value_match = true) or name match; 0 when neither is found
+    uint64_t find(std::string_view name, std::string_view value, bool &value_match) const;
+
+  public:
+    // The peer's SETTINGS_HEADER_TABLE_SIZE; the encoder never uses more than the default
+    void set_peer_table_size(size_t size);
+
+    // Once per header block, before the first field: announces a pending table size change
+    void begin_block(std::string &out);
+
+    void encode_status(std::string &out, int status);
+
+    // name must already be lowercase. Fields larger than a quarter of the table, and those
+    // passed with index = false (values that rarely repeat), are not added to the table.
+    void encode(std::string &out, std::string_view name, std::string_view value, bool index = true);
+};
+
+// Huffman code of RFC 7541 Appendix B. decode() fails on EOS or bad padding.
+bool huffman_decode(std::string_view in, std::string &out);
+size_t huffman_encoded_size(std::string_view in);
+void huffman_encode(std::string_view in, std::string &out);
+
+#endif // HPACK_H
@@ -0,0 +1,106 @@
+#include "http-date.h"
+#include "ring-buffer.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+#include <time.h>
+
+// Lines kept published at once. A slot is rewritten DATE_SLOTS - 1 seconds after it stopped
+// being current, far beyond the few loads a reader takes to copy it.
+static constexpr size_t DATE_SLOTS = 4;
+
+static constexpr size_t DATE_WORDS = (DATE_HEADER_LENGTH + 1 + 7) / 8; // With snprintf's NUL
+
+// Fixed names rather than strftime's %a and %b, which follow the locale
+static const char DAY_NAMES[7][4] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
+static const char MONTH_NAMES[12][4] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                        "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+
+namespace {
+
+// One rendered line, held in atomic words so that a copy racing a rewrite is not a data race
+struct alignas(CACHE_LINE_SIZE) DateSlot {
+    std::atomic<uint64_t> words[DATE_WORDS];
+};
+
+class DateClock {
+  private:
+    DateSlot slots[DATE_SLOTS];
+    std::atomic<size_t> current{0};
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+    std::thread thread;
+
+    void render(size_t slot, time_t seconds) {
+        struct tm parts;
+        gmtime_r(&seconds, &parts);
+        char line[DATE_WORDS * 8] = {};
+        snprintf(line, sizeof(line), "Date: %s, %02d %s %04d %02d:%02d:%02d GMT\r\n", DAY_NAMES[parts.tm_wday],
+                 parts.tm_mday, MONTH_NAMES[parts.tm_mon], parts.tm_year + 1900, parts.tm_hour, parts.tm_min,
+                 parts.tm_sec);
+        for (size_t i = 0; i < DATE_WORDS; ++i) {
+            uint64_t word;
+            memcpy(&word, line + i * 8, 8);
+            slots[slot].words[i].store(word, std::memory_order_relaxed);
+        }
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!stopping) {
+            // Wakes just past the next second boundary, then renders the second it is in
+            struct timespec now;
+            clock_gettime(CLOCK_REALTIME, &now);
+            wake.wait_for(lock, std::chrono::nanoseconds(1000000000 - now.tv_nsec + 1000));
+            if (stopping) {
+                break;
+            }
+            // Not time(): it reads the coarse clock, which can still be in the previous second
+            clock_gettime(CLOCK_REALTIME, &now);
+            size_t next = (current.load(std::memory_order_relaxed) + 1) % DATE_SLOTS;
+            render(next, now.tv_sec);
+            current.store(next, std::memory_order_release);
+        }
+    }
+
+  public:
+    DateClock() {
+        render(0, time(nullptr));
+        thread = std::thread([this] { run(); });
+    }
+
+    ~DateClock() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_one();
+        thread.join();
+    }
+
+    void copy(char *dest) const {
+        const DateSlot &slot = slots[current.load(std::memory_order_acquire)];
+        char line[DATE_WORDS * 8];
+        for (size_t i = 0; i < DATE_WORDS; ++i) {
+            uint64_t word = slot.words[i].load(std::memory_order_relaxed);
+            memcpy(line + i * 8, &word, 8);
+        }
+        memcpy(dest, line, DATE_HEADER_LENGTH);
+    }
+
+    static DateClock &instance() {
+        static DateClock clock;
+        return clock;
+    }
+};
+
+} // namespace
+
+void copy_date_header(char *dest) { DateClock::instance().copy(dest); }
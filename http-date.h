@@ -0,0 +1,17 @@
+#ifndef HTTP_DATE_H
+#define HTTP_DATE_H
+
+#include <cstddef>
+
+// "Date: Sun, 06 Nov 1994 08:49:37 GMT\r\n", the IMF-fixdate of RFC 9110 section 5.6.7
+constexpr size_t DATE_HEADER_LENGTH = 37;
+
+/**
+ * @brief Copies the Date header line of the current second into dest (DATE_HEADER_LENGTH
+ * bytes). A ticker thread, started on first use, renders the line once a second and
+ * publishes it through an atomic slot index, so a call reads no clock, formats nothing and
+ * takes no lock: it is a handful of relaxed loads.
+ */
+void copy_date_header(char *dest);
+
+#endif // HTTP_DATE_H
@@ -0,0 +1,289 @@
+#include "http-parser.h"
+#include "simd-scan.h"
+#include <cstring>
+
+static inline char ascii_lower(char c) { return (c >= 'A' && c <= 'Z') ? static_cast<char>(c + ('a' - 'A')) : c; }
+
+// RFC 9110 tchar: the characters allowed in methods and header names
+static bool is_token_char(unsigned char c) {
+    if (c >= '0' && c <= '9') {
+        return true;
+    }
+    if ((c | 0x20) >= 'a' && (c | 0x20) <= 'z') {
+        return true;
+    }
+    return c != 0 && std::strchr("!#$%&'*+-.^_`|~", c) != nullptr;
+}
+
+static std::string_view trim_ows(std::string_view s) {
+    while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) {
+        s.remove_prefix(1);
+    }
+    while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) {
+        s.remove_suffix(1);
+    }
+    return s;
+}
+
+bool equals_ignore_case(std::string_view a, std::string_view b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (ascii_lower(a[i]) != ascii_lower(b[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string_view HTTPRequest::header(std::string_view name) const {
+    for (size_t i = 0; i < header_count; ++i) {
+        if (equals_ignore_case(headers[i].name, name)) {
+            return headers[i].value;
+        }
+    }
+    return {};
+}
+
+bool HTTPRequest::has_header(std::string_view name) const {
+    for (size_t i = 0; i < header_count; ++i) {
+        if (equals_ignore_case(headers[i].name, name)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// What the scanner stops at in each part of a line. CR is included so a stray CR that is
+// not followed by LF is caught in the same pass instead of leaking into a token.
+static constexpr DelimiterSet REQUEST_LINE_DELIMITERS(" \r\n");
+static constexpr DelimiterSet HEADER_NAME_DELIMITERS(":\r\n");
+static constexpr DelimiterSet LINE_END_DELIMITERS("\r\n");
+
+void HttpRequestParser::reset() {
+    state = State::RequestLine;
+    error_code = Error::None;
+    line_start = scan_pos = 0;
+    first_delimiter = second_delimiter = NO_DELIMITER;
+    header_count = 0;
+    body_start = content_length = 0;
+    chunked = false;
+    version_minor = 1;
+}
+
+HttpRequestParser::Status HttpRequestParser::fail(Error error) {
+    state = State::Failed;
+    error_code = error;
+    return Status::Error;
+}
+
+bool HttpRequestParser::parse_request_line(std::string_view buffer, size_t line_end) {
+    // method SP request-target SP HTTP-version; the scanner recorded both spaces
+    size_t sp1 = first_delimiter;
+    size_t sp2 = second_delimiter;
+    if (sp1 == NO_DELIMITER || sp1 == line_start || sp2 == NO_DELIMITER || sp2 == sp1 + 1) {
+        return false;
+    }
+    for (size_t i = line_start; i < sp1; ++i) {
+        if (!is_token_char(buffer[i])) {
+            return false;
+        }
+    }
+
+    method = {static_cast<uint32_t>(line_start), static_cast<uint32_t>(sp1 - line_start)};
+    target = {static_cast<uint32_t>(sp1 + 1), static_cast<uint32_t>(sp2 - sp1 - 1)};
+    version = {static_cast<uint32_t>(sp2 + 1), static_cast<uint32_t>(line_end - sp2 - 1)};
+    return true;
+}
+
+HttpRequestParser::Status HttpRequestParser::parse_header_line(std::string_view buffer, size_t line_end) {
+    if (buffer[line_start] == ' ' || buffer[line_start] == '\t') {
+        return fail(Error::BadHeader); // Obsolete line folding
+    }
+    size_t colon = first_delimiter;
+    if (colon == NO_DELIMITER || colon == line_start) {
+        return fail(Error::BadHeader);
+    }
+    for (size_t i = line_start; i < colon; ++i) {
+        if (!is_token_char(buffer[i])) {
+            return fail(Error::BadHeader); // Includes whitespace before the colon
+        }
+    }
+    if (header_count == MAX_HEADERS) {
+        return fail(Error::TooManyHeaders);
+    }
+
+    std::string_view value = trim_ows(buffer.substr(colon + 1, line_end - colon - 1));
+    size_t value_offset = value.empty() ? line_end : static_cast<size_t>(value.data() - buffer.data());
+    header_names[header_count] = {static_cast<uint32_t>(line_start), static_cast<uint32_t>(colon - line_start)};
+    header_values[header_count] = {static_cast<uint32_t>(value_offset), static_cast<uint32_t>(value.size())};
+    ++header_count;
+    return Status::Incomplete;
+}
+
+void HttpRequestParser::fill(std::string_view buffer, HTTPRequest &request) const {
+    auto view = [&](Span span) { return buffer.substr(span.offset, span.length); };
+
+    request.method = view(method);
+    request.path = view(target);
+    request.version = view(version);
+    request.version_minor = version_minor;
+    request.header_count = header_count;
+    for (size_t i = 0; i < header_count; ++i) {
+        request.headers[i] = {view(header_names[i]), view(header_values[i])};
+    }
+    request.content_length = content_length;
+    request.chunked = chunked;
+    request.body = {};
+}
+
+/**
+ * @brief Works out how the body is framed once all headers are in (RFC 9112 6.3).
+ * Content-Length must be a plain decimal number, repeated only with the same value; a
+ * request carrying both it and Transfer-Encoding is refused rather than guessed at.
+ */
+HttpRequestParser::Status HttpRequestParser::parse_framing(std::string_view buffer) {
+    content_length = 0;
+    chunked = false;
+    bool seen_length = false;
+    bool seen_encoding = false;
+
+    for (size_t i = 0; i < header_count; ++i) {
+        std::string_view name = buffer.substr(header_names[i].offset, header_names[i].length);
+        std::string_view value = buffer.substr(header_values[i].offset, header_values[i].length);
+
+        if (equals_ignore_case(name, "Transfer-Encoding")) {
+            if (seen_encoding || !equals_ignore_case(value, "chunked")) {
+                return fail(Error::UnsupportedTransferEncoding);
+            }
+            seen_encoding = chunked = true;
+            continue;
+        }
+        if (!equals_ignore_case(name, "Content-Length")) {
+            continue;
+        }
+        if (value.empty() || value.size() > 18) {
+            return fail(Error::BadContentLength);
+        }
+        size_t length = 0;
+        for (char c : value) {
+            if (c < '0' || c > '9') {
+                return fail(Error::BadContentLength);
+            }
+            length = length * 10 + (c - '0');
+        }
+        if (seen_length && content_length != length) {
+            return fail(Error::BadContentLength); // Conflicting duplicates
+        }
+        content_length = length;
+        seen_length = true;
+    }
+
+    if (seen_length && seen_encoding) {
+        return fail(Error::BadTransferEncoding);
+    }
+    return Status::Complete;
+}
+
+HttpRequestParser::Status HttpRequestParser::parse(std::string_view buffer, HTTPRequest &request) {
+    while (state == State::RequestLine || state == State::Headers) {
+        // Single pass over each line: stop only at the delimiters this part of the line
+        // cares about, remember them, and pick up from scan_pos on the next call
+        const DelimiterSet *delimiters = &LINE_END_DELIMITERS;
+        if (state == State::RequestLine) {
+            delimiters = &REQUEST_LINE_DELIMITERS;
+        } else if (first_delimiter == NO_DELIMITER) {
+            delimiters = &HEADER_NAME_DELIMITERS;
+        }
+
+        const char *end = buffer.data() + buffer.size();
+        const char *hit = scan_pos < buffer.size() ? find_first_of(buffer.data() + scan_pos, end, *delimiters) : end;
+        size_t pos = hit - buffer.data();
+        if (pos >= max_header_bytes) {
+            return fail(Error::HeadersTooLarge);
+        }
+        if (hit == end) {
+            scan_pos = buffer.size();
+            return Status::Incomplete;
+        }
+
+        if (*hit == ' ' || *hit == ':') {
+            if (first_delimiter == NO_DELIMITER) {
+                first_delimiter = pos;
+            } else if (second_delimiter == NO_DELIMITER) {
+                second_delimiter = pos;
+            }
+            scan_pos = pos + 1;
+            continue;
+        }
+
+        // End of line: CRLF, or a bare LF which is accepted too
+        size_t line_end = pos;
+        size_t next_line = pos + 1;
+        if (*hit == '\r') {
+            if (next_line == buffer.size()) {
+                scan_pos = pos; // Re-examine the CR once its LF arrives
+                return Status::Incomplete;
+            }
+            if (buffer[next_line] != '\n') {
+                return fail(state == State::RequestLine ? Error::BadRequestLine : Error::BadHeader);
+            }
+            ++next_line;
+        }
+
+        bool empty_line = line_end == line_start;
+        bool first_line = line_start == 0;
+        Status status = Status::Incomplete;
+        if (state == State::RequestLine) {
+            // RFC 9112 2.2: ignore at least one empty line before the request-line
+            if (!(empty_line && first_line)) {
+                if (!parse_request_line(buffer, line_end)) {
+                    return fail(Error::BadRequestLine);
+                }
+                std::string_view v = buffer.substr(version.offset, version.length);
+                if (v.size() != 8 || v.substr(0, 7) != "HTTP/1." || v[7] < '0' || v[7] > '9') {
+                    return fail(Error::BadVersion);
+                }
+                version_minor = v[7] - '0';
+                state = State::Headers;
+            }
+        } else if (!empty_line) {
+            status = parse_header_line(buffer, line_end);
+        }
+
+        line_start = scan_pos = next_line;
+        first_delimiter = second_delimiter = NO_DELIMITER;
+        if (status == Status::Error) {
+            return status;
+        }
+        if (state == State::RequestLine || !empty_line) {
+            continue;
+        }
+
+        // Blank line: end of the head
+        body_start = next_line;
+        if (parse_framing(buffer) == Status::Error) {
+            return Status::Error;
+        }
+        state = State::Done;
+    }
+
+    if (state == State::Failed) {
+        return Status::Error;
+    }
+
+    fill(buffer, request);
+    return Status::Complete;
+}
+
+HTTPRequest parse_http_request(std::string_view request) {
+    HTTPRequest http_request;
+    HttpRequestParser parser(request.size());
+    if (parser.parse(request, http_request) != HttpRequestParser::Status::Complete || http_request.chunked ||
+        request.size() - parser.head_length() < http_request.content_length) {
+        return HTTPRequest();
+    }
+    http_request.body = request.substr(parser.head_length(), http_request.content_length);
+    return http_request;
+}
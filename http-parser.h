@@ -0,0 +1,275 @@
+#ifndef HTTP_PARSER_H
+#define HTTP_PARSER_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// Upper bound on the request line plus headers
+#define MAX_REQUEST_SIZE 4096
+
+// Headers beyond this count are rejected (431)
+#define MAX_HEADERS 32
+
+// A configured head size limit as enforced: 0 (unlimited) and anything larger become the
+// largest head the parser's 32-bit offsets can index
+constexpr size_t header_size_limit(size_t configured) {
+    constexpr size_t largest = UINT32_MAX;
+    return configured == 0 || configured > largest ? largest : configured;
+}
+
+// Case-insensitive ASCII comparison for header names and tokens
+bool equals_ignore_case(std::string_view a, std::string_view b);
+
+struct HttpHeader {
+    std::string_view name;
+    std::string_view value;
+};
+
+// Zero-copy view of one parsed request head. Every string_view points into the buffer that
+// was handed to HttpRequestParser::parse() and is only valid while that buffer is unchanged.
+struct HTTPRequest {
+    std::string_view method;
+    std::string_view path;
+    std::string_view version;
+    std::string_view body; // Only filled by parse_http_request(); the server streams bodies
+    int version_minor = 1; // HTTP/1.<minor>
+
+    std::array<HttpHeader, MAX_HEADERS> headers;
+    size_t header_count = 0;
+
+    // Body framing: a Content-Length body, or Transfer-Encoding: chunked (ChunkedDecoder)
+    size_t content_length = 0;
+    bool chunked = false;
+
+    bool has_body() const { return chunked || content_length > 0; }
+
+    // Case-insensitive lookup; returns an empty view if the header is absent
+    std::string_view header(std::string_view name) const;
+    bool has_header(std::string_view name) const;
+};
+
+/**
+ * @brief Incremental HTTP/1.x request head parser.
+ * Call parse() with the whole unconsumed buffer every time more bytes arrive: it resumes
+ * from where it stopped instead of rescanning, and only stores offsets internally, so the
+ * buffer may grow (and reallocate) between calls. Once it reports Complete the request
+ * line and headers are filled in; the body, if any, starts head_length() bytes in and is
+ * framed by the caller (see ChunkedDecoder). reset() before parsing the next request.
+ */
+class HttpRequestParser {
+  public:
+    enum class Status { Incomplete, Complete, Error };
+    enum class Error {
+        None,
+        BadRequestLine,
+        BadVersion,
+        BadHeader,
+        TooManyHeaders,
+        HeadersTooLarge,
+        BadContentLength,
+        BadTransferEncoding,         // Both Content-Length and Transfer-Encoding (smuggling vector)
+        UnsupportedTransferEncoding, // Any coding other than plain "chunked" (501)
+    };
+
+  private:
+    enum class State { RequestLine, Headers, Done, Failed };
+
+    struct Span {
+        uint32_t offset = 0;
+        uint32_t length = 0;
+    };
+
+    size_t max_header_bytes;
+    State state = State::RequestLine;
+    Error error_code = Error::None;
+
+    static constexpr size_t NO_DELIMITER = static_cast<size_t>(-1);
+
+    size_t line_start = 0; // Start of the line being parsed
+    size_t scan_pos = 0;   // Where the delimiter scan of the current line resumes
+
+    // Delimiters already found on the current line: the request line's two spaces, or a
+    // header's colon
+    size_t first_delimiter = NO_DELIMITER;
+    size_t second_delimiter = NO_DELIMITER;
+
+    Span method, target, version;
+    int version_minor = 1;
+    std::array<Span, MAX_HEADERS> header_names;
+    std::array<Span, MAX_HEADERS> header_values;
+    size_t header_count = 0;
+    size_t body_start = 0;
+    size_t content_length = 0;
+    bool chunked = false;
+
+    Status fail(Error error);
+    bool parse_request_line(std::string_view buffer, size_t line_end);
+    Status parse_header_line(std::string_view buffer, size_t line_end);
+    Status parse_framing(std::string_view buffer);
+    void fill(std::string_view buffer, HTTPRequest &request) const;
+
+  public:
+    // max_header_size: 0 = unlimited (see header_size_limit())
+    explicit HttpRequestParser(size_t max_header_size = MAX_REQUEST_SIZE)
+        : max_header_bytes(header_size_limit(max_header_size)) {}
+
+    Status parse(std::string_view buffer, HTTPRequest &request);
+
+    // Bytes occupied by the request line and headers; valid after Complete
+    size_t head_length() const { return body_start; }
+
+    Error error() const { return error_code; }
+
+    void reset();
+};
+
+/**
+ * @brief Incremental decoder for a Transfer-Encoding: chunked body.
+ * decode() consumes as much of its input as it can, handing chunk data to on_data as
+ * views into that input, and stops right after the final CRLF so a pipelined request
+ * behind the body is left alone. Chunk extensions and trailer fields are skipped.
+ */
+class ChunkedDecoder {
+  public:
+    enum class Status { NeedMore, Done, Error };
+
+  private:
+    enum class State { Size, Extension, SizeLF, Data, DataCR, DataLF, Trailer, TrailerLF, Done };
+
+    static constexpr int MAX_SIZE_DIGITS = 15;           // Keeps the size well inside uint64_t
+    static constexpr size_t MAX_TRAILER_BYTES = MAX_REQUEST_SIZE;
+
+    State state = State::Size;
+    uint64_t remaining = 0; // Chunk size while reading it, then the unread part of the chunk
+    int size_digits = 0;
+    bool line_empty = true; // Trailer section: nothing but CR seen on the current line
+    size_t trailer_bytes = 0;
+
+    static int hex_value(char c) {
+        if (c >= '0' && c <= '9')
+            return c - '0';
+        if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f')
+            return (c | 0x20) - 'a' + 10;
+        return -1;
+    }
+
+    // LF at the end of a chunk-size line: the zero-size chunk starts the trailer section
+    void end_size_line() {
+        state = remaining != 0 ? State::Data : State::Trailer;
+        line_empty = true;
+    }
+
+  public:
+    template <class OnData> Status decode(std::string_view input, size_t &consumed, OnData &&on_data) {
+        size_t i = 0;
+        while (i < input.size() && state != State::Done) {
+            char c = input[i];
+            switch (state) {
+            case State::Size: {
+                int digit = hex_value(c);
+                if (digit >= 0) {
+                    if (++size_digits > MAX_SIZE_DIGITS) {
+                        return Status::Error;
+                    }
+                    remaining = remaining * 16 + digit;
+                } else if (size_digits == 0) {
+                    return Status::Error;
+                } else if (c == ';' || c == ' ' || c == '\t') {
+                    state = State::Extension;
+                } else if (c == '\r') {
+                    state = State::SizeLF;
+                } else if (c == '\n') {
+                    end_size_line();
+                } else {
+                    return Status::Error;
+                }
+                ++i;
+                break;
+            }
+            case State::Extension:
+                if (c == '\r') {
+                    state = State::SizeLF;
+                } else if (c == '\n') {
+                    end_size_line();
+                }
+                ++i;
+                break;
+            case State::SizeLF:
+                if (c != '\n') {
+                    return Status::Error;
+                }
+                end_size_line();
+                ++i;
+                break;
+            case State::Data: {
+                size_t n = input.size() - i;
+                if (n > remaining) {
+                    n = static_cast<size_t>(remaining);
+                }
+                on_data(input.substr(i, n));
+                i += n;
+                remaining -= n;
+                if (remaining == 0) {
+                    state = State::DataCR;
+                }
+                break;
+            }
+            case State::DataCR:
+                if (c == '\r') {
+                    state = State::DataLF;
+                } else if (c == '\n') {
+                    state = State::Size;
+                    size_digits = 0;
+                } else {
+                    return Status::Error;
+                }
+                ++i;
+                break;
+            case State::DataLF:
+                if (c != '\n') {
+                    return Status::Error;
+                }
+                state = State::Size;
+                size_digits = 0;
+                ++i;
+                break;
+            case State::Trailer:
+                if (c == '\r') {
+                    state = State::TrailerLF;
+                } else if (c == '\n') {
+                    state = line_empty ? State::Done : State::Trailer;
+                    line_empty = true;
+                } else {
+                    line_empty = false;
+                    if (++trailer_bytes > MAX_TRAILER_BYTES) {
+                        return Status::Error;
+                    }
+                }
+                ++i;
+                break;
+            case State::TrailerLF:
+                if (c != '\n') {
+                    return Status::Error;
+                }
+                state = line_empty ? State::Done : State::Trailer;
+                line_empty = true;
+                ++i;
+                break;
+            case State::Done:
+                break;
+            }
+        }
+        consumed = i;
+        return state == State::Done ? Status::Done : Status::NeedMore;
+    }
+
+    void reset() { *this = ChunkedDecoder(); }
+};
+
+// One-shot parse of a complete request held in `request`; the views point into it.
+// Returns a request with an empty method if it is malformed or incomplete.
+HTTPRequest parse_http_request(std::string_view request);
+
+#endif // HTTP_PARSER_H
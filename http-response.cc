@@ -0,0 +1,752 @@
+#include "http-response.h"
+#include "http-date.h"
+#include "http-parser.h"
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+std::string_view reason_phrase(int status) {
+    std::string_view line = status_line(status);
+    if (line.empty()) {
+        return "Unknown";
+    }
+    // "HTTP/1.1 NNN " is 13 bytes; the line ends in CRLF
+    return line.substr(13, line.size() - 15);
+}
+
+// --- OutputQueue ---
+
+void OutputQueue::append_borrowed(std::string_view data, std::shared_ptr<const void> owner) {
+    if (data.empty()) {
+        return;
+    }
+    // Continues the tail segment in memory: one iovec instead of two. Owners must agree (or
+    // one side is static), since the merged segment can keep only one alive.
+    if (segments.size() > pinned && segments.back().kind == SegmentKind::Borrowed) {
+        Segment &tail = segments.back();
+        if (tail.borrowed.data() + tail.borrowed.size() == data.data() && (!owner || !tail.owner || owner == tail.owner)) {
+            tail.borrowed = std::string_view(tail.borrowed.data(), tail.borrowed.size() + data.size());
+            if (!tail.owner) {
+                tail.owner = std::move(owner);
+            }
+            pending += data.size();
+            return;
+        }
+    }
+    Segment segment;
+    segment.borrowed = data;
+    segment.owner = std::move(owner);
+    segments.push_back(std::move(segment));
+    pending += data.size();
+}
+
+void OutputQueue::append_owned(std::string &&data) {
+    if (data.empty()) {
+        return;
+    }
+    pending += data.size();
+    // Views are taken at write time, so growing a partly written tail segment is safe
+    if (segments.size() > pinned && segments.back().kind == SegmentKind::Owned &&
+        segments.back().owned.size() + data.size() <= COALESCE_LIMIT) {
+        segments.back().owned += data;
+        return;
+    }
+    Segment segment;
+    segment.kind = SegmentKind::Owned;
+    segment.owned = std::move(data);
+    segments.push_back(std::move(segment));
+}
+
+void OutputQueue::append_copy(std::string_view data) { append_borrowed(scratch.copy(data)); }
+
+void OutputQueue::append_file(int fd, off_t offset, size_t length, std::shared_ptr<const void> owner) {
+    if (length == 0) {
+        return;
+    }
+    struct stat st;
+    Segment segment;
+    segment.kind = fstat(fd, &st) == 0 && S_ISFIFO(st.st_mode) ? SegmentKind::Pipe : SegmentKind::File;
+    segment.owner = std::move(owner);
+    segment.file_fd = fd;
+    segment.file_offset = offset;
+    segment.file_length = length;
+    segments.push_back(std::move(segment));
+    pending += length;
+}
+
+void OutputQueue::append_stream(std::shared_ptr<BodyStream> stream) {
+    Segment segment;
+    segment.kind = SegmentKind::Stream;
+    segment.stream = std::move(stream);
+    segments.push_back(std::move(segment));
+    ++streams;
+}
+
+std::shared_ptr<BodyStream> OutputQueue::stalled_stream() const {
+    if (segments.empty() || segments.front().kind != SegmentKind::Stream) {
+        return nullptr;
+    }
+    return segments.front().stream;
+}
+
+void OutputQueue::pop_stream() {
+    segments.pop_front();
+    front_offset = 0;
+    --streams;
+}
+
+void OutputQueue::cancel_streams() {
+    if (streams == 0) {
+        return;
+    }
+    for (Segment &segment : segments) {
+        if (segment.kind == SegmentKind::Stream) {
+            segment.stream->cancel();
+        }
+    }
+}
+
+void OutputQueue::consume(size_t bytes) {
+    pending -= bytes;
+    while (bytes > 0) {
+        size_t left = segments.front().size() - front_offset;
+        if (bytes < left) {
+            front_offset += bytes;
+            return;
+        }
+        bytes -= left;
+        segments.pop_front();
+        front_offset = 0;
+    }
+    if (pending == 0) {
+        scratch.reset(); // Nothing borrowed from it is left to send
+    }
+}
+
+ssize_t OutputQueue::write_file(int fd, const Segment &segment) {
+    size_t length = segment.file_length - front_offset;
+    bool more = segments.size() > 1;
+    ssize_t sent;
+    if (segment.kind == SegmentKind::Pipe) {
+        sent = splice(segment.file_fd, nullptr, fd, nullptr, length,
+                      SPLICE_F_MOVE | SPLICE_F_NONBLOCK | (more ? SPLICE_F_MORE : 0));
+    } else {
+        off_t offset = segment.file_offset + static_cast<off_t>(front_offset);
+        sent = sendfile(fd, segment.file_fd, &offset, length);
+    }
+    if (sent == 0) {
+        // The file shrank (or the pipe's writer went away) under a response that promised more
+        errno = EPIPE;
+        return -1;
+    }
+    return sent;
+}
+
+// The front segment's stream writes for itself; once it is done the queue goes on behind it
+ssize_t OutputQueue::write_stream(int fd) {
+    BodyStream &stream = *segments.front().stream;
+    if (stream.watched) {
+        errno = ENODATA; // Left alone until whoever waits for it is woken
+        return -1;
+    }
+    ssize_t sent = stream.done() ? 0 : stream.write_to(fd);
+    if (stream.done()) {
+        pop_stream();
+    }
+    return sent;
+}
+
+size_t OutputQueue::fill_iov(struct iovec *iov, size_t max_iov, bool &before_file) const {
+    size_t count = 0;
+    before_file = false;
+    for (auto it = segments.begin(); it != segments.end() && count < max_iov; ++it) {
+        if (!it->in_memory()) {
+            before_file = true;
+            break;
+        }
+        std::string_view data = it->view();
+        if (count == 0) {
+            data.remove_prefix(front_offset);
+        }
+        iov[count].iov_base = const_cast<char *>(data.data());
+        iov[count].iov_len = data.size();
+        ++count;
+    }
+    return count;
+}
+
+ssize_t OutputQueue::write_to(int fd) {
+    if (segments.front().kind == SegmentKind::Stream) {
+        return write_stream(fd);
+    }
+    ssize_t sent;
+    if (!segments.front().in_memory()) {
+        sent = write_file(fd, segments.front());
+    } else {
+        struct iovec iov[MAX_IOV];
+        bool before_file;
+        size_t count = fill_iov(iov, MAX_IOV, before_file);
+
+        // sendmsg() rather than writev(): it takes MSG_NOSIGNAL, so a reset peer is an EPIPE, not a
+        // SIGPIPE. MSG_MORE lets a response head share a packet with the file data behind it.
+        struct msghdr message = {};
+        message.msg_iov = iov;
+        message.msg_iovlen = count;
+        sent = sendmsg(fd, &message, MSG_NOSIGNAL | (before_file ? MSG_MORE : 0));
+    }
+    if (sent > 0) {
+        consume(static_cast<size_t>(sent));
+    }
+    return sent;
+}
+
+size_t OutputQueue::gather(struct iovec *iov, size_t max_iov, bool &before_file) {
+    before_file = false;
+    if (segments.empty() || !segments.front().in_memory()) {
+        return 0;
+    }
+    size_t count = fill_iov(iov, max_iov, before_file);
+    pinned = count;
+    return count;
+}
+
+ssize_t OutputQueue::peek(char *dest, size_t capacity) {
+    // A stream in front is peeked on its own, and sent() then goes to it
+    while (!segments.empty() && segments.front().kind == SegmentKind::Stream) {
+        BodyStream &stream = *segments.front().stream;
+        if (stream.watched) {
+            errno = ENODATA;
+            return -1;
+        }
+        if (!stream.done()) {
+            return stream.peek(dest, capacity);
+        }
+        pop_stream();
+    }
+    size_t copied = 0;
+    size_t offset = front_offset;
+    for (auto it = segments.begin(); it != segments.end() && copied < capacity; ++it, offset = 0) {
+        if (it->kind == SegmentKind::Stream) {
+            break;
+        }
+        size_t length = std::min(it->size() - offset, capacity - copied);
+        if (it->in_memory()) {
+            memcpy(dest + copied, it->view().data() + offset, length);
+            copied += length;
+            continue;
+        }
+        if (it->kind == SegmentKind::File) {
+            ssize_t got = pread(it->file_fd, dest + copied, length, it->file_offset + static_cast<off_t>(offset));
+            if (got <= 0) {
+                if (got == 0) {
+                    errno = EPIPE; // The file shrank, as in write_file()
+                }
+                return copied > 0 ? static_cast<ssize_t>(copied) : -1;
+            }
+            copied += static_cast<size_t>(got);
+            if (static_cast<size_t>(got) < length) {
+                break;
+            }
+            continue;
+        }
+        // A pipe cannot be read twice: what comes out becomes an owned segment in front of it
+        if (offset > 0) {
+            it->file_length -= offset; // Spliced already: those bytes have left the pipe
+            front_offset = 0;
+        }
+        ssize_t got = read(it->file_fd, dest + copied, length);
+        if (got <= 0) {
+            if (got == 0) {
+                errno = EPIPE;
+            }
+            return copied > 0 ? static_cast<ssize_t>(copied) : -1;
+        }
+        Segment taken;
+        taken.kind = SegmentKind::Owned;
+        taken.owned.assign(dest + copied, static_cast<size_t>(got));
+        it->file_length -= static_cast<size_t>(got);
+        if (it->file_length == 0) {
+            *it = std::move(taken);
+        } else {
+            it = segments.insert(it, std::move(taken));
+        }
+        copied += static_cast<size_t>(got);
+        break;
+    }
+    return static_cast<ssize_t>(copied);
+}
+
+void OutputQueue::sent(size_t bytes) {
+    pinned = 0;
+    if (segments.empty() || segments.front().kind != SegmentKind::Stream) {
+        consume(bytes);
+        return;
+    }
+    segments.front().stream->sent(bytes);
+    if (segments.front().stream->done()) {
+        pop_stream();
+    }
+}
+
+void OutputQueue::clear() {
+    cancel_streams();
+    segments.clear();
+    front_offset = 0;
+    pending = 0;
+    pinned = 0;
+    streams = 0;
+    scratch.reset();
+}
+
+// --- HttpResponse ---
+
+HttpResponse::HttpResponse(int code) : status_code(code), status(status_line(code)) {
+    if (status.empty()) {
+        custom_status = "HTTP/1.1 " + std::to_string(code) + " Unknown\r\n";
+    }
+}
+
+HttpResponse::HttpResponse(int code, std::string_view head, size_t status_line_length)
+    : status_code(code), status(head.substr(0, status_line_length)) {
+    if (head.size() > status_line_length) {
+        header_lines[header_line_count++] = head.substr(status_line_length);
+    }
+}
+
+HttpResponse HttpResponse::from_string(std::string serialized) {
+    HttpResponse response;
+    response.raw = std::move(serialized);
+    response.is_raw = true;
+    // Keeps status_code_value() meaningful for metrics: "HTTP/1.1 404 ..."
+    size_t space = response.raw.find(' ');
+    if (space != std::string::npos && space + 3 < response.raw.size()) {
+        int code = 0;
+        for (size_t i = space + 1; i < space + 4 && response.raw[i] >= '0' && response.raw[i] <= '9'; ++i) {
+            code = code * 10 + (response.raw[i] - '0');
+        }
+        if (code >= 100) {
+            response.status_code = code;
+        }
+    }
+    return response;
+}
+
+HttpResponse HttpResponse::from_prepared(std::shared_ptr<const PreparedResponse> prepared) {
+    HttpResponse response(prepared->status);
+    response.prepared = std::move(prepared);
+    return response;
+}
+
+HttpResponse &HttpResponse::set_header(std::string_view name, std::string_view value) {
+    if (equals_ignore_case(name, "Connection")) {
+        if (equals_ignore_case(value, "close")) {
+            connection = Connection::Close;
+        } else if (equals_ignore_case(value, "keep-alive")) {
+            connection = Connection::KeepAlive;
+        }
+        return *this;
+    }
+    if (equals_ignore_case(name, "Date")) {
+        has_date = true;
+    }
+    headers.append(name);
+    headers.append(": ");
+    headers.append(value);
+    headers.append("\r\n");
+    return *this;
+}
+
+HttpResponse &HttpResponse::add_header_line(std::string_view line) {
+    if (line == HEADER_CONNECTION_CLOSE) {
+        connection = Connection::Close;
+    } else if (line == HEADER_CONNECTION_KEEP_ALIVE) {
+        connection = Connection::KeepAlive;
+    } else if (header_line_count < MAX_HEADER_LINES) {
+        header_lines[header_line_count++] = line;
+    } else {
+        headers.append(line);
+    }
+    return *this;
+}
+
+HttpResponse &HttpResponse::set_body(std::string body) {
+    body_kind = BodyKind::Owned;
+    owned_body = std::move(body);
+    body_owner.reset();
+    return *this;
+}
+
+HttpResponse &HttpResponse::set_body_view(std::string_view body, std::shared_ptr<const void> owner) {
+    body_kind = BodyKind::Borrowed;
+    borrowed_body = body;
+    body_owner = std::move(owner);
+    owned_body.clear();
+    return *this;
+}
+
+HttpResponse &HttpResponse::set_body_file(int fd, off_t offset, size_t length, std::shared_ptr<const void> owner) {
+    body_kind = BodyKind::File;
+    body_fd = fd;
+    body_offset = offset;
+    body_length = length;
+    body_owner = std::move(owner);
+    owned_body.clear();
+    return *this;
+}
+
+HttpResponse &HttpResponse::set_body_stream(std::shared_ptr<BodyStream> stream, size_t length) {
+    body_kind = BodyKind::Stream;
+    body_stream = std::move(stream);
+    body_length = length;
+    framed = true;
+    body_owner.reset();
+    owned_body.clear();
+    return *this;
+}
+
+HttpResponse &HttpResponse::set_body_stream(std::shared_ptr<BodyStream> stream) {
+    set_body_stream(std::move(stream), 0);
+    framed = false;
+    return *this;
+}
+
+size_t HttpResponse::body_size() const {
+    return body_kind == BodyKind::File || body_kind == BodyKind::Stream ? body_length : body().size();
+}
+
+// Value of header name among "Name: value\r\n" lines, trimmed; false if it is not there
+static bool find_header_line(std::string_view lines, std::string_view name, std::string_view &value) {
+    while (!lines.empty()) {
+        size_t line_end = lines.find("\r\n");
+        std::string_view line = lines.substr(0, line_end);
+        lines.remove_prefix(line_end == std::string_view::npos ? lines.size() : line_end + 2);
+        if (line.size() <= name.size() || line[name.size()] != ':' ||
+            !equals_ignore_case(line.substr(0, name.size()), name)) {
+            continue;
+        }
+        value = line.substr(name.size() + 1);
+        while (!value.empty() && (value.front() == ' ' || value.front() == '\t')) {
+            value.remove_prefix(1);
+        }
+        while (!value.empty() && (value.back() == ' ' || value.back() == '\t')) {
+            value.remove_suffix(1);
+        }
+        return true;
+    }
+    return false;
+}
+
+std::string_view HttpResponse::header(std::string_view name) const {
+    std::string_view value;
+    for (size_t i = 0; i < header_line_count; ++i) {
+        if (find_header_line(header_lines[i], name, value)) {
+            return value;
+        }
+    }
+    find_header_line(headers, name, value);
+    return value;
+}
+
+// 1xx, 204 and 304 responses never have a body, so they carry no Content-Length either
+static bool status_has_body(int status) { return status >= 200 && status != 204 && status != 304; }
+
+// The Date line, "Content-Length: " + 20 digits + CRLF, and the blank line
+static constexpr size_t HEAD_END_MAX = DATE_HEADER_LENGTH + 16 + 20 + 2 + 2;
+
+// Date (when date is set), Content-Length (when the status allows a body and framed is set)
+// and the blank line that ends the head, written into out (HEAD_END_MAX bytes); returns the
+// length
+static size_t format_head_end(char *out, int status, size_t body_size, bool framed, bool date) {
+    char *next = out;
+    if (date) {
+        copy_date_header(next);
+        next += DATE_HEADER_LENGTH;
+    }
+    if (framed && status_has_body(status)) {
+        std::memcpy(next, "Content-Length: ", 16);
+        next = std::to_chars(next + 16, out + HEAD_END_MAX, body_size).ptr;
+        *next++ = '\r';
+        *next++ = '\n';
+    }
+    *next++ = '\r';
+    *next++ = '\n';
+    return next - out;
+}
+
+std::shared_ptr<const PreparedResponse> HttpResponse::prepare() const {
+    if (prepared) {
+        return prepared;
+    }
+    auto result = std::make_shared<PreparedResponse>();
+    result->status = status_code;
+
+    if (is_raw) {
+        // The Connection header goes right after the status line, as apply_connection_header() puts it
+        size_t status_end = raw.find("\r\n");
+        size_t header_end = raw.find("\r\n\r\n");
+        if (status_end == std::string::npos || header_end == std::string::npos) {
+            return nullptr;
+        }
+        // A Connection header of the handler's own would be replayed to every client
+        for (size_t line = status_end + 2; line < header_end; line = raw.find("\r\n", line) + 2) {
+            if (equals_ignore_case(std::string_view(raw).substr(line, 11), "Connection:")) {
+                return nullptr;
+            }
+        }
+        result->bytes = raw;
+        result->head_length = status_end + 2;
+        result->body_offset = header_end + 4;
+        return result;
+    }
+
+    if (body_kind == BodyKind::File || body_kind == BodyKind::Stream || connection != Connection::Default) {
+        return nullptr;
+    }
+    std::string &bytes = result->bytes;
+    bytes.append(custom_status.empty() ? status : std::string_view(custom_status));
+    for (size_t i = 0; i < header_line_count; ++i) {
+        bytes.append(header_lines[i]);
+    }
+    bytes.append(headers);
+    result->head_length = bytes.size();
+    result->dated = !has_date;
+
+    // Without the Date: it is added each time the response is sent
+    char head_end[HEAD_END_MAX];
+    bytes.append(head_end, format_head_end(head_end, status_code, body_size(), true, false));
+    result->body_offset = bytes.size();
+    if (send_body && status_has_body(status_code)) {
+        bytes.append(body());
+    }
+    return result;
+}
+
+void HttpResponse::append_to(OutputQueue &out) && {
+    if (is_raw) {
+        if (!send_body) {
+            // A serialized response to HEAD: keep its head, Content-Length included
+            size_t header_end = raw.find("\r\n\r\n");
+            if (header_end != std::string::npos) {
+                raw.resize(header_end + 4);
+            }
+        }
+        out.append_owned(std::move(raw));
+        return;
+    }
+    if (prepared) {
+        // Segments go out in order, so the owner on the last one keeps both alive
+        out.append_borrowed(prepared->head());
+        if (connection == Connection::Close) {
+            out.append_borrowed(HEADER_CONNECTION_CLOSE);
+        } else if (connection == Connection::KeepAlive) {
+            out.append_borrowed(HEADER_CONNECTION_KEEP_ALIVE);
+        }
+        if (prepared->dated) {
+            char date[DATE_HEADER_LENGTH];
+            copy_date_header(date);
+            out.append_borrowed(out.arena().copy(std::string_view(date, DATE_HEADER_LENGTH)));
+        }
+        std::string_view tail = send_body ? prepared->tail() : prepared->tail_headers();
+        out.append_borrowed(tail, std::move(prepared));
+        return;
+    }
+
+    if (custom_status.empty()) {
+        out.append_borrowed(status);
+    } else {
+        out.append_owned(std::move(custom_status));
+    }
+    if (connection == Connection::Close) {
+        out.append_borrowed(HEADER_CONNECTION_CLOSE);
+    } else if (connection == Connection::KeepAlive) {
+        out.append_borrowed(HEADER_CONNECTION_KEEP_ALIVE);
+    }
+    for (size_t i = 0; i < header_line_count; ++i) {
+        out.append_borrowed(header_lines[i]);
+    }
+
+    // Content-Length and the blank line close the head from the queue's arena, so a response
+    // without set_header() lines costs no allocation for its head
+    out.append_owned(std::move(headers));
+    char head_end[HEAD_END_MAX];
+    size_t head_end_length = format_head_end(head_end, status_code, body_size(), framed, !has_date);
+    out.append_borrowed(out.arena().copy(std::string_view(head_end, head_end_length)));
+
+    if (!send_body || !status_has_body(status_code)) {
+        return;
+    }
+    switch (body_kind) {
+    case BodyKind::Owned:
+        out.append_owned(std::move(owned_body));
+        break;
+    case BodyKind::Borrowed:
+        out.append_borrowed(borrowed_body, std::move(body_owner));
+        break;
+    case BodyKind::File:
+        out.append_file(body_fd, body_offset, body_length, std::move(body_owner));
+        break;
+    case BodyKind::Stream:
+        if (body_stream) {
+            out.append_stream(std::move(body_stream));
+        }
+        break;
+    }
+}
+
+// The header lines and body of a serialized response; false when it has no complete head
+static bool split_serialized(std::string_view serialized, ResponseParts &parts) {
+    size_t status_end = serialized.find("\r\n");
+    size_t header_end = serialized.find("\r\n\r\n");
+    if (status_end == std::string_view::npos || header_end == std::string_view::npos) {
+        return false;
+    }
+    for (size_t line = status_end + 2; line < header_end + 2;) {
+        size_t line_end = serialized.find("\r\n", line) + 2;
+        std::string_view text = serialized.substr(line, line_end - line);
+        if (!equals_ignore_case(text.substr(0, 15), "Content-Length:") &&
+            !equals_ignore_case(text.substr(0, 11), "Connection:")) {
+            parts.headers.append(text);
+        }
+        line = line_end;
+    }
+    parts.body = serialized.substr(header_end + 4);
+    parts.content_length = parts.body.size();
+    return true;
+}
+
+ResponseParts HttpResponse::take_parts() && {
+    ResponseParts parts;
+    parts.status = status_code;
+
+    if (is_raw || prepared) {
+        auto bytes = prepared ? std::shared_ptr<const std::string>(prepared, &prepared->bytes)
+                              : std::make_shared<const std::string>(std::move(raw));
+        if (!split_serialized(*bytes, parts)) {
+            parts.status = 500;
+            return parts;
+        }
+        parts.owner = std::move(bytes);
+        parts.has_body = send_body && status_has_body(parts.status) && !parts.body.empty();
+        if (prepared && prepared->dated) {
+            char date[DATE_HEADER_LENGTH];
+            copy_date_header(date);
+            parts.headers.append(date, DATE_HEADER_LENGTH);
+        }
+        return parts;
+    }
+    if (body_kind == BodyKind::Stream && (send_body || body_stream)) {
+        parts.status = 500;
+        return parts;
+    }
+
+    for (size_t i = 0; i < header_line_count; ++i) {
+        parts.headers.append(header_lines[i]);
+    }
+    parts.headers.append(headers);
+    if (!has_date) {
+        char date[DATE_HEADER_LENGTH];
+        copy_date_header(date);
+        parts.headers.append(date, DATE_HEADER_LENGTH);
+    }
+    parts.content_length = body_size();
+    parts.has_body = send_body && status_has_body(status_code) && parts.content_length > 0;
+
+    switch (body_kind) {
+    case BodyKind::Owned: {
+        auto body_bytes = std::make_shared<const std::string>(std::move(owned_body));
+        parts.body = *body_bytes;
+        parts.owner = std::move(body_bytes);
+        break;
+    }
+    case BodyKind::Borrowed:
+        parts.body = borrowed_body;
+        parts.owner = std::move(body_owner);
+        break;
+    case BodyKind::File:
+        parts.body_fd = body_fd;
+        parts.body_offset = body_offset;
+        parts.body_length = body_length;
+        parts.owner = std::move(body_owner);
+        break;
+    case BodyKind::Stream:
+        break;
+    }
+    return parts;
+}
+
+std::string HttpResponse::to_string() const {
+    if (is_raw) {
+        return raw;
+    }
+    if (prepared) {
+        std::string flat(prepared->head());
+        if (connection == Connection::Close) {
+            flat.append(HEADER_CONNECTION_CLOSE);
+        } else if (connection == Connection::KeepAlive) {
+            flat.append(HEADER_CONNECTION_KEEP_ALIVE);
+        }
+        if (prepared->dated) {
+            char date[DATE_HEADER_LENGTH];
+            copy_date_header(date);
+            flat.append(date, DATE_HEADER_LENGTH);
+        }
+        flat.append(prepared->tail());
+        return flat;
+    }
+    std::string flat;
+    flat.append(custom_status.empty() ? status : std::string_view(custom_status));
+    if (connection == Connection::Close) {
+        flat.append(HEADER_CONNECTION_CLOSE);
+    } else if (connection == Connection::KeepAlive) {
+        flat.append(HEADER_CONNECTION_KEEP_ALIVE);
+    }
+    for (size_t i = 0; i < header_line_count; ++i) {
+        flat.append(header_lines[i]);
+    }
+    flat.append(headers);
+    char head_end[HEAD_END_MAX];
+    flat.append(head_end, format_head_end(head_end, status_code, body_size(), framed, !has_date));
+
+    if (!send_body || !status_has_body(status_code) || body_kind == BodyKind::Stream) {
+        return flat;
+    }
+    if (body_kind != BodyKind::File) {
+        flat.append(body());
+        return flat;
+    }
+    size_t start = flat.size();
+    flat.resize(start + body_length);
+    size_t done = 0;
+    while (done < body_length) {
+        ssize_t n = pread(body_fd, flat.data() + start + done, body_length - done, body_offset + done);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR)
+                continue;
+            flat.resize(start + done);
+            break;
+        }
+        done += n;
+    }
+    return flat;
+}
+
+HttpResponse status_response(int status) {
+    // Every part is interned: the body is a view into the status line table, so building one
+    // allocates nothing
+    std::string_view line = status_line(status);
+    HttpResponse response(status);
+    response.add_header_line(HEADER_CONTENT_TYPE_TEXT);
+    if (line.empty()) {
+        response.set_body(std::to_string(status));
+    } else {
+        response.set_body_view(line.substr(9, line.size() - 11)); // Drop "HTTP/1.1 " and CRLF
+    }
+    return response;
+}
@@ -0,0 +1,446 @@
+#ifndef HTTP_RESPONSE_H
+#define HTTP_RESPONSE_H
+
+#include "arena.h"
+#include <array>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <sys/types.h>
+
+struct iovec;
+
+// Pre-serialized header lines with static storage, for HttpResponse::add_header_line()
+constexpr std::string_view HEADER_CONTENT_TYPE_TEXT = "Content-Type: text/plain\r\n";
+constexpr std::string_view HEADER_CONTENT_TYPE_HTML = "Content-Type: text/html; charset=utf-8\r\n";
+constexpr std::string_view HEADER_CONTENT_TYPE_JSON = "Content-Type: application/json\r\n";
+constexpr std::string_view HEADER_CONTENT_TYPE_OCTET = "Content-Type: application/octet-stream\r\n";
+constexpr std::string_view HEADER_CONNECTION_CLOSE = "Connection: close\r\n";
+constexpr std::string_view HEADER_CONNECTION_KEEP_ALIVE = "Connection: keep-alive\r\n";
+
+struct StatusEntry {
+    int code;
+    std::string_view line;
+};
+
+// Sorted by code; status_line() binary-searches it (at compile time for ResponseTemplate)
+inline constexpr StatusEntry STATUS_LINES[] = {
+    {100, "HTTP/1.1 100 Continue\r\n"},
+    {101, "HTTP/1.1 101 Switching Protocols\r\n"},
+    {200, "HTTP/1.1 200 OK\r\n"},
+    {201, "HTTP/1.1 201 Created\r\n"},
+    {202, "HTTP/1.1 202 Accepted\r\n"},
+    {204, "HTTP/1.1 204 No Content\r\n"},
+    {206, "HTTP/1.1 206 Partial Content\r\n"},
+    {301, "HTTP/1.1 301 Moved Permanently\r\n"},
+    {302, "HTTP/1.1 302 Found\r\n"},
+    {304, "HTTP/1.1 304 Not Modified\r\n"},
+    {307, "HTTP/1.1 307 Temporary Redirect\r\n"},
+    {308, "HTTP/1.1 308 Permanent Redirect\r\n"},
+    {400, "HTTP/1.1 400 Bad Request\r\n"},
+    {401, "HTTP/1.1 401 Unauthorized\r\n"},
+    {403, "HTTP/1.1 403 Forbidden\r\n"},
+    {404, "HTTP/1.1 404 Not Found\r\n"},
+    {405, "HTTP/1.1 405 Method Not Allowed\r\n"},
+    {408, "HTTP/1.1 408 Request Timeout\r\n"},
+    {409, "HTTP/1.1 409 Conflict\r\n"},
+    {411, "HTTP/1.1 411 Length Required\r\n"},
+    {412, "HTTP/1.1 412 Precondition Failed\r\n"},
+    {413, "HTTP/1.1 413 Payload Too Large\r\n"},
+    {414, "HTTP/1.1 414 URI Too Long\r\n"},
+    {415, "HTTP/1.1 415 Unsupported Media Type\r\n"},
+    {416, "HTTP/1.1 416 Range Not Satisfiable\r\n"},
+    {429, "HTTP/1.1 429 Too Many Requests\r\n"},
+    {431, "HTTP/1.1 431 Request Header Fields Too Large\r\n"},
+    {500, "HTTP/1.1 500 Internal Server Error\r\n"},
+    {501, "HTTP/1.1 501 Not Implemented\r\n"},
+    {502, "HTTP/1.1 502 Bad Gateway\r\n"},
+    {503, "HTTP/1.1 503 Service Unavailable\r\n"},
+    {504, "HTTP/1.1 504 Gateway Timeout\r\n"},
+    {505, "HTTP/1.1 505 HTTP Version Not Supported\r\n"},
+};
+
+// "HTTP/1.1 <code> <reason>\r\n" from the table above; empty for codes it does not know
+constexpr std::string_view status_line(int status) {
+    size_t lo = 0;
+    size_t hi = sizeof(STATUS_LINES) / sizeof(STATUS_LINES[0]);
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (STATUS_LINES[mid].code < status) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo < sizeof(STATUS_LINES) / sizeof(STATUS_LINES[0]) && STATUS_LINES[lo].code == status) {
+        return STATUS_LINES[lo].line;
+    }
+    return {};
+}
+
+std::string_view reason_phrase(int status);
+
+class HttpResponse;
+
+/**
+ * @brief A response serialized once for reuse (see ResponseCache). bytes holds the head up
+ * to where a Connection header would go, then the rest: Content-Length, the blank line
+ * and the body. Immutable once built, so any number of connections may queue it at once.
+ * The Date header of a dated response goes in with the Connection header, when it is sent.
+ */
+struct PreparedResponse {
+    std::string bytes;
+    size_t head_length = 0;
+    size_t body_offset = 0; // Past the blank line that ends the headers
+    int status = 200;
+    bool dated = false;
+
+    std::string_view head() const { return std::string_view(bytes).substr(0, head_length); }
+    std::string_view tail() const { return std::string_view(bytes).substr(head_length); }
+
+    // tail() up to the body, for a HEAD answer
+    std::string_view tail_headers() const {
+        return std::string_view(bytes).substr(head_length, body_offset - head_length);
+    }
+};
+
+/**
+ * @brief An HttpResponse taken apart for a framing other than HTTP/1.1 (HTTP/2): the status,
+ * the header lines as "Name: value\r\n" text and the body, left where the response kept
+ * it. Content-Length and Connection are not among the lines; content_length is the size
+ * the body would have even when it is not sent (HEAD).
+ */
+struct ResponseParts {
+    int status = 200;
+    std::string headers;
+
+    std::string_view body; // Memory bodies; owner keeps them alive
+    int body_fd = -1;      // File bodies: body_length bytes of body_fd from body_offset
+    off_t body_offset = 0;
+    size_t body_length = 0;
+    std::shared_ptr<const void> owner;
+
+    size_t content_length = 0;
+    bool has_body = false; // Whether any body bytes are to be sent
+
+    size_t body_size() const { return body_fd >= 0 ? body_length : body.size(); }
+};
+
+// Plain-text reply whose body is the status itself ("404 Not Found")
+HttpResponse status_response(int status);
+
+/**
+ * @brief A response body still arriving from elsewhere (an upstream server), sent on as it
+ * comes instead of being held whole. OutputQueue pulls from it once everything queued in
+ * front of it has gone out. write_to() and peek() fail with ENODATA while nothing new has
+ * arrived: the sender then waits for wait_fd() to become readable rather than for its own
+ * socket, and sets watched so that only one waits at a time.
+ */
+class BodyStream {
+  public:
+    bool watched = false;
+
+    virtual ~BodyStream() = default;
+
+    // One splice() or send() of the next body bytes to fd, as OutputQueue::write_to()
+    virtual ssize_t write_to(int fd) = 0;
+
+    // As OutputQueue::peek() and sent(): bytes copied out stay until sent() takes them
+    virtual ssize_t peek(char *dest, size_t capacity) = 0;
+    virtual void sent(size_t bytes) = 0;
+
+    // Every byte of the body has been written (or taken by sent())
+    virtual bool done() const = 0;
+
+    virtual int wait_fd() const = 0;
+
+    // The connection went away first: end any wait on wait_fd() now rather than when the
+    // source next sends something
+    virtual void cancel() = 0;
+};
+
+/**
+ * @brief Bytes waiting to go out on one connection, as a queue of segments.
+ * Owned segments hold their bytes; borrowed ones point at storage that stays alive until
+ * the queue has sent them (static strings, or anything pinned by the segment's owner).
+ * File segments are a byte range of a descriptor, sent by the kernel without a copy.
+ * write_to() hands the memory segments in front of the next file segment (up to MAX_IOV)
+ * to one sendmsg() and advances past whatever was written, so a short write resumes
+ * mid-segment on the next call. Small generated parts (a response's Content-Length line,
+ * append_copy()) are carved from the queue's arena, which resets whenever the queue drains.
+ * A borrowed append that continues the previous one in memory (a ResponseTemplate head,
+ * consecutive arena copies) extends that segment instead of adding one.
+ * A stream segment (BodyStream) counts for nothing in size() but keeps the queue non-empty
+ * until its body is complete; streams still queued when the queue is cleared are cancelled.
+ */
+class OutputQueue {
+  public:
+    static constexpr size_t MAX_IOV = 64;
+
+    // Small owned appends are coalesced into the tail segment up to this size
+    static constexpr size_t COALESCE_LIMIT = 4096;
+
+  private:
+    enum class SegmentKind { Owned, Borrowed, File, Pipe, Stream };
+
+    struct Segment {
+        SegmentKind kind = SegmentKind::Borrowed;
+        std::string owned;
+        std::string_view borrowed;
+        std::shared_ptr<const void> owner; // Keeps borrowed storage or the file descriptor alive
+        std::shared_ptr<BodyStream> stream;
+
+        int file_fd = -1;
+        off_t file_offset = 0;
+        size_t file_length = 0;
+
+        size_t size() const {
+            switch (kind) {
+            case SegmentKind::Owned:
+                return owned.size();
+            case SegmentKind::Borrowed:
+                return borrowed.size();
+            case SegmentKind::Stream:
+                return 0;
+            default:
+                return file_length;
+            }
+        }
+        std::string_view view() const { return kind == SegmentKind::Owned ? std::string_view(owned) : borrowed; }
+        bool in_memory() const { return kind == SegmentKind::Owned || kind == SegmentKind::Borrowed; }
+    };
+
+    std::deque<Segment> segments;
+    size_t front_offset = 0; // Bytes of segments.front() already written
+    size_t pending = 0;      // Bytes not yet written
+    size_t pinned = 0;       // Leading segments handed out by gather(); never grown in place
+    size_t streams = 0;      // Stream segments queued
+    Arena scratch;           // Backs borrowed segments built by the queue's users
+
+    void consume(size_t bytes);
+    size_t fill_iov(struct iovec *iov, size_t max_iov, bool &before_file) const;
+    ssize_t write_file(int fd, const Segment &segment);
+    ssize_t write_stream(int fd);
+    void pop_stream();
+    void cancel_streams();
+
+  public:
+    OutputQueue() = default;
+    OutputQueue(OutputQueue &&other) noexcept = default;
+    OutputQueue &operator=(OutputQueue &&other) noexcept = default;
+    ~OutputQueue() { cancel_streams(); }
+
+    void append_borrowed(std::string_view data, std::shared_ptr<const void> owner = nullptr);
+    void append_owned(std::string &&data);
+    void append_copy(std::string_view data); // Into the arena: no allocation of its own
+
+    // length bytes of fd from offset, sent with sendfile(). A pipe is spliced instead and must
+    // already hold the bytes (offset is ignored). fd must stay open while owner lives.
+    void append_file(int fd, off_t offset, size_t length, std::shared_ptr<const void> owner);
+
+    // A body pulled from stream when it reaches the front, for as long as it takes
+    void append_stream(std::shared_ptr<BodyStream> stream);
+
+    // One sendmsg(MSG_NOSIGNAL), sendfile() or splice() call. Returns the byte count
+    // written, or -1 with errno set (EAGAIN on a full socket buffer).
+    ssize_t write_to(int fd);
+
+    // For senders that learn the result later (io_uring): fills iov with the memory segments
+    // in front of the next file segment and pins them until sent(), so appends cannot move
+    // their bytes meanwhile. Returns 0 when a file segment is in front; use write_to() then.
+    // before_file is set when a file segment follows the gathered ones.
+    size_t gather(struct iovec *iov, size_t max_iov, bool &before_file);
+    void sent(size_t bytes);
+
+    // For senders that transform the bytes first (user-space TLS): copies up to capacity bytes
+    // from the front into dest without consuming them; sent() does once they are taken. File
+    // ranges are read with pread(), and bytes read from a pipe are kept in the queue, so a
+    // retry sees the same bytes again. Returns -1 with errno set if a read fails.
+    ssize_t peek(char *dest, size_t capacity);
+
+    // The stream in front, after write_to() or peek() failed with ENODATA; null otherwise
+    std::shared_ptr<BodyStream> stalled_stream() const;
+
+    bool empty() const { return pending == 0 && streams == 0; }
+    size_t size() const { return pending; }
+    size_t segment_count() const { return segments.size(); }
+
+    // Storage for bytes appended with append_borrowed(); valid until the queue is empty
+    Arena &arena() { return scratch; }
+
+    void clear();
+};
+
+/**
+ * @brief A response assembled from parts instead of one concatenated string.
+ * The status line and add_header_line() fragments are interned (borrowed, never copied),
+ * set_header() lines are serialized into one owned block, and the body is either owned or
+ * borrowed. Content-Length and Date (copy_date_header(), unless set_header() gave one) are
+ * filled in when the response is queued. Queuing it costs one segment per part and no copy
+ * of the body.
+ */
+class HttpResponse {
+  public:
+    static constexpr size_t MAX_HEADER_LINES = 8;
+
+    enum class Connection { Default, Close, KeepAlive };
+
+  private:
+    int status_code = 200;
+    std::string_view status;    // Interned status line, or empty when custom_status is used
+    std::string custom_status; // Status codes missing from the table
+
+    std::array<std::string_view, MAX_HEADER_LINES> header_lines;
+    size_t header_line_count = 0;
+    std::string headers; // Serialized "Name: value\r\n" lines
+    bool has_date = false; // set_header() was given a Date (a proxied response's)
+
+    enum class BodyKind { Owned, Borrowed, File, Stream };
+
+    BodyKind body_kind = BodyKind::Owned;
+    std::string owned_body;
+    std::string_view borrowed_body;
+    std::shared_ptr<const void> body_owner;
+    int body_fd = -1;
+    off_t body_offset = 0;
+    size_t body_length = 0;
+    std::shared_ptr<BodyStream> body_stream;
+    bool framed = true; // Content-Length describes the body
+    bool send_body = true;
+
+    Connection connection = Connection::Default;
+
+    // Legacy handlers return a complete response string; it is sent as-is
+    std::string raw;
+    bool is_raw = false;
+
+    // Set instead of everything above for a response served from a PreparedResponse
+    std::shared_ptr<const PreparedResponse> prepared;
+
+  public:
+    explicit HttpResponse(int code = 200);
+
+    // A head fixed at compile time (see ResponseTemplate): its first status_line_length bytes
+    // are code's status line, the rest complete header lines; head must have static storage
+    HttpResponse(int code, std::string_view head, size_t status_line_length);
+
+    // Wraps a complete, already serialized response (what RequestHandler returns)
+    static HttpResponse from_string(std::string serialized);
+
+    // Queues the prepared bytes by reference: no copy, only a Connection header in between
+    static HttpResponse from_prepared(std::shared_ptr<const PreparedResponse> prepared);
+
+    // The response serialized for from_prepared(); null for a file body or a response that
+    // sets its own Connection header, since neither can be replayed as-is
+    std::shared_ptr<const PreparedResponse> prepare() const;
+
+    // Copies name and value; a Connection header is tracked, not copied
+    HttpResponse &set_header(std::string_view name, std::string_view value);
+
+    // line must be a complete "Name: value\r\n" with static storage (the HEADER_* constants)
+    HttpResponse &add_header_line(std::string_view line);
+
+    HttpResponse &set_body(std::string body);
+
+    // body is not copied and must stay alive until the response has been sent: either it has
+    // static storage or owner keeps it alive
+    HttpResponse &set_body_view(std::string_view body, std::shared_ptr<const void> owner = nullptr);
+
+    // length bytes of fd from offset, sent with sendfile(); owner keeps fd open meanwhile
+    HttpResponse &set_body_file(int fd, off_t offset, size_t length, std::shared_ptr<const void> owner);
+
+    // A body of length bytes that arrives while it is sent (see BodyStream). Without a length
+    // no Content-Length goes out: the headers must frame the body (Transfer-Encoding: chunked,
+    // with the stream producing the chunks) or the response must close the connection.
+    // HEAD answers may pass a null stream with omit_body(). Only HTTP/1.1 can send these.
+    HttpResponse &set_body_stream(std::shared_ptr<BodyStream> stream, size_t length);
+    HttpResponse &set_body_stream(std::shared_ptr<BodyStream> stream);
+
+    // HEAD: Content-Length still describes the body, but the body itself is not sent
+    HttpResponse &omit_body() {
+        send_body = false;
+        return *this;
+    }
+
+    HttpResponse &set_connection(Connection value) {
+        connection = value;
+        return *this;
+    }
+
+    int status_code_value() const { return status_code; }
+    bool prepared_response() const { return static_cast<bool>(prepared); }
+    bool body_omitted() const { return !send_body; }
+    bool body_streamed() const { return body_kind == BodyKind::Stream; }
+    Connection connection_header() const { return connection; }
+    bool raw_response() const { return is_raw; }
+    std::string &raw_string() { return raw; }
+
+    // Empty for a file or streamed body
+    std::string_view body() const {
+        return body_kind == BodyKind::Borrowed ? borrowed_body : std::string_view(owned_body);
+    }
+    size_t body_size() const;
+
+    // File body: its descriptor (-1 for any other body) and where the body starts
+    int body_file() const { return body_kind == BodyKind::File ? body_fd : -1; }
+    off_t body_file_offset() const { return body_offset; }
+
+    // Value of the first header line called name (set_header() or add_header_line()); empty
+    // if there is none. Not for raw or prepared responses.
+    std::string_view header(std::string_view name) const;
+
+    // Moves the parts into out: status line, interned lines, owned header block, body
+    void append_to(OutputQueue &out) &&;
+
+    // The response as parts; it is left empty. A streamed body cannot be taken apart: it
+    // turns into a bodiless 500 (a HEAD answer with a null stream keeps its length).
+    ResponseParts take_parts() &&;
+
+    // Flattened copy, for callers that need one contiguous string. A file body is read in;
+    // a streamed one is left out.
+    std::string to_string() const;
+};
+
+/**
+ * @brief A response head assembled at compile time: Status's line and the given header lines
+ * (HEADER_* constants, or any constexpr std::string_view holding complete lines) in one
+ * static string, queued as a single borrowed segment. A handler only supplies the body;
+ * Content-Length and Date are added when the response is queued.
+ *
+ *   using TextOk = ResponseTemplate<200, HEADER_CONTENT_TYPE_TEXT>;
+ *   return std::move(TextOk::response().set_body_view("Status: OK"));
+ */
+template <int Status, const std::string_view &...Lines> class ResponseTemplate {
+  private:
+    static constexpr std::string_view STATUS_LINE = status_line(Status);
+    static_assert(!STATUS_LINE.empty(), "ResponseTemplate: status code missing from STATUS_LINES");
+    static_assert(((Lines.size() >= 2 && Lines.substr(Lines.size() - 2) == "\r\n") && ...),
+                  "ResponseTemplate: every header line must end in CRLF");
+    static_assert(((Lines != HEADER_CONNECTION_CLOSE && Lines != HEADER_CONNECTION_KEEP_ALIVE) && ...),
+                  "ResponseTemplate: Connection is set per response (HttpResponse::set_connection())");
+
+    static constexpr size_t LENGTH = STATUS_LINE.size() + (Lines.size() + ... + 0);
+
+    static constexpr std::array<char, LENGTH> HEAD = [] {
+        std::array<char, LENGTH> head{};
+        size_t at = 0;
+        auto put = [&](std::string_view part) {
+            for (char c : part) {
+                head[at++] = c;
+            }
+        };
+        put(STATUS_LINE);
+        (put(Lines), ...);
+        return head;
+    }();
+
+  public:
+    static constexpr std::string_view head() { return std::string_view(HEAD.data(), LENGTH); }
+
+    // A response with this head and an empty body, to be filled in
+    static HttpResponse response() { return HttpResponse(Status, head(), STATUS_LINE.size()); }
+};
+
+#endif // HTTP_RESPONSE_H
@@ -1,14 +1,26 @@
 #include "http-server.h"
+#include "http2.h"
+#include "log.h"
+#include "metrics.h"
+#include "reactor.h"
+#include "static-files.h"
+#include "uring-worker.h"
+#include "util.h"
 #include <algorithm>
 #include <arpa/inet.h>
 #include <cctype>
+#include <climits>
 #include <chrono> // For std::this_thread::sleep_for
 #include <errno.h>
 #include <fcntl.h>
 #include <iostream>
 #include <stdexcept>
 #include <string.h>
+#include <linux/filter.h>
+#include <netinet/tcp.h>
+#include <poll.h>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/socket.h>
 #include <unistd.h>
 
@@ -16,7 +28,7 @@
 
 /**
  * @brief Sets a file descriptor to non-blocking mode.
- * NOTE: Only used for the listening socket in this TPC model.
+ * Used for the listening socket and every client socket.
  */
 int set_non_blocking(int fd) {
     int flags = fcntl(fd, F_GETFL, 0);
@@ -26,119 +38,364 @@ int set_non_blocking(int fd) {
 }
 
 /**
- * @brief Extracts a header value (case-insensitive search).
+ * @brief Disables Nagle's algorithm on a client socket. Responses leave in whole writes, so
+ * there is nothing to coalesce, while an HTTP/2 DATA frame that ends short of a full segment
+ * would otherwise wait for the peer's delayed ACK. Best effort: failure is ignored.
  */
-std::string get_header_value(const std::string &headers, const std::string &name) {
-    std::string search_name = name;
-    std::transform(search_name.begin(), search_name.end(), search_name.begin(), ::tolower);
-    search_name += ":";
+void set_tcp_nodelay(int fd) {
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+/**
+ * @brief Extracts a header value (case-insensitive search) from a raw header block.
+ * Header names are matched line by line, so "Content-Length" and "content-length"
+ * both hit, and the last header (with no trailing CRLF) is found too. Requests go
+ * through HttpRequestParser instead; this is for blocks such as handler responses.
+ */
+std::string_view get_header_value(std::string_view headers, std::string_view name) {
+    size_t line_start = 0;
 
-    size_t pos = headers.find(search_name);
-    if (pos == std::string::npos) {
-        return "";
+    while (line_start < headers.length()) {
+        size_t line_end = headers.find("\r\n", line_start);
+        if (line_end == std::string_view::npos) {
+            line_end = headers.length();
+        }
+
+        size_t colon = headers.find(':', line_start);
+        if (colon < line_end && equals_ignore_case(headers.substr(line_start, colon - line_start), name)) {
+            size_t start = colon + 1;
+            while (start < line_end && (headers[start] == ' ' || headers[start] == '\t')) {
+                start++;
+            }
+            size_t end = line_end;
+            while (end > start && (headers[end - 1] == ' ' || headers[end - 1] == '\t')) {
+                end--;
+            }
+            return headers.substr(start, end - start);
+        }
+
+        line_start = line_end + 2;
     }
 
-    size_t start = pos + search_name.length();
+    return {};
+}
+
+// True if the comma-separated header value contains token (case-insensitive).
+bool has_token(std::string_view value, std::string_view token) {
+    size_t pos = 0;
 
-    while (start < headers.length() && (headers[start] == ' ' || headers[start] == '\t')) {
-        start++;
+    while (pos < value.length()) {
+        size_t end = value.find(',', pos);
+        if (end == std::string_view::npos) {
+            end = value.length();
+        }
+        while (pos < end && (value[pos] == ' ' || value[pos] == '\t')) {
+            pos++;
+        }
+        size_t last = end;
+        while (last > pos && (value[last - 1] == ' ' || value[last - 1] == '\t')) {
+            last--;
+        }
+        if (equals_ignore_case(value.substr(pos, last - pos), token)) {
+            return true;
+        }
+        pos = end + 1;
     }
+    return false;
+}
 
-    size_t end = headers.find("\r\n", start);
-    if (end == std::string::npos) {
-        return "";
+/**
+ * @brief HTTP/1.1 connections persist unless the client sends "Connection: close";
+ * HTTP/1.0 connections close unless the client sends "Connection: keep-alive".
+ */
+bool request_wants_keep_alive(const HTTPRequest &request) {
+    std::string_view connection = request.header("Connection");
+    if (request.version_minor >= 1) {
+        return !has_token(connection, "close");
     }
+    return has_token(connection, "keep-alive");
+}
 
-    return headers.substr(start, end - start);
+// Canned reply for a request the parser rejected; the connection closes after it.
+static HttpResponse parse_error_response(HttpRequestParser::Error error) {
+    int status = 400;
+    if (error == HttpRequestParser::Error::HeadersTooLarge || error == HttpRequestParser::Error::TooManyHeaders) {
+        status = 431;
+    } else if (error == HttpRequestParser::Error::UnsupportedTransferEncoding) {
+        status = 501;
+    }
+    return std::move(status_response(status).set_connection(HttpResponse::Connection::Close));
 }
 
-// Parses the initial request line and body.
-HTTPRequest parse_http_request(const std::string &request) {
-    HTTPRequest req;
-    size_t line_end = request.find("\r\n");
-    if (line_end == std::string::npos)
-        return req;
+static HttpResponse payload_too_large_response() {
+    return std::move(status_response(413).set_connection(HttpResponse::Connection::Close));
+}
 
-    std::string first_line = request.substr(0, line_end);
+static constexpr std::string_view CONTINUE_RESPONSE = "HTTP/1.1 100 Continue\r\n\r\n";
 
-    // 1. Parse Method, Path, Version
-    size_t method_end = first_line.find(' ');
-    if (method_end != std::string::npos) {
-        req.method = first_line.substr(0, method_end);
+HttpResponse request_timeout_response() {
+    return std::move(status_response(408).set_connection(HttpResponse::Connection::Close));
+}
 
-        size_t path_end = first_line.find(' ', method_end + 1);
-        if (path_end != std::string::npos) {
-            req.path = first_line.substr(method_end + 1, path_end - method_end - 1);
-            req.version = first_line.substr(path_end + 1);
-        }
-    }
+// Out of line: Http2Session is incomplete in the header
+RequestState::RequestState(size_t max_header_size) : parser(max_header_size) {}
+RequestState::RequestState(RequestState &&other) noexcept = default;
+RequestState &RequestState::operator=(RequestState &&other) noexcept = default;
+RequestState::~RequestState() = default;
 
-    // Parse Body
-    size_t body_start = request.find("\r\n\r\n");
-    if (body_start != std::string::npos) {
-        req.body = request.substr(body_start + 4);
+// --- Connection Deadlines ---
+
+TimeoutPhase timeout_phase(const RequestState &state, bool input_buffered, bool output_queued) {
+    if (output_queued)
+        return TimeoutPhase::Write;
+    if (state.h2)
+        return state.h2->timeout_phase(input_buffered);
+    if (state.awaiting_response() && !state.relay)
+        return TimeoutPhase::Handler;
+    if (state.in_body)
+        return TimeoutPhase::Body;
+    // Everything complete has been served, so buffered input is the start of the next head
+    return input_buffered ? TimeoutPhase::Header : TimeoutPhase::Idle;
+}
+
+void ConnectionTimer::update(TimerWheel &wheel, const ServerConfig &config, TimeoutPhase next, bool read_progress,
+                             bool write_progress, size_t requests_served) {
+    bool rearm = next != phase;
+    if (next == TimeoutPhase::Header) {
+        rearm |= requests_served != request_index; // The old head was served; this is a new one
+    } else if (next == TimeoutPhase::Body) {
+        rearm |= read_progress;
+    } else if (next == TimeoutPhase::Write) {
+        rearm |= write_progress;
+    }
+    if (!rearm) {
+        return;
     }
 
-    return req;
+    phase = next;
+    request_index = requests_served;
+    uint64_t timeout_ms = 0;
+    switch (next) {
+    case TimeoutPhase::Write:
+        timeout_ms = config.write_timeout_ms;
+        break;
+    case TimeoutPhase::Body:
+        timeout_ms = config.body_timeout_ms;
+        break;
+    case TimeoutPhase::Header:
+        timeout_ms = config.header_timeout_ms;
+        break;
+    case TimeoutPhase::Idle:
+        timeout_ms = config.keep_alive_timeout_ms;
+        break;
+    case TimeoutPhase::None:
+    case TimeoutPhase::Handler:
+        break;
+    }
+    if (timeout_ms == 0) {
+        wheel.cancel(&node);
+    } else {
+        wheel.schedule(&node, timeout_ms);
+    }
 }
 
 // --- HttpServer Core Implementation ---
 
-HttpServer::HttpServer(int p, size_t num_threads) : port(p) {
-    // Initialize the Thread Pool
-    thread_pool = new ThreadPool(num_threads);
+HttpServer::HttpServer(int p, size_t num_threads, const ServerConfig &server_config)
+    : port(p), config(server_config), num_workers(num_threads), admission(server_config.admission) {
+    BufferSlab::set_default_max_cached(config.slab_cached_blocks); // Before any worker thread starts
+    if (config.accept_batch == 0) {
+        config.accept_batch = 1; // Accepting nothing would leave the listener ready forever
+    }
+    if (config.tls.enabled()) {
+        tls_context = std::make_unique<TlsContext>(config.tls, config.http2);
+        if (config.io_backend == IoBackend::IoUring) {
+            std::cerr << "TLS is served by epoll workers; not using io_uring" << std::endl;
+            config.io_backend = IoBackend::Epoll;
+        }
+    }
+    if (config.mode == ServerMode::Reactor || config.mode == ServerMode::ReusePort) {
+        if (num_workers == 0) {
+            num_workers = std::thread::hardware_concurrency();
+            if (num_workers == 0)
+                num_workers = 4;
+        }
+        for (size_t i = 0; i < num_workers; ++i) {
+            reactors.push_back(make_event_loop(i));
+        }
+        if (config.pin_workers) {
+            place_reactors();
+        }
+        if (config.mode == ServerMode::Reactor) {
+            reactor_batches.resize(reactors.size());
+        }
+        std::cout << "Started " << num_workers << " reactor workers on "
+                  << (config.io_backend == IoBackend::IoUring ? "io_uring" : "epoll")
+                  << (config.pin_workers ? ", pinned" : "") << "." << std::endl;
+    } else {
+        // Initialize the Thread Pool
+        std::vector<int> cpus;
+        if (config.pin_workers) {
+            cpus = CpuTopology::system().cpus;
+        }
+        thread_pool = new ThreadPool(num_threads, config.queue_mode, 4096, std::move(cpus));
+    }
+}
+
+void HttpServer::place_reactors() {
+    const CpuTopology &topology = CpuTopology::system();
+    reactor_on_cpu.assign(topology.cpu_nodes.size(), -1);
+    node_reactors.assign(static_cast<size_t>(topology.node_count), {});
+    next_node_reactor.assign(static_cast<size_t>(topology.node_count), 0);
+
+    for (size_t i = 0; i < reactors.size(); ++i) {
+        int cpu = topology.cpu_for_worker(i);
+        reactors[i]->set_cpu(cpu);
+        if (reactor_on_cpu[cpu] == -1) {
+            reactor_on_cpu[cpu] = static_cast<int>(i);
+        }
+        node_reactors[topology.node_of(cpu)].push_back(i);
+    }
+}
+
+std::unique_ptr<EventLoop> HttpServer::make_event_loop(size_t worker_id) {
+    if (config.io_backend == IoBackend::IoUring) {
+        try {
+            return std::make_unique<UringWorker>(worker_id, *this);
+        } catch (const std::exception &e) {
+            // Every worker falls back together: one mode per server keeps behaviour predictable
+            std::cerr << "io_uring unavailable (" << e.what() << "), falling back to epoll" << std::endl;
+            config.io_backend = IoBackend::Epoll;
+            reactors.clear();
+            for (size_t i = 0; i < worker_id; ++i) {
+                reactors.push_back(std::make_unique<ReactorWorker>(i, *this));
+            }
+        }
+    }
+    return std::make_unique<ReactorWorker>(worker_id, *this);
 }
 
 HttpServer::~HttpServer() {
     stop();
+    handoff.reset(); // Its thread calls stop() on us
+    reactors.clear();
     if (thread_pool) {
         delete thread_pool;
         thread_pool = nullptr;
     }
+    for (const ParkedClient &parked : park_queue) {
+        close(parked.fd);
+    }
+    for (auto &entry : parked_clients) {
+        idle_timers.cancel(&entry.second.idle_timer);
+        close(entry.first);
+    }
+    if (server_fd != -1) {
+        close(server_fd);
+    }
+    if (wake_fd != -1) {
+        close(wake_fd);
+    }
     if (epoll_fd != -1) {
         close(epoll_fd);
     }
 }
 
-void HttpServer::create_socket() {
-    server_fd = socket(AF_INET, SOCK_STREAM, 0);
-    if (server_fd == -1) {
+int HttpServer::create_socket() {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
         perror("Socket creation failed");
         exit(EXIT_FAILURE);
     }
+    return fd;
 }
 
-void HttpServer::config_socket_opt() {
+void HttpServer::config_socket_opt(int fd) {
     int opt = 1;
-    // SO_REUSEADDR allows the socket to be bound to a port that is already in use
-    if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR | SO_REUSEPORT, &opt, sizeof(opt))) {
-        perror("setsockopt failed");
+    // SO_REUSEADDR allows the socket to be bound to a port still in TIME_WAIT
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt))) {
+        perror("setsockopt SO_REUSEADDR failed");
+        exit(EXIT_FAILURE);
+    }
+    // SO_REUSEPORT is a separate option: it lets every ReusePort worker bind its own
+    // listener to the same port and have the kernel load-balance between them
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt))) {
+        perror("setsockopt SO_REUSEPORT failed");
         exit(EXIT_FAILURE);
     }
-    // The main listening socket MUST be non-blocking for epoll accept loop
-    if (set_non_blocking(server_fd) == -1) {
-        perror("set_non_blocking failed for server_fd");
+    // The listening socket MUST be non-blocking for the epoll accept loop
+    if (set_non_blocking(fd) == -1) {
+        perror("set_non_blocking failed for listening socket");
         exit(EXIT_FAILURE);
     }
+    // Neither is fatal: without them a connection is just reported (and handed over) earlier
+    if (config.defer_accept_s > 0 &&
+        setsockopt(fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, &config.defer_accept_s, sizeof(config.defer_accept_s))) {
+        perror("setsockopt TCP_DEFER_ACCEPT failed");
+    }
+    // Set before listen(); the server side also needs bit 2 of the net.ipv4.tcp_fastopen sysctl
+    if (config.fastopen_queue > 0 &&
+        setsockopt(fd, IPPROTO_TCP, TCP_FASTOPEN, &config.fastopen_queue, sizeof(config.fastopen_queue))) {
+        perror("setsockopt TCP_FASTOPEN failed");
+    }
 }
 
-void HttpServer::bind_socket(struct sockaddr_in &address) {
+void HttpServer::bind_socket(int fd, struct sockaddr_in &address) {
     address.sin_family = AF_INET;
     address.sin_addr.s_addr = INADDR_ANY;
     address.sin_port = htons(port);
 
-    if (bind(server_fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
         perror("Bind failed");
         exit(EXIT_FAILURE);
     }
 }
 
-void HttpServer::listen_socket() {
-    if (listen(server_fd, 1024) < 0) {
+void HttpServer::listen_socket(int fd) {
+    if (listen(fd, 1024) < 0) {
         perror("Listen failed");
         exit(EXIT_FAILURE);
     }
-    std::cout << "Server listening on port " << port << std::endl;
+}
+
+int HttpServer::open_listener(struct sockaddr_in &address) {
+    int fd = create_socket();
+    config_socket_opt(fd);
+    bind_socket(fd, address);
+    listen_socket(fd);
+    return fd;
+}
+
+int HttpServer::take_listener(std::vector<int> &inherited, struct sockaddr_in &address) {
+    if (inherited.empty()) {
+        return open_listener(address);
+    }
+    // Already bound, listening and non-blocking: those are properties of the shared socket
+    int fd = inherited.front();
+    inherited.erase(inherited.begin());
+    return fd;
+}
+
+/**
+ * @brief Attaches a classic BPF program that picks the listener by CPU number.
+ * The kernel indexes the reuseport group in bind order, so listener i receives the
+ * connections whose SYN was processed on CPU (i mod group_size).
+ */
+void HttpServer::attach_reuseport_cbpf(int fd, size_t group_size) {
+    struct sock_filter code[] = {
+        {BPF_LD | BPF_W | BPF_ABS, 0, 0, (uint32_t)(SKF_AD_OFF + SKF_AD_CPU)}, // A = current CPU
+        {BPF_ALU | BPF_MOD | BPF_K, 0, 0, (uint32_t)group_size},              // A %= group_size
+        {BPF_RET | BPF_A, 0, 0, 0},                                           // return A
+    };
+    struct sock_fprog prog;
+    prog.len = sizeof(code) / sizeof(code[0]);
+    prog.filter = code;
+
+    if (setsockopt(fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog))) {
+        // Not fatal: the kernel falls back to its default 4-tuple hash
+        perror("setsockopt SO_ATTACH_REUSEPORT_CBPF failed");
+    }
 }
 
 void HttpServer::setup_epoll() {
@@ -158,133 +415,1062 @@ void HttpServer::setup_epoll() {
         perror("epoll_ctl: server_fd failed");
         exit(EXIT_FAILURE);
     }
+
+    // main_loop sleeps until the next idle deadline, so stop() and newly parked clients
+    // need a way to wake it
+    wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    event.events = EPOLLIN;
+    event.data.fd = wake_fd;
+    if (wake_fd == -1 || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &event) == -1) {
+        perror("eventfd: wake_fd failed");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * @brief Blocks until fd is ready for events or timeout_ms (0 = no limit) pass. Returns
+ * false only on timeout; errors and hangups count as ready for the retried call to report.
+ */
+static bool wait_for(int fd, short events, uint64_t timeout_ms) {
+    struct pollfd entry = {fd, events, 0};
+    int timeout = timeout_ms == 0 ? -1 : static_cast<int>(std::min<uint64_t>(timeout_ms, INT_MAX));
+    int ready;
+    while ((ready = poll(&entry, 1, timeout)) == -1 && errno == EINTR) {
+    }
+    return ready != 0;
+}
+
+// recv() and OutputQueue::write_to() for a connection that may be TLS
+static ssize_t receive(int fd, TlsConnection *tls, char *buffer, size_t length) {
+    return tls ? tls->recv(buffer, length) : recv(fd, buffer, length, 0);
+}
+
+static ssize_t send_output(int fd, TlsConnection *tls, OutputQueue &out) {
+    return tls ? tls->send(out) : out.write_to(fd);
+}
+
+// Runs a TLS handshake to completion within header_timeout_ms (0 = no limit)
+static bool handshake_blocking(int fd, TlsConnection &tls, uint64_t timeout_ms) {
+    uint64_t deadline = monotonic_ms() + timeout_ms;
+    while (true) {
+        TlsConnection::Handshake status = tls.handshake();
+        if (status != TlsConnection::Handshake::Pending) {
+            return status == TlsConnection::Handshake::Done;
+        }
+        uint64_t now = monotonic_ms();
+        uint64_t wait_ms = 0;
+        if (timeout_ms != 0) {
+            wait_ms = deadline > now ? deadline - now : 1;
+        }
+        if (!wait_for(fd, tls.wants_write() ? POLLOUT : POLLIN, wait_ms)) {
+            return false;
+        }
+    }
 }
 
 /**
- * @brief Reads the entire request from the socket using a blocking loop.
- * This function is run by a single worker thread.
- * NOTE: This is slightly simplified to read headers and body sequentially.
+ * @brief Reads from the socket using a blocking loop until serve_pipelined() can make
+ * progress: a complete (or malformed) request head or, mid-body, any body bytes.
+ * This function is run by a single worker thread. The parser resumes where it stopped
+ * after every recv(), so a request trickling in is scanned once, not once per read.
+ * Bytes past the first request stay in the buffer so pipelined requests are served
+ * without another recv().
  */
-std::string HttpServer::read_full_request_blocking(int client_fd) {
-    std::string request_buffer;
-    request_buffer.reserve(BUFFER_SIZE); // Reserve initial space
-    char temp_buffer[BUFFER_SIZE];
-    const char *end_delimiter = "\r\n\r\n";
-    size_t delimiter_len = 4;
-    size_t content_length = 0;
-    bool headers_complete = false;
-
-    // Phase 1: Read Headers until "\r\n\r\n" is found
-    while (request_buffer.size() < MAX_REQUEST_SIZE) {
-        // Use blocking recv(). The worker thread will block here,
-        // but the other workers and main thread are free.
-        ssize_t bytes_received = recv(client_fd, temp_buffer, BUFFER_SIZE, 0);
+bool HttpServer::read_request_blocking(int client_fd, TlsConnection *tls, InputBuffer &request_buffer,
+                                       RequestState &state) {
+    HTTPRequest http_request;
+
+    if (state.h2) {
+        // Frames are not requests: whatever arrives is for Http2Session::serve(). An idle
+        // connection is closed without a word once keep_alive_timeout_ms passes.
+        while (true) {
+            char *tail = request_buffer.prepare(BUFFER_SIZE);
+            ssize_t bytes_received = receive(client_fd, tls, tail, request_buffer.writable());
+            if (bytes_received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                if (!wait_for(client_fd, POLLIN, config.keep_alive_timeout_ms)) {
+                    return false;
+                }
+                continue;
+            }
+            if (bytes_received < 0 && errno == EINTR) {
+                continue;
+            }
+            if (bytes_received <= 0) {
+                return false;
+            }
+            request_buffer.commit(static_cast<size_t>(bytes_received));
+            ThreadMetrics::local().bytes_in.add(static_cast<uint64_t>(bytes_received));
+            return true;
+        }
+    }
+
+    // The head has one deadline however it trickles in; a body only has to keep moving
+    uint64_t head_deadline = monotonic_ms() + config.header_timeout_ms;
+
+    while (state.in_body ? request_buffer.empty()
+                         : state.parser.parse(request_buffer.view(), http_request) ==
+                                   HttpRequestParser::Status::Incomplete) {
+        // The worker thread blocks here, but the other workers and main thread are free.
+        // The socket is non-blocking: waits happen in wait_for(), bounded by the deadline.
+        // Bytes land straight in the slab block the parser reads.
+        char *tail = request_buffer.prepare(BUFFER_SIZE);
+        ssize_t bytes_received = receive(client_fd, tls, tail, request_buffer.writable());
 
+        if (bytes_received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            uint64_t now = monotonic_ms();
+            uint64_t timeout_ms = 0; // No limit
+            if (state.in_body) {
+                timeout_ms = config.body_timeout_ms;
+            } else if (config.header_timeout_ms != 0) {
+                timeout_ms = head_deadline > now ? head_deadline - now : 1;
+            }
+            if (!wait_for(client_fd, POLLIN, timeout_ms)) {
+                // Best effort: the connection closes either way
+                OutputQueue out;
+                request_timeout_response().append_to(out);
+                send_output(client_fd, tls, out);
+                return false;
+            }
+            continue; // Readable, or an error the next recv() reports
+        }
+        if (bytes_received < 0 && errno == EINTR) {
+            continue;
+        }
         if (bytes_received <= 0) {
-            return ""; // Connection error or closed
+            return false; // Connection error or closed
         }
 
-        request_buffer.append(temp_buffer, bytes_received);
+        request_buffer.commit(static_cast<size_t>(bytes_received));
+        ThreadMetrics::local().bytes_in.add(static_cast<uint64_t>(bytes_received));
+        HTTP_TRACE_FIRST_BYTE(state);
+    }
 
-        if (!headers_complete) {
-            size_t header_pos = request_buffer.find(end_delimiter);
-            if (header_pos != std::string::npos) {
-                headers_complete = true;
+    return true;
+}
 
-                std::string headers_only = request_buffer.substr(0, header_pos);
-                std::string cl_str = get_header_value(headers_only, "Content-Length");
+// Up front, a context body reader reserves no more than this; append() grows it as bytes arrive
+static constexpr size_t CONTEXT_BODY_RESERVE = 16 * 1024;
 
-                if (!cl_str.empty()) {
-                    try {
-                        content_length = std::stoul(cl_str);
-                    } catch (...) {
-                        // Ignore malformed CL, treat as 0 or close later
-                    }
-                }
+/**
+ * @brief Buffers the body of a request to a context endpoint, then runs the handler on it.
+ * The head's views die with the connection's input buffer once the head has been handled,
+ * so the reader keeps copies of them, all in one string sized up front. A body beyond
+ * max_size (one without a Content-Length to refuse up front) is dropped and answered 413.
+ */
+class ContextBodyReader : public BodyReader {
+  private:
+    const ContextHandler &handler; // Owned by the router's endpoint, which outlives requests
+    std::string head;
+    HTTPRequest request;
+    std::string_view path;
+    RouteParams params;
+    ConnectionInfo connection;
+    std::string body;
+    size_t max_size;
+    bool too_large = false;
+
+    std::string_view keep(std::string_view view) {
+        size_t offset = head.size();
+        head.append(view);
+        return std::string_view(head).substr(offset, view.size());
+    }
+
+  public:
+    ContextBodyReader(const ContextHandler &handler, const HTTPRequest &http_request, std::string_view request_path,
+                      const RouteParams &route_params, const ConnectionInfo &info, size_t max_body_size)
+        : handler(handler), request(http_request), params(route_params), connection(info), max_size(max_body_size) {
+        size_t length = http_request.method.size() + http_request.path.size() + http_request.version.size();
+        for (size_t i = 0; i < http_request.header_count; ++i) {
+            length += http_request.headers[i].name.size() + http_request.headers[i].value.size();
+        }
+        for (size_t i = 0; i < params.count; ++i) {
+            length += params.items[i].second.size(); // Names belong to the router
+        }
+        head.reserve(length); // No reallocation below, so the views stay put
+
+        request.method = keep(http_request.method);
+        request.path = keep(http_request.path);
+        request.version = keep(http_request.version);
+        for (size_t i = 0; i < request.header_count; ++i) {
+            request.headers[i] = {keep(http_request.headers[i].name), keep(http_request.headers[i].value)};
+        }
+        path = request.path.substr(0, request_path.size());
+        for (size_t i = 0; i < params.count; ++i) {
+            params.items[i].second = keep(params.items[i].second);
+        }
+        // Not the declared length itself: the client has not sent (and may never send) those bytes
+        body.reserve(std::min(http_request.content_length, CONTEXT_BODY_RESERVE));
+    }
+
+    void on_data(std::string_view chunk) override {
+        if (too_large || (max_size != 0 && chunk.size() > max_size - body.size())) {
+            too_large = true;
+            body.clear();
+            body.shrink_to_fit();
+            return;
+        }
+        body.append(chunk);
+    }
+
+    HttpResponse on_complete() override {
+        if (too_large) {
+            return status_response(413);
+        }
+        HttpResponse response;
+        handler(Request(request, path, params, connection, body), response);
+        return response;
+    }
+};
 
-                // If headers are complete and Content-Length is non-zero, proceed to body reading
-                if (content_length > 0)
-                    break;
+HttpResponse HttpServer::get_response(const HTTPRequest &http_request, std::unique_ptr<BodyReader> *body_reader,
+                                      ResponseTask *async_task, uint32_t *metrics_route,
+                                      std::shared_ptr<BodyRelay> *body_relay, const ConnectionInfo *connection) {
+    static const ConnectionInfo NO_CONNECTION; // For callers with no connection to describe
+    if (!connection) {
+        connection = &NO_CONNECTION;
+    }
+    HttpMethod method = parse_method(http_request.method);
+    std::string_view path = http_request.path.substr(0, http_request.path.find('?'));
+
+    try {
+        if (const StaticRoute *route = router.match_static(method, path)) {
+            return HttpResponse::from_string(route->handler(std::string(http_request.method), std::string(path)));
+        }
+        RouteParams params;
+        if (const Endpoint *endpoint = router.match(method, http_request.method, path, &params)) {
+            if (metrics_route) {
+                *metrics_route = endpoint->metrics_route;
             }
+            if (endpoint->static_files) {
+                // The last capture (the trailing wildcard) names the file; without one the path does
+                std::string_view file = params.count ? params.items[params.count - 1].second : path;
+                return endpoint->static_files->serve(http_request, file);
+            }
+            if (endpoint->streaming_handler) {
+                std::unique_ptr<BodyReader> reader = endpoint->streaming_handler(http_request);
+                if (!reader) {
+                    throw std::runtime_error("streaming handler returned no reader");
+                }
+                if (body_reader) {
+                    *body_reader = std::move(reader);
+                    return HttpResponse();
+                }
+                return reader->on_complete();
+            }
+            if (endpoint->proxy) {
+                if (!async_task) {
+                    throw std::runtime_error("proxied endpoint reached without a task slot");
+                }
+                std::shared_ptr<BodyRelay> relay;
+                if (body_relay && http_request.has_body()) {
+                    relay = std::make_shared<BodyRelay>();
+                    *body_relay = relay;
+                }
+                *async_task =
+                    endpoint->proxy->forward(http_request, body_relay != nullptr, std::move(relay), body_reader);
+                return HttpResponse();
+            }
+            if (endpoint->async_handler) {
+                if (!async_task) {
+                    throw std::runtime_error("coroutine endpoint reached without a task slot");
+                }
+                // A literal route hands its own pattern over by reference: no copy of the path
+                std::string dynamic_path;
+                if (endpoint->dynamic) {
+                    dynamic_path = path;
+                }
+                const std::string &handler_path = endpoint->dynamic ? dynamic_path : endpoint->pattern;
+                *async_task = endpoint->async_handler(endpoint->method, handler_path);
+                return HttpResponse();
+            }
+            if (endpoint->reads_body && body_reader) {
+                size_t max_buffered = config.max_buffered_body_size;
+                if (max_buffered != 0 && http_request.content_length > max_buffered) {
+                    return status_response(413); // The body is discarded, as for a plain handler
+                }
+                *body_reader = std::make_unique<ContextBodyReader>(endpoint->handler, http_request, path, params,
+                                                                   *connection, max_buffered);
+                return HttpResponse();
+            }
+            ResponseCache *cache = http_request.has_body() ? nullptr : endpoint->cache.get();
+            if (cache) {
+                if (std::shared_ptr<const PreparedResponse> hit = cache->lookup(http_request)) {
+                    ThreadMetrics::local().cache_hits.add();
+                    return HttpResponse::from_prepared(std::move(hit));
+                }
+                ThreadMetrics::local().cache_misses.add();
+            }
+            HttpResponse response;
+            endpoint->handler(Request(http_request, path, params, *connection), response);
+            if (cache) {
+                // Stored compressed for this Accept-Encoding, which cache_endpoint() made part of the key
+                compress_response(response, accepted_codings(http_request.header("Accept-Encoding")),
+                                  config.compression);
+                if (std::shared_ptr<const PreparedResponse> stored = cache->store(http_request, response)) {
+                    return HttpResponse::from_prepared(std::move(stored));
+                }
+            }
+            return response;
         }
+    } catch (const std::exception &e) {
+        // A failing handler must not take the worker (and the connection) down with it
+        log_line(LogLevel::Error, "Handler for ", path, " threw: ", e.what());
+        return status_response(500);
+    }
 
-        // If headers are complete but no body expected (GET/HEAD), break
-        if (headers_complete && content_length == 0)
-            break;
+    return status_response(404);
+}
+
+/**
+ * @brief Reconciles the response's Connection header with the keep-alive decision.
+ * A handler that already sent "Connection: close" wins; otherwise the header is
+ * added when the client needs to be told. Returns the final keep-alive decision.
+ */
+static bool apply_connection_header(HttpResponse &http_response, bool keep_alive, bool http10) {
+    if (!http_response.raw_response()) {
+        if (http_response.connection_header() == HttpResponse::Connection::Close) {
+            return false;
+        }
+        if (!keep_alive) {
+            http_response.set_connection(HttpResponse::Connection::Close);
+        } else if (http10 && http_response.connection_header() == HttpResponse::Connection::Default) {
+            http_response.set_connection(HttpResponse::Connection::KeepAlive);
+        }
+        return keep_alive;
     }
 
-    // Phase 2: Read Body (only if Content-Length was found and is non-zero)
-    if (content_length > 0) {
-        size_t header_end_pos = request_buffer.find(end_delimiter) + delimiter_len;
-        size_t body_already_received = request_buffer.size() - header_end_pos;
-        size_t remaining_to_read = content_length > body_already_received ? content_length - body_already_received : 0;
+    // A legacy handler's serialized response: the header goes in right after the status line
+    std::string &response = http_response.raw_string();
+    size_t status_end = response.find("\r\n");
+    if (status_end == std::string::npos) {
+        return false;
+    }
 
-        while (remaining_to_read > 0) {
-            ssize_t bytes_to_read = std::min((size_t)BUFFER_SIZE, remaining_to_read);
-            ssize_t bytes_received = recv(client_fd, temp_buffer, bytes_to_read, 0);
+    size_t header_end = response.find("\r\n\r\n");
+    std::string_view headers(response);
+    headers = headers.substr(status_end + 2, header_end == std::string::npos ? 0 : header_end - status_end);
+    std::string_view connection = get_header_value(headers, "Connection");
+    if (has_token(connection, "close")) {
+        return false;
+    }
+    bool has_connection = !connection.empty(); // The view dies with the insert below
 
-            if (bytes_received <= 0) {
-                return ""; // Connection closed before full body received
+    if (!keep_alive) {
+        response.insert(status_end + 2, "Connection: close\r\n");
+    } else if (http10 && !has_connection) {
+        response.insert(status_end + 2, "Connection: keep-alive\r\n");
+    }
+    return keep_alive;
+}
+
+void HttpServer::finish_response(HttpResponse response, RequestState &state, OutputQueue &out) const {
+    compress_response(response, state.accept_codings, config.compression);
+    if (state.head_request) {
+        // Whatever the handler produced: a body here would be read as the next response
+        response.omit_body();
+    }
+    uint64_t nanos = monotonic_ns() - state.started_ns;
+    ThreadMetrics::local().record_response(state.route, response.status_code_value(), nanos);
+    HTTP_TRACE_HANDLER_DONE(state, response.status_code_value());
+    std::move(response).append_to(out);
+}
+
+// Drives one coroutine handler to completion; exceptions become a 500 like a plain handler's
+static DetachedTask run_async_handler(ResponseTask task, std::shared_ptr<AsyncResponse> slot) {
+    HttpResponse response;
+    try {
+        response = co_await std::move(task);
+    } catch (const std::exception &e) {
+        log_line(LogLevel::Error, "Coroutine handler threw: ", e.what());
+        response = status_response(500);
+    }
+    slot->complete(std::move(response));
+}
+
+std::shared_ptr<AsyncResponse> HttpServer::launch_async(ResponseTask task, const std::function<void()> &wake) {
+    auto slot = std::make_shared<AsyncResponse>();
+    slot->wake = wake;
+    run_async_handler(std::move(task), slot);
+    if (!slot->response) {
+        slot->suspended = true;
+    }
+    return slot;
+}
+
+bool HttpServer::start_async_response(ResponseTask task, RequestState &state, OutputQueue &out) {
+    std::shared_ptr<AsyncResponse> slot = launch_async(std::move(task), state.async_wake);
+    if (!slot->response) {
+        state.async = AsyncResponseRef(std::move(slot));
+        return true;
+    }
+    HttpResponse response = std::move(*slot->response);
+    bool keep_open = apply_connection_header(response, state.keep_alive, state.http10);
+    finish_response(std::move(response), state, out);
+    return keep_open;
+}
+
+bool HttpServer::upgrade_to_http2(const HTTPRequest &http_request, RequestState &state, OutputQueue &out,
+                                  size_t &requests_served) {
+    // RFC 7540 section 3.2; a request with a body is left to HTTP/1.1, as it may be
+    if (!config.http2 || http_request.version_minor != 1 || http_request.has_body() ||
+        !has_token(http_request.header("Connection"), "upgrade") ||
+        !has_token(http_request.header("Upgrade"), "h2c") || !http_request.has_header("HTTP2-Settings")) {
+        return false;
+    }
+    auto session = std::make_unique<Http2Session>(*this, state.async_wake, state.connection);
+    if (!session->accept_upgrade_settings(http_request.header("HTTP2-Settings"))) {
+        return false;
+    }
+    out.append_borrowed("HTTP/1.1 101 Switching Protocols\r\nConnection: Upgrade\r\nUpgrade: h2c\r\n\r\n");
+    session->start(out);
+    session->start_upgraded_stream(http_request, out, requests_served);
+    state.h2 = std::move(session);
+    return true;
+}
+
+bool HttpServer::begin_request(const HTTPRequest &http_request, RequestState &state, OutputQueue &out,
+                               size_t &requests_served) {
+    if (upgrade_to_http2(http_request, state, out, requests_served)) {
+        return true;
+    }
+    HTTP_TRACE_HEADERS(state, http_request, requests_served == 0);
+    requests_served++;
+    state.connection.requests_served = requests_served;
+    state.started_ns = monotonic_ns();
+    state.route = 0;
+    state.accept_codings = config.compression.enabled ? accepted_codings(http_request.header("Accept-Encoding")) : 0;
+    state.head_request = http_request.method == "HEAD";
+
+    // A draining server closes each connection after the response it is working on
+    bool keep_alive = config.keep_alive && !draining && request_wants_keep_alive(http_request);
+    if (config.max_requests_per_connection != 0 && requests_served >= config.max_requests_per_connection) {
+        keep_alive = false;
+    }
+    bool http10 = http_request.version_minor == 0;
+
+    if (!http_request.has_body()) {
+        ResponseTask task;
+        std::shared_ptr<BodyRelay> relay;
+        HttpResponse response = get_response(http_request, nullptr, &task, &state.route, &relay, &state.connection);
+        if (task) {
+            state.keep_alive = keep_alive;
+            state.http10 = http10;
+            return start_async_response(std::move(task), state, out);
+        }
+        bool keep_open = apply_connection_header(response, keep_alive, http10);
+        finish_response(std::move(response), state, out);
+        return keep_open;
+    }
+
+    if (config.max_body_size != 0 && http_request.content_length > config.max_body_size) {
+        finish_response(payload_too_large_response(), state, out);
+        return false;
+    }
+
+    // Handlers run while the head's views are still valid; only a streaming reader sees the body
+    std::unique_ptr<BodyReader> reader;
+    ResponseTask task;
+    std::shared_ptr<BodyRelay> relay;
+    HttpResponse response = get_response(http_request, &reader, &task, &state.route, &relay, &state.connection);
+    bool expects_continue = http_request.version_minor >= 1 && equals_ignore_case(http_request.header("Expect"), "100-continue");
+
+    if (!reader && !task && expects_continue) {
+        // The body would only be thrown away: answer now and let the client skip sending it
+        apply_connection_header(response, false, http10);
+        finish_response(std::move(response), state, out);
+        return false;
+    }
+    if (expects_continue) {
+        out.append_borrowed(CONTINUE_RESPONSE);
+    }
+
+    state.in_body = true;
+    state.chunked = http_request.chunked;
+    state.body_remaining = http_request.content_length;
+    state.body_received = 0;
+    state.chunked_decoder.reset();
+    state.reader = std::move(reader);
+    state.pending_response = std::move(response);
+    state.keep_alive = keep_alive;
+    state.http10 = http10;
+    if (relay) {
+        // Started now: it connects upstream while the body is still arriving
+        relay->wake = state.async_wake;
+        state.relay = BodyRelayRef(std::move(relay));
+        return start_async_response(std::move(task), state, out);
+    }
+    state.pending_task = std::move(task);
+    return true;
+}
+
+bool HttpServer::consume_body(std::string_view pending, RequestState &state, OutputQueue &out, size_t &used,
+                              bool &done) {
+    bool too_large = false;
+    auto deliver = [&](std::string_view chunk) {
+        state.body_received += chunk.size();
+        if (config.max_body_size != 0 && state.body_received > config.max_body_size) {
+            too_large = true;
+        } else if (state.reader && !too_large) {
+            state.reader->on_data(chunk);
+        }
+    };
+
+    done = false;
+    try {
+        if (!state.chunked) {
+            used = std::min(pending.size(), state.body_remaining);
+            deliver(pending.substr(0, used));
+            state.body_remaining -= used;
+            done = state.body_remaining == 0;
+        } else {
+            ChunkedDecoder::Status status = state.chunked_decoder.decode(pending, used, deliver);
+            if (status == ChunkedDecoder::Status::Error) {
+                ThreadMetrics::local().parse_errors.add();
+                finish_response(parse_error_response(HttpRequestParser::Error::BadTransferEncoding), state, out);
+                return false;
             }
+            done = status == ChunkedDecoder::Status::Done;
+        }
+    } catch (const std::exception &e) {
+        log_line(LogLevel::Error, "Body reader threw: ", e.what());
+        HttpResponse response = status_response(500);
+        apply_connection_header(response, false, state.http10);
+        finish_response(std::move(response), state, out);
+        return false;
+    }
 
-            request_buffer.append(temp_buffer, bytes_received);
-            remaining_to_read -= bytes_received;
+    if (too_large) {
+        finish_response(payload_too_large_response(), state, out);
+        return false;
+    }
+    return true;
+}
+
+bool HttpServer::relay_body(std::string_view pending, RequestState &state, OutputQueue &out, size_t &used,
+                            bool &done) {
+    // Once the proxy has answered there is no response left to send for an error
+    bool answered = !state.async;
+    done = false;
+    if (!state.chunked) {
+        used = state.relay->relay(pending.substr(0, std::min(pending.size(), state.body_remaining)));
+        state.body_remaining -= used;
+        state.body_received += used;
+        done = state.body_remaining == 0;
+        return true;
+    }
+
+    // Where the body ends decides how much to offer; the relay's taking decides what is decoded
+    ChunkedDecoder probe = state.chunked_decoder;
+    size_t end = 0;
+    bool too_large = false;
+    auto count = [&](std::string_view chunk) {
+        state.body_received += chunk.size();
+        too_large = too_large || (config.max_body_size != 0 && state.body_received > config.max_body_size);
+    };
+    if (probe.decode(pending, end, [](std::string_view) {}) == ChunkedDecoder::Status::Error) {
+        ThreadMetrics::local().parse_errors.add();
+        if (!answered) {
+            finish_response(parse_error_response(HttpRequestParser::Error::BadTransferEncoding), state, out);
         }
+        used = pending.size();
+        return false;
     }
+    used = state.relay->relay(pending.substr(0, end));
+    size_t decoded = 0;
+    done = state.chunked_decoder.decode(pending.substr(0, used), decoded, count) == ChunkedDecoder::Status::Done;
+    if (too_large) {
+        if (!answered) {
+            finish_response(payload_too_large_response(), state, out);
+        }
+        return false;
+    }
+    return true;
+}
 
-    return request_buffer;
+static DetachedTask resume_on_stream(std::shared_ptr<BodyStream> stream, std::function<void()> wake) {
+    co_await wait_readable(stream->wait_fd());
+    stream->watched = false;
+    wake();
 }
 
-std::string HttpServer::get_response(const std::string &request) {
-    // Find matching handler and generate response
-    HTTPRequest http_request = parse_http_request(request);
+void HttpServer::await_body_stream(const OutputQueue &out, const std::function<void()> &wake) {
+    std::shared_ptr<BodyStream> stream = out.stalled_stream();
+    if (!stream || stream->watched || !wake) {
+        return;
+    }
+    stream->watched = true;
+    resume_on_stream(std::move(stream), wake);
+}
+
+bool HttpServer::serve_pipelined(InputBuffer &in_buffer, OutputQueue &out, RequestState &state,
+                                 size_t &requests_served) {
+    size_t consumed = 0;
+    bool keep_open = true;
+    HTTPRequest http_request;
+
+    while (keep_open) {
+        if (state.h2) {
+            // Switched by an Upgrade just now, or by the preface below
+            in_buffer.consume(consumed);
+            return state.h2->serve(in_buffer, out, requests_served);
+        }
+
+        if (state.async && state.async->response) {
+            HttpResponse response = std::move(*state.async->response);
+            state.async.reset();
+            keep_open = apply_connection_header(response, state.keep_alive, state.http10);
+            finish_response(std::move(response), state, out);
+            continue;
+        }
+        if (state.async && !state.relay) {
+            // Responses go out in request order: nothing more is served until this one is in.
+            // A proxied request's body keeps flowing upstream meanwhile.
+            break;
+        }
+
+        // The views in http_request point into in_buffer, which is not touched until the loop ends
+        std::string_view pending(in_buffer.data() + consumed, in_buffer.size() - consumed);
+
+        if (state.in_body) {
+            size_t used = 0;
+            bool done = false;
+            keep_open = state.relay ? relay_body(pending, state, out, used, done)
+                                    : consume_body(pending, state, out, used, done);
+            consumed += used;
+            if (!keep_open) {
+                state.relay.reset();
+                state.async.reset();
+                break;
+            }
+            if (!done) {
+                break;
+            }
+            if (state.relay) {
+                state.relay->finish();
+                state.relay.reset();
+                state.end_body();
+                continue;
+            }
+            if (state.pending_task) {
+                ResponseTask task = std::move(state.pending_task);
+                state.end_body();
+                keep_open = start_async_response(std::move(task), state, out);
+                continue;
+            }
+
+            HttpResponse response = std::move(state.pending_response);
+            if (state.reader) {
+                try {
+                    response = state.reader->on_complete();
+                } catch (const std::exception &e) {
+                    log_line(LogLevel::Error, "Body reader threw: ", e.what());
+                    response = status_response(500);
+                }
+            }
+            keep_open = apply_connection_header(response, state.keep_alive, state.http10);
+            finish_response(std::move(response), state, out);
+            state.end_body();
+            continue;
+        }
 
-    std::string default_response =
-        "HTTP/1.1 404 Not Found\r\nContent-Type: text/plain\r\nContent-Length: 13\r\n\r\n404 Not Found";
+        // Prior knowledge: the client opens with the HTTP/2 preface instead of a request
+        if (config.http2 && requests_served == 0 && consumed == 0 && pending.size() >= 4 &&
+            HTTP2_PREFACE.substr(0, std::min(pending.size(), HTTP2_PREFACE.size())) ==
+                pending.substr(0, std::min(pending.size(), HTTP2_PREFACE.size()))) {
+            state.parser.reset();
+            state.h2 = std::make_unique<Http2Session>(*this, state.async_wake, state.connection);
+            state.h2->start(out);
+            continue;
+        }
 
-    for (const auto &route : routes) {
-        if (route.method == http_request.method && route.path == http_request.path) {
-            return route.handler(http_request.method, http_request.path);
+        HttpRequestParser::Status status = state.parser.parse(pending, http_request);
+        if (status == HttpRequestParser::Status::Incomplete) {
+            break;
+        }
+        if (status == HttpRequestParser::Status::Error) {
+            HttpResponse response = parse_error_response(state.parser.error());
+            ThreadMetrics::local().record_parse_error(response.status_code_value());
+            std::move(response).append_to(out);
+            consumed = in_buffer.size();
+            keep_open = false;
+            break;
         }
+
+        consumed += state.parser.head_length();
+        state.parser.reset();
+        keep_open = begin_request(http_request, state, out, requests_served);
     }
 
-    return default_response;
+    in_buffer.consume(consumed);
+    return keep_open;
 }
 
 /**
- * @brief The worker task: executes the full blocking I/O cycle for one client.
- * This is the task that gets delegated to the ThreadPool.
+ * @brief The worker task: executes the blocking I/O cycle for one client.
+ * This is the task that gets delegated to the ThreadPool. It keeps serving while the
+ * client has pipelined requests buffered, then parks the idle connection back in the
+ * master epoll rather than sitting in recv() until the next request.
  */
-void HttpServer::handle_client_blocking(int client_fd) {
-    // 1. Read the full request (BLOCKING I/O - the worker thread is tied up here)
-    std::string request = read_full_request_blocking(client_fd);
+void HttpServer::handle_client_blocking(int client_fd, size_t requests_served, std::shared_ptr<TlsConnection> tls) {
+    InputBuffer request_buffer; // Takes a block from this worker's slab on the first recv()
+    OutputQueue output;
+    RequestState state(config.max_header_size);
+    HTTP_TRACE_CONNECTION(state, client_fd);
+    state.connection.fd = client_fd;
+    state.connection.tls = tls != nullptr;
+    ThreadMetrics &metrics = ThreadMetrics::local();
 
-    if (!request.empty()) {
-        // 2. Process request (BLOCKING CPU/DELAY)
-        std::string response = get_response(request);
+    // 0. A new TLS client: the first bytes that woke us are its ClientHello
+    if (tls && !tls->established() && !handshake_blocking(client_fd, *tls, config.header_timeout_ms)) {
+        close(client_fd);
+        metrics.closed.add();
+        return;
+    }
 
-        // 3. Send response (BLOCKING I/O)
-        ssize_t bytes_sent = send(client_fd, response.c_str(), response.size(), 0);
-        if (bytes_sent == -1) {
-            // Log error, but don't crash the server
-            perror("send failed in worker");
+    while (true) {
+        // 1. Read at least one request head, or more of the body being received
+        // (BLOCKING I/O - the worker thread is tied up here)
+        if (!read_request_blocking(client_fd, tls.get(), request_buffer, state)) {
+            break; // Client disconnected before sending a full request
+        }
+
+        // 2. Process every buffered request (BLOCKING CPU/DELAY)
+        bool keep_open = serve_pipelined(request_buffer, output, state, requests_served);
+
+        // 3. Send all responses, gathered into as few sendmsg() calls as possible (BLOCKING I/O)
+        while (!output.empty()) {
+            ssize_t sent = send_output(client_fd, tls.get(), output);
+            if (sent == -1) {
+                if (errno == EINTR)
+                    continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    if (wait_for(client_fd, POLLOUT, config.write_timeout_ms))
+                        continue;
+                    // The client stopped reading for write_timeout_ms
+                } else if (errno == ENODATA) {
+                    // A streamed body waits on its source (an upstream), not on this socket
+                    std::shared_ptr<BodyStream> stream = output.stalled_stream();
+                    if (stream && wait_for(stream->wait_fd(), POLLIN, config.write_timeout_ms))
+                        continue;
+                } else {
+                    // Log error, but don't crash the server
+                    log_errno("send failed in worker");
+                }
+                keep_open = false;
+                break;
+            }
+            metrics.bytes_out.add(static_cast<uint64_t>(sent));
+        }
+        if (output.empty()) {
+            HTTP_TRACE_SENT(state);
+        }
+        output.clear();
+
+        if (!keep_open) {
+            break;
+        }
+
+        // 4. Nothing buffered and no body pending: hand the idle connection back to the master
+        // An HTTP/2 connection stays with its worker: its session lives in state. So does a
+        // TLS one whose next bytes are decrypted already: the socket will not signal them.
+        if (request_buffer.empty() && !state.in_body && !state.h2 && !(tls && tls->has_buffered_input())) {
+            park_client(client_fd, requests_served, std::move(tls));
+            return;
         }
-    } else {
-        // Handle case where client disconnected before sending full request
     }
 
-    // 4. Cleanup and close
+    // 5. Cleanup and close
     close(client_fd);
+    metrics.closed.add();
 }
 
+void HttpServer::park_client(int client_fd, size_t requests_served, std::shared_ptr<TlsConnection> tls) {
+    // Queue first, arm second: any readiness event main_loop sees for client_fd is then
+    // guaranteed to find the entry when adopt_parked_clients() runs after epoll_wait.
+    bool first = false;
+    {
+        std::lock_guard<std::mutex> lock(park_mutex);
+        ParkedClient parked;
+        parked.fd = client_fd;
+        parked.requests_served = requests_served;
+        parked.tls = std::move(tls);
+        first = park_queue.empty();
+        park_queue.push_back(std::move(parked));
+    }
+
+    struct epoll_event event;
+    event.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+    event.data.fd = client_fd;
+
+    // A client parked before is still registered (disarmed by EPOLLONESHOT): re-arm it
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, client_fd, &event) == -1 &&
+        (errno != ENOENT || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client_fd, &event) == -1)) {
+        // The idle wheel will still reclaim the FD
+        log_errno("epoll_ctl: parking client failed");
+    }
+
+    // main_loop may be asleep with no deadline: wake it to adopt the client and start its idle
+    // timer. The queue was non-empty otherwise, so a wakeup is already on its way.
+    if (first) {
+        uint64_t one = 1;
+        if (write(wake_fd, &one, sizeof(one)) == -1) {
+            log_errno("eventfd write failed in park_client");
+        }
+    }
+}
+
+void HttpServer::adopt_parked_clients() {
+    std::vector<ParkedClient> adopted;
+    {
+        std::lock_guard<std::mutex> lock(park_mutex);
+        adopted.swap(park_queue);
+    }
+
+    uint64_t now = monotonic_ms();
+    for (ParkedClient &entry : adopted) {
+        adopt_parked_client(entry, now);
+    }
+}
+
+void HttpServer::adopt_parked_client(ParkedClient &entry, uint64_t now) {
+    ParkedClient &parked = parked_clients[entry.fd];
+    parked.fd = entry.fd;
+    parked.requests_served = entry.requests_served;
+    parked.tls = std::move(entry.tls);
+    parked.idle_timer.fd = entry.fd;
+    idle_timers.schedule(&parked.idle_timer, config.keep_alive_timeout_ms, now);
+}
+
+void HttpServer::resume_parked_client(int client_fd) {
+    auto it = parked_clients.find(client_fd);
+    if (it == parked_clients.end()) {
+        return;
+    }
+
+    size_t requests_served = it->second.requests_served;
+    std::shared_ptr<TlsConnection> tls = std::move(it->second.tls);
+    idle_timers.cancel(&it->second.idle_timer);
+    parked_clients.erase(it);
+
+    if (admission.is_saturated()) {
+        shed_client(client_fd, tls.get());
+        return;
+    }
+
+    uint64_t queued_ns = admission.enabled() ? monotonic_ns() : 0;
+    clients_in_workers.fetch_add(1, std::memory_order_relaxed);
+    pool_batch.emplace_back([this, client_fd, requests_served, tls, queued_ns] {
+        // Released even if the task throws: a drain waits for this count to reach zero
+        struct InWorker {
+            std::atomic<size_t> &count;
+            ~InWorker() { count.fetch_sub(1, std::memory_order_release); }
+        } in_worker{clients_in_workers};
+
+        if (queued_ns != 0) {
+            admission.on_dequeue(queued_ns, monotonic_ns());
+        }
+        handle_client_blocking(client_fd, requests_served, tls);
+    });
+    pool_batch_fds.push_back(client_fd);
+}
+
+void HttpServer::flush_dispatch_batches() {
+    for (size_t i = 0; i < reactor_batches.size(); ++i) {
+        if (!reactor_batches[i].empty()) {
+            reactors[i]->hand_off(reactor_batches[i]);
+            reactor_batches[i].clear();
+        }
+    }
+
+    if (pool_batch.empty()) {
+        return;
+    }
+    try {
+        thread_pool->post_batch(pool_batch);
+    } catch (const std::exception &e) {
+        log_line(LogLevel::Error, "Error enqueueing task: ", e.what());
+        // The tasks left in the batch were never queued
+        for (size_t i = 0; i < pool_batch.size(); ++i) {
+            if (pool_batch[i]) {
+                clients_in_workers.fetch_sub(1, std::memory_order_relaxed);
+                close(pool_batch_fds[i]);
+                ThreadMetrics::local().closed.add();
+            }
+        }
+        pool_batch.clear();
+    }
+    pool_batch_fds.clear();
+}
+
+void HttpServer::expire_idle_clients() {
+    idle_timers.advance(monotonic_ms(), [this](TimerNode *node) {
+        // close() also drops the FD from the master epoll
+        close(node->fd);
+        parked_clients.erase(node->fd);
+        ThreadMetrics::local().closed.add();
+    });
+}
+
+bool HttpServer::drain_step() {
+    if (server_fd != -1) {
+        // Removed before it is closed, and on the thread that owns epoll_fd: no other thread
+        // can be inside an epoll_ctl() for it, nor get the number back from a new socket first
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, server_fd, nullptr);
+        close(server_fd);
+        server_fd = -1;
+    }
+
+    // Read before the park queue: a worker parks its client before its task returns
+    bool workers_idle = clients_in_workers.load(std::memory_order_acquire) == 0;
+    adopt_parked_clients();
+
+    // A parked client that has already sent its next request is served (with Connection:
+    // close); one that has not is closed. A new client still to send its first request gets
+    // until the deadline.
+    std::vector<int> idle;
+    for (const auto &entry : parked_clients) {
+        char byte;
+        if (entry.second.requests_served > 0 && recv(entry.first, &byte, 1, MSG_PEEK | MSG_DONTWAIT) == -1 &&
+            (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            idle.push_back(entry.first);
+        }
+    }
+    for (int fd : idle) {
+        idle_timers.cancel(&parked_clients[fd].idle_timer);
+        parked_clients.erase(fd);
+        close(fd);
+        ThreadMetrics::local().closed.add();
+    }
+
+    return (workers_idle && parked_clients.empty()) || monotonic_ms() >= drain_deadline_ms;
+}
+
+void HttpServer::update_admission() {
+    if (!admission.enabled() || !thread_pool || server_fd == -1) {
+        return;
+    }
+    bool saturated = admission.update(thread_pool->queue_depth(), monotonic_ns());
+    if (saturated == accept_paused) {
+        return;
+    }
+
+    // No events while paused: new connections wait in the kernel's accept queue, where they
+    // cost us nothing, rather than in ours
+    struct epoll_event event;
+    event.events = saturated ? 0u : static_cast<uint32_t>(EPOLLIN);
+    event.data.fd = server_fd;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, server_fd, &event) == -1) {
+        perror("epoll_ctl: pausing the listener failed");
+        return;
+    }
+    accept_paused = saturated;
+}
+
+void HttpServer::shed_client(int client_fd, TlsConnection *tls) {
+    // Closing with unread input resets the connection, which could discard the 503 before
+    // the client reads it: drop what has arrived first, a few reads at most
+    if (!tls) {
+        char discard[BUFFER_SIZE];
+        for (int i = 0; i < 4 && recv(client_fd, discard, sizeof(discard), MSG_DONTWAIT) > 0; ++i) {
+        }
+        // Best effort, like the 408: the connection closes either way
+        if (send(client_fd, OVERLOADED_RESPONSE.data(), OVERLOADED_RESPONSE.size(), MSG_DONTWAIT | MSG_NOSIGNAL) > 0) {
+            ThreadMetrics::local().bytes_out.add(OVERLOADED_RESPONSE.size());
+        }
+    } else if (tls->established()) {
+        OutputQueue out;
+        out.append_borrowed(OVERLOADED_RESPONSE);
+        tls->send(out);
+    }
+    // A TLS client still handshaking has sent no request to answer
+
+    close(client_fd);
+    ThreadMetrics &metrics = ThreadMetrics::local();
+    metrics.shed.add();
+    metrics.closed.add();
+}
+
+size_t HttpServer::pick_reactor(int client_fd) {
+    if (config.numa_steering && !reactor_on_cpu.empty()) {
+        // The CPU whose softirq last handled this socket's packets: the NIC queue's CPU
+        int cpu = -1;
+        socklen_t length = sizeof(cpu);
+        if (getsockopt(client_fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &length) == 0 && cpu >= 0) {
+            if (static_cast<size_t>(cpu) < reactor_on_cpu.size() && reactor_on_cpu[cpu] != -1) {
+                return static_cast<size_t>(reactor_on_cpu[cpu]);
+            }
+            size_t node = static_cast<size_t>(CpuTopology::system().node_of(cpu));
+            if (node < node_reactors.size() && !node_reactors[node].empty()) {
+                size_t &position = next_node_reactor[node];
+                position = (position + 1) % node_reactors[node].size();
+                return node_reactors[node][position];
+            }
+        }
+    }
+    size_t index = next_reactor;
+    next_reactor = (next_reactor + 1) % reactors.size();
+    return index;
+}
+
+void HttpServer::dispatch_client(int client_fd) {
+    // client_fd is non-blocking from accept4(). Reactor workers never block; ThreadPool workers
+    // do, but in poll() with a deadline (wait_for()), not in a recv() or sendfile() the client
+    // could hold open at will.
+    set_tcp_nodelay(client_fd);
+
+    if (config.mode == ServerMode::Reactor) {
+        reactor_batches[pick_reactor(client_fd)].push_back(client_fd);
+        return;
+    }
+
+    // Parked until its first byte arrives, like a keep-alive client between requests: a
+    // client that connects and sends nothing never ties up a worker, it only ages out.
+    // resume_parked_client() then delegates the connection to the thread pool.
+    std::shared_ptr<TlsConnection> tls;
+    if (tls_context && !(tls = tls_context->accept(client_fd))) {
+        log_line(LogLevel::Error, "TLS session allocation failed for client_fd");
+        close(client_fd);
+        ThreadMetrics::local().closed.add();
+        return;
+    }
+
+    // On the master already: straight into parked_clients, no park_queue or wake_fd round trip.
+    // With TCP_DEFER_ACCEPT its request is usually in, and the next epoll_wait reports it.
+    ParkedClient entry;
+    entry.fd = client_fd;
+    entry.tls = std::move(tls);
+    adopt_parked_client(entry, monotonic_ms());
+
+    struct epoll_event event;
+    event.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+    event.data.fd = client_fd;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client_fd, &event) == -1) {
+        // The idle wheel will still reclaim the FD
+        log_errno("epoll_ctl: parking client failed");
+    }
+}
+
+// How often a master that stopped accepting re-checks the queue
+static constexpr int ADMISSION_POLL_MS = 10;
+
+// How often a draining master checks whether its workers are done
+static constexpr int DRAIN_POLL_MS = 100;
+
 /**
- * @brief The main server loop uses epoll only to accept connections and dispatch tasks.
- * This loop MUST remain non-blocking.
+ * @brief The main server loop uses epoll to accept connections, dispatch tasks and
+ * watch parked keep-alive clients. This loop MUST remain non-blocking.
  */
 void HttpServer::main_loop(struct sockaddr_in *address, socklen_t *addrlen) {
     while (running) {
-        // Wait for events (blocks until an event occurs or timeout)
-        int num_events = epoll_wait(epoll_fd, events, MAX_EVENTS, 100); // 100ms timeout to check 'running' flag
+        // Sleeps until the next idle deadline (stop() and park_client() wake it through wake_fd).
+        // Nothing wakes it when the queue drains enough to accept again, or when a drain's workers
+        // are done, so it polls every ADMISSION_POLL_MS while paused and DRAIN_POLL_MS while draining.
+        int timeout_ms = idle_timers.next_timeout_ms();
+        int poll_ms = draining ? DRAIN_POLL_MS : accept_paused ? ADMISSION_POLL_MS : -1;
+        if (poll_ms >= 0 && (timeout_ms < 0 || timeout_ms > poll_ms)) {
+            timeout_ms = poll_ms;
+        }
+        int num_events = epoll_wait(epoll_fd, events, MAX_EVENTS, timeout_ms);
 
         if (num_events < 0) {
             if (errno == EINTR)
@@ -293,38 +1479,58 @@ void HttpServer::main_loop(struct sockaddr_in *address, socklen_t *addrlen) {
             break;
         }
 
+        // Must run before the events are handled: see park_client()
+        adopt_parked_clients();
+
+        // Decides, against the current queue, whether the clients that woke up are queued or shed
+        update_admission();
+
         for (int i = 0; i < num_events; i++) {
             int current_fd = events[i].data.fd;
 
+            if (current_fd == wake_fd) {
+                // Parked clients were adopted above; after stop() the loop condition ends it
+                uint64_t counter;
+                if (read(wake_fd, &counter, sizeof(counter)) == -1 && errno != EAGAIN) {
+                    perror("eventfd read failed in main loop");
+                }
+                continue;
+            }
             if (current_fd == server_fd) {
-                // Event on listening socket: new connection
-                while (true) {
-                    struct sockaddr_in client_addr;
-                    socklen_t addrlen_temp = sizeof(client_addr);
-
-                    // accept is non-blocking because server_fd is non-blocking
-                    int client_fd = accept(server_fd, (struct sockaddr *)&client_addr, &addrlen_temp);
+                // Event on listening socket: new connections, at most accept_batch of them
+                // this pass so parked clients are not starved; the listener is level-triggered
+                for (size_t accepted = 0; accepted < config.accept_batch; ++accepted) {
+                    // accept4 hands back a non-blocking socket directly, saving the fcntl round trip
+                    int client_fd = accept4(server_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
 
                     if (client_fd < 0) {
                         if (errno == EAGAIN || errno == EWOULDBLOCK) {
                             break; // No more new connections to accept
                         } else {
-                            perror("accept error");
+                            log_errno("accept error");
                             break;
                         }
                     }
 
-                    // CRITICAL STEP: Delegate the full connection handling to the thread pool
-                    try {
-                        // The lambda captures 'this' to call the member function, and client_fd by value
-                        thread_pool->enqueue(&HttpServer::handle_client_blocking, this, client_fd);
-                    } catch (const std::exception &e) {
-                        std::cerr << "Error enqueueing task: " << e.what() << std::endl;
-                        close(client_fd); // Close socket if task fails to queue
-                    }
+                    ThreadMetrics::local().accepted.add();
+                    HTTP_TRACE_ACCEPT(client_fd);
+                    dispatch_client(client_fd);
                 }
+            } else {
+                // A parked keep-alive client sent its next request (or hung up)
+                resume_parked_client(current_fd);
             }
         }
+
+        // One notification per reactor (or for the pool) for everything this pass accepted
+        // or resumed
+        flush_dispatch_batches();
+
+        expire_idle_clients();
+
+        if (draining && drain_step()) {
+            break;
+        }
     }
 }
 
@@ -332,31 +1538,183 @@ void HttpServer::start() {
     struct sockaddr_in address;
     socklen_t addrlen = sizeof(address);
 
-    create_socket();
-    config_socket_opt();
-    bind_socket(address);
-    listen_socket();
+    // A restart: the previous process keeps serving on these sockets until we acknowledge them
+    std::vector<int> inherited;
+    if (!config.handoff_socket.empty()) {
+        inherited = ListenerHandoff::take_over(config.handoff_socket);
+        if (!inherited.empty()) {
+            std::cout << "Took over " << inherited.size() << " listening sockets from " << config.handoff_socket
+                      << std::endl;
+        }
+    }
 
-    setup_epoll();
+    std::vector<int> listeners;
+    if (config.mode == ServerMode::ReusePort) {
+        // Zero-master: one listener per worker, all bound before any worker starts so the
+        // reuseport group (and the CPU index mapping used by the CBPF program) is complete
+        for (size_t i = 0; i < reactors.size(); ++i) {
+            listeners.push_back(take_listener(inherited, address));
+        }
+        if (config.reuseport_cbpf) {
+            attach_reuseport_cbpf(listeners[0], listeners.size());
+        }
+        std::cout << "Server listening on port " << port << " with " << listeners.size()
+                  << " SO_REUSEPORT listeners" << (config.reuseport_cbpf ? " (CPU-steered)" : "") << std::endl;
+    } else {
+        server_fd = take_listener(inherited, address);
+        listeners.push_back(server_fd);
+        std::cout << "Server listening on port " << port << std::endl;
+    }
+    for (int fd : inherited) {
+        // More than this server has workers for: its connections were the old process's to serve
+        close(fd);
+    }
 
+    if (config.mode != ServerMode::ReusePort) {
+        setup_epoll();
+    }
     running = true;
+    for (size_t i = 0; i < reactors.size(); ++i) {
+        if (config.mode == ServerMode::ReusePort) {
+            reactors[i]->set_listener(listeners[i]);
+        }
+        reactors[i]->start();
+    }
 
-    // The main_loop now runs the non-blocking I/O multiplexer
-    main_loop(&address, &addrlen);
+    // Offered only now that every listener is being served
+    if (!config.handoff_socket.empty()) {
+        handoff = std::make_unique<ListenerHandoff>(config.handoff_socket, listeners, [this] { stop(); });
+    }
+
+    if (config.mode == ServerMode::ReusePort) {
+        // No accept loop on this thread: park until stop() flips the flag
+        if (!draining) {
+            running.wait(true);
+        }
+    } else {
+        // The main_loop now runs the non-blocking I/O multiplexer
+        main_loop(&address, &addrlen);
+    }
+    shut_down_workers();
 }
 
-void HttpServer::stop() {
+void HttpServer::shut_down_workers() {
     running = false;
-    if (server_fd != -1) {
-        close(server_fd);
-        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, server_fd, nullptr);
-        server_fd = -1;
+    handoff.reset();
+    for (auto &reactor : reactors) {
+        if (draining) {
+            reactor->join(); // Ends by itself once drained, at drain_deadline_ms at the latest
+        }
+        reactor->stop();
     }
     if (thread_pool) {
         thread_pool->shutdown();
     }
 }
 
+void HttpServer::stop() {
+    if (draining.exchange(true)) {
+        return;
+    }
+    uint64_t deadline = monotonic_ms() + config.drain_timeout_ms;
+    drain_deadline_ms = deadline;
+
+    // Each loop closes its own listener and connections; nothing is closed from this thread
+    for (auto &reactor : reactors) {
+        reactor->drain(deadline);
+    }
+    if (config.mode == ServerMode::ReusePort) {
+        running = false;
+        running.notify_all();
+    }
+    if (wake_fd != -1) {
+        uint64_t one = 1;
+        if (write(wake_fd, &one, sizeof(one)) == -1) {
+            perror("eventfd write failed in stop");
+        }
+    }
+}
+
 void HttpServer::add_endpoint(const std::string &method, const std::string &path, RequestHandler handler) {
-    routes.emplace_back(method, path, handler);
+    router.add(method, path, std::move(handler));
+}
+
+void HttpServer::add_endpoint(const std::string &method, const std::string &path, ResponseHandler handler) {
+    router.add(method, path, std::move(handler));
+}
+
+void HttpServer::add_endpoint(const std::string &method, const std::string &path, ContextHandler handler) {
+    router.add(method, path, std::move(handler));
+}
+
+void HttpServer::add_async_endpoint(const std::string &method, const std::string &path, AsyncHandler handler) {
+    router.add_async(method, path, std::move(handler));
+}
+
+void HttpServer::add_endpoint(const std::string &method, const std::string &path,
+                              std::shared_ptr<const StaticFiles> files) {
+    if (method == "GET") {
+        router.add_static_files("HEAD", path, files);
+    }
+    router.add_static_files(method, path, std::move(files));
+}
+
+void HttpServer::add_endpoint(const std::string &method, const std::string &path,
+                              std::shared_ptr<ReverseProxy> proxy) {
+    if (method == "GET") {
+        router.add_proxy("HEAD", path, proxy);
+    }
+    router.add_proxy(method, path, std::move(proxy));
+}
+
+void HttpServer::add_streaming_endpoint(const std::string &method, const std::string &path, StreamingHandler handler) {
+    router.add_streaming(method, path, std::move(handler));
+}
+
+bool HttpServer::cache_endpoint(const std::string &method, const std::string &path, const ResponseCachePolicy &policy) {
+    if (method != "GET" && method != "HEAD") {
+        std::cerr << "Only GET and HEAD routes can be cached, not " << method << ' ' << path << std::endl;
+        return false;
+    }
+    Endpoint *endpoint = router.find(method, path);
+    if (!endpoint || !endpoint->handler) {
+        std::cerr << "No cacheable endpoint for " << method << ' ' << path << std::endl;
+        return false;
+    }
+    ResponseCachePolicy route_policy = policy;
+    if (config.compression.enabled &&
+        std::none_of(route_policy.vary.begin(), route_policy.vary.end(),
+                     [](const std::string &name) { return equals_ignore_case(name, "Accept-Encoding"); })) {
+        // Entries are stored compressed (or not) for the request that filled them
+        route_policy.vary.push_back("Accept-Encoding");
+    }
+    endpoint->cache = std::make_shared<ResponseCache>(std::move(route_policy));
+    return true;
+}
+
+HttpResponse HttpServer::metrics_response() const {
+    std::string body;
+    body.reserve(16 * 1024);
+    render_metrics(collect_metrics(), body);
+
+    auto append_metric = [&body](const char *name, const char *type, const char *help, uint64_t value) {
+        body += std::string("# HELP ") + name + ' ' + help + "\n# TYPE " + name + ' ' + type + '\n';
+        body += std::string(name) + ' ' + std::to_string(value) + '\n';
+    };
+    if (thread_pool) {
+        append_metric("http_thread_pool_queue_depth", "gauge", "Tasks waiting for a ThreadPool worker.",
+                      thread_pool->queue_depth());
+        append_metric("http_accept_paused", "gauge", "1 while admission control has stopped accepting.",
+                      accept_paused ? 1 : 0);
+    }
+    SlabStats slab = buffer_slab_stats();
+    append_metric("http_buffer_slab_blocks_in_use", "gauge", "Buffer slab blocks held by connections.", slab.in_use());
+    append_metric("http_buffer_slab_blocks_cached", "gauge", "Free buffer slab blocks kept for reuse.", slab.cached);
+    append_metric("http_buffer_slab_acquired_total", "counter", "Buffer slab blocks handed out.", slab.acquired);
+    append_metric("http_buffer_slab_freed_total", "counter", "Released blocks returned to the allocator.", slab.freed);
+
+    HttpResponse response(200);
+    response.set_header("Content-Type", "text/plain; version=0.0.4");
+    response.set_body(std::move(body));
+    return response;
 }
@@ -1,7 +1,19 @@
 #ifndef HTTP_SERVER_H
 #define HTTP_SERVER_H
 
+#include "admission.h"
+#include "arena.h"
+#include "compression.h"
+#include "http-parser.h"
+#include "http-response.h"
+#include "listener-handoff.h"
+#include "proxy.h"
+#include "response-cache.h"
+#include "router.h"
 #include "thread-pool.h"
+#include "timer-wheel.h"
+#include "tls.h"
+#include "trace.h"
 #include <atomic>
 #include <functional>
 #include <netinet/in.h>
@@ -9,83 +21,520 @@
 #include <string_view>
 #include <sys/epoll.h>
 #include <unistd.h>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
 #include <vector>
 
 // Constants
 #define MAX_EVENTS 1000
 #define BUFFER_SIZE 4096
-#define MAX_REQUEST_SIZE 4096
 
-// Type definitions
-using RequestHandler = std::function<std::string(const std::string &, const std::string &)>;
+// Selects how accepted connections are served.
+enum class ServerMode {
+    ThreadPool, // Master epoll accepts; a ThreadPool worker runs the blocking recv/send cycle per client
+    Reactor,    // Master epoll accepts; per-worker epoll reactors drive non-blocking, edge-triggered I/O
+    ReusePort,  // Zero-master: every reactor owns an SO_REUSEPORT listener and accepts for itself
+};
+
+// Reactor/ReusePort modes: the kernel interface each reactor worker is built on.
+enum class IoBackend {
+    Epoll,   // Readiness: edge-triggered epoll, then non-blocking recv/sendmsg
+    IoUring, // Completion: multishot accept/recv and linked sends; epoll if the kernel refuses it
+};
+
+// Construction-time server settings. Defaults: ThreadPool mode with every feature that needs no
+// configuration enabled.
+struct ServerConfig {
+    ServerMode mode = ServerMode::ThreadPool;
+
+    // ThreadPool mode: task queue shared by the workers
+    QueueMode queue_mode = QueueMode::LockFree;
+
+    // ThreadPool mode: once the queue is saturated (see AdmissionConfig), requests on ready
+    // connections are answered 503 from a preformatted buffer instead of queued, and the
+    // listener is taken out of the master epoll until the queue recovers.
+    AdmissionConfig admission;
+
+    // Listening sockets. The master accepts at most accept_batch connections per wakeup and
+    // hands each worker (or the pool) its share with one notification; the level-triggered
+    // listener reports the rest on the next pass. defer_accept_s sets TCP_DEFER_ACCEPT, so a
+    // connection is only reported once its first data has arrived (or after about that many
+    // seconds), and fastopen_queue > 0 enables TCP_FASTOPEN with that many pending cookies,
+    // letting a returning client send its request in the SYN. 0 = off for both.
+    size_t accept_batch = 64;
+    int defer_accept_s = 1;
+    int fastopen_queue = 256;
+
+    // ReusePort mode: attach an SO_ATTACH_REUSEPORT_CBPF program that steers each new
+    // connection to the listener whose index matches the CPU that received the SYN.
+    bool reuseport_cbpf = false;
+
+    // Reactor/ReusePort modes. With IoUring, uring_sqpoll adds a kernel thread per worker
+    // that polls the submission queue, so submitting needs no syscall at all.
+    IoBackend io_backend = IoBackend::Epoll;
+    bool uring_sqpoll = false;
+    unsigned uring_entries = 4096; // Submission queue size per worker
+
+    // HTTP/1.1 persistent connections: on by default, HTTP/1.0 clients must opt in
+    bool keep_alive = true;
+    size_t max_requests_per_connection = 1000; // 0 = unlimited
+    uint64_t keep_alive_timeout_ms = 5000;     // Idle connections are pruned after this
+
+    // Slowloris defense. A request head must be complete within header_timeout_ms of its
+    // first byte and a body may not stall for body_timeout_ms (both answered with 408); a
+    // client that stops reading its response is dropped once a write has made no progress
+    // for write_timeout_ms. 0 = no limit.
+    uint64_t header_timeout_ms = 10000;
+    uint64_t body_timeout_ms = 30000;
+    uint64_t write_timeout_ms = 30000;
+
+    // Request limits: larger heads get 431, larger bodies 413. 0 = unlimited (for heads: up to
+    // the 4 GiB the parser's 32-bit offsets can index, see header_size_limit()). Streaming
+    // endpoints never hold a body whole, so max_body_size bounds upload size rather than
+    // memory. A context endpoint (Request::body()) holds its body in memory until the handler
+    // has run, so those bodies have their own, smaller max_buffered_body_size.
+    size_t max_header_size = MAX_REQUEST_SIZE;
+    size_t max_body_size = 64 * 1024 * 1024;
+    size_t max_buffered_body_size = 1024 * 1024;
+
+    // Free BufferSlab blocks (BLOCK_SIZE each) a worker keeps for reuse; beyond this, released
+    // blocks go back to the allocator. Size it from buffer_slab_stats(): a high freed count
+    // against acquired says the list is too short.
+    size_t slab_cached_blocks = 256;
+
+    // Pin every worker thread (ThreadPool workers or reactors) to one CPU of the process's
+    // affinity mask, worker i on the i-th CPU, wrapping around. Each worker pins itself
+    // before it allocates anything, so its slab blocks and connection state are placed on
+    // that CPU's NUMA node.
+    bool pin_workers = false;
+
+    // Reactor mode, with pin_workers: the master hands each accepted connection to the
+    // reactor pinned to the CPU that received it (SO_INCOMING_CPU), or failing that to one
+    // on the same NUMA node. ReusePort mode gets the same placement from reuseport_cbpf.
+    bool numa_steering = false;
+
+    // HTTP/2 over cleartext, both with prior knowledge and through an h2c Upgrade from
+    // HTTP/1.1. Each connection runs up to http2_max_streams requests at once.
+    bool http2 = true;
+    uint32_t http2_max_streams = 256;
+
+    // TLS on every connection once tls.certificate_file is set (see TlsConfig). Served by
+    // epoll workers in Reactor and ReusePort modes: io_backend falls back from IoUring.
+    TlsConfig tls;
+
+    // gzip, br and zstd bodies for clients that accept them (see compress_response())
+    CompressionConfig compression;
+
+    // Graceful stop: stop() stops accepting at once, idle keep-alive connections are closed
+    // and the rest get drain_timeout_ms to finish (answered with Connection: close) before
+    // start() returns.
+    uint64_t drain_timeout_ms = 30000;
+
+    // Zero-downtime restarts (see ListenerHandoff): start() first takes over the listening
+    // sockets of a server offering them on this Unix socket path, then offers its own there.
+    // The server that handed them over drains as if stop() had been called. Empty = off.
+    std::string handoff_socket;
+};
+
+// Where a coroutine handler that suspended leaves its response. Shared by the handler's
+// frame and the connection, either of which may go first.
+struct AsyncResponse {
+    std::optional<HttpResponse> response;
+    std::function<void()> wake; // RequestState::async_wake at the time the handler started
+    bool suspended = false;     // Finished after serve_pipelined() returned: wake is due
+    bool cancelled = false;     // The connection is gone: nobody to wake
+
+    void complete(HttpResponse result) {
+        response.emplace(std::move(result));
+        if (suspended && !cancelled && wake) {
+            wake();
+        }
+    }
+};
+
+// The connection's reference to an AsyncResponse: cancels it when dropped or replaced, so a
+// handler finishing after its connection closed does not call back into a stale one
+class AsyncResponseRef {
+  private:
+    std::shared_ptr<AsyncResponse> slot;
+
+  public:
+    AsyncResponseRef() = default;
+    explicit AsyncResponseRef(std::shared_ptr<AsyncResponse> s) : slot(std::move(s)) {}
+    AsyncResponseRef(AsyncResponseRef &&other) noexcept = default;
+    AsyncResponseRef &operator=(AsyncResponseRef &&other) noexcept {
+        if (this != &other) {
+            reset();
+            slot = std::move(other.slot);
+        }
+        return *this;
+    }
+    ~AsyncResponseRef() { reset(); }
+
+    void reset() {
+        if (slot) {
+            slot->cancelled = true;
+            slot.reset();
+        }
+    }
+    AsyncResponse *operator->() const { return slot.get(); }
+    explicit operator bool() const { return static_cast<bool>(slot); }
+};
+
+class Http2Session;
+
+// Progress of the request currently arriving on one connection: its head parser and,
+// once the head is in, how much body is left and where it goes.
+struct RequestState {
+    HttpRequestParser parser;
+
+    bool in_body = false;
+    bool chunked = false;
+    size_t body_remaining = 0; // Content-Length bodies
+    size_t body_received = 0;
+    ChunkedDecoder chunked_decoder;
+
+    // Streaming endpoint: receives the body. Otherwise the body is discarded and
+    // pending_response, produced when the head arrived, is sent once it has been read.
+    std::unique_ptr<BodyReader> reader;
+    HttpResponse pending_response;
+    bool keep_alive = false;
+    bool http10 = false;
+
+    // Coroutine endpoint: pending_task waits for the body; once started, async holds the
+    // suspended handler's response and later pipelined requests wait their turn behind it.
+    ResponseTask pending_task;
+    AsyncResponseRef async;
+
+    // Proxied endpoint: the body goes upstream through relay while async waits for the answer
+    BodyRelayRef relay;
+
+    // Set by event loops that resume suspended handlers: called on the loop's thread when one
+    // has finished, so it can serve the connection again. Without it handlers run to completion.
+    std::function<void()> async_wake;
+
+    // For the latency histograms: when the current request's head was parsed, and its route
+    uint64_t started_ns = 0;
+    uint32_t route = 0;
+
+    // ContentCoding bits the current request's Accept-Encoding allows, for its response
+    uint8_t accept_codings = 0;
+
+    // The current request is HEAD: finish_response() drops the body, keeping Content-Length
+    bool head_request = false;
+
+    // What context handlers see of the connection (Request::connection())
+    ConnectionInfo connection;
+
+    // Set once the connection has switched to HTTP/2, which then owns everything above
+    std::unique_ptr<Http2Session> h2;
+
+#ifdef HTTP_TRACE
+    // When the connection was accepted, the phases of the request being received and those of
+    // the responses queued but not sent yet (see trace.h)
+    uint64_t trace_accept = 0;
+    RequestTrace trace;
+    std::vector<RequestTrace> trace_unsent;
+#endif
+
+    explicit RequestState(size_t max_header_size = MAX_REQUEST_SIZE);
+    RequestState(RequestState &&other) noexcept;
+    RequestState &operator=(RequestState &&other) noexcept;
+    ~RequestState();
+
+    // Called once the body has been consumed
+    void end_body() {
+        in_body = false;
+        reader.reset();
+        pending_response = HttpResponse();
+        pending_task = ResponseTask();
+    }
+
+    bool awaiting_response() const { return static_cast<bool>(async); }
+};
 
-// Simple structure to hold parsed HTTP request details
-struct HTTPRequest {
-    std::string method;
-    std::string path;
-    std::string version;
-    std::string body;
+// Which deadline a connection is under, from the most to the least pressing
+enum class TimeoutPhase : uint8_t {
+    None,
+    Write,   // Output queued: write_timeout_ms since the last progress
+    Handler, // A coroutine handler is suspended (and not receiving a body): no deadline of its own
+    Body,    // Receiving a body: body_timeout_ms since the last byte
+    Header,  // Part of a head buffered: header_timeout_ms since it started
+    Idle,    // Between requests: keep_alive_timeout_ms
 };
 
-// Structure to store route definitions.
-struct Route {
-    std::string method;
-    std::string path;
-    RequestHandler handler;
+/**
+ * @brief A connection's single wheel entry, re-armed for whichever phase the connection is
+ * in after each I/O event. Moving between phases re-arms it; within a phase only progress
+ * does (bytes of the body, bytes written), and never more header bytes, so a head trickled
+ * in a byte at a time still has to beat one deadline.
+ */
+struct ConnectionTimer {
+    TimerNode node;
+    TimeoutPhase phase = TimeoutPhase::None;
+    size_t request_index = 0; // requests_served when the Header phase was armed
 
-    Route(const std::string &m, const std::string &p, RequestHandler h) : method(m), path(p), handler(h) {}
+    void update(TimerWheel &wheel, const ServerConfig &config, TimeoutPhase next, bool read_progress,
+                bool write_progress, size_t requests_served);
+    void cancel(TimerWheel &wheel) {
+        wheel.cancel(&node);
+        phase = TimeoutPhase::None;
+    }
 };
 
+// The phase a connection is in, given what it has buffered either way
+TimeoutPhase timeout_phase(const RequestState &state, bool input_buffered, bool output_queued);
+
+// 408 with Connection: close, for a head or body that missed its deadline
+HttpResponse request_timeout_response();
+
+class EventLoop;
+
 class HttpServer {
   private:
+    // ThreadPool mode: a keep-alive client waiting for its next request. Parked in the
+    // master epoll instead of pinning a worker inside recv().
+    struct ParkedClient {
+        int fd = -1;
+        size_t requests_served = 0;
+        std::shared_ptr<TlsConnection> tls; // Shared with the worker task that resumes it
+        TimerNode idle_timer;
+    };
+
     int port;
     int server_fd = -1;
     int epoll_fd = -1; // Only for listening socket now
+    int wake_fd = -1;  // eventfd in epoll_fd: written by stop() and park_client() to wake main_loop
     std::atomic<bool> running = false;
-    std::vector<Route> routes;
+    Router router;
+
+    ServerConfig config;
+    size_t num_workers;
+
+    std::unique_ptr<TlsContext> tls_context; // config.tls enabled only
 
     ThreadPool *thread_pool = nullptr;
 
+    // Set by stop(): the master stops accepting and every loop runs until its connections are
+    // done or drain_deadline_ms (monotonic_ms()) passes
+    std::atomic<bool> draining = false;
+    std::atomic<uint64_t> drain_deadline_ms = 0;
+
+    // ThreadPool mode: clients posted to the pool whose task has not returned yet
+    std::atomic<size_t> clients_in_workers = 0;
+
+    // handoff_socket set: offers this server's listeners to its successor
+    std::unique_ptr<ListenerHandoff> handoff;
+
+    // ThreadPool mode: whether the queue can take more. accept_paused mirrors the listener's
+    // registration in epoll_fd; it is written by the master and read by metrics scrapes.
+    AdmissionController admission;
+    std::atomic<bool> accept_paused = false;
+
+    // Reactor/ReusePort modes: one event loop (epoll or io_uring) per worker. In Reactor mode
+    // main_loop feeds them round-robin; in ReusePort mode each one accepts on its own listener.
+    std::vector<std::unique_ptr<EventLoop>> reactors;
+    size_t next_reactor = 0;
+
+    // Reactor mode with numa_steering: where dispatch_client() looks for a nearby reactor
+    std::vector<int> reactor_on_cpu;                // CPU id -> reactor pinned there, or -1
+    std::vector<std::vector<size_t>> node_reactors; // NUMA node -> reactors pinned on it
+    std::vector<size_t> next_node_reactor;          // Round-robin position within each node
+
+    // ThreadPool mode: workers queue idle clients here; main_loop moves them into
+    // parked_clients and the idle wheel, which only the master thread touches.
+    std::mutex park_mutex;
+    std::vector<ParkedClient> park_queue;
+    std::unordered_map<int, ParkedClient> parked_clients;
+    TimerWheel idle_timers;
+
+    // What one main_loop pass hands over, sent at its end so each worker is woken once
+    std::vector<std::vector<int>> reactor_batches; // Reactor mode: accepted clients, per reactor
+    std::vector<UniqueTask> pool_batch;            // ThreadPool mode: tasks of resumed clients
+    std::vector<int> pool_batch_fds;               // and their FDs, closed if the post fails
+
     // epoll event storage
     struct epoll_event events[MAX_EVENTS];
 
     // Core socket setup methods
-    void create_socket();
-    void config_socket_opt(); // Only sets reuseaddr/reuseport for listening socket
-    void bind_socket(struct sockaddr_in &address);
-    void listen_socket();
+    int create_socket();
+    void config_socket_opt(int fd); // Only sets reuseaddr/reuseport for listening sockets
+    void bind_socket(int fd, struct sockaddr_in &address);
+    void listen_socket(int fd);
+
+    // Runs the four steps above and returns a listening, non-blocking socket
+    int open_listener(struct sockaddr_in &address);
+
+    // The next listener handed over by the previous process, if any is left, else a new one
+    int take_listener(std::vector<int> &inherited, struct sockaddr_in &address);
+
+    // Installs the CPU-affinity steering program on a complete SO_REUSEPORT group
+    void attach_reuseport_cbpf(int fd, size_t group_size);
 
     void setup_epoll(); // Only registers the listening socket
 
+    // A worker on config.io_backend; switches the config to Epoll if io_uring is unavailable
+    std::unique_ptr<EventLoop> make_event_loop(size_t worker_id);
+
+    // pin_workers: assigns each reactor its CPU and fills the numa_steering tables
+    void place_reactors();
+
     // The main epoll loop (NON-BLOCKING I/O MULTIPLEXER)
     void main_loop(struct sockaddr_in *address, socklen_t *addrlen);
 
     // --- Worker Task Function (Executed by Thread Pool) ---
-    // This function performs the entire blocking I/O cycle for one client.
-    void handle_client_blocking(int client_fd);
+    // This function performs the blocking I/O cycle for one client until it closes or goes idle.
+    // tls is the connection's TLS session, if any, handshaking first if it has not yet.
+    void handle_client_blocking(int client_fd, size_t requests_served, std::shared_ptr<TlsConnection> tls);
+
+    // Worker side of keep-alive: re-arms client_fd (EPOLLONESHOT) in the master epoll
+    void park_client(int client_fd, size_t requests_served, std::shared_ptr<TlsConnection> tls);
+
+    // Master side: adopts queued clients and resumes or prunes parked ones. A resumed client
+    // joins pool_batch; flush_dispatch_batches() posts it.
+    void adopt_parked_clients();
+    void adopt_parked_client(ParkedClient &entry, uint64_t now);
+    void resume_parked_client(int client_fd);
+    void expire_idle_clients();
+
+    // End of a main_loop pass: hands the pass's clients to the pool or the reactors
+    void flush_dispatch_batches();
+
+    // Master side of a drain: stops accepting and closes parked clients with nothing to say.
+    // True once no connection of the master's is left or the deadline has passed.
+    bool drain_step();
 
-    // Request/Response handling
-    std::string get_response(const std::string &request);
+    // After the master loop: joins draining reactors and shuts the workers down
+    void shut_down_workers();
 
-    // Robust blocking read function (used by worker threads)
-    std::string read_full_request_blocking(int client_fd);
+    // Master side of admission control: re-evaluates saturation and pauses or resumes accepting
+    void update_admission();
+
+    // Answers a ready client 503 without queueing it, then closes it
+    void shed_client(int client_fd, TlsConnection *tls);
+
+    // Queues a freshly accepted (non-blocking) client for a reactor worker or, in ThreadPool
+    // mode, parks it until it sends something
+    void dispatch_client(int client_fd);
+
+    // Reactor mode: the worker for a new client, near its RX CPU when numa_steering is on
+    size_t pick_reactor(int client_fd);
+
+    // Request/Response handling. For a streaming endpoint the reader is handed back through
+    // body_reader (and the returned response is empty); without body_reader it is run on an
+    // empty body straight away. A coroutine endpoint's task is handed back, not yet started,
+    // through async_task. The matched endpoint's histogram id goes to metrics_route, if given.
+    // A proxied endpoint is a coroutine too; callers that can send a streamed response
+    // (HTTP/1.1) pass body_relay, which gets the relay for a request body, if there is one.
+    // A context endpoint with a body to read is handed back as a reader that buffers it.
+    HttpResponse get_response(const HTTPRequest &request, std::unique_ptr<BodyReader> *body_reader = nullptr,
+                              ResponseTask *async_task = nullptr, uint32_t *metrics_route = nullptr,
+                              std::shared_ptr<BodyRelay> *body_relay = nullptr,
+                              const ConnectionInfo *connection = nullptr);
+
+    // Starts a coroutine handler. A response it has by its first suspension (or at all, without
+    // RequestState::async_wake) is appended right away; otherwise it is parked in state.async
+    // for serve_pipelined() to pick up when the loop wakes the connection. Returns false once
+    // the connection must close.
+    bool start_async_response(ResponseTask task, RequestState &state, OutputQueue &out);
+
+    // Runs a coroutine handler up to its first suspension. The slot has the response already
+    // if it finished; otherwise wake (when set) is called once it does.
+    static std::shared_ptr<AsyncResponse> launch_async(ResponseTask task, const std::function<void()> &wake);
+
+    // Every response to a parsed request goes out through here: the compression stage, for the
+    // codings in state.accept_codings, then the latency histogram of its route
+    void finish_response(HttpResponse response, RequestState &state, OutputQueue &out) const;
+
+    // Head received: answers a bodiless request or sets state up to receive the body.
+    // Returns false once the connection must close.
+    bool begin_request(const HTTPRequest &request, RequestState &state, OutputQueue &out, size_t &requests_served);
+
+    // h2c: switches the connection to HTTP/2 if request asks to Upgrade and may. Appends the
+    // 101 and the response to request, now stream 1, and returns true; false to serve it as HTTP/1.1.
+    bool upgrade_to_http2(const HTTPRequest &request, RequestState &state, OutputQueue &out,
+                          size_t &requests_served);
+
+    // Feeds the body bytes at the front of pending to the reader (or discards them) and
+    // reports how many were used. Appends the response and returns false on a framing or
+    // size error; sets done once the body is complete.
+    bool consume_body(std::string_view pending, RequestState &state, OutputQueue &out, size_t &used, bool &done);
+
+    // consume_body() for a proxied request: offers the body bytes at the front of pending to
+    // state.relay, framing included, and uses only what it takes
+    bool relay_body(std::string_view pending, RequestState &state, OutputQueue &out, size_t &used, bool &done);
+
+    // After out failed to send with ENODATA: has wake called once its streamed body has more,
+    // unless something waits for that already
+    static void await_body_stream(const OutputQueue &out, const std::function<void()> &wake);
+
+    // Serves every complete request at the front of in_buffer (pipelining), appends the
+    // responses to out and consumes the bytes used. state carries a partially
+    // received request (head or body) between calls. Returns false once the connection
+    // must close after out is flushed.
+    bool serve_pipelined(InputBuffer &in_buffer, OutputQueue &out, RequestState &state, size_t &requests_served);
+
+    // Robust blocking read function (used by worker threads): receives into request_buffer
+    // until serve_pipelined() has something to act on: a complete (or malformed) head or,
+    // while a body is arriving, more body bytes. Returns false on EOF/error, and after
+    // answering 408 once the head or body misses its deadline (ServerConfig::*_timeout_ms).
+    bool read_request_blocking(int client_fd, TlsConnection *tls, InputBuffer &request_buffer, RequestState &state);
+
+    friend class ReactorWorker;
+    friend class UringWorker;
+    friend class Http2Session;
 
   public:
-    // Constructor: Takes the port number and number of threads
-    HttpServer(int p, size_t num_threads);
+    // Constructor: Takes the port number, number of worker threads and the server settings
+    HttpServer(int p, size_t num_threads, const ServerConfig &server_config = ServerConfig());
     ~HttpServer();
 
-    // Control methods
+    // Control methods. start() serves until stop() and returns once the drain is over.
+    // stop() only starts the drain, so it may be called from any thread, a handler's included.
     void start();
     void stop();
 
-    // Route configuration
+    // Route configuration. path may contain ":name" and a trailing "*name" segment.
     void add_endpoint(const std::string &method, const std::string &path, RequestHandler handler);
+    void add_endpoint(const std::string &method, const std::string &path, ResponseHandler handler);
+
+    // The handler sees the whole request (headers, query, cookies, buffered body, connection)
+    void add_endpoint(const std::string &method, const std::string &path, ContextHandler handler);
+
+    // Serves files below a wildcard pattern such as "/static/*path"; a GET route answers HEAD too
+    void add_endpoint(const std::string &method, const std::string &path, std::shared_ptr<const StaticFiles> files);
+
+    // Forwards matching requests through proxy; a GET route answers HEAD too
+    void add_endpoint(const std::string &method, const std::string &path, std::shared_ptr<ReverseProxy> proxy);
+
+    // The handler gets the body piece by piece through the BodyReader it returns
+    void add_streaming_endpoint(const std::string &method, const std::string &path, StreamingHandler handler);
+
+    // The handler is a coroutine: while it is suspended in co_await the worker serves other
+    // connections. Reactor modes resume it on the worker's event loop; ThreadPool workers block.
+    void add_async_endpoint(const std::string &method, const std::string &path, AsyncHandler handler);
+
+    // Compile-time route table, consulted before the add_endpoint() routes. It must outlive
+    // the server, e.g. a static constexpr StaticRouteTable.
+    template <size_t N> void add_static_routes(const StaticRouteTable<N> &table) { router.set_static_routes(table); }
+
+    // Caches the 200 responses of an existing GET or HEAD route added with add_endpoint()
+    // (not files, streaming or coroutine routes) for policy.ttl_ms, keyed by method, target
+    // and policy.vary. Call before start(); returns false and logs when the route cannot be cached.
+    bool cache_endpoint(const std::string &method, const std::string &path, const ResponseCachePolicy &policy);
+
+    // Prometheus text exposition of the server's counters and latency histograms, for an
+    // endpoint such as add_endpoint("GET", "/metrics", ...). Each call sums every thread's shard.
+    HttpResponse metrics_response() const;
 };
 
 // Utility functions (defined in CPP)
-HTTPRequest parse_http_request(const std::string &request);
-std::string get_header_value(const std::string &headers, const std::string &name);
-int set_non_blocking(int fd); // Will be modified to only be used on the listening socket
+std::string_view get_header_value(std::string_view headers, std::string_view name);
+bool has_token(std::string_view value, std::string_view token);
+bool request_wants_keep_alive(const HTTPRequest &request);
+int set_non_blocking(int fd);
+void set_tcp_nodelay(int fd);
 
 #endif // HTTP_SERVER_H
@@ -0,0 +1,940 @@
+#include "http2.h"
+#include "log.h"
+#include "http-server.h"
+#include "metrics.h"
+#include <algorithm>
+#include <charconv>
+#include <iostream>
+
+// Frame types (RFC 9113 section 6)
+enum FrameType : uint8_t {
+    DATA = 0x0,
+    HEADERS = 0x1,
+    PRIORITY = 0x2,
+    RST_STREAM = 0x3,
+    SETTINGS = 0x4,
+    PUSH_PROMISE = 0x5,
+    PING = 0x6,
+    GOAWAY = 0x7,
+    WINDOW_UPDATE = 0x8,
+    CONTINUATION = 0x9,
+};
+
+// Frame flags
+constexpr uint8_t FLAG_END_STREAM = 0x1;
+constexpr uint8_t FLAG_ACK = 0x1;
+constexpr uint8_t FLAG_END_HEADERS = 0x4;
+constexpr uint8_t FLAG_PADDED = 0x8;
+constexpr uint8_t FLAG_PRIORITY = 0x20;
+
+// Settings identifiers
+constexpr uint16_t SETTINGS_HEADER_TABLE_SIZE = 0x1;
+constexpr uint16_t SETTINGS_ENABLE_PUSH = 0x2;
+constexpr uint16_t SETTINGS_MAX_CONCURRENT_STREAMS = 0x3;
+constexpr uint16_t SETTINGS_INITIAL_WINDOW_SIZE = 0x4;
+constexpr uint16_t SETTINGS_MAX_FRAME_SIZE = 0x5;
+constexpr uint16_t SETTINGS_MAX_HEADER_LIST_SIZE = 0x6;
+
+constexpr size_t FRAME_HEADER_SIZE = 9;
+constexpr size_t MAX_FRAME_SIZE = 16384; // What we accept: SETTINGS_MAX_FRAME_SIZE is left at its default
+constexpr int64_t MAX_WINDOW = 0x7fffffff;
+
+static uint32_t read_u32(const char *p) {
+    const unsigned char *u = reinterpret_cast<const unsigned char *>(p);
+    return (uint32_t(u[0]) << 24) | (uint32_t(u[1]) << 16) | (uint32_t(u[2]) << 8) | u[3];
+}
+
+static void put_u32(char *p, uint32_t value) {
+    p[0] = static_cast<char>(value >> 24);
+    p[1] = static_cast<char>(value >> 16);
+    p[2] = static_cast<char>(value >> 8);
+    p[3] = static_cast<char>(value);
+}
+
+static void put_frame_header(char *p, size_t length, uint8_t type, uint8_t flags, uint32_t stream_id) {
+    p[0] = static_cast<char>(length >> 16);
+    p[1] = static_cast<char>(length >> 8);
+    p[2] = static_cast<char>(length);
+    p[3] = static_cast<char>(type);
+    p[4] = static_cast<char>(flags);
+    put_u32(p + 5, stream_id & 0x7fffffff);
+}
+
+// HTTP/1.1 connection-specific fields, which HTTP/2 forbids (RFC 9113 section 8.2.2)
+static bool is_connection_header(std::string_view lower_name) {
+    return lower_name == "connection" || lower_name == "keep-alive" || lower_name == "proxy-connection" ||
+           lower_name == "transfer-encoding" || lower_name == "upgrade";
+}
+
+// HTTP2-Settings is base64url without padding (RFC 7540 section 3.2.1)
+static bool decode_base64url(std::string_view in, std::string &out) {
+    uint32_t buffer = 0;
+    int bits = 0;
+    for (char c : in) {
+        int value;
+        if (c >= 'A' && c <= 'Z') {
+            value = c - 'A';
+        } else if (c >= 'a' && c <= 'z') {
+            value = c - 'a' + 26;
+        } else if (c >= '0' && c <= '9') {
+            value = c - '0' + 52;
+        } else if (c == '-' || c == '+') {
+            value = 62;
+        } else if (c == '_' || c == '/') {
+            value = 63;
+        } else if (c == '=') {
+            break;
+        } else {
+            return false;
+        }
+        buffer = (buffer << 6) | static_cast<uint32_t>(value);
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            out += static_cast<char>(buffer >> bits);
+        }
+    }
+    return true;
+}
+
+struct Http2Session::Stream {
+    uint32_t id = 0;
+
+    // Request: the decoded fields, which request's views point into
+    std::vector<HpackField> fields;
+    HTTPRequest request;
+    int64_t declared_length = -1; // content-length, when sent
+    size_t body_received = 0;
+    int64_t receive_window = HTTP2_STREAM_WINDOW;
+    bool remote_closed = false; // END_STREAM received
+    bool discarding = false;    // Answered before its body ended; the rest is dropped
+
+    std::unique_ptr<BodyReader> reader;
+    HttpResponse pending_response;
+    ResponseTask pending_task;
+    AsyncResponseRef async;
+
+    // Response
+    bool answered = false;
+    ResponseParts response;
+    size_t body_sent = 0;
+    int64_t send_window = 0;
+
+    uint64_t started_ns = 0;
+    uint32_t route = 0;
+};
+
+Http2Session::Http2Session(HttpServer &owner, std::function<void()> async_wake, const ConnectionInfo &info)
+    : server(owner), wake(std::move(async_wake)), connection(info),
+      max_header_list_size(header_size_limit(owner.config.max_header_size) + MAX_HEADERS * HpackTable::ENTRY_OVERHEAD),
+      max_streams(owner.config.http2_max_streams) {
+    connection.http2 = true;
+}
+
+Http2Session::~Http2Session() = default;
+
+// --- Output ---
+
+void Http2Session::write_frame_header(OutputQueue &out, size_t length, uint8_t type, uint8_t flags,
+                                      uint32_t stream_id) {
+    char header[FRAME_HEADER_SIZE];
+    put_frame_header(header, length, type, flags, stream_id);
+    out.append_copy(std::string_view(header, sizeof(header)));
+}
+
+void Http2Session::write_settings(OutputQueue &out) {
+    const std::pair<uint16_t, uint32_t> settings[] = {
+        {SETTINGS_MAX_CONCURRENT_STREAMS, max_streams},
+        {SETTINGS_INITIAL_WINDOW_SIZE, HTTP2_STREAM_WINDOW},
+        {SETTINGS_MAX_HEADER_LIST_SIZE, static_cast<uint32_t>(std::min<size_t>(max_header_list_size, UINT32_MAX))},
+    };
+    char frame[FRAME_HEADER_SIZE + sizeof(settings) / sizeof(settings[0]) * 6];
+    put_frame_header(frame, sizeof(frame) - FRAME_HEADER_SIZE, SETTINGS, 0, 0);
+    char *next = frame + FRAME_HEADER_SIZE;
+    for (const auto &[id, value] : settings) {
+        next[0] = static_cast<char>(id >> 8);
+        next[1] = static_cast<char>(id);
+        put_u32(next + 2, value);
+        next += 6;
+    }
+    out.append_copy(std::string_view(frame, sizeof(frame)));
+}
+
+void Http2Session::write_window_update(OutputQueue &out, uint32_t stream_id, uint32_t increment) {
+    char frame[FRAME_HEADER_SIZE + 4];
+    put_frame_header(frame, 4, WINDOW_UPDATE, 0, stream_id);
+    put_u32(frame + FRAME_HEADER_SIZE, increment);
+    out.append_copy(std::string_view(frame, sizeof(frame)));
+}
+
+void Http2Session::write_rst_stream(OutputQueue &out, uint32_t stream_id, ErrorCode code) {
+    char frame[FRAME_HEADER_SIZE + 4];
+    put_frame_header(frame, 4, RST_STREAM, 0, stream_id);
+    put_u32(frame + FRAME_HEADER_SIZE, code);
+    out.append_copy(std::string_view(frame, sizeof(frame)));
+}
+
+void Http2Session::connection_error(OutputQueue &out, ErrorCode code) {
+    char frame[FRAME_HEADER_SIZE + 8];
+    put_frame_header(frame, 8, GOAWAY, 0, 0);
+    put_u32(frame + FRAME_HEADER_SIZE, last_stream_id);
+    put_u32(frame + FRAME_HEADER_SIZE + 4, code);
+    out.append_copy(std::string_view(frame, sizeof(frame)));
+    failed = true;
+}
+
+void Http2Session::start(OutputQueue &out) {
+    write_settings(out);
+    write_window_update(out, 0, HTTP2_CONNECTION_WINDOW - 65535);
+}
+
+// --- Settings ---
+
+Http2Session::ErrorCode Http2Session::apply_settings(std::string_view payload) {
+    if (payload.size() % 6 != 0) {
+        return FRAME_SIZE_ERROR;
+    }
+    for (size_t i = 0; i < payload.size(); i += 6) {
+        uint16_t id = static_cast<uint16_t>((uint8_t(payload[i]) << 8) | uint8_t(payload[i + 1]));
+        uint32_t value = read_u32(payload.data() + i + 2);
+        switch (id) {
+        case SETTINGS_HEADER_TABLE_SIZE:
+            encoder.set_peer_table_size(value);
+            break;
+        case SETTINGS_ENABLE_PUSH:
+            if (value > 1) {
+                return PROTOCOL_ERROR;
+            }
+            break;
+        case SETTINGS_INITIAL_WINDOW_SIZE: {
+            if (value > MAX_WINDOW) {
+                return FLOW_CONTROL_ERROR;
+            }
+            // Applies to every open stream, retroactively (RFC 9113 section 6.9.2)
+            int64_t delta = static_cast<int64_t>(value) - peer_initial_window;
+            for (auto &[stream_id, stream] : streams) {
+                stream->send_window += delta;
+                if (stream->send_window > MAX_WINDOW) {
+                    return FLOW_CONTROL_ERROR;
+                }
+            }
+            peer_initial_window = value;
+            break;
+        }
+        case SETTINGS_MAX_FRAME_SIZE:
+            if (value < 16384 || value > 16777215) {
+                return PROTOCOL_ERROR;
+            }
+            peer_max_frame_size = value;
+            break;
+        default:
+            break; // MAX_CONCURRENT_STREAMS only limits pushes; MAX_HEADER_LIST_SIZE is advisory
+        }
+    }
+    return NO_ERROR;
+}
+
+bool Http2Session::accept_upgrade_settings(std::string_view settings) {
+    std::string payload;
+    return decode_base64url(settings, payload) && apply_settings(payload) == NO_ERROR;
+}
+
+bool Http2Session::on_settings(uint8_t flags, std::string_view payload, OutputQueue &out) {
+    if (flags & FLAG_ACK) {
+        if (!payload.empty()) {
+            connection_error(out, FRAME_SIZE_ERROR);
+            return false;
+        }
+        return true;
+    }
+    ErrorCode error = apply_settings(payload);
+    if (error != NO_ERROR) {
+        connection_error(out, error);
+        return false;
+    }
+    settings_received = true;
+    write_frame_header(out, 0, SETTINGS, FLAG_ACK, 0);
+    return true;
+}
+
+// --- Frames ---
+
+bool Http2Session::serve(InputBuffer &in, OutputQueue &out, size_t &requests_served) {
+    std::string_view input = in.view();
+    size_t pos = 0;
+
+    if (!preface_received) {
+        size_t length = std::min(input.size(), HTTP2_PREFACE.size());
+        if (input.substr(0, length) != HTTP2_PREFACE.substr(0, length)) {
+            in.consume(input.size());
+            connection_error(out, PROTOCOL_ERROR);
+            return false;
+        }
+        if (length < HTTP2_PREFACE.size()) {
+            return true;
+        }
+        pos = HTTP2_PREFACE.size();
+        preface_received = true;
+    }
+
+    // Payload views point into in, which is not touched until the loop ends
+    while (!failed && input.size() - pos >= FRAME_HEADER_SIZE) {
+        const char *header = input.data() + pos;
+        size_t length = (size_t(uint8_t(header[0])) << 16) | (size_t(uint8_t(header[1])) << 8) | uint8_t(header[2]);
+        uint8_t type = static_cast<uint8_t>(header[3]);
+        uint8_t flags = static_cast<uint8_t>(header[4]);
+        uint32_t stream_id = read_u32(header + 5) & 0x7fffffff;
+
+        if (length > MAX_FRAME_SIZE) {
+            connection_error(out, FRAME_SIZE_ERROR);
+            break;
+        }
+        if (input.size() - pos - FRAME_HEADER_SIZE < length) {
+            break;
+        }
+        std::string_view payload = input.substr(pos + FRAME_HEADER_SIZE, length);
+        pos += FRAME_HEADER_SIZE + length;
+
+        // The client's preface ends with its SETTINGS
+        if (!settings_received && (type != SETTINGS || (flags & FLAG_ACK))) {
+            connection_error(out, PROTOCOL_ERROR);
+            break;
+        }
+        on_frame(type, flags, stream_id, payload, out, requests_served);
+    }
+
+    in.consume(failed ? input.size() : pos);
+    if (failed) {
+        return false;
+    }
+    collect_async(out);
+    pump(out);
+    return !(goaway_received && streams.empty());
+}
+
+bool Http2Session::on_frame(uint8_t type, uint8_t flags, uint32_t stream_id, std::string_view payload,
+                            OutputQueue &out, size_t &requests_served) {
+    // A header block is indivisible: nothing but its CONTINUATION frames may come in between
+    if (header_stream != 0 && (type != CONTINUATION || stream_id != header_stream)) {
+        connection_error(out, PROTOCOL_ERROR);
+        return false;
+    }
+
+    switch (type) {
+    case DATA:
+        return on_data(flags, stream_id, payload, out);
+    case HEADERS:
+        return on_headers(flags, stream_id, payload, out, requests_served);
+    case PRIORITY:
+        // Deprecated (RFC 9113 section 5.3.2): checked, then ignored
+        if (stream_id == 0) {
+            connection_error(out, PROTOCOL_ERROR);
+            return false;
+        }
+        if (payload.size() != 5) {
+            write_rst_stream(out, stream_id, FRAME_SIZE_ERROR);
+            drop_stream(stream_id);
+        }
+        return true;
+    case RST_STREAM:
+        if (stream_id == 0 || stream_id > last_stream_id) {
+            connection_error(out, PROTOCOL_ERROR);
+            return false;
+        }
+        if (payload.size() != 4) {
+            connection_error(out, FRAME_SIZE_ERROR);
+            return false;
+        }
+        drop_stream(stream_id);
+        return true;
+    case SETTINGS:
+        if (stream_id != 0) {
+            connection_error(out, PROTOCOL_ERROR);
+            return false;
+        }
+        return on_settings(flags, payload, out);
+    case PUSH_PROMISE:
+        connection_error(out, PROTOCOL_ERROR); // Clients cannot push
+        return false;
+    case PING:
+        if (stream_id != 0) {
+            connection_error(out, PROTOCOL_ERROR);
+            return false;
+        }
+        if (payload.size() != 8) {
+            connection_error(out, FRAME_SIZE_ERROR);
+            return false;
+        }
+        if (!(flags & FLAG_ACK)) {
+            write_frame_header(out, 8, PING, FLAG_ACK, 0);
+            out.append_copy(payload);
+        }
+        return true;
+    case GOAWAY:
+        if (stream_id != 0) {
+            connection_error(out, PROTOCOL_ERROR);
+            return false;
+        }
+        goaway_received = true; // Streams already open still get their responses
+        return true;
+    case WINDOW_UPDATE:
+        return on_window_update(stream_id, payload, out);
+    case CONTINUATION:
+        if (header_stream == 0) {
+            connection_error(out, PROTOCOL_ERROR);
+            return false;
+        }
+        if (header_block.size() + payload.size() > max_header_list_size * 2) {
+            connection_error(out, ENHANCE_YOUR_CALM);
+            return false;
+        }
+        header_block.append(payload);
+        if (flags & FLAG_END_HEADERS) {
+            return on_header_block(out, requests_served);
+        }
+        return true;
+    default:
+        return true; // Unknown frame types are ignored
+    }
+}
+
+bool Http2Session::on_headers(uint8_t flags, uint32_t stream_id, std::string_view payload, OutputQueue &out,
+                              size_t &requests_served) {
+    if (stream_id == 0 || stream_id % 2 == 0) {
+        connection_error(out, PROTOCOL_ERROR);
+        return false;
+    }
+    size_t offset = 0;
+    size_t padding = 0;
+    if (flags & FLAG_PADDED) {
+        if (payload.empty()) {
+            connection_error(out, PROTOCOL_ERROR);
+            return false;
+        }
+        padding = static_cast<uint8_t>(payload[0]);
+        offset = 1;
+    }
+    if (flags & FLAG_PRIORITY) {
+        offset += 5;
+    }
+    if (offset + padding > payload.size()) {
+        connection_error(out, PROTOCOL_ERROR);
+        return false;
+    }
+
+    header_stream = stream_id;
+    header_flags = flags;
+    header_block.assign(payload.substr(offset, payload.size() - offset - padding));
+    if (flags & FLAG_END_HEADERS) {
+        return on_header_block(out, requests_served);
+    }
+    return true;
+}
+
+bool Http2Session::on_header_block(OutputQueue &out, size_t &requests_served) {
+    uint32_t stream_id = header_stream;
+    bool end_stream = (header_flags & FLAG_END_STREAM) != 0;
+    header_stream = 0;
+
+    auto it = streams.find(stream_id);
+    if (it != streams.end() || stream_id <= last_stream_id) {
+        // Trailers, or a block for a stream already closed: decoded for the table's sake only
+        std::vector<HpackField> trailers;
+        if (decoder.decode(header_block, trailers, max_header_list_size) == HpackDecoder::Status::Error) {
+            connection_error(out, COMPRESSION_ERROR);
+            return false;
+        }
+        if (it == streams.end()) {
+            return true;
+        }
+        Stream &stream = *it->second;
+        if (stream.remote_closed || !end_stream) {
+            write_rst_stream(out, stream_id, PROTOCOL_ERROR);
+            drop_stream(stream_id);
+            return true;
+        }
+        stream.remote_closed = true;
+        --receiving_bodies;
+        if (!stream.discarding) {
+            end_stream_body(stream, out);
+        }
+        return true;
+    }
+
+    last_stream_id = stream_id;
+    auto stream = std::make_unique<Stream>();
+    stream->id = stream_id;
+    HpackDecoder::Status status = decoder.decode(header_block, stream->fields, max_header_list_size);
+    if (status == HpackDecoder::Status::Error) {
+        connection_error(out, COMPRESSION_ERROR);
+        return false;
+    }
+    if (streams.size() >= max_streams || goaway_received) {
+        write_rst_stream(out, stream_id, REFUSED_STREAM);
+        return true;
+    }
+
+    stream->send_window = peer_initial_window;
+    stream->remote_closed = end_stream;
+    Stream &added = *stream;
+    streams.emplace(stream_id, std::move(stream));
+    if (!end_stream) {
+        ++receiving_bodies;
+    }
+
+    bool too_many = status == HpackDecoder::Status::TooLarge;
+    if (!too_many && !build_request(added, too_many)) {
+        write_rst_stream(out, stream_id, PROTOCOL_ERROR);
+        drop_stream(stream_id);
+        return true;
+    }
+    if (too_many) {
+        ++requests_served;
+        added.started_ns = monotonic_ns();
+        added.discarding = true;
+        respond(added, status_response(431), out);
+        return true;
+    }
+    begin_stream(added, end_stream, out, requests_served);
+    return true;
+}
+
+bool Http2Session::build_request(Stream &stream, bool &too_many) {
+    HTTPRequest &request = stream.request;
+    request = HTTPRequest();
+    request.version = "HTTP/2.0";
+    request.version_minor = 1; // Handlers see HTTP/1.1 semantics
+
+    std::string_view scheme;
+    std::string_view authority;
+    bool regular_seen = false;
+    for (const HpackField &field : stream.fields) {
+        std::string_view name = field.name;
+        if (name.empty() || std::any_of(name.begin(), name.end(), [](char c) { return c >= 'A' && c <= 'Z'; })) {
+            return false;
+        }
+        if (name[0] == ':') {
+            // Pseudo-headers come first, once each
+            std::string_view *slot = nullptr;
+            if (name == ":method") {
+                slot = &request.method;
+            } else if (name == ":path") {
+                slot = &request.path;
+            } else if (name == ":scheme") {
+                slot = &scheme;
+            } else if (name == ":authority") {
+                slot = &authority;
+            }
+            if (regular_seen || !slot || !slot->empty()) {
+                return false;
+            }
+            *slot = field.value;
+            continue;
+        }
+        regular_seen = true;
+        if (is_connection_header(name) || (name == "te" && field.value != "trailers")) {
+            return false;
+        }
+        if (name == "content-length") {
+            uint64_t length = 0;
+            auto [end, error] = std::from_chars(field.value.data(), field.value.data() + field.value.size(), length);
+            if (error != std::errc() || end != field.value.data() + field.value.size()) {
+                return false;
+            }
+            stream.declared_length = static_cast<int64_t>(length);
+        }
+        if (request.header_count == MAX_HEADERS) {
+            too_many = true;
+            return true;
+        }
+        request.headers[request.header_count++] = HttpHeader{name, field.value};
+    }
+    if (request.method.empty() || request.path.empty() || scheme.empty()) {
+        return false; // Includes CONNECT, which is not supported
+    }
+    // Handlers look for Host, which HTTP/2 carries as :authority
+    if (!authority.empty() && !request.has_header("host")) {
+        if (request.header_count == MAX_HEADERS) {
+            too_many = true;
+            return true;
+        }
+        request.headers[request.header_count++] = HttpHeader{"host", authority};
+    }
+    request.content_length = stream.declared_length > 0 ? static_cast<size_t>(stream.declared_length) : 0;
+    return true;
+}
+
+bool Http2Session::on_data(uint8_t flags, uint32_t stream_id, std::string_view payload, OutputQueue &out) {
+    if (stream_id == 0) {
+        connection_error(out, PROTOCOL_ERROR);
+        return false;
+    }
+    // Padding counts against the windows too
+    connection_receive_window -= static_cast<int64_t>(payload.size());
+    if (connection_receive_window < 0) {
+        connection_error(out, FLOW_CONTROL_ERROR);
+        return false;
+    }
+    if (HTTP2_CONNECTION_WINDOW - connection_receive_window >= HTTP2_CONNECTION_WINDOW / 2) {
+        uint32_t increment = static_cast<uint32_t>(HTTP2_CONNECTION_WINDOW - connection_receive_window);
+        write_window_update(out, 0, increment);
+        connection_receive_window += increment;
+    }
+
+    std::string_view data = payload;
+    if (flags & FLAG_PADDED) {
+        size_t padding = payload.empty() ? 0 : static_cast<uint8_t>(payload[0]);
+        if (payload.empty() || padding + 1 > payload.size()) {
+            connection_error(out, PROTOCOL_ERROR);
+            return false;
+        }
+        data = payload.substr(1, payload.size() - 1 - padding);
+    }
+
+    auto it = streams.find(stream_id);
+    if (it == streams.end()) {
+        if (stream_id > last_stream_id) {
+            connection_error(out, PROTOCOL_ERROR); // Idle stream
+            return false;
+        }
+        return true; // A stream we reset: the peer may not have seen it yet
+    }
+    Stream &stream = *it->second;
+    if (stream.remote_closed) {
+        write_rst_stream(out, stream_id, STREAM_CLOSED);
+        drop_stream(stream_id);
+        return true;
+    }
+    stream.receive_window -= static_cast<int64_t>(payload.size());
+    if (stream.receive_window < 0) {
+        write_rst_stream(out, stream_id, FLOW_CONTROL_ERROR);
+        drop_stream(stream_id);
+        return true;
+    }
+
+    stream.body_received += data.size();
+    if (!stream.discarding) {
+        size_t max_body_size = server.config.max_body_size;
+        if (max_body_size != 0 && stream.body_received > max_body_size) {
+            stream.discarding = true;
+            respond(stream, status_response(413), out);
+        } else if (stream.reader) {
+            try {
+                stream.reader->on_data(data);
+            } catch (const std::exception &e) {
+                log_line(LogLevel::Error, "Body reader threw: ", e.what());
+                stream.discarding = true;
+                respond(stream, status_response(500), out);
+            }
+        }
+    }
+
+    if (flags & FLAG_END_STREAM) {
+        stream.remote_closed = true;
+        --receiving_bodies;
+        if (stream.declared_length >= 0 && stream.body_received != static_cast<size_t>(stream.declared_length)) {
+            write_rst_stream(out, stream_id, PROTOCOL_ERROR); // Malformed (RFC 9113 section 8.1.1)
+            drop_stream(stream_id);
+        } else if (!stream.discarding) {
+            end_stream_body(stream, out);
+        }
+        return true;
+    }
+
+    // The bytes were handed on (or dropped) already: give the window back once half is used
+    if (HTTP2_STREAM_WINDOW - stream.receive_window >= HTTP2_STREAM_WINDOW / 2) {
+        uint32_t increment = static_cast<uint32_t>(HTTP2_STREAM_WINDOW - stream.receive_window);
+        write_window_update(out, stream_id, increment);
+        stream.receive_window += increment;
+    }
+    return true;
+}
+
+bool Http2Session::on_window_update(uint32_t stream_id, std::string_view payload, OutputQueue &out) {
+    if (payload.size() != 4) {
+        connection_error(out, FRAME_SIZE_ERROR);
+        return false;
+    }
+    int64_t increment = read_u32(payload.data()) & 0x7fffffff;
+
+    if (stream_id == 0) {
+        connection_send_window += increment;
+        if (increment == 0 || connection_send_window > MAX_WINDOW) {
+            connection_error(out, increment == 0 ? PROTOCOL_ERROR : FLOW_CONTROL_ERROR);
+            return false;
+        }
+        return true;
+    }
+    auto it = streams.find(stream_id);
+    if (it == streams.end()) {
+        if (stream_id > last_stream_id) {
+            connection_error(out, PROTOCOL_ERROR);
+            return false;
+        }
+        return true;
+    }
+    Stream &stream = *it->second;
+    stream.send_window += increment;
+    if (increment == 0 || stream.send_window > MAX_WINDOW) {
+        write_rst_stream(out, stream_id, increment == 0 ? PROTOCOL_ERROR : FLOW_CONTROL_ERROR);
+        drop_stream(stream_id);
+    }
+    return true;
+}
+
+// --- Streams ---
+
+void Http2Session::begin_stream(Stream &stream, bool end_stream, OutputQueue &out, size_t &requests_served) {
+    ++requests_served;
+    connection.requests_served = requests_served;
+    stream.started_ns = monotonic_ns();
+
+    if (end_stream) {
+        ResponseTask task;
+        HttpResponse response = server.get_response(stream.request, nullptr, &task, &stream.route, nullptr, &connection);
+        if (task) {
+            start_async(stream, std::move(task), out);
+        } else {
+            respond(stream, std::move(response), out);
+        }
+        return;
+    }
+
+    size_t max_body_size = server.config.max_body_size;
+    if (max_body_size != 0 && stream.declared_length > static_cast<int64_t>(max_body_size)) {
+        stream.discarding = true;
+        respond(stream, status_response(413), out);
+        return;
+    }
+    // The body arrives in DATA frames, for the streaming reader or to be discarded
+    stream.pending_response =
+        server.get_response(stream.request, &stream.reader, &stream.pending_task, &stream.route, nullptr, &connection);
+}
+
+void Http2Session::end_stream_body(Stream &stream, OutputQueue &out) {
+    if (stream.pending_task) {
+        start_async(stream, std::move(stream.pending_task), out);
+        return;
+    }
+    HttpResponse response = std::move(stream.pending_response);
+    if (stream.reader) {
+        try {
+            response = stream.reader->on_complete();
+        } catch (const std::exception &e) {
+            log_line(LogLevel::Error, "Body reader threw: ", e.what());
+            response = status_response(500);
+        }
+        stream.reader.reset();
+    }
+    respond(stream, std::move(response), out);
+}
+
+void Http2Session::start_async(Stream &stream, ResponseTask task, OutputQueue &out) {
+    std::shared_ptr<AsyncResponse> slot = HttpServer::launch_async(std::move(task), wake);
+    if (slot->response) {
+        respond(stream, std::move(*slot->response), out);
+        return;
+    }
+    stream.async = AsyncResponseRef(std::move(slot));
+    suspended.push_back(stream.id);
+}
+
+void Http2Session::collect_async(OutputQueue &out) {
+    size_t kept = 0;
+    for (uint32_t stream_id : suspended) {
+        auto it = streams.find(stream_id);
+        if (it == streams.end()) {
+            continue; // Reset by the peer
+        }
+        Stream &stream = *it->second;
+        if (!stream.async->response) {
+            suspended[kept++] = stream_id;
+            continue;
+        }
+        HttpResponse response = std::move(*stream.async->response);
+        stream.async.reset();
+        respond(stream, std::move(response), out);
+    }
+    suspended.resize(kept);
+}
+
+void Http2Session::respond(Stream &stream, HttpResponse response, OutputQueue &out) {
+    if (stream.answered) {
+        return;
+    }
+    stream.answered = true;
+    stream.reader.reset();
+    stream.pending_task = ResponseTask();
+
+    // The stream keeps its request (and the fields its views point into) until it is dropped
+    compress_response(response, accepted_codings(stream.request.header("Accept-Encoding")), server.config.compression);
+    if (stream.request.method == "HEAD") {
+        response.omit_body();
+    }
+    stream.response = std::move(response).take_parts();
+    const ResponseParts &parts = stream.response;
+    ThreadMetrics::local().record_response(stream.route, parts.status, monotonic_ns() - stream.started_ns);
+
+    std::string block;
+    encoder.begin_block(block);
+    encoder.encode_status(block, parts.status);
+    std::string name;
+    std::string_view lines = parts.headers;
+    while (!lines.empty()) {
+        size_t line_end = lines.find("\r\n");
+        std::string_view line = lines.substr(0, line_end);
+        lines.remove_prefix(line_end == std::string_view::npos ? lines.size() : line_end + 2);
+
+        size_t colon = line.find(':');
+        if (colon == std::string_view::npos || colon == 0) {
+            continue;
+        }
+        name.assign(line.substr(0, colon));
+        std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return std::tolower(c); });
+        if (is_connection_header(name)) {
+            continue;
+        }
+        std::string_view value = line.substr(colon + 1);
+        while (!value.empty() && (value.front() == ' ' || value.front() == '\t')) {
+            value.remove_prefix(1);
+        }
+        encoder.encode(block, name, value);
+    }
+    if (parts.status >= 200 && parts.status != 204 && parts.status != 304) {
+        char digits[20];
+        char *end = std::to_chars(digits, digits + sizeof(digits), parts.content_length).ptr;
+        encoder.encode(block, "content-length", std::string_view(digits, end - digits), false);
+    }
+
+    // HEADERS, then CONTINUATION for whatever does not fit one frame
+    uint8_t end_stream = parts.has_body ? 0 : FLAG_END_STREAM;
+    size_t offset = 0;
+    do {
+        size_t length = std::min<size_t>(block.size() - offset, peer_max_frame_size);
+        bool last = offset + length == block.size();
+        std::string frame(FRAME_HEADER_SIZE, '\0');
+        put_frame_header(frame.data(), length, offset == 0 ? HEADERS : CONTINUATION,
+                         static_cast<uint8_t>((offset == 0 ? end_stream : 0) | (last ? FLAG_END_HEADERS : 0)),
+                         stream.id);
+        frame.append(block, offset, length);
+        out.append_owned(std::move(frame));
+        offset += length;
+    } while (offset < block.size());
+
+    // The stream is closed, or its body sent, by pump(): never while a frame is being handled
+    send_queue.push_back(stream.id);
+}
+
+void Http2Session::pump(OutputQueue &out) {
+    size_t blocked = 0; // Consecutive streams without stream window
+    while (!send_queue.empty() && blocked < send_queue.size()) {
+        uint32_t stream_id = send_queue.front();
+        send_queue.pop_front();
+        auto it = streams.find(stream_id);
+        if (it == streams.end()) {
+            continue;
+        }
+        Stream &stream = *it->second;
+        const ResponseParts &parts = stream.response;
+        size_t remaining = parts.has_body ? parts.body_size() - stream.body_sent : 0;
+        if (remaining == 0) {
+            close_stream(stream_id, out);
+            continue;
+        }
+        if (connection_send_window <= 0) {
+            send_queue.push_front(stream_id);
+            break;
+        }
+        if (stream.send_window <= 0) {
+            send_queue.push_back(stream_id);
+            ++blocked;
+            continue;
+        }
+        blocked = 0;
+
+        size_t length = std::min<size_t>({remaining, peer_max_frame_size, static_cast<size_t>(stream.send_window),
+                                          static_cast<size_t>(connection_send_window)});
+        bool last = length == remaining;
+        write_frame_header(out, length, DATA, last ? FLAG_END_STREAM : 0, stream_id);
+        if (parts.body_fd >= 0) {
+            out.append_file(parts.body_fd, parts.body_offset + static_cast<off_t>(stream.body_sent), length,
+                            parts.owner);
+        } else {
+            out.append_borrowed(parts.body.substr(stream.body_sent, length), parts.owner);
+        }
+        stream.body_sent += length;
+        stream.send_window -= static_cast<int64_t>(length);
+        connection_send_window -= static_cast<int64_t>(length);
+
+        if (last) {
+            close_stream(stream_id, out);
+        } else {
+            send_queue.push_back(stream_id);
+        }
+    }
+}
+
+void Http2Session::close_stream(uint32_t stream_id, OutputQueue &out) {
+    auto it = streams.find(stream_id);
+    if (it == streams.end()) {
+        return;
+    }
+    if (!it->second->remote_closed) {
+        // Answered early: ask the client to stop sending the body (RFC 9113 section 8.1)
+        write_rst_stream(out, stream_id, NO_ERROR);
+    }
+    drop_stream(stream_id);
+}
+
+void Http2Session::drop_stream(uint32_t stream_id) {
+    auto it = streams.find(stream_id);
+    if (it == streams.end()) {
+        return;
+    }
+    if (!it->second->remote_closed) {
+        --receiving_bodies;
+    }
+    streams.erase(it); // A suspended handler is cancelled with its AsyncResponseRef
+}
+
+// --- h2c Upgrade ---
+
+void Http2Session::start_upgraded_stream(const HTTPRequest &request, OutputQueue &out, size_t &requests_served) {
+    auto stream = std::make_unique<Stream>();
+    stream->id = 1;
+    stream->send_window = peer_initial_window;
+    stream->remote_closed = true;
+    stream->fields.push_back(HpackField{":method", std::string(request.method)});
+    stream->fields.push_back(HpackField{":scheme", "http"});
+    stream->fields.push_back(HpackField{":path", std::string(request.path)});
+    for (size_t i = 0; i < request.header_count; ++i) {
+        std::string name(request.headers[i].name);
+        std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return std::tolower(c); });
+        if (is_connection_header(name) || name == "http2-settings" || name == "te") {
+            continue;
+        }
+        stream->fields.push_back(HpackField{std::move(name), std::string(request.headers[i].value)});
+    }
+    last_stream_id = 1;
+
+    Stream &added = *stream;
+    streams.emplace(1, std::move(stream));
+    bool too_many = false;
+    if (!build_request(added, too_many) || too_many) {
+        ++requests_served;
+        added.started_ns = monotonic_ns();
+        respond(added, status_response(400), out);
+        return;
+    }
+    begin_stream(added, true, out, requests_served);
+}
+
+TimeoutPhase Http2Session::timeout_phase(bool input_buffered) const {
+    if (!send_queue.empty())
+        return TimeoutPhase::Write; // Responses waiting for the peer to open its window
+    if (!suspended.empty())
+        return TimeoutPhase::Handler;
+    if (receiving_bodies != 0)
+        return TimeoutPhase::Body;
+    return input_buffered ? TimeoutPhase::Header : TimeoutPhase::Idle;
+}
@@ -0,0 +1,166 @@
+#ifndef HTTP2_H
+#define HTTP2_H
+
+#include "arena.h"
+#include "hpack.h"
+#include "http-parser.h"
+#include "http-response.h"
+#include "router.h"
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// What a prior-knowledge HTTP/2 client sends before its first frame (RFC 9113 section 3.4)
+constexpr std::string_view HTTP2_PREFACE = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+
+// Receive windows we grant: per stream through SETTINGS_INITIAL_WINDOW_SIZE, and for the
+// whole connection through a WINDOW_UPDATE right after our SETTINGS
+#define HTTP2_STREAM_WINDOW (1u << 20)
+#define HTTP2_CONNECTION_WINDOW (16u << 20)
+
+class HttpServer;
+enum class TimeoutPhase : uint8_t;
+
+/**
+ * @brief Server side of one HTTP/2 connection (RFC 9113) over cleartext: frame parsing,
+ * HPACK, flow control both ways and any number of concurrent streams, each dispatched to
+ * the server's routes like an HTTP/1.1 request.
+ *
+ * serve() is the HTTP/2 counterpart of HttpServer::serve_pipelined() and is driven the same
+ * way, by every event loop and by ThreadPool workers. Streams are independent: a coroutine
+ * handler suspended on one does not hold up the others, and its response goes out when the
+ * loop's wake callback brings the connection back to serve(). Response bodies are queued by
+ * reference in DATA frames as the peer's connection and stream windows allow; request body
+ * windows are replenished as the bytes are handed to the route.
+ */
+class Http2Session {
+  private:
+    struct Stream;
+
+    HttpServer &server;
+    std::function<void()> wake; // RequestState::async_wake of the connection
+    ConnectionInfo connection;  // For context handlers; requests_served is kept current
+
+    HpackDecoder decoder;
+    HpackEncoder encoder;
+
+    std::unordered_map<uint32_t, std::unique_ptr<Stream>> streams;
+    std::deque<uint32_t> send_queue;       // Streams with response bytes waiting for window
+    std::vector<uint32_t> suspended;       // Streams whose coroutine handler has not answered yet
+    uint32_t last_stream_id = 0;           // Highest client stream seen
+    size_t receiving_bodies = 0;           // Streams still reading a request body
+
+    bool preface_received = false;
+    bool settings_received = false;
+    bool goaway_received = false;
+
+    // Header block being assembled from HEADERS and CONTINUATION frames
+    uint32_t header_stream = 0;
+    uint8_t header_flags = 0;
+    std::string header_block;
+
+    // Peer settings
+    uint32_t peer_max_frame_size = 16384;
+    int64_t peer_initial_window = 65535;
+
+    int64_t connection_send_window = 65535;
+    int64_t connection_receive_window = HTTP2_CONNECTION_WINDOW;
+
+    size_t max_header_list_size;
+    uint32_t max_streams;
+
+    enum ErrorCode : uint32_t {
+        NO_ERROR = 0x0,
+        PROTOCOL_ERROR = 0x1,
+        INTERNAL_ERROR = 0x2,
+        FLOW_CONTROL_ERROR = 0x3,
+        STREAM_CLOSED = 0x5,
+        FRAME_SIZE_ERROR = 0x6,
+        REFUSED_STREAM = 0x7,
+        CANCEL = 0x8,
+        COMPRESSION_ERROR = 0x9,
+        ENHANCE_YOUR_CALM = 0xb,
+    };
+
+    // Set by a connection error: the GOAWAY is queued and serve() returns false
+    bool failed = false;
+
+    void write_frame_header(OutputQueue &out, size_t length, uint8_t type, uint8_t flags, uint32_t stream_id);
+    void write_settings(OutputQueue &out);
+    void write_window_update(OutputQueue &out, uint32_t stream_id, uint32_t increment);
+    void write_rst_stream(OutputQueue &out, uint32_t stream_id, ErrorCode code);
+    void connection_error(OutputQueue &out, ErrorCode code);
+
+    // SETTINGS payload from a frame or the HTTP2-Settings header
+    ErrorCode apply_settings(std::string_view payload);
+
+    // One complete frame; returns false after a connection error
+    bool on_frame(uint8_t type, uint8_t flags, uint32_t stream_id, std::string_view payload, OutputQueue &out,
+                  size_t &requests_served);
+    bool on_headers(uint8_t flags, uint32_t stream_id, std::string_view payload, OutputQueue &out,
+                    size_t &requests_served);
+    bool on_header_block(OutputQueue &out, size_t &requests_served);
+    bool on_data(uint8_t flags, uint32_t stream_id, std::string_view payload, OutputQueue &out);
+    bool on_settings(uint8_t flags, std::string_view payload, OutputQueue &out);
+    bool on_window_update(uint32_t stream_id, std::string_view payload, OutputQueue &out);
+
+    // Builds the stream's HTTPRequest from its decoded fields; false for a malformed request.
+    // too_many is set when the fields do not fit HTTPRequest::headers (431).
+    static bool build_request(Stream &stream, bool &too_many);
+
+    // Routes a stream whose head is in; a body-less request is answered (or started) right away
+    void begin_stream(Stream &stream, bool end_stream, OutputQueue &out, size_t &requests_served);
+
+    // The request body is complete: runs what begin_stream() set up
+    void end_stream_body(Stream &stream, OutputQueue &out);
+
+    // Starts a coroutine handler; its response is sent now or once it resumes and finishes
+    void start_async(Stream &stream, ResponseTask task, OutputQueue &out);
+
+    // Queues HEADERS and, window permitting, DATA
+    void respond(Stream &stream, HttpResponse response, OutputQueue &out);
+
+    // Sends queued response bytes as far as the windows allow
+    void pump(OutputQueue &out);
+
+    // Our side of the stream is done: drops it, resetting it if the peer is still sending
+    void close_stream(uint32_t stream_id, OutputQueue &out);
+
+    // Forgets a stream, cancelling its handler if one is suspended
+    void drop_stream(uint32_t stream_id);
+
+    // Responses of suspended handlers that have finished since the last call
+    void collect_async(OutputQueue &out);
+
+  public:
+    Http2Session(HttpServer &owner, std::function<void()> async_wake, const ConnectionInfo &info);
+    ~Http2Session();
+
+    Http2Session(const Http2Session &) = delete;
+    Http2Session &operator=(const Http2Session &) = delete;
+
+    // h2c Upgrade: applies the base64url HTTP2-Settings header. false if it is malformed, in
+    // which case the request is served as HTTP/1.1.
+    bool accept_upgrade_settings(std::string_view settings);
+
+    // Queues our SETTINGS and connection window; call once, before the first serve()
+    void start(OutputQueue &out);
+
+    // h2c Upgrade: the request that asked for it becomes stream 1, already half-closed
+    void start_upgraded_stream(const HTTPRequest &request, OutputQueue &out, size_t &requests_served);
+
+    // Processes every complete frame in in (consuming it), answers finished handlers and queues
+    // what the windows allow. Returns false once the connection must close after out is sent.
+    bool serve(InputBuffer &in, OutputQueue &out, size_t &requests_served);
+
+    // For the connection's timer
+    TimeoutPhase timeout_phase(bool input_buffered) const;
+};
+
+#endif // HTTP2_H
@@ -0,0 +1,306 @@
+#include "io-uring.h"
+#include <errno.h>
+#include <stdexcept>
+#include <string>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <vector>
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params *params) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+static int sys_io_uring_register(int fd, unsigned opcode, const void *arg, unsigned nr_args) {
+    return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, nr_args));
+}
+
+IoUring::IoUring(unsigned entries, bool use_sqpoll, unsigned sqpoll_idle_ms) : sqpoll(use_sqpoll) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    // Multishot receives can post many completions per submission: give the CQ headroom
+    params.flags = IORING_SETUP_CLAMP | IORING_SETUP_CQSIZE;
+    params.cq_entries = entries * 4;
+    if (sqpoll) {
+        params.flags |= IORING_SETUP_SQPOLL;
+        params.sq_thread_idle = sqpoll_idle_ms;
+    } else {
+        // Completions are reaped at the next enter anyway: no need to interrupt the loop for them
+        params.flags |= IORING_SETUP_COOP_TASKRUN;
+    }
+
+    ring_fd = sys_io_uring_setup(entries, &params);
+    if (ring_fd < 0) {
+        throw std::runtime_error(std::string("io_uring_setup failed: ") + strerror(errno));
+    }
+    features = params.features;
+    enter_fd = ring_fd;
+
+    sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool single_mmap = has_feature(IORING_FEAT_SINGLE_MMAP);
+    if (single_mmap) {
+        sq_ring_size = cq_ring_size = sq_ring_size > cq_ring_size ? sq_ring_size : cq_ring_size;
+    }
+
+    sq_ring = mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd,
+                   IORING_OFF_SQ_RING);
+    if (sq_ring == MAP_FAILED) {
+        sq_ring = nullptr;
+        destroy();
+        throw std::runtime_error("mmap of the io_uring SQ ring failed");
+    }
+    if (single_mmap) {
+        cq_ring = sq_ring;
+    } else {
+        cq_ring = mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd,
+                       IORING_OFF_CQ_RING);
+        if (cq_ring == MAP_FAILED) {
+            cq_ring = nullptr;
+            destroy();
+            throw std::runtime_error("mmap of the io_uring CQ ring failed");
+        }
+    }
+
+    sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    void *sqe_map =
+        mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+    if (sqe_map == MAP_FAILED) {
+        destroy();
+        throw std::runtime_error("mmap of the io_uring SQE array failed");
+    }
+    sqes = static_cast<struct io_uring_sqe *>(sqe_map);
+
+    char *sq = static_cast<char *>(sq_ring);
+    sq_head = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+    sq_tail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    sq_flags = reinterpret_cast<unsigned *>(sq + params.sq_off.flags);
+    sq_mask = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    sq_entries = params.sq_entries;
+    sqe_tail = *sq_tail;
+
+    // SQE i always sits in array slot i, so the indirection array is filled once
+    unsigned *sq_array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    for (unsigned i = 0; i < sq_entries; ++i) {
+        sq_array[i] = i;
+    }
+
+    char *cq = static_cast<char *>(cq_ring);
+    cq_head = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    cq_tail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    cq_mask = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<struct io_uring_cqe *>(cq + params.cq_off.cqes);
+
+}
+
+IoUring::~IoUring() { destroy(); }
+
+bool IoUring::register_ring_fd() {
+    struct io_uring_rsrc_update ring_slot;
+    memset(&ring_slot, 0, sizeof(ring_slot));
+    ring_slot.offset = -1U;
+    ring_slot.data = static_cast<uint64_t>(ring_fd);
+    if (sys_io_uring_register(ring_fd, IORING_REGISTER_RING_FDS, &ring_slot, 1) != 1) {
+        return false;
+    }
+    enter_fd = static_cast<int>(ring_slot.offset);
+    enter_flags = IORING_ENTER_REGISTERED_RING;
+    return true;
+}
+
+void IoUring::destroy() {
+    if (sqes) {
+        munmap(sqes, sqes_size);
+        sqes = nullptr;
+    }
+    if (cq_ring && cq_ring != sq_ring) {
+        munmap(cq_ring, cq_ring_size);
+    }
+    cq_ring = nullptr;
+    if (sq_ring) {
+        munmap(sq_ring, sq_ring_size);
+        sq_ring = nullptr;
+    }
+    if (ring_fd != -1) {
+        // Closing the ring cancels whatever is still in flight
+        close(ring_fd);
+        ring_fd = -1;
+    }
+}
+
+bool IoUring::supports(std::initializer_list<uint8_t> opcodes) const {
+    std::vector<char> storage(sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op), 0);
+    auto *probe = reinterpret_cast<struct io_uring_probe *>(storage.data());
+    if (sys_io_uring_register(ring_fd, IORING_REGISTER_PROBE, probe, 256) < 0) {
+        return false;
+    }
+    for (uint8_t opcode : opcodes) {
+        if (opcode > probe->last_op || !(probe->ops[opcode].flags & IO_URING_OP_SUPPORTED)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+struct io_uring_sqe *IoUring::get_sqe() {
+    if (!reserve(1)) {
+        return nullptr;
+    }
+    struct io_uring_sqe *sqe = &sqes[sqe_tail & sq_mask];
+    ++sqe_tail;
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+bool IoUring::reserve(unsigned count) {
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        if (sq_entries - (sqe_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE)) >= count) {
+            return true;
+        }
+        if (sqpoll) {
+            // Let the poller thread catch up
+            flush();
+            enter(0, 0, IORING_ENTER_SQ_WAIT | (sq_thread_needs_wakeup() ? IORING_ENTER_SQ_WAKEUP : 0), nullptr,
+                  0);
+        } else {
+            submit();
+        }
+    }
+    return false;
+}
+
+void IoUring::flush() { __atomic_store_n(sq_tail, sqe_tail, __ATOMIC_RELEASE); }
+
+unsigned IoUring::unsubmitted() const { return sqe_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE); }
+
+bool IoUring::sq_thread_needs_wakeup() const {
+    // Pairs with the poller's barrier between setting NEED_WAKEUP and its last look at the
+    // tail: either it sees our new tail or we see that it went to sleep
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    return (__atomic_load_n(sq_flags, __ATOMIC_RELAXED) & IORING_SQ_NEED_WAKEUP) != 0;
+}
+
+int IoUring::enter(unsigned to_submit, unsigned min_complete, unsigned flags, const void *arg, size_t arg_size) {
+    return static_cast<int>(
+        syscall(__NR_io_uring_enter, enter_fd, to_submit, min_complete, flags | enter_flags, arg, arg_size));
+}
+
+int IoUring::submit() {
+    flush();
+    if (sqpoll) {
+        return sq_thread_needs_wakeup() ? enter(0, 0, IORING_ENTER_SQ_WAKEUP, nullptr, 0) : 0;
+    }
+    unsigned pending = unsubmitted();
+    return pending == 0 ? 0 : enter(pending, 0, 0, nullptr, 0);
+}
+
+int IoUring::submit_and_wait(int timeout_ms) {
+    flush();
+    unsigned flags = IORING_ENTER_GETEVENTS;
+    unsigned to_submit = 0;
+    if (sqpoll) {
+        if (sq_thread_needs_wakeup()) {
+            flags |= IORING_ENTER_SQ_WAKEUP;
+        }
+    } else {
+        to_submit = unsubmitted();
+    }
+
+    if (timeout_ms < 0) {
+        return enter(to_submit, 1, flags, nullptr, 0);
+    }
+    struct __kernel_timespec timeout;
+    timeout.tv_sec = timeout_ms / 1000;
+    timeout.tv_nsec = static_cast<long long>(timeout_ms % 1000) * 1000000;
+    struct io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    arg.ts = reinterpret_cast<uint64_t>(&timeout);
+    return enter(to_submit, 1, flags | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+}
+
+int IoUring::register_files_sparse(unsigned count) {
+    struct io_uring_rsrc_register files;
+    memset(&files, 0, sizeof(files));
+    files.nr = count;
+    files.flags = IORING_RSRC_REGISTER_SPARSE;
+    return sys_io_uring_register(ring_fd, IORING_REGISTER_FILES2, &files, sizeof(files)) < 0 ? -errno : 0;
+}
+
+int IoUring::update_file(unsigned slot, int file_fd) {
+    struct io_uring_rsrc_update update;
+    memset(&update, 0, sizeof(update));
+    update.offset = slot;
+    update.data = reinterpret_cast<uint64_t>(&file_fd);
+    return sys_io_uring_register(ring_fd, IORING_REGISTER_FILES_UPDATE, &update, 1) < 0 ? -errno : 0;
+}
+
+int IoUring::register_buffer_ring(struct io_uring_buf_ring *buffers, unsigned entries, uint16_t group) {
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = reinterpret_cast<uint64_t>(buffers);
+    reg.ring_entries = entries;
+    reg.bgid = group;
+    return sys_io_uring_register(ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0 ? -errno : 0;
+}
+
+int IoUring::unregister_buffer_ring(uint16_t group) {
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.bgid = group;
+    return sys_io_uring_register(ring_fd, IORING_UNREGISTER_PBUF_RING, &reg, 1) < 0 ? -errno : 0;
+}
+
+// --- BufferRing ---
+
+BufferRing::BufferRing(IoUring &owner, uint16_t group_id, unsigned buffer_count, unsigned buffer_size)
+    : ring(owner), group(group_id), count(buffer_count), size(buffer_size) {
+    if (count == 0 || (count & (count - 1)) != 0 || count > 32768) {
+        throw std::runtime_error("buffer ring size must be a power of two up to 32768");
+    }
+
+    ring_bytes = count * sizeof(struct io_uring_buf);
+    void *ring_map = mmap(nullptr, ring_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring_map == MAP_FAILED) {
+        throw std::runtime_error("mmap of the provided-buffer ring failed");
+    }
+    buffers = static_cast<struct io_uring_buf_ring *>(ring_map);
+
+    size_t storage_bytes = static_cast<size_t>(count) * size;
+    void *storage_map = mmap(nullptr, storage_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (storage_map == MAP_FAILED) {
+        munmap(buffers, ring_bytes);
+        throw std::runtime_error("mmap of the provided buffers failed");
+    }
+    storage = static_cast<char *>(storage_map);
+
+    int result = ring.register_buffer_ring(buffers, count, group);
+    if (result < 0) {
+        munmap(storage, storage_bytes);
+        munmap(buffers, ring_bytes);
+        throw std::runtime_error(std::string("IORING_REGISTER_PBUF_RING failed: ") + strerror(-result));
+    }
+
+    for (unsigned i = 0; i < count; ++i) {
+        recycle(static_cast<uint16_t>(i));
+    }
+}
+
+BufferRing::~BufferRing() {
+    ring.unregister_buffer_ring(group);
+    munmap(storage, static_cast<size_t>(count) * size);
+    munmap(buffers, ring_bytes);
+}
+
+void BufferRing::recycle(uint16_t buffer_id) {
+    // Not buffers->bufs: in C++ __DECLARE_FLEX_ARRAY puts a one-byte empty struct in front
+    // of it, moving the array off the start of the ring where the kernel expects it
+    struct io_uring_buf &buffer = reinterpret_cast<struct io_uring_buf *>(buffers)[tail & (count - 1)];
+    buffer.addr = reinterpret_cast<uint64_t>(data(buffer_id));
+    buffer.len = size;
+    buffer.bid = buffer_id;
+    ++tail;
+    // The tail overlays bufs[0].resv: publish it only once the entry is complete
+    __atomic_store_n(&buffers->tail, tail, __ATOMIC_RELEASE);
+}
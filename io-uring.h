@@ -0,0 +1,143 @@
+#ifndef IO_URING_H
+#define IO_URING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <linux/io_uring.h>
+
+/**
+ * @brief A submission/completion ring pair driven through the raw io_uring syscalls.
+ * SQEs are published with a release store of the SQ tail; io_uring_enter() is only needed
+ * to hand them to the kernel, and with SQPOLL not even that: a kernel thread polls the tail
+ * and the ring is entered only to wake it after it went idle, or to sleep for completions.
+ * Not thread-safe: each ring belongs to one event loop.
+ */
+class IoUring {
+  private:
+    int ring_fd = -1;
+    int enter_fd = -1; // Registered ring index when enter_flags says so, else ring_fd
+    unsigned enter_flags = 0;
+    unsigned features = 0;
+    bool sqpoll = false;
+
+    void *sq_ring = nullptr;
+    size_t sq_ring_size = 0;
+    void *cq_ring = nullptr; // Same mapping as sq_ring with IORING_FEAT_SINGLE_MMAP
+    size_t cq_ring_size = 0;
+    struct io_uring_sqe *sqes = nullptr;
+    size_t sqes_size = 0;
+
+    unsigned *sq_head = nullptr;
+    unsigned *sq_tail = nullptr;
+    unsigned *sq_flags = nullptr;
+    unsigned sq_mask = 0;
+    unsigned sq_entries = 0;
+    unsigned sqe_tail = 0; // Next SQE to hand out; published to *sq_tail by flush()
+
+    unsigned *cq_head = nullptr;
+    unsigned *cq_tail = nullptr;
+    unsigned cq_mask = 0;
+    struct io_uring_cqe *cqes = nullptr;
+
+    void destroy();
+    void flush();
+    unsigned unsubmitted() const;
+    bool sq_thread_needs_wakeup() const;
+    int enter(unsigned to_submit, unsigned min_complete, unsigned flags, const void *arg, size_t arg_size);
+
+  public:
+    // Throws std::runtime_error when the kernel refuses the ring (e.g. io_uring disabled)
+    IoUring(unsigned entries, bool use_sqpoll, unsigned sqpoll_idle_ms = 1000);
+    ~IoUring();
+
+    IoUring(const IoUring &) = delete;
+    IoUring &operator=(const IoUring &) = delete;
+
+    int fd() const { return ring_fd; }
+
+    // Registers the ring fd with the calling thread, so its enters skip the fd table lookup.
+    // The registration is per thread: call it from the thread that drives the ring.
+    bool register_ring_fd();
+    bool has_feature(unsigned feature) const { return (features & feature) != 0; }
+
+    // True if every opcode is known to the kernel (IORING_REGISTER_PROBE)
+    bool supports(std::initializer_list<uint8_t> opcodes) const;
+
+    // Next free SQE, zeroed (an untouched one is a NOP). Submits to make room when the
+    // queue is full; nullptr only if the kernel still has not consumed anything.
+    struct io_uring_sqe *get_sqe();
+
+    // Makes room for count SQEs, submitting first if needed, so the next count get_sqe()
+    // calls cannot split a linked chain across two submissions
+    bool reserve(unsigned count);
+
+    // Publishes queued SQEs and enters the kernel only if it would not find them itself
+    int submit();
+
+    // submit(), then sleeps until a completion is ready or timeout_ms passed (-1 = no limit).
+    // Returns -1 with errno ETIME on timeout.
+    int submit_and_wait(int timeout_ms);
+
+    // Calls on_cqe for every completion ready now; returns how many there were
+    template <class F> unsigned for_each_completion(F &&on_cqe);
+
+    // Registered files: a table of count empty slots, filled later with
+    // IORING_OP_FILES_UPDATE or update_file(). Returns 0 or -errno.
+    int register_files_sparse(unsigned count);
+    int update_file(unsigned slot, int file_fd);
+
+    // Provided buffer rings (see BufferRing). Return 0 or -errno.
+    int register_buffer_ring(struct io_uring_buf_ring *buffers, unsigned entries, uint16_t group);
+    int unregister_buffer_ring(uint16_t group);
+};
+
+template <class F> unsigned IoUring::for_each_completion(F &&on_cqe) {
+    unsigned head = *cq_head;
+    unsigned seen = 0;
+    while (true) {
+        unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+        if (head == tail) {
+            return seen;
+        }
+        // A slot is not reused before the head passes it, so the callback may queue new SQEs
+        for (; head != tail; ++head, ++seen) {
+            on_cqe(cqes[head & cq_mask]);
+        }
+        __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+    }
+}
+
+/**
+ * @brief count buffers of size bytes, shared with the kernel as a provided-buffer ring.
+ * A receive flagged IOSQE_BUFFER_SELECT takes whichever buffer is next instead of naming
+ * one, so an idle connection pins no receive memory. The completion carries the buffer id
+ * (IORING_CQE_F_BUFFER); recycle() it once the bytes have been copied out.
+ */
+class BufferRing {
+  private:
+    IoUring &ring;
+    uint16_t group;
+    unsigned count;
+    unsigned size;
+    struct io_uring_buf_ring *buffers = nullptr; // count entries, mapped page-aligned
+    size_t ring_bytes = 0;
+    char *storage = nullptr;
+    uint16_t tail = 0;
+
+  public:
+    // count must be a power of two. Throws std::runtime_error on failure.
+    BufferRing(IoUring &owner, uint16_t group_id, unsigned buffer_count, unsigned buffer_size);
+    ~BufferRing();
+
+    BufferRing(const BufferRing &) = delete;
+    BufferRing &operator=(const BufferRing &) = delete;
+
+    uint16_t group_id() const { return group; }
+    const char *data(uint16_t buffer_id) const { return storage + static_cast<size_t>(buffer_id) * size; }
+
+    // Gives buffer_id back to the kernel
+    void recycle(uint16_t buffer_id);
+};
+
+#endif // IO_URING_H
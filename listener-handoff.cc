@@ -0,0 +1,217 @@
+#include "listener-handoff.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <iostream>
+#include <poll.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Descriptors one message carries: one listener per ReusePort worker, so well past any core count
+static constexpr size_t MAX_HANDOFF_FDS = 252;
+
+// How long either side waits for the other's message before giving up on the exchange
+static constexpr int HANDOFF_TIMEOUT_MS = 5000;
+
+static const char HANDOFF_ACK = 'A';
+
+static bool make_address(const std::string &path, struct sockaddr_un &address) {
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(address.sun_path)) {
+        std::cerr << "Handoff socket path is empty or too long: " << path << std::endl;
+        return false;
+    }
+    memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return true;
+}
+
+static bool wait_for_fd(int fd, short events) {
+    struct pollfd entry = {fd, events, 0};
+    int ready;
+    while ((ready = poll(&entry, 1, HANDOFF_TIMEOUT_MS)) == -1 && errno == EINTR) {
+    }
+    return ready > 0;
+}
+
+ListenerHandoff::ListenerHandoff(std::string socket_path, const std::vector<int> &listener_fds,
+                                 std::function<void()> callback)
+    : path(std::move(socket_path)), on_handed_off(std::move(callback)) {
+    struct sockaddr_un address;
+    if (listener_fds.empty() || listener_fds.size() > MAX_HANDOFF_FDS || !make_address(path, address)) {
+        return;
+    }
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (listen_fd == -1 || stop_fd == -1) {
+        perror("Handoff socket creation failed");
+        return;
+    }
+    // The previous process has handed off (it binds nothing after that) or is gone
+    unlink(path.c_str());
+    if (bind(listen_fd, (struct sockaddr *)&address, sizeof(address)) == -1 || listen(listen_fd, 4) == -1) {
+        perror("Handoff socket bind failed");
+        close(listen_fd);
+        listen_fd = -1;
+        return;
+    }
+
+    for (int fd : listener_fds) {
+        int copy = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+        if (copy == -1) {
+            perror("dup of a listener for handoff failed");
+            continue;
+        }
+        listeners.push_back(copy);
+    }
+    thread = std::thread([this] { run(); });
+}
+
+ListenerHandoff::~ListenerHandoff() {
+    if (thread.joinable()) {
+        uint64_t one = 1;
+        if (write(stop_fd, &one, sizeof(one)) == -1) {
+            perror("eventfd write failed in ~ListenerHandoff");
+        }
+        thread.join();
+    }
+    if (listen_fd != -1) {
+        close(listen_fd);
+        // After a handoff the path is the new process's
+        if (!handed_off) {
+            unlink(path.c_str());
+        }
+    }
+    if (stop_fd != -1) {
+        close(stop_fd);
+    }
+    for (int fd : listeners) {
+        close(fd);
+    }
+}
+
+void ListenerHandoff::run() {
+    struct pollfd entries[2] = {{listen_fd, POLLIN, 0}, {stop_fd, POLLIN, 0}};
+    while (true) {
+        if (poll(entries, 2, -1) == -1) {
+            if (errno == EINTR)
+                continue;
+            perror("poll failed in listener handoff");
+            return;
+        }
+        if (entries[1].revents) {
+            return;
+        }
+
+        int peer_fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (peer_fd == -1) {
+            continue;
+        }
+        bool done = serve(peer_fd);
+        close(peer_fd);
+        if (done) {
+            handed_off = true;
+            std::cout << "Listening sockets handed off; draining." << std::endl;
+            on_handed_off();
+            return;
+        }
+    }
+}
+
+bool ListenerHandoff::serve(int peer_fd) {
+    uint32_t count = static_cast<uint32_t>(listeners.size());
+    struct iovec data = {&count, sizeof(count)};
+
+    alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(int) * MAX_HANDOFF_FDS)];
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &data;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = CMSG_SPACE(sizeof(int) * listeners.size());
+
+    struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(int) * listeners.size());
+    memcpy(CMSG_DATA(header), listeners.data(), sizeof(int) * listeners.size());
+
+    if (sendmsg(peer_fd, &message, MSG_NOSIGNAL) != static_cast<ssize_t>(sizeof(count))) {
+        perror("Sending listeners for handoff failed");
+        return false;
+    }
+
+    // Until the ack, the new process may still fail to start: keep serving as if nothing happened
+    char ack = 0;
+    if (!wait_for_fd(peer_fd, POLLIN) || recv(peer_fd, &ack, 1, 0) != 1 || ack != HANDOFF_ACK) {
+        std::cerr << "Listener handoff was not acknowledged; still serving" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+std::vector<int> ListenerHandoff::take_over(const std::string &socket_path) {
+    std::vector<int> fds;
+    struct sockaddr_un address;
+    if (!make_address(socket_path, address)) {
+        return fds;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        perror("Handoff socket creation failed");
+        return fds;
+    }
+    if (connect(fd, (struct sockaddr *)&address, sizeof(address)) == -1) {
+        // Nothing to take over: the first process of a deploy binds its own listeners
+        close(fd);
+        return fds;
+    }
+
+    uint32_t count = 0;
+    struct iovec data = {&count, sizeof(count)};
+    alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(int) * MAX_HANDOFF_FDS)];
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &data;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    if (!wait_for_fd(fd, POLLIN) || recvmsg(fd, &message, MSG_CMSG_CLOEXEC) != static_cast<ssize_t>(sizeof(count))) {
+        std::cerr << "No listeners received from " << socket_path << std::endl;
+        close(fd);
+        return fds;
+    }
+    for (struct cmsghdr *header = CMSG_FIRSTHDR(&message); header; header = CMSG_NXTHDR(&message, header)) {
+        if (header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_RIGHTS) {
+            size_t received = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            const unsigned char *bytes = CMSG_DATA(header);
+            for (size_t i = 0; i < received; ++i) {
+                int listener;
+                memcpy(&listener, bytes + i * sizeof(int), sizeof(int));
+                fds.push_back(listener);
+            }
+        }
+    }
+    if (fds.size() != count || (message.msg_flags & MSG_CTRUNC)) {
+        std::cerr << "Listener handoff from " << socket_path << " was truncated" << std::endl;
+        for (int listener : fds) {
+            close(listener);
+        }
+        fds.clear();
+        close(fd);
+        return fds;
+    }
+
+    // From here the old process stops accepting; the sockets it leaves are served by us
+    if (send(fd, &HANDOFF_ACK, 1, MSG_NOSIGNAL) != 1) {
+        perror("Acknowledging the listener handoff failed");
+    }
+    close(fd);
+    return fds;
+}
@@ -0,0 +1,50 @@
+#ifndef LISTENER_HANDOFF_H
+#define LISTENER_HANDOFF_H
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Zero-downtime restarts: a running server offers its listening sockets on a Unix
+ * domain socket, and its replacement takes them over (SCM_RIGHTS) instead of binding anew.
+ * Both processes then share the same listening sockets, so no connection attempt is refused
+ * while one process starts and the other drains.
+ *
+ * The exchange is one message each way: the offering side sends the descriptors, the taking
+ * side acknowledges once it has them, and only then does the offering side call its
+ * on_handed_off callback (HttpServer::stop()) and give up the socket path. The new process
+ * binds the path in turn, so the next deploy finds it there.
+ */
+class ListenerHandoff {
+  private:
+    std::string path;
+    int listen_fd = -1;
+    int stop_fd = -1;           // eventfd: wakes the thread out of poll() when destroyed
+    std::vector<int> listeners; // dup()s of the offered sockets, valid whatever the server closes
+    std::function<void()> on_handed_off;
+    std::atomic<bool> handed_off = false;
+    std::thread thread;
+
+    void run();
+
+    // Sends the listeners over one accepted connection; true once the peer acknowledged them
+    bool serve(int peer_fd);
+
+  public:
+    // Binds path (replacing a stale socket left there) and serves one takeover from a
+    // background thread. Logs and offers nothing if the path cannot be bound.
+    ListenerHandoff(std::string socket_path, const std::vector<int> &listener_fds, std::function<void()> callback);
+    ~ListenerHandoff();
+
+    ListenerHandoff(const ListenerHandoff &) = delete;
+    ListenerHandoff &operator=(const ListenerHandoff &) = delete;
+
+    // New process: the listeners of the server offering them at socket_path, acknowledged,
+    // in the order they were offered. Empty if nobody serves the path.
+    static std::vector<int> take_over(const std::string &socket_path);
+};
+
+#endif // LISTENER_HANDOFF_H
@@ -0,0 +1,193 @@
+#include "log.h"
+#include "ring-buffer.h"
+#include <atomic>
+#include <chrono>
+#include <errno.h>
+#include <memory>
+#include <mutex>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+// Lines a thread can have waiting for the log thread before it starts dropping them
+static constexpr size_t LOG_RING_CAPACITY = 1024;
+
+// How long the log thread sleeps when a pass found nothing to write
+static constexpr int LOG_IDLE_SLEEP_MS = 5;
+
+namespace {
+
+// One thread's ring. Shared with the log thread, which frees it once the thread has exited
+// and everything it wrote is out.
+struct ThreadLog {
+    SpscRing<LogRecord> ring{LOG_RING_CAPACITY};
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<bool> exited{false};
+};
+
+class LogThread {
+  private:
+    // Guards the list and the consumer side of every ring: whoever holds it drains
+    std::mutex mutex;
+    std::vector<std::shared_ptr<ThreadLog>> logs;
+    std::atomic<bool> stopping{false};
+    std::thread thread;
+    std::string errors;  // Formatted stderr lines of the current pass
+    std::string access;  // and stdout lines
+
+    void run() {
+        while (!stopping.load(std::memory_order_relaxed)) {
+            bool wrote;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                wrote = drain_locked();
+            }
+            if (!wrote) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(LOG_IDLE_SLEEP_MS));
+            }
+        }
+    }
+
+    static void write_all(int fd, const std::string &text) {
+        size_t done = 0;
+        while (done < text.size()) {
+            ssize_t n = write(fd, text.data() + done, text.size() - done);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                return; // Nowhere to report it
+            }
+            done += static_cast<size_t>(n);
+        }
+    }
+
+    static void format(const LogRecord &record, std::string &out) {
+        time_t seconds = static_cast<time_t>(record.time_ns / 1000000000);
+        struct tm parts;
+        gmtime_r(&seconds, &parts);
+        char stamp[40];
+        size_t length = strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%S", &parts);
+        length += static_cast<size_t>(snprintf(stamp + length, sizeof(stamp) - length, ".%03uZ ",
+                                               static_cast<unsigned>(record.time_ns / 1000000 % 1000)));
+        out.append(stamp, length);
+        switch (record.level) {
+        case LogLevel::Info:
+            out += "info ";
+            break;
+        case LogLevel::Warning:
+            out += "warning ";
+            break;
+        case LogLevel::Error:
+            out += "error ";
+            break;
+        case LogLevel::Access:
+            break;
+        }
+        out.append(record.text, record.length);
+        out += '\n';
+    }
+
+    // One pass over every ring, written with one write() per stream. True if anything was.
+    bool drain_locked() {
+        LogRecord record;
+        for (size_t i = 0; i < logs.size();) {
+            ThreadLog &log = *logs[i];
+            while (log.ring.try_pop(record)) {
+                format(record, record.level == LogLevel::Access ? access : errors);
+            }
+            uint64_t dropped = log.dropped.exchange(0, std::memory_order_relaxed);
+            if (dropped != 0) {
+                errors += "warning " + std::to_string(dropped) + " log lines dropped: a log ring was full\n";
+            }
+            // Re-checked after the exit flag: the thread's last lines may have landed meanwhile
+            if (log.exited.load(std::memory_order_acquire) && log.ring.size_approx() == 0) {
+                logs[i] = std::move(logs.back());
+                logs.pop_back();
+                continue;
+            }
+            ++i;
+        }
+        bool wrote = !errors.empty() || !access.empty();
+        write_all(STDERR_FILENO, errors);
+        write_all(STDOUT_FILENO, access);
+        errors.clear();
+        access.clear();
+        return wrote;
+    }
+
+  public:
+    ~LogThread() {
+        stopping = true;
+        if (thread.joinable()) {
+            thread.join();
+        }
+        flush();
+    }
+
+    std::shared_ptr<ThreadLog> attach() {
+        auto log = std::make_shared<ThreadLog>();
+        std::lock_guard<std::mutex> lock(mutex);
+        logs.push_back(log);
+        if (!thread.joinable()) {
+            thread = std::thread([this] { run(); });
+        }
+        return log;
+    }
+
+    void flush() {
+        std::lock_guard<std::mutex> lock(mutex);
+        drain_locked();
+    }
+
+    static LogThread &instance() {
+        static LogThread log_thread;
+        return log_thread;
+    }
+};
+
+// Marks the ring as orphaned when its thread exits; the log thread drains and frees it
+struct ThreadLogHandle {
+    std::shared_ptr<ThreadLog> log;
+
+    ~ThreadLogHandle() {
+        if (log) {
+            log->exited.store(true, std::memory_order_release);
+        }
+    }
+};
+
+thread_local ThreadLogHandle tls_log;
+
+} // namespace
+
+LogRecord begin_log_record(LogLevel level) {
+    LogRecord record;
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME_COARSE, &now);
+    record.time_ns = static_cast<uint64_t>(now.tv_sec) * 1000000000 + static_cast<uint64_t>(now.tv_nsec);
+    record.level = level;
+    return record;
+}
+
+void submit_log(LogRecord &record) {
+    if (!tls_log.log) {
+        tls_log.log = LogThread::instance().attach();
+    }
+    if (!tls_log.log->ring.try_push(std::move(record))) {
+        tls_log.log->dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void flush_log() { LogThread::instance().flush(); }
+
+void log_errno(std::string_view message) {
+    int error = errno;
+    char buffer[128];
+    // GNU strerror_r: returns the message, which need not be in buffer
+    const char *text = strerror_r(error, buffer, sizeof(buffer));
+    log_line(LogLevel::Error, message, ": ", text);
+}
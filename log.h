@@ -0,0 +1,71 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <type_traits>
+
+enum class LogLevel : uint8_t {
+    Info,
+    Warning,
+    Error,
+    Access, // One line per request (see trace.h); written to stdout, everything else to stderr
+};
+
+/**
+ * @brief One log line as it travels from the thread that wrote it to the log thread: fixed
+ * size, so a log call copies into the thread's ring and allocates nothing. Longer lines are
+ * cut at TEXT_SIZE bytes.
+ */
+struct LogRecord {
+    static constexpr size_t TEXT_SIZE = 232;
+
+    uint64_t time_ns = 0; // CLOCK_REALTIME_COARSE
+    LogLevel level = LogLevel::Info;
+    uint16_t length = 0;
+    char text[TEXT_SIZE];
+
+    void append(std::string_view part) {
+        size_t n = part.size() < TEXT_SIZE - length ? part.size() : TEXT_SIZE - length;
+        for (size_t i = 0; i < n; ++i) {
+            text[length + i] = part[i];
+        }
+        length = static_cast<uint16_t>(length + n);
+    }
+
+    void append(char c) { append(std::string_view(&c, 1)); }
+
+    template <class T, std::enable_if_t<std::is_integral_v<T> && !std::is_same_v<T, char> && !std::is_same_v<T, bool>, int> = 0>
+    void append(T value) {
+        char digits[24];
+        std::to_chars_result result = std::to_chars(digits, digits + sizeof(digits), value);
+        append(std::string_view(digits, static_cast<size_t>(result.ptr - digits)));
+    }
+};
+
+/**
+ * @brief Hands record to the log thread through the calling thread's own ring (a lock-free
+ * SPSC ring, created on the thread's first log call). Never blocks and never takes the stdio
+ * lock: when the ring is full the line is dropped and counted, and the log thread reports
+ * how many were lost.
+ */
+void submit_log(LogRecord &record);
+
+// Writes out every line submitted so far, e.g. before the process exits
+void flush_log();
+
+LogRecord begin_log_record(LogLevel level);
+
+// A line made of string pieces, characters and integers: log_line(LogLevel::Error, "fd ", fd, " failed")
+template <class... Parts> void log_line(LogLevel level, const Parts &...parts) {
+    LogRecord record = begin_log_record(level);
+    (record.append(parts), ...);
+    submit_log(record);
+}
+
+// perror() through the log ring: message, ": " and strerror(errno)
+void log_errno(std::string_view message);
+
+#endif // LOG_H
@@ -1,79 +1,243 @@
 #include "http-server.h"
+#include "proxy.h"
+#include "static-files.h"
+#include "util.h"
+#include <algorithm>
 #include <chrono>
 #include <iostream>
+#include <memory>
+#include <signal.h>
 #include <stdlib.h>
+#include <string>
 #include <thread>
 
 using namespace std::chrono;
 
 // --- Custom Endpoint Handlers for Testing ---
 
-std::string handle_fast_check(const std::string &method, const std::string &path) {
-    std::string content = "Status: OK";
-    std::string response = "HTTP/1.1 200 OK\r\n"
-                           "Content-Type: text/plain\r\n"
-                           "Content-Length: " +
-                           std::to_string(content.length()) +
-                           "\r\n"
-                           "Connection: close\r\n"
-                           "\r\n" +
-                           content;
-    return response;
+// Status line and headers shared by the handlers below, assembled at compile time
+using TextOk = ResponseTemplate<200, HEADER_CONTENT_TYPE_TEXT>;
+
+HttpResponse handle_fast_check(const std::string &, const std::string &) {
+    // Static body: borrowed by the response, never copied
+    return std::move(TextOk::response().set_body_view("Status: OK"));
 }
 
-// Slow Endpoint: Simulates a 500ms blocking task
-std::string handle_slow_task(const std::string &method, const std::string &path) {
+// Slow Endpoint: Simulates a 500ms wait (an upstream call, a timer)
+ResponseTask handle_slow_task(std::string, std::string) {
     const int delay_ms = 500;
-    // This sleep now happens inside a worker thread,
-    // blocking only that thread, not the whole server.
-    std::this_thread::sleep_for(milliseconds(delay_ms));
-
-    std::string content = "Task complete after " + std::to_string(delay_ms) + "ms delay.";
-    std::string response = "HTTP/1.1 200 OK\r\n"
-                           "Content-Type: text/plain\r\n"
-                           "Content-Length: " +
-                           std::to_string(content.length()) +
-                           "\r\n"
-                           "Connection: close\r\n"
-                           "\r\n" +
-                           content;
-    return response;
+    // Reactor workers park the coroutine in their event loop and serve other connections
+    // meanwhile; a ThreadPool worker sleeps here instead.
+    co_await sleep_for(milliseconds(delay_ms));
+
+    HttpResponse response = TextOk::response();
+    response.set_body("Task complete after " + std::to_string(delay_ms) + "ms delay.");
+    co_return response;
+}
+
+// Streaming Endpoint: counts the body as it arrives, so uploads of any size cost no memory
+class EchoBodyReader : public BodyReader {
+  private:
+    size_t length = 0;
+
+  public:
+    void on_data(std::string_view chunk) override { length += chunk.size(); }
+
+    HttpResponse on_complete() override {
+        HttpResponse response = TextOk::response();
+        response.set_body("POST received! Length: " + std::to_string(length) + " bytes.");
+        return response;
+    }
+};
+
+std::unique_ptr<BodyReader> handle_post_echo(const HTTPRequest &) {
+    return std::make_unique<EchoBodyReader>();
 }
 
-std::string handle_post_echo(const std::string &method, const std::string &path) {
-    std::string content = "POST received! Length unknown.";
-    std::string response = "HTTP/1.1 200 OK\r\n"
-                           "Content-Type: text/plain\r\n"
-                           "Content-Length: " +
-                           std::to_string(content.length()) +
-                           "\r\n"
-                           "Connection: close\r\n"
-                           "\r\n" +
-                           content;
-    return response;
+// Context Endpoint: the whole request at hand. Try /hello?name=you, or POST name=you.
+void handle_hello(const Request &request, HttpResponse &response) {
+    std::string_view name = request.query_param("name");
+    if (name.empty() && request.body().starts_with("name=")) {
+        name = request.body().substr(5);
+    }
+    const ConnectionInfo &connection = request.connection();
+    response = TextOk::response();
+    response.set_body("Hello, " + (name.empty() ? std::string("stranger") : Request::decode(name)) + "! Request " +
+                      std::to_string(connection.requests_served) + " on this " +
+                      (connection.http2 ? "HTTP/2" : "HTTP/1.1") + " connection.");
 }
 
 // --- Main Program ---
 
-int main() {
+static void print_usage(const char *program) {
+    std::cerr << "Usage: " << program
+              << " [--mode=threadpool|reactor|reuseport] [--reuseport-cbpf] [--queue=lockfree|locked|workstealing]"
+                 " [--io=epoll|uring] [--sqpoll] [--pin] [--numa] [--no-http2] [--no-compression] [--static=DIR]"
+                 " [--tls-cert=FILE --tls-key=FILE] [--no-ktls] [--proxy=/PREFIX=HOST:PORT[,HOST:PORT...]]"
+                 " [--admission=static|codel] [--max-queue=N] [--handoff=SOCKET_PATH] [--drain-timeout=MS]"
+                 " [--accept-batch=N] [--defer-accept=SECONDS] [--fastopen=QUEUE]"
+              << std::endl;
+}
+
+int main(int argc, char *argv[]) {
     const int server_port = 8080;
+    ServerConfig config;
+    std::string static_root;
+    std::string proxy_prefix;
+    ProxyConfig proxy_config;
 
-    // Determine optimal thread count: typically 2x Core Count for I/O-bound tasks
-    size_t num_cores = std::thread::hardware_concurrency();
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--mode=threadpool") {
+            config.mode = ServerMode::ThreadPool;
+        } else if (arg == "--mode=reactor") {
+            config.mode = ServerMode::Reactor;
+        } else if (arg == "--mode=reuseport") {
+            config.mode = ServerMode::ReusePort;
+        } else if (arg == "--reuseport-cbpf") {
+            config.reuseport_cbpf = true;
+        } else if (arg == "--queue=lockfree") {
+            config.queue_mode = QueueMode::LockFree;
+        } else if (arg == "--queue=locked") {
+            config.queue_mode = QueueMode::Locked;
+        } else if (arg == "--queue=workstealing") {
+            config.queue_mode = QueueMode::WorkStealing;
+        } else if (arg == "--admission=static") {
+            config.admission.policy = AdmissionPolicy::Static;
+        } else if (arg == "--admission=codel") {
+            config.admission.policy = AdmissionPolicy::CoDel;
+        } else if (arg.rfind("--max-queue=", 0) == 0) {
+            config.admission.max_queue_depth = strtoul(arg.c_str() + 12, nullptr, 10);
+        } else if (arg.rfind("--accept-batch=", 0) == 0) {
+            config.accept_batch = strtoul(arg.c_str() + 15, nullptr, 10);
+        } else if (arg.rfind("--defer-accept=", 0) == 0) {
+            config.defer_accept_s = atoi(arg.c_str() + 15);
+        } else if (arg.rfind("--fastopen=", 0) == 0) {
+            config.fastopen_queue = atoi(arg.c_str() + 11);
+        } else if (arg.rfind("--handoff=", 0) == 0) {
+            config.handoff_socket = arg.substr(10);
+        } else if (arg.rfind("--drain-timeout=", 0) == 0) {
+            config.drain_timeout_ms = strtoull(arg.c_str() + 16, nullptr, 10);
+        } else if (arg == "--io=epoll") {
+            config.io_backend = IoBackend::Epoll;
+        } else if (arg == "--io=uring") {
+            config.io_backend = IoBackend::IoUring;
+        } else if (arg == "--sqpoll") {
+            config.uring_sqpoll = true;
+        } else if (arg == "--pin") {
+            config.pin_workers = true;
+        } else if (arg == "--numa") {
+            config.pin_workers = true;
+            config.numa_steering = true;
+        } else if (arg == "--no-http2") {
+            config.http2 = false;
+        } else if (arg == "--no-compression") {
+            config.compression.enabled = false;
+        } else if (arg.rfind("--static=", 0) == 0) {
+            static_root = arg.substr(9);
+        } else if (arg.rfind("--tls-cert=", 0) == 0) {
+            config.tls.certificate_file = arg.substr(11);
+        } else if (arg.rfind("--tls-key=", 0) == 0) {
+            config.tls.private_key_file = arg.substr(10);
+        } else if (arg == "--no-ktls") {
+            config.tls.ktls = false;
+        } else if (arg.rfind("--proxy=", 0) == 0 && arg.find('=', 8) != std::string::npos) {
+            size_t equals = arg.find('=', 8);
+            proxy_prefix = arg.substr(8, equals - 8);
+            while (!proxy_prefix.empty() && proxy_prefix.back() == '/') {
+                proxy_prefix.pop_back();
+            }
+            for (size_t start = equals + 1; start <= arg.size();) {
+                size_t comma = std::min(arg.find(',', start), arg.size());
+                if (comma > start) {
+                    proxy_config.upstreams.push_back(arg.substr(start, comma - start));
+                }
+                start = comma + 1;
+            }
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (config.tls.certificate_file.empty() != config.tls.private_key_file.empty()) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    // Determine optimal thread count: typically 2x Core Count for I/O-bound tasks.
+    // Reactors never block on I/O, so one per core is enough there. Cores are the ones this
+    // process may run on (taskset, cpuset cgroups), not every core of the machine.
+    size_t num_cores = CpuTopology::system().cpus.size();
     size_t num_threads = num_cores > 0 ? num_cores * 2 : 8;
+    if (config.mode != ServerMode::ThreadPool) {
+        num_threads = num_cores > 0 ? num_cores : 4;
+    }
 
-    HttpServer server(server_port, num_threads);
+    // SIGTERM and SIGINT drain the server instead of killing it. Blocked before any thread
+    // exists, so every thread inherits the mask and only the waiter below receives them.
+    sigset_t stop_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGTERM);
+    sigaddset(&stop_signals, SIGINT);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, nullptr);
+
+    HttpServer server(server_port, num_threads, config);
+    std::thread([&server, stop_signals] {
+        int signal_number;
+        if (sigwait(&stop_signals, &signal_number) == 0) {
+            std::cout << "Signal " << signal_number << " received: draining." << std::endl;
+            server.stop();
+        }
+    }).detach();
 
     server.add_endpoint("GET", "/status", handle_fast_check);
-    server.add_endpoint("GET", "/slow", handle_slow_task);
-    server.add_endpoint("POST", "/echo", handle_post_echo);
+    server.cache_endpoint("GET", "/status", ResponseCachePolicy{});
+    server.add_async_endpoint("GET", "/slow", handle_slow_task);
+    server.add_streaming_endpoint("POST", "/echo", handle_post_echo);
+    server.add_endpoint("GET", "/hello", handle_hello);
+    server.add_endpoint("POST", "/hello", handle_hello);
+    server.add_endpoint("GET", "/metrics", ResponseHandler([&server](const std::string &, const std::string &) {
+                            return server.metrics_response();
+                        }));
+    if (!static_root.empty()) {
+        server.add_endpoint("GET", "/static/*path", std::make_shared<StaticFiles>(static_root));
+    }
+    if (!proxy_config.upstreams.empty()) {
+        std::shared_ptr<ReverseProxy> proxy;
+        try {
+            proxy = std::make_shared<ReverseProxy>(proxy_config);
+        } catch (const std::exception &e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+        for (const char *method : {"GET", "POST", "PUT", "PATCH", "DELETE", "OPTIONS"}) {
+            server.add_endpoint(method, proxy_prefix + "/*path", proxy);
+        }
+    }
 
-    std::cout << "Starting HIGH-PERFORMANCE HTTP Server (Hybrid Epoll + Thread Pool)." << std::endl;
-    std::cout << "Architecture: Epoll handles connections; " << num_threads
-              << " workers handle blocking I/O and processing." << std::endl;
+    if (config.mode == ServerMode::Reactor) {
+        std::cout << "Starting HIGH-PERFORMANCE HTTP Server (Reactor-per-Core)." << std::endl;
+        std::cout << "Architecture: Master accepts; " << num_threads
+                  << " reactor workers each own an " << (config.io_backend == IoBackend::IoUring ? "io_uring" : "epoll")
+                  << " instance and drive non-blocking I/O." << std::endl;
+    } else if (config.mode == ServerMode::ReusePort) {
+        std::cout << "Starting HIGH-PERFORMANCE HTTP Server (Zero-Master SO_REUSEPORT)." << std::endl;
+        std::cout << "Architecture: " << num_threads
+                  << " reactor workers each own a listener; the kernel shards accepts between them." << std::endl;
+    } else {
+        std::cout << "Starting HIGH-PERFORMANCE HTTP Server (Hybrid Epoll + Thread Pool)." << std::endl;
+        std::cout << "Architecture: Epoll handles connections; " << num_threads
+                  << " workers handle blocking I/O and processing." << std::endl;
+    }
     std::cout << "--------------------------------------------------------" << std::endl;
     std::cout << "To test CONCURRENCY: Run 10 simultaneous requests to http://127.0.0.1:8080/slow" << std::endl;
-    std::cout << "Expected Result: All requests should finish concurrently in ~500ms." << std::endl;
+    if (config.mode == ServerMode::ThreadPool) {
+        std::cout << "Expected Result: Up to " << num_threads << " requests finish concurrently in ~500ms;"
+                  << " each one holds a worker while it waits." << std::endl;
+    } else {
+        std::cout << "Expected Result: All requests finish concurrently in ~500ms; waiting handlers are"
+                  << " suspended on the reactor, not holding a thread." << std::endl;
+    }
     std::cout << "--------------------------------------------------------" << std::endl;
 
     try {
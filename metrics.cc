@@ -0,0 +1,360 @@
+#include "metrics.h"
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+
+// --- HistogramSnapshot ---
+
+size_t HistogramSnapshot::index_of(uint64_t nanos) {
+    if (nanos < SUB_COUNT) {
+        return static_cast<size_t>(nanos);
+    }
+    // Shift that brings nanos into [SUB_HALF, SUB_COUNT)
+    int shift = (63 - __builtin_clzll(nanos)) - (SUB_BITS - 1);
+    size_t index = static_cast<size_t>(SUB_COUNT + (shift - 1) * SUB_HALF + ((nanos >> shift) - SUB_HALF));
+    return std::min(index, BUCKETS - 1);
+}
+
+uint64_t HistogramSnapshot::upper_bound(size_t index) {
+    if (index < SUB_COUNT) {
+        return index;
+    }
+    uint64_t shift = (index - SUB_COUNT) / SUB_HALF + 1;
+    uint64_t sub = (index - SUB_COUNT) % SUB_HALF + SUB_HALF;
+    return ((sub + 1) << shift) - 1;
+}
+
+uint64_t HistogramSnapshot::value_at_percentile(double percentile) const {
+    if (count == 0) {
+        return 0;
+    }
+    uint64_t wanted = static_cast<uint64_t>(percentile / 100.0 * static_cast<double>(count) + 0.5);
+    wanted = std::clamp<uint64_t>(wanted, 1, count);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKETS; ++i) {
+        seen += counts[i];
+        if (seen >= wanted) {
+            return upper_bound(i);
+        }
+    }
+    return upper_bound(BUCKETS - 1);
+}
+
+uint64_t HistogramSnapshot::count_at_or_below(uint64_t nanos) const {
+    // Buckets straddling the bound are counted in full, so this leans towards the bound
+    size_t last = index_of(nanos);
+    uint64_t seen = 0;
+    for (size_t i = 0; i <= last; ++i) {
+        seen += counts[i];
+    }
+    return seen;
+}
+
+void HistogramSnapshot::merge(const HistogramSnapshot &other) {
+    for (size_t i = 0; i < BUCKETS; ++i) {
+        counts[i] += other.counts[i];
+    }
+    count += other.count;
+    sum_ns += other.sum_ns;
+}
+
+// --- LatencyHistogram ---
+
+void LatencyHistogram::add_to(HistogramSnapshot &snapshot) const {
+    uint64_t seen = 0;
+    for (size_t i = 0; i < HistogramSnapshot::BUCKETS; ++i) {
+        uint64_t bucket = counts[i].load(std::memory_order_relaxed);
+        snapshot.counts[i] += bucket;
+        seen += bucket;
+    }
+    // Summing the buckets keeps count consistent with them while the owner keeps recording
+    snapshot.count += seen;
+    snapshot.sum_ns += sum_ns.get();
+}
+
+// --- Registry ---
+
+struct RouteName {
+    std::string method;
+    std::string pattern;
+};
+
+// Every live shard, for collect_metrics(); shards of exited threads leave their totals behind
+struct MetricsRegistry {
+    std::mutex mutex;
+    std::vector<const ThreadMetrics *> shards;
+    MetricsSnapshot retired;
+    std::vector<RouteName> routes{{"", ""}}; // Route 0: requests no registered route matched
+};
+
+static MetricsRegistry &registry() {
+    static MetricsRegistry instance; // Constructed before, so destroyed after, any thread's shard
+    return instance;
+}
+
+static void merge_into(MetricsSnapshot &total, const MetricsSnapshot &part) {
+    total.accepted += part.accepted;
+    total.closed += part.closed;
+    total.requests += part.requests;
+    total.parse_errors += part.parse_errors;
+    total.bytes_in += part.bytes_in;
+    total.bytes_out += part.bytes_out;
+    total.cache_hits += part.cache_hits;
+    total.cache_misses += part.cache_misses;
+    total.tls_handshakes += part.tls_handshakes;
+    total.tls_resumed += part.tls_resumed;
+    total.tls_handshake_errors += part.tls_handshake_errors;
+    total.tls_kernel_send += part.tls_kernel_send;
+    total.compressed += part.compressed;
+    total.compressed_bytes_in += part.compressed_bytes_in;
+    total.compressed_bytes_out += part.compressed_bytes_out;
+    total.proxy_requests += part.proxy_requests;
+    total.proxy_errors += part.proxy_errors;
+    total.proxy_reused += part.proxy_reused;
+    total.shed += part.shed;
+    for (size_t i = 0; i < total.responses.size(); ++i) {
+        total.responses[i] += part.responses[i];
+    }
+    if (total.routes.size() < part.routes.size()) {
+        total.routes.resize(part.routes.size());
+    }
+    for (size_t i = 0; i < part.routes.size(); ++i) {
+        total.routes[i].merge(part.routes[i]);
+    }
+}
+
+uint32_t register_metric_route(std::string_view method, std::string_view pattern) {
+    MetricsRegistry &metrics = registry();
+    std::lock_guard<std::mutex> lock(metrics.mutex);
+    for (size_t i = 1; i < metrics.routes.size(); ++i) {
+        if (metrics.routes[i].method == method && metrics.routes[i].pattern == pattern) {
+            return static_cast<uint32_t>(i);
+        }
+    }
+    if (metrics.routes.size() >= MAX_METRIC_ROUTES) {
+        return 0;
+    }
+    metrics.routes.push_back({std::string(method), std::string(pattern)});
+    return static_cast<uint32_t>(metrics.routes.size() - 1);
+}
+
+// --- ThreadMetrics ---
+
+ThreadMetrics::ThreadMetrics() {
+    MetricsRegistry &metrics = registry();
+    std::lock_guard<std::mutex> lock(metrics.mutex);
+    metrics.shards.push_back(this);
+}
+
+ThreadMetrics::~ThreadMetrics() {
+    MetricsRegistry &metrics = registry();
+    {
+        std::lock_guard<std::mutex> lock(metrics.mutex);
+        metrics.shards.erase(std::remove(metrics.shards.begin(), metrics.shards.end(), this), metrics.shards.end());
+        MetricsSnapshot mine;
+        add_to(mine);
+        merge_into(metrics.retired, mine);
+    }
+    // No scrape can reach this shard any more
+    for (std::atomic<LatencyHistogram *> &route : routes) {
+        delete route.load(std::memory_order_relaxed);
+    }
+}
+
+void ThreadMetrics::record_response(uint32_t route, int status, uint64_t nanos) {
+    requests.add();
+    count_status(status);
+    if (route >= MAX_METRIC_ROUTES) {
+        route = 0;
+    }
+    LatencyHistogram *histogram = routes[route].load(std::memory_order_relaxed);
+    if (!histogram) {
+        histogram = new LatencyHistogram();
+        routes[route].store(histogram, std::memory_order_release); // Scrapes see it zeroed
+    }
+    histogram->record(nanos);
+}
+
+void ThreadMetrics::add_to(MetricsSnapshot &snapshot) const {
+    snapshot.accepted += accepted.get();
+    snapshot.closed += closed.get();
+    snapshot.requests += requests.get();
+    snapshot.parse_errors += parse_errors.get();
+    snapshot.bytes_in += bytes_in.get();
+    snapshot.bytes_out += bytes_out.get();
+    snapshot.cache_hits += cache_hits.get();
+    snapshot.cache_misses += cache_misses.get();
+    snapshot.tls_handshakes += tls_handshakes.get();
+    snapshot.tls_resumed += tls_resumed.get();
+    snapshot.tls_handshake_errors += tls_handshake_errors.get();
+    snapshot.tls_kernel_send += tls_kernel_send.get();
+    snapshot.compressed += compressed.get();
+    snapshot.compressed_bytes_in += compressed_bytes_in.get();
+    snapshot.compressed_bytes_out += compressed_bytes_out.get();
+    snapshot.proxy_requests += proxy_requests.get();
+    snapshot.proxy_errors += proxy_errors.get();
+    snapshot.proxy_reused += proxy_reused.get();
+    snapshot.shed += shed.get();
+    for (size_t i = 0; i < responses.size(); ++i) {
+        snapshot.responses[i] += responses[i].get();
+    }
+    for (size_t i = 0; i < routes.size(); ++i) {
+        const LatencyHistogram *histogram = routes[i].load(std::memory_order_acquire);
+        if (!histogram) {
+            continue;
+        }
+        if (snapshot.routes.size() <= i) {
+            snapshot.routes.resize(i + 1);
+        }
+        histogram->add_to(snapshot.routes[i]);
+    }
+}
+
+ThreadMetrics &ThreadMetrics::local() {
+    static thread_local ThreadMetrics shard;
+    return shard;
+}
+
+MetricsSnapshot collect_metrics() {
+    MetricsRegistry &metrics = registry();
+    std::lock_guard<std::mutex> lock(metrics.mutex);
+    MetricsSnapshot total;
+    merge_into(total, metrics.retired);
+    for (const ThreadMetrics *shard : metrics.shards) {
+        shard->add_to(total);
+    }
+    return total;
+}
+
+// --- Prometheus text ---
+
+static void append_format(std::string &out, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+static void append_format(std::string &out, const char *format, ...) {
+    char line[512];
+    va_list args;
+    va_start(args, format);
+    int length = std::vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    if (length > 0) {
+        out.append(line, std::min(static_cast<size_t>(length), sizeof(line) - 1));
+    }
+}
+
+// Label values are route patterns; quote the characters the exposition format escapes
+static std::string escape_label(const std::string &value) {
+    std::string escaped;
+    escaped.reserve(value.size());
+    for (char c : value) {
+        if (c == '\\' || c == '"') {
+            escaped += '\\';
+        } else if (c == '\n') {
+            escaped += "\\n";
+            continue;
+        }
+        escaped += c;
+    }
+    return escaped;
+}
+
+static std::string route_labels(size_t route, const std::vector<RouteName> &names) {
+    if (route == 0 || route >= names.size()) {
+        return "method=\"\",route=\"other\"";
+    }
+    return "method=\"" + escape_label(names[route].method) + "\",route=\"" + escape_label(names[route].pattern) + "\"";
+}
+
+static void append_counter(std::string &out, const char *name, const char *help, uint64_t value) {
+    append_format(out, "# HELP %s %s\n# TYPE %s counter\n%s %lu\n", name, help, name, name,
+                  static_cast<unsigned long>(value));
+}
+
+void render_metrics(const MetricsSnapshot &snapshot, std::string &out) {
+    std::vector<RouteName> names;
+    {
+        MetricsRegistry &metrics = registry();
+        std::lock_guard<std::mutex> lock(metrics.mutex);
+        names = metrics.routes;
+    }
+
+    append_counter(out, "http_connections_accepted_total", "Connections accepted.", snapshot.accepted);
+    append_counter(out, "http_connections_closed_total", "Connections closed.", snapshot.closed);
+    uint64_t active = snapshot.accepted > snapshot.closed ? snapshot.accepted - snapshot.closed : 0;
+    append_format(out, "# HELP http_connections_active Connections open at scrape time.\n"
+                       "# TYPE http_connections_active gauge\nhttp_connections_active %lu\n",
+                  static_cast<unsigned long>(active));
+    append_counter(out, "http_requests_total", "Requests answered.", snapshot.requests);
+    append_counter(out, "http_parse_errors_total", "Requests rejected as malformed.", snapshot.parse_errors);
+    append_counter(out, "http_received_bytes_total", "Bytes read from clients.", snapshot.bytes_in);
+    append_counter(out, "http_sent_bytes_total", "Bytes written to clients.", snapshot.bytes_out);
+    append_counter(out, "http_cache_hits_total", "Requests answered from a response cache.", snapshot.cache_hits);
+    append_counter(out, "http_cache_misses_total", "Cached routes' requests that ran the handler.",
+                   snapshot.cache_misses);
+    append_counter(out, "http_tls_handshakes_total", "TLS handshakes completed.", snapshot.tls_handshakes);
+    append_counter(out, "http_tls_resumed_total", "TLS handshakes resumed from a session ticket.",
+                   snapshot.tls_resumed);
+    append_counter(out, "http_tls_handshake_errors_total", "TLS handshakes that failed.",
+                   snapshot.tls_handshake_errors);
+    append_counter(out, "http_tls_kernel_send_total", "TLS connections encrypted by the kernel (kTLS).",
+                   snapshot.tls_kernel_send);
+    append_counter(out, "http_compressed_responses_total", "Response bodies compressed.", snapshot.compressed);
+    append_counter(out, "http_compressed_bytes_in_total", "Body bytes before compression.",
+                   snapshot.compressed_bytes_in);
+    append_counter(out, "http_compressed_bytes_out_total", "Body bytes after compression.",
+                   snapshot.compressed_bytes_out);
+    append_counter(out, "http_proxy_requests_total", "Requests forwarded to an upstream.", snapshot.proxy_requests);
+    append_counter(out, "http_proxy_errors_total", "Proxied requests answered 502, 503 or 504 by the proxy.",
+                   snapshot.proxy_errors);
+    append_counter(out, "http_proxy_reused_connections_total", "Proxied requests sent over a pooled connection.",
+                   snapshot.proxy_reused);
+    append_counter(out, "http_requests_shed_total", "Requests answered 503 by admission control.", snapshot.shed);
+
+    append_format(out, "# HELP http_responses_total Responses by status class.\n# TYPE http_responses_total counter\n");
+    for (size_t i = 0; i < snapshot.responses.size(); ++i) {
+        append_format(out, "http_responses_total{code=\"%zuxx\"} %lu\n", i + 1,
+                      static_cast<unsigned long>(snapshot.responses[i]));
+    }
+
+    // Bucket bounds in microseconds; the histogram's finer buckets are folded into these
+    static constexpr uint64_t BOUNDS_US[] = {10,    25,     50,     100,    250,     500,     1000,    2500,   5000,
+                                             10000, 25000,  50000,  100000, 250000,  500000,  1000000, 2500000,
+                                             5000000, 10000000};
+    append_format(out, "# HELP http_request_duration_seconds Time from request head to response, by route.\n"
+                       "# TYPE http_request_duration_seconds histogram\n");
+    for (size_t i = 0; i < snapshot.routes.size(); ++i) {
+        const HistogramSnapshot &histogram = snapshot.routes[i];
+        if (histogram.count == 0) {
+            continue;
+        }
+        std::string labels = route_labels(i, names);
+        for (uint64_t bound : BOUNDS_US) {
+            uint64_t at_or_below = histogram.count_at_or_below(bound * 1000);
+            append_format(out, "http_request_duration_seconds_bucket{%s,le=\"%g\"} %lu\n", labels.c_str(),
+                          static_cast<double>(bound) / 1e6, static_cast<unsigned long>(at_or_below));
+        }
+        append_format(out, "http_request_duration_seconds_bucket{%s,le=\"+Inf\"} %lu\n", labels.c_str(),
+                      static_cast<unsigned long>(histogram.count));
+        append_format(out, "http_request_duration_seconds_sum{%s} %.9f\n", labels.c_str(),
+                      static_cast<double>(histogram.sum_ns) / 1e9);
+        append_format(out, "http_request_duration_seconds_count{%s} %lu\n", labels.c_str(),
+                      static_cast<unsigned long>(histogram.count));
+    }
+
+    // Percentiles straight from the fine buckets, which the le buckets above cannot give
+    append_format(out, "# HELP http_request_duration_quantile_seconds Latency percentiles, by route.\n"
+                       "# TYPE http_request_duration_quantile_seconds gauge\n");
+    for (size_t i = 0; i < snapshot.routes.size(); ++i) {
+        const HistogramSnapshot &histogram = snapshot.routes[i];
+        if (histogram.count == 0) {
+            continue;
+        }
+        std::string labels = route_labels(i, names);
+        for (double quantile : {50.0, 90.0, 99.0, 99.9}) {
+            append_format(out, "http_request_duration_quantile_seconds{%s,quantile=\"%g\"} %.9f\n", labels.c_str(),
+                          quantile / 100.0,
+                          static_cast<double>(histogram.value_at_percentile(quantile)) / 1e9);
+        }
+    }
+}
@@ -0,0 +1,172 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "ring-buffer.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Nanoseconds on the monotonic clock; the time base for request latencies
+inline uint64_t monotonic_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+// Routes with a latency histogram of their own; route 0 collects everything unmatched
+#define MAX_METRIC_ROUTES 256
+
+// A counter with one writer: add() is a relaxed load and store, not a locked read-modify-write.
+// Readers on other threads see a recent value.
+struct LocalCounter {
+    std::atomic<uint64_t> value{0};
+
+    void add(uint64_t n = 1) { value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed); }
+    uint64_t get() const { return value.load(std::memory_order_relaxed); }
+};
+
+// Merged copy of LatencyHistograms, taken at scrape time
+struct HistogramSnapshot {
+    static constexpr int SUB_BITS = 5;
+    static constexpr uint64_t SUB_COUNT = uint64_t(1) << SUB_BITS; // 32
+    static constexpr uint64_t SUB_HALF = SUB_COUNT / 2;
+    static constexpr int MAX_SHIFT = 36; // Up to ~36 minutes in nanoseconds
+    static constexpr size_t BUCKETS = SUB_COUNT + MAX_SHIFT * SUB_HALF;
+
+    std::array<uint64_t, BUCKETS> counts{};
+    uint64_t count = 0;
+    uint64_t sum_ns = 0;
+
+    static size_t index_of(uint64_t nanos);
+    static uint64_t upper_bound(size_t index); // Highest value recorded into bucket index
+
+    // Smallest bucket bound with at least percentile% of the values at or below it
+    uint64_t value_at_percentile(double percentile) const;
+    uint64_t count_at_or_below(uint64_t nanos) const;
+    void merge(const HistogramSnapshot &other);
+};
+
+/**
+ * @brief Log-linear latency histogram in nanoseconds, with one writing thread. Values below
+ * 32ns get a bucket each, every power of two above that is split into 16, so a reported value
+ * is within ~6% of the recorded one in under 5 KiB. Recording is an index computation and the relaxed
+ * load/store of one bucket; scrapes read it at any time through add_to().
+ */
+class LatencyHistogram {
+  private:
+    std::array<std::atomic<uint64_t>, HistogramSnapshot::BUCKETS> counts{};
+    LocalCounter total;
+    LocalCounter sum_ns;
+
+  public:
+    void record(uint64_t nanos) {
+        std::atomic<uint64_t> &bucket = counts[HistogramSnapshot::index_of(nanos)];
+        bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        total.add();
+        sum_ns.add(nanos);
+    }
+
+    void add_to(HistogramSnapshot &snapshot) const;
+};
+
+// Totals over every thread, for render_metrics()
+struct MetricsSnapshot {
+    uint64_t accepted = 0;
+    uint64_t closed = 0;
+    uint64_t requests = 0;
+    uint64_t parse_errors = 0;
+    uint64_t bytes_in = 0;
+    uint64_t bytes_out = 0;
+    uint64_t cache_hits = 0;
+    uint64_t cache_misses = 0;
+    uint64_t tls_handshakes = 0;
+    uint64_t tls_resumed = 0;
+    uint64_t tls_handshake_errors = 0;
+    uint64_t tls_kernel_send = 0;
+    uint64_t compressed = 0;
+    uint64_t compressed_bytes_in = 0;
+    uint64_t compressed_bytes_out = 0;
+    uint64_t proxy_requests = 0;
+    uint64_t proxy_errors = 0;
+    uint64_t proxy_reused = 0;
+    uint64_t shed = 0;
+    std::array<uint64_t, 5> responses{}; // By status class, 1xx to 5xx
+    std::vector<HistogramSnapshot> routes; // Indexed by route id; empty where nothing was recorded
+};
+
+/**
+ * @brief One thread's share of the server's counters, on cache lines of its own.
+ * Every thread that serves connections (master, reactors, ThreadPool workers) writes only to
+ * its own ThreadMetrics (local()), so the hot path never contends on a shared line; a scrape
+ * sums the shards (collect_metrics()). Route histograms are allocated the first time the
+ * thread finishes a request on that route.
+ */
+class alignas(CACHE_LINE_SIZE) ThreadMetrics {
+  public:
+    LocalCounter accepted;
+    LocalCounter closed;
+    LocalCounter requests;
+    LocalCounter parse_errors;
+    LocalCounter bytes_in;
+    LocalCounter bytes_out;
+    LocalCounter cache_hits; // Routes with a ResponseCache only
+    LocalCounter cache_misses;
+    LocalCounter tls_handshakes; // Completed, of which tls_resumed were resumed from a ticket
+    LocalCounter tls_resumed;
+    LocalCounter tls_handshake_errors;
+    LocalCounter tls_kernel_send; // Connections whose records the kernel encrypts (kTLS)
+    LocalCounter compressed;      // Response bodies compressed, from compressed_bytes_in bytes to _out
+    LocalCounter compressed_bytes_in;
+    LocalCounter compressed_bytes_out;
+    LocalCounter proxy_requests; // Forwarded upstream, of which proxy_errors were answered by the proxy itself
+    LocalCounter proxy_errors;   // (502, 503, 504)
+    LocalCounter proxy_reused;   // Sent over a pooled keep-alive upstream connection
+    LocalCounter shed;           // Answered 503 by admission control instead of queued
+    std::array<LocalCounter, 5> responses;
+
+  private:
+    std::array<std::atomic<LatencyHistogram *>, MAX_METRIC_ROUTES> routes{};
+
+    void count_status(int status) {
+        int status_class = status / 100 - 1;
+        if (status_class >= 0 && status_class < static_cast<int>(responses.size())) {
+            responses[status_class].add();
+        }
+    }
+
+  public:
+    ThreadMetrics();
+    ~ThreadMetrics();
+
+    ThreadMetrics(const ThreadMetrics &) = delete;
+    ThreadMetrics &operator=(const ThreadMetrics &) = delete;
+
+    // One answered request: its status and how long it took from head to response
+    void record_response(uint32_t route, int status, uint64_t nanos);
+
+    // A head too malformed to route, answered with status
+    void record_parse_error(int status) {
+        parse_errors.add();
+        count_status(status);
+    }
+
+    void add_to(MetricsSnapshot &snapshot) const;
+
+    // The calling thread's shard, created on first use
+    static ThreadMetrics &local();
+};
+
+// Names a route for the latency histograms and returns its id (0 once the table is full).
+// The same method and pattern always get the same id.
+uint32_t register_metric_route(std::string_view method, std::string_view pattern);
+
+MetricsSnapshot collect_metrics();
+
+// Prometheus text exposition (version 0.0.4) of a snapshot, appended to out
+void render_metrics(const MetricsSnapshot &snapshot, std::string &out);
+
+#endif // METRICS_H
@@ -0,0 +1,1187 @@
+#include "proxy.h"
+#include "http-response.h"
+#include "http-server.h"
+#include "log.h"
+#include "metrics.h"
+#include "timer-wheel.h"
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// A response head larger than this is a broken upstream
+static constexpr size_t MAX_UPSTREAM_HEAD = 65536;
+
+// recv() granularity for heads and for bodies that go through user space
+static constexpr size_t UPSTREAM_READ_SIZE = 16384;
+
+// Splice pipes: sized so that one splice() moves a useful amount, a few kept per thread
+static constexpr int SPLICE_PIPE_SIZE = 256 * 1024;
+static constexpr size_t MAX_IDLE_PIPES = 16;
+
+// Upstream deadlines are checked this often; they guard against hung upstreams, not latency
+static constexpr uint64_t DEADLINE_TICK_MS = 100;
+
+// poll() for one descriptor; false on timeout
+static bool wait_ready(int fd, short events, uint64_t timeout_ms) {
+    struct pollfd entry = {fd, events, 0};
+    int result;
+    while ((result = poll(&entry, 1, static_cast<int>(std::min<uint64_t>(timeout_ms, INT32_MAX)))) == -1 &&
+           errno == EINTR) {
+    }
+    return result > 0;
+}
+
+static bool status_has_body(int status) { return status >= 200 && status != 204 && status != 304; }
+
+// --- Deadlines ---
+
+/**
+ * @brief A timeout on the waits for one upstream socket. Under a Scheduler those waits have
+ * none of their own, so the thread's deadline wheel shuts the socket down once the deadline
+ * passes, which ends whatever wait is pending with an error; a ticker coroutine drives the
+ * wheel while anything is armed. Blocking waits (no Scheduler) poll until at_ms instead.
+ */
+struct Deadline {
+    TimerNode node; // First member: the wheel hands it back
+    uint64_t at_ms = 0;
+    bool expired = false;
+
+    Deadline() = default;
+    Deadline(const Deadline &) = delete;
+    Deadline &operator=(const Deadline &) = delete;
+    ~Deadline() { disarm(); }
+
+    void arm(int fd, uint64_t timeout_ms);
+    void disarm();
+
+    uint64_t remaining_ms() const {
+        uint64_t now = monotonic_ms();
+        return at_ms > now ? at_ms - now : 0;
+    }
+};
+
+static thread_local TimerWheel deadline_wheel(DEADLINE_TICK_MS);
+static thread_local bool deadline_ticker = false;
+
+static DetachedTask run_deadlines() {
+    deadline_ticker = true;
+    while (!deadline_wheel.empty()) {
+        co_await sleep_for(std::chrono::milliseconds(DEADLINE_TICK_MS));
+        deadline_wheel.advance(monotonic_ms(), [](TimerNode *node) {
+            reinterpret_cast<Deadline *>(node)->expired = true;
+            shutdown(node->fd, SHUT_RDWR);
+        });
+    }
+    deadline_ticker = false;
+}
+
+void Deadline::arm(int fd, uint64_t timeout_ms) {
+    at_ms = monotonic_ms() + timeout_ms;
+    expired = false;
+    node.fd = fd;
+    if (Scheduler::current()) {
+        deadline_wheel.schedule(&node, timeout_ms);
+        if (!deadline_ticker) {
+            run_deadlines();
+        }
+    }
+}
+
+void Deadline::disarm() {
+    if (node.scheduled()) {
+        deadline_wheel.cancel(&node);
+    }
+}
+
+// Waits until fd is ready or the deadline passes; resumes with false in the second case
+struct UpstreamWait {
+    int fd;
+    bool writable;
+    Deadline &deadline;
+    bool ready = true;
+
+    bool await_ready() const noexcept { return false; }
+    bool await_suspend(std::coroutine_handle<> handle) {
+        if (Scheduler *scheduler = Scheduler::current()) {
+            scheduler->resume_when_ready(handle, fd, writable);
+            return true;
+        }
+        ready = wait_ready(fd, writable ? POLLOUT : POLLIN, deadline.remaining_ms());
+        deadline.expired = !ready;
+        return false;
+    }
+    bool await_resume() const noexcept { return ready && !deadline.expired; }
+};
+
+// --- Per-thread pools: idle upstream connections and splice pipes ---
+
+struct IdleConnection {
+    const ReverseProxy::Upstream *upstream;
+    int fd;
+    uint64_t since_ms;
+};
+
+static thread_local std::vector<IdleConnection> idle_connections;
+
+// A pooled connection to upstream that is still open, or -1. Connections idle for longer
+// than idle_timeout_ms, to any upstream, are closed on the way.
+static int take_idle(const ReverseProxy::Upstream &upstream, uint64_t idle_timeout_ms) {
+    uint64_t now = monotonic_ms();
+    int found = -1;
+    // Most recently used first: the likeliest to still be open upstream
+    for (size_t i = idle_connections.size(); i-- > 0;) {
+        IdleConnection &idle = idle_connections[i];
+        bool stale = now - idle.since_ms > idle_timeout_ms;
+        if (!stale && (found >= 0 || idle.upstream != &upstream)) {
+            continue;
+        }
+        int fd = idle.fd;
+        idle_connections.erase(idle_connections.begin() + static_cast<std::ptrdiff_t>(i));
+        // An open, quiet connection has nothing to read; EOF or stray bytes mean it is done
+        char byte;
+        if (stale || recv(fd, &byte, 1, MSG_PEEK | MSG_DONTWAIT) != -1 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+            close(fd);
+            continue;
+        }
+        found = fd;
+    }
+    return found;
+}
+
+static void put_idle(const ReverseProxy::Upstream &upstream, int fd, size_t max_idle) {
+    size_t count = 0;
+    for (const IdleConnection &idle : idle_connections) {
+        count += idle.upstream == &upstream;
+    }
+    if (count >= max_idle) {
+        close(fd);
+        return;
+    }
+    idle_connections.push_back({&upstream, fd, monotonic_ms()});
+}
+
+struct SplicePipe {
+    int read_fd = -1;
+    int write_fd = -1;
+};
+
+static thread_local std::vector<SplicePipe> idle_pipes;
+
+static bool take_pipe(SplicePipe &pipe) {
+    if (!idle_pipes.empty()) {
+        pipe = idle_pipes.back();
+        idle_pipes.pop_back();
+        return true;
+    }
+    int fds[2];
+    if (pipe2(fds, O_NONBLOCK | O_CLOEXEC) == -1) {
+        return false;
+    }
+    fcntl(fds[1], F_SETPIPE_SZ, SPLICE_PIPE_SIZE); // The default 64 KiB also works, in smaller steps
+    pipe = {fds[0], fds[1]};
+    return true;
+}
+
+// A pipe still holding bytes cannot be reused
+static void return_pipe(SplicePipe &pipe, bool empty) {
+    if (pipe.read_fd < 0) {
+        return;
+    }
+    if (empty && idle_pipes.size() < MAX_IDLE_PIPES) {
+        idle_pipes.push_back(pipe);
+    } else {
+        close(pipe.read_fd);
+        close(pipe.write_fd);
+    }
+    pipe = SplicePipe();
+}
+
+/**
+ * @brief One request's hold on an upstream: counts towards its outstanding requests and owns
+ * the connection. release() hands a connection that may serve another request back to the
+ * thread's pool; anything else, including destruction without release(), closes it.
+ */
+class UpstreamLease {
+  private:
+    ReverseProxy::Upstream *upstream = nullptr;
+    int socket_fd = -1;
+    size_t max_idle = 0;
+
+  public:
+    UpstreamLease() = default;
+    UpstreamLease(ReverseProxy::Upstream &target, size_t max_idle_connections)
+        : upstream(&target), max_idle(max_idle_connections) {
+        upstream->outstanding.fetch_add(1, std::memory_order_relaxed);
+    }
+    UpstreamLease(UpstreamLease &&other) noexcept
+        : upstream(std::exchange(other.upstream, nullptr)), socket_fd(std::exchange(other.socket_fd, -1)),
+          max_idle(other.max_idle) {}
+    UpstreamLease &operator=(UpstreamLease &&other) noexcept {
+        if (this != &other) {
+            release(false);
+            upstream = std::exchange(other.upstream, nullptr);
+            socket_fd = std::exchange(other.socket_fd, -1);
+            max_idle = other.max_idle;
+        }
+        return *this;
+    }
+    ~UpstreamLease() { release(false); }
+
+    void adopt(int fd) { socket_fd = fd; }
+    int fd() const { return socket_fd; }
+
+    void release(bool reusable) {
+        if (socket_fd >= 0) {
+            if (reusable && upstream) {
+                put_idle(*upstream, socket_fd, max_idle);
+            } else {
+                close(socket_fd);
+            }
+            socket_fd = -1;
+        }
+        if (upstream) {
+            upstream->outstanding.fetch_sub(1, std::memory_order_relaxed);
+            upstream = nullptr;
+        }
+    }
+};
+
+// --- BodyRelay ---
+
+void BodyRelay::notify() {
+    if (!waiter) {
+        return;
+    }
+    std::coroutine_handle<> handle = std::exchange(waiter, {});
+    // Not from inside the connection's serve_pipelined(): the proxy may call wake, which re-enters it
+    Scheduler *scheduler = Scheduler::current();
+    if (blocking || !scheduler) {
+        handle.resume();
+    } else {
+        scheduler->resume_after(handle, 0);
+    }
+}
+
+void BodyRelay::attach(int socket, uint64_t write_timeout_ms) {
+    fd = socket;
+    blocking = Scheduler::current() == nullptr;
+    timeout_ms = write_timeout_ms;
+}
+
+size_t BodyRelay::relay(std::string_view data) {
+    if (failed || cancelled) {
+        return data.size();
+    }
+    if (fd < 0) {
+        stalled = !data.empty();
+        return 0;
+    }
+    size_t taken = 0;
+    while (taken < data.size()) {
+        ssize_t sent = send(fd, data.data() + taken, data.size() - taken, MSG_NOSIGNAL);
+        if (sent > 0) {
+            taken += static_cast<size_t>(sent);
+            continue;
+        }
+        if (sent == -1 && errno == EINTR) {
+            continue;
+        }
+        if (sent == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            if (!blocking) {
+                stalled = true;
+                notify();
+                break;
+            }
+            if (wait_ready(fd, POLLOUT, timeout_ms)) {
+                continue;
+            }
+        }
+        failed = true;
+        notify();
+        return data.size();
+    }
+    relayed += taken;
+    return taken;
+}
+
+void BodyRelay::finish() {
+    complete = true;
+    notify();
+}
+
+void BodyRelay::cancel() {
+    if (complete) {
+        return; // The connection letting go of a finished body: the exchange carries on
+    }
+    cancelled = true;
+    notify();
+}
+
+// --- Response heads ---
+
+struct UpstreamHead {
+    int status = 0;
+    bool keep_alive = true;
+    bool chunked = false;
+    bool has_length = false;
+    size_t content_length = 0;
+    size_t length = 0; // Of the head, blank line included
+    std::vector<HttpHeader> headers;
+};
+
+// 1 once buffer starts with a complete head, 0 while it may still become one, -1 if it cannot
+static int parse_upstream_head(std::string_view buffer, UpstreamHead &head) {
+    size_t end = buffer.find("\r\n\r\n");
+    if (end == std::string_view::npos) {
+        return buffer.size() > MAX_UPSTREAM_HEAD ? -1 : 0;
+    }
+    head = UpstreamHead();
+    head.length = end + 4;
+
+    // "HTTP/1.x NNN reason"
+    size_t line_end = buffer.find("\r\n");
+    std::string_view line = buffer.substr(0, line_end);
+    if (line.size() < 12 || line.substr(0, 7) != "HTTP/1." || line[8] != ' ' ||
+        std::from_chars(line.data() + 9, line.data() + 12, head.status).ptr != line.data() + 12 || head.status < 100) {
+        return -1;
+    }
+    head.keep_alive = line[7] == '1';
+
+    std::string_view connection;
+    std::string_view transfer_encoding;
+    for (size_t start = line_end + 2; start < end + 2;) {
+        size_t next = buffer.find("\r\n", start);
+        std::string_view header = buffer.substr(start, next - start);
+        start = next + 2;
+        size_t colon = header.find(':');
+        if (colon == std::string_view::npos || colon == 0) {
+            return -1;
+        }
+        std::string_view name = header.substr(0, colon);
+        std::string_view value = header.substr(colon + 1);
+        while (!value.empty() && (value.front() == ' ' || value.front() == '\t')) {
+            value.remove_prefix(1);
+        }
+        while (!value.empty() && (value.back() == ' ' || value.back() == '\t')) {
+            value.remove_suffix(1);
+        }
+        if (equals_ignore_case(name, "Content-Length")) {
+            size_t length = 0;
+            if (value.empty() || std::from_chars(value.data(), value.data() + value.size(), length).ptr !=
+                                     value.data() + value.size() ||
+                (head.has_length && length != head.content_length)) {
+                return -1;
+            }
+            head.has_length = true;
+            head.content_length = length;
+        } else if (equals_ignore_case(name, "Transfer-Encoding")) {
+            transfer_encoding = value;
+        } else if (equals_ignore_case(name, "Connection")) {
+            connection = value;
+        }
+        head.headers.push_back({name, value});
+    }
+
+    if (has_token(connection, "close")) {
+        head.keep_alive = false;
+    } else if (has_token(connection, "keep-alive")) {
+        head.keep_alive = true;
+    }
+    if (!transfer_encoding.empty()) {
+        // Chunked only as the final coding; any other leaves the body delimited by the close
+        size_t comma = transfer_encoding.rfind(',');
+        std::string_view last = comma == std::string_view::npos ? transfer_encoding
+                                                                : transfer_encoding.substr(comma + 1);
+        while (!last.empty() && last.front() == ' ') {
+            last.remove_prefix(1);
+        }
+        head.chunked = equals_ignore_case(last, "chunked");
+        head.has_length = false;
+        if (!head.chunked) {
+            head.keep_alive = false;
+        }
+    }
+    return 1;
+}
+
+// Hop-by-hop headers (RFC 9110 section 7.6.1) describe one connection and are not forwarded,
+// nor is anything the Connection header lists
+static bool hop_by_hop(std::string_view name, std::string_view connection) {
+    static constexpr std::string_view HOP_BY_HOP[] = {"Connection", "Proxy-Connection", "Keep-Alive", "TE", "Upgrade"};
+    for (std::string_view header : HOP_BY_HOP) {
+        if (equals_ignore_case(name, header)) {
+            return true;
+        }
+    }
+    return has_token(connection, name);
+}
+
+// --- UpstreamBody ---
+
+/**
+ * @brief A response body read from the upstream while the client is sent what came before.
+ * Content-Length and close-delimited bodies are spliced from the upstream socket through a
+ * pipe to the client socket; with TLS in user space (peek()) and for chunked bodies, which
+ * must be scanned for their end, they pass through memory. Chunked bodies keep their framing
+ * unless decode is set (HTTP/1.0 clients). The upstream connection goes back to the pool as
+ * soon as the last byte has been read from it.
+ */
+class UpstreamBody : public BodyStream {
+  public:
+    enum class Framing { Length, Chunked, UntilClose };
+
+  private:
+    UpstreamLease lease;
+    Framing framing;
+    bool decode;
+    bool reusable;             // The upstream keeps the connection open after this response
+    size_t remaining = 0;      // Length: bytes still to come from the upstream
+    ChunkedDecoder decoder;
+    bool upstream_done = false;
+    std::string staged;        // Read from the upstream, not sent yet
+    size_t staged_sent = 0;
+    SplicePipe pipe;
+    size_t in_pipe = 0;
+
+    void finish_upstream(bool clean) {
+        upstream_done = true;
+        lease.release(clean && reusable);
+    }
+
+    // Applies the framing to bytes just read; false if they break it
+    bool accept_bytes(std::string_view data) {
+        switch (framing) {
+        case Framing::Length: {
+            size_t take = std::min(data.size(), remaining);
+            staged.append(data.substr(0, take));
+            remaining -= take;
+            reusable = reusable && take == data.size(); // Bytes past the body: the connection is garbled
+            if (remaining == 0) {
+                finish_upstream(true);
+            }
+            return true;
+        }
+        case Framing::UntilClose:
+            staged.append(data);
+            return true;
+        case Framing::Chunked: {
+            size_t used = 0;
+            ChunkedDecoder::Status status =
+                decode ? decoder.decode(data, used, [this](std::string_view chunk) { staged.append(chunk); })
+                       : decoder.decode(data, used, [](std::string_view) {});
+            if (status == ChunkedDecoder::Status::Error) {
+                return false;
+            }
+            if (!decode) {
+                staged.append(data.substr(0, used));
+            }
+            if (status == ChunkedDecoder::Status::Done) {
+                reusable = reusable && used == data.size();
+                finish_upstream(true);
+            }
+            return true;
+        }
+        }
+        return false;
+    }
+
+    // One recv() through accept_bytes(): bytes read, or -1 with errno (ENODATA for nothing yet)
+    ssize_t fill_memory() {
+        char buffer[UPSTREAM_READ_SIZE];
+        size_t want = framing == Framing::Length ? std::min(sizeof(buffer), remaining) : sizeof(buffer);
+        while (true) {
+            ssize_t got = recv(lease.fd(), buffer, want, 0);
+            if (got > 0) {
+                if (!accept_bytes(std::string_view(buffer, static_cast<size_t>(got)))) {
+                    errno = EPROTO;
+                    return -1;
+                }
+                return got;
+            }
+            if (got == 0) {
+                if (framing == Framing::UntilClose) {
+                    finish_upstream(false);
+                    return 0;
+                }
+                errno = EPIPE; // Closed inside the body: the client cannot be given the rest either
+                return -1;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                errno = ENODATA;
+            }
+            return -1;
+        }
+    }
+
+    void compact() {
+        if (staged_sent == staged.size()) {
+            staged.clear();
+            staged_sent = 0;
+        }
+    }
+
+  public:
+    UpstreamBody(UpstreamLease upstream_lease, Framing body_framing, bool decode_chunks, bool keep_alive,
+                 size_t length, std::string_view early)
+        : lease(std::move(upstream_lease)), framing(body_framing), decode(decode_chunks), reusable(keep_alive),
+          remaining(length) {
+        if (!early.empty()) {
+            // Read along with the head. A framing error surfaces at the first write instead.
+            if (!accept_bytes(early)) {
+                reusable = false;
+                lease.release(false);
+            }
+        }
+    }
+    ~UpstreamBody() override { return_pipe(pipe, in_pipe == 0); }
+
+    ssize_t write_to(int fd) override {
+        while (true) {
+            if (staged_sent < staged.size()) {
+                ssize_t sent = send(fd, staged.data() + staged_sent, staged.size() - staged_sent, MSG_NOSIGNAL);
+                if (sent > 0) {
+                    staged_sent += static_cast<size_t>(sent);
+                    compact();
+                }
+                return sent;
+            }
+            if (in_pipe > 0) {
+                ssize_t sent = splice(pipe.read_fd, nullptr, fd, nullptr, in_pipe, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+                if (sent > 0) {
+                    in_pipe -= static_cast<size_t>(sent);
+                }
+                return sent;
+            }
+            if (upstream_done) {
+                return 0;
+            }
+            if (lease.fd() < 0) {
+                errno = EPROTO;
+                return -1;
+            }
+            if (framing != Framing::Chunked && (pipe.read_fd >= 0 || take_pipe(pipe))) {
+                size_t want = framing == Framing::Length ? std::min<size_t>(remaining, SPLICE_PIPE_SIZE)
+                                                         : SPLICE_PIPE_SIZE;
+                ssize_t got = splice(lease.fd(), nullptr, pipe.write_fd, nullptr, want,
+                                     SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+                if (got > 0) {
+                    in_pipe += static_cast<size_t>(got);
+                    if (framing == Framing::Length && (remaining -= static_cast<size_t>(got)) == 0) {
+                        finish_upstream(true);
+                    }
+                    continue;
+                }
+                if (got == 0) {
+                    if (framing == Framing::UntilClose) {
+                        finish_upstream(false);
+                        continue;
+                    }
+                    errno = EPIPE;
+                    return -1;
+                }
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    errno = ENODATA;
+                }
+                return -1;
+            }
+            if (fill_memory() < 0) {
+                return -1;
+            }
+        }
+    }
+
+    ssize_t peek(char *dest, size_t capacity) override {
+        while (staged_sent == staged.size()) {
+            if (in_pipe > 0) {
+                // Spliced in already: read it back out
+                char buffer[UPSTREAM_READ_SIZE];
+                ssize_t got = read(pipe.read_fd, buffer, std::min(in_pipe, sizeof(buffer)));
+                if (got <= 0) {
+                    if (got == 0) {
+                        errno = EPIPE;
+                    }
+                    return -1;
+                }
+                in_pipe -= static_cast<size_t>(got);
+                staged.append(buffer, static_cast<size_t>(got));
+                continue;
+            }
+            if (upstream_done) {
+                return 0;
+            }
+            if (lease.fd() < 0) {
+                errno = EPROTO;
+                return -1;
+            }
+            if (fill_memory() < 0) {
+                return -1;
+            }
+        }
+        size_t length = std::min(capacity, staged.size() - staged_sent);
+        memcpy(dest, staged.data() + staged_sent, length);
+        return static_cast<ssize_t>(length);
+    }
+
+    void sent(size_t bytes) override {
+        staged_sent += bytes;
+        compact();
+    }
+
+    bool done() const override { return upstream_done && staged_sent == staged.size() && in_pipe == 0; }
+
+    int wait_fd() const override { return lease.fd(); }
+
+    void cancel() override {
+        if (lease.fd() >= 0) {
+            shutdown(lease.fd(), SHUT_RDWR);
+        }
+    }
+};
+
+// --- Exchange helpers ---
+
+// A new non-blocking connection to upstream: its fd, or -errno (-ETIMEDOUT past the deadline)
+static Task<int> connect_upstream(const ReverseProxy::Upstream &upstream, Deadline &deadline, uint64_t timeout_ms) {
+    int fd = socket(upstream.address.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        co_return -errno;
+    }
+    if (connect(fd, reinterpret_cast<const struct sockaddr *>(&upstream.address), upstream.address_length) == -1) {
+        if (errno != EINPROGRESS) {
+            int error = errno;
+            close(fd);
+            co_return -error;
+        }
+        deadline.arm(fd, timeout_ms);
+        bool ready = co_await UpstreamWait{fd, true, deadline};
+        deadline.disarm();
+        int error = 0;
+        socklen_t error_length = sizeof(error);
+        if (!ready) {
+            error = ETIMEDOUT;
+        } else if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &error_length) == -1) {
+            error = errno;
+        }
+        if (error != 0) {
+            close(fd);
+            co_return -error;
+        }
+    }
+    set_tcp_nodelay(fd);
+    co_return fd;
+}
+
+// Sends all of data; false if the connection fails or the deadline passes first
+static Task<bool> write_upstream(int fd, std::string_view data, Deadline &deadline) {
+    while (!data.empty()) {
+        ssize_t sent = send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+        if (sent > 0) {
+            data.remove_prefix(static_cast<size_t>(sent));
+            continue;
+        }
+        if (sent == -1 && errno == EINTR) {
+            continue;
+        }
+        if (sent == 0 || (errno != EAGAIN && errno != EWOULDBLOCK) || !co_await UpstreamWait{fd, true, deadline}) {
+            co_return false;
+        }
+    }
+    co_return true;
+}
+
+// Reads into buffer until it starts with a final (non-1xx) response head, which is parsed
+// into head. 1 once it does, 0 if the connection closed before sending anything, -1 on any
+// other failure.
+static Task<int> read_head(int fd, std::string &buffer, UpstreamHead &head, Deadline &deadline) {
+    bool received = false;
+    while (true) {
+        int parsed = parse_upstream_head(buffer, head);
+        if (parsed < 0) {
+            co_return -1;
+        }
+        if (parsed > 0) {
+            if (head.status >= 200) {
+                co_return 1;
+            }
+            if (head.status == 101) {
+                co_return -1; // Upgrades are not proxied
+            }
+            buffer.erase(0, head.length); // 100 Continue and the like: the client got its own
+            continue;
+        }
+        size_t start = buffer.size();
+        buffer.resize(start + UPSTREAM_READ_SIZE);
+        ssize_t got = recv(fd, buffer.data() + start, UPSTREAM_READ_SIZE, 0);
+        buffer.resize(start + (got > 0 ? static_cast<size_t>(got) : 0));
+        if (got > 0) {
+            received = true;
+            continue;
+        }
+        if (got == 0) {
+            co_return received ? -1 : 0;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if ((errno != EAGAIN && errno != EWOULDBLOCK) || !co_await UpstreamWait{fd, false, deadline}) {
+            co_return received || deadline.expired ? -1 : 0;
+        }
+    }
+}
+
+static HttpResponse proxy_error(int status) {
+    ThreadMetrics::local().proxy_errors.add();
+    return status_response(status);
+}
+
+// --- ReverseProxy ---
+
+// A request body collected before the exchange starts (HTTP/2 clients)
+struct BufferedBody {
+    std::string bytes;
+    bool overflow = false;
+};
+
+// The request as it goes upstream: its head (without the blank line) and how its body follows
+struct ReverseProxy::Exchange {
+    std::string head;
+    bool head_request = false;
+    bool http10 = false;
+    bool streamed = false;
+    std::shared_ptr<BodyRelay> relay;
+    std::shared_ptr<BufferedBody> body; // Not streamed, with a body
+};
+
+// Collects a body for an exchange that is not streamed, up to limit
+class BufferingReader : public BodyReader {
+  private:
+    std::shared_ptr<BufferedBody> body;
+    size_t limit;
+
+  public:
+    BufferingReader(std::shared_ptr<BufferedBody> target, size_t max_size)
+        : body(std::move(target)), limit(max_size) {}
+
+    void on_data(std::string_view chunk) override {
+        if (body->bytes.size() + chunk.size() > limit) {
+            body->overflow = true;
+        } else if (!body->overflow) {
+            body->bytes.append(chunk);
+        }
+    }
+    HttpResponse on_complete() override { return HttpResponse(); } // The exchange answers
+};
+
+ReverseProxy::ReverseProxy(ProxyConfig proxy_config) : config(std::move(proxy_config)) {
+    if (config.upstreams.empty()) {
+        throw std::runtime_error("Reverse proxy without upstreams");
+    }
+    for (const std::string &name : config.upstreams) {
+        size_t colon = name.rfind(':');
+        if (colon == std::string::npos || colon == 0 || colon + 1 == name.size()) {
+            throw std::runtime_error("Upstream " + name + " is not host:port");
+        }
+        std::string host = name.substr(0, colon);
+        std::string port = name.substr(colon + 1);
+        if (host.size() > 2 && host.front() == '[' && host.back() == ']') {
+            host = host.substr(1, host.size() - 2); // [::1]:8080
+        }
+
+        struct addrinfo hints = {};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        struct addrinfo *result = nullptr;
+        int error = getaddrinfo(host.c_str(), port.c_str(), &hints, &result);
+        if (error != 0) {
+            throw std::runtime_error("Cannot resolve upstream " + name + ": " + gai_strerror(error));
+        }
+        auto upstream = std::make_unique<Upstream>();
+        upstream->name = name;
+        std::memcpy(&upstream->address, result->ai_addr, result->ai_addrlen);
+        upstream->address_length = result->ai_addrlen;
+        freeaddrinfo(result);
+        upstreams.push_back(std::move(upstream));
+    }
+
+    if (config.health_interval_ms != 0) {
+        health_thread = std::thread(&ReverseProxy::check_health, this);
+    }
+}
+
+ReverseProxy::~ReverseProxy() {
+    {
+        std::lock_guard<std::mutex> lock(health_mutex);
+        stopping = true;
+    }
+    health_wakeup.notify_all();
+    if (health_thread.joinable()) {
+        health_thread.join();
+    }
+}
+
+ReverseProxy::Upstream *ReverseProxy::pick(Upstream *avoid) {
+    // Ties rotate, so equally idle upstreams share the load
+    static thread_local size_t rotor = 0;
+    size_t count = upstreams.size();
+    size_t start = rotor++ % count;
+    Upstream *best = nullptr;
+    uint32_t best_load = 0;
+    for (size_t i = 0; i < count; ++i) {
+        Upstream *upstream = upstreams[(start + i) % count].get();
+        if (upstream == avoid || !upstream->healthy.load(std::memory_order_relaxed)) {
+            continue;
+        }
+        uint32_t load = upstream->outstanding.load(std::memory_order_relaxed);
+        if (!best || load < best_load) {
+            best = upstream;
+            best_load = load;
+        }
+    }
+    if (!best && avoid && avoid->healthy.load(std::memory_order_relaxed)) {
+        best = avoid;
+    }
+    return best;
+}
+
+void ReverseProxy::report_failure(Upstream &upstream) {
+    if (config.health_interval_ms == 0) {
+        return; // Nothing would ever bring it back
+    }
+    unsigned failures = upstream.failures.fetch_add(1, std::memory_order_relaxed) + 1;
+    if (failures >= config.fail_threshold && upstream.healthy.exchange(false)) {
+        log_line(LogLevel::Warning, "Upstream ", upstream.name, " is down");
+    }
+}
+
+void ReverseProxy::report_success(Upstream &upstream) {
+    if (upstream.failures.load(std::memory_order_relaxed) != 0) {
+        upstream.failures.store(0, std::memory_order_relaxed);
+    }
+}
+
+// A GET of the health path on a connection of its own: true for any 2xx or 3xx
+static bool probe_upstream(const ReverseProxy::Upstream &upstream, const std::string &request, uint64_t timeout_ms) {
+    int fd = socket(upstream.address.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        return false;
+    }
+    uint64_t deadline = monotonic_ms() + timeout_ms;
+    auto left = [deadline] {
+        uint64_t now = monotonic_ms();
+        return deadline > now ? deadline - now : 0;
+    };
+
+    bool healthy = false;
+    int error = 0;
+    socklen_t error_length = sizeof(error);
+    if (connect(fd, reinterpret_cast<const struct sockaddr *>(&upstream.address), upstream.address_length) == 0 ||
+        (errno == EINPROGRESS && wait_ready(fd, POLLOUT, left()) &&
+         getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &error_length) == 0 && error == 0)) {
+        std::string_view data = request;
+        while (!data.empty()) {
+            ssize_t sent = send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+            if (sent > 0) {
+                data.remove_prefix(static_cast<size_t>(sent));
+            } else if (sent == 0 || (errno != EAGAIN && errno != EINTR) || !wait_ready(fd, POLLOUT, left())) {
+                break;
+            }
+        }
+        char status[12]; // "HTTP/1.1 200"
+        size_t received = 0;
+        while (data.empty() && received < sizeof(status)) {
+            ssize_t got = recv(fd, status + received, sizeof(status) - received, 0);
+            if (got > 0) {
+                received += static_cast<size_t>(got);
+            } else if (got == 0 || (errno != EAGAIN && errno != EINTR) || !wait_ready(fd, POLLIN, left())) {
+                break;
+            }
+        }
+        healthy = received == sizeof(status) && std::string_view(status, 7) == "HTTP/1." &&
+                  (status[9] == '2' || status[9] == '3');
+    }
+    close(fd);
+    return healthy;
+}
+
+void ReverseProxy::check_health() {
+    std::unique_lock<std::mutex> lock(health_mutex);
+    while (!stopping) {
+        lock.unlock();
+        for (const std::unique_ptr<Upstream> &upstream : upstreams) {
+            std::string request = "GET " + config.health_path + " HTTP/1.1\r\nHost: " + upstream->name +
+                                  "\r\nConnection: close\r\n\r\n";
+            if (!probe_upstream(*upstream, request, config.connect_timeout_ms)) {
+                report_failure(*upstream);
+                continue;
+            }
+            upstream->failures.store(0, std::memory_order_relaxed);
+            if (!upstream->healthy.exchange(true)) {
+                log_line(LogLevel::Warning, "Upstream ", upstream->name, " is back up");
+            }
+        }
+        lock.lock();
+        health_wakeup.wait_for(lock, std::chrono::milliseconds(config.health_interval_ms), [this] { return stopping; });
+    }
+}
+
+ResponseTask ReverseProxy::forward(const HTTPRequest &request, bool streamed, std::shared_ptr<BodyRelay> relay,
+                                   std::unique_ptr<BodyReader> *body_reader) {
+    Exchange exchange_request;
+    exchange_request.head_request = request.method == "HEAD";
+    exchange_request.http10 = request.version_minor == 0;
+    exchange_request.streamed = streamed;
+    exchange_request.relay = std::move(relay);
+    // An HTTP/2 body need not declare its length: a reader is asked for whenever one follows
+    if (!streamed && body_reader) {
+        exchange_request.body = std::make_shared<BufferedBody>();
+        *body_reader = std::make_unique<BufferingReader>(exchange_request.body, config.max_buffered_body);
+    }
+
+    std::string_view path = request.path;
+    std::string &head = exchange_request.head;
+    head.reserve(256 + request.path.size());
+    head.append(request.method);
+    head.push_back(' ');
+    if (!config.strip_prefix.empty() && path.substr(0, config.strip_prefix.size()) == config.strip_prefix) {
+        path.remove_prefix(config.strip_prefix.size());
+    }
+    if (path.empty() || (path.front() != '/' && path.front() != '*')) {
+        head.push_back('/');
+    }
+    head.append(path);
+    head.append(" HTTP/1.1\r\n");
+
+    // The body framing headers stay when the body is relayed as it came, framing included
+    std::string_view connection = request.header("Connection");
+    bool has_host = false;
+    for (size_t i = 0; i < request.header_count; ++i) {
+        const HttpHeader &header = request.headers[i];
+        if (header.name.empty() || header.name.front() == ':' || hop_by_hop(header.name, connection) ||
+            equals_ignore_case(header.name, "Expect") || equals_ignore_case(header.name, "HTTP2-Settings") ||
+            (!streamed && (equals_ignore_case(header.name, "Content-Length") ||
+                           equals_ignore_case(header.name, "Transfer-Encoding")))) {
+            continue;
+        }
+        has_host = has_host || equals_ignore_case(header.name, "Host");
+        head.append(header.name);
+        head.append(": ");
+        head.append(header.value);
+        head.append("\r\n");
+    }
+    if (!has_host) {
+        head.append("Host: ");
+        head.append(upstreams.front()->name);
+        head.append("\r\n");
+    }
+    return exchange(std::move(exchange_request));
+}
+
+ResponseTask ReverseProxy::exchange(Exchange request) {
+    ThreadMetrics::local().proxy_requests.add();
+    std::shared_ptr<BodyRelay> relay = request.relay;
+
+    // However the exchange ends, a body still arriving is discarded from then on
+    struct RelayGuard {
+        BodyRelay *relay;
+        ~RelayGuard() {
+            if (relay) {
+                relay->fail();
+            }
+        }
+    } guard{relay.get()};
+
+    if (request.body && request.body->overflow) {
+        co_return status_response(413);
+    }
+    std::string &head = request.head;
+    if (request.body) {
+        head.append("Content-Length: ");
+        head.append(std::to_string(request.body->bytes.size()));
+        head.append("\r\n\r\n");
+        head.append(request.body->bytes);
+        request.body.reset();
+    } else {
+        head.append("\r\n");
+    }
+
+    Upstream *upstream = nullptr;
+    UpstreamLease lease;
+    Deadline deadline;
+    std::string buffer;
+    UpstreamHead response_head;
+    for (int attempt = 0;; ++attempt) {
+        bool retry = attempt == 0;
+        upstream = pick(upstream);
+        if (!upstream) {
+            co_return proxy_error(503);
+        }
+        lease = UpstreamLease(*upstream, config.max_idle_per_worker);
+        int fd = take_idle(*upstream, config.idle_timeout_ms);
+        bool reused = fd >= 0;
+        if (reused) {
+            ThreadMetrics::local().proxy_reused.add();
+        } else {
+            fd = co_await connect_upstream(*upstream, deadline, config.connect_timeout_ms);
+            if (fd < 0) {
+                report_failure(*upstream);
+                if (retry) {
+                    continue; // Another upstream, if there is one
+                }
+                co_return proxy_error(fd == -ETIMEDOUT ? 504 : 502);
+            }
+        }
+        lease.adopt(fd);
+        // A pooled connection the upstream closed meanwhile fails before any response byte:
+        // the request is sent again on a new one, unless body bytes have gone out already
+        bool stale_retry = reused && retry;
+
+        deadline.arm(fd, config.response_timeout_ms);
+        if (!co_await write_upstream(fd, head, deadline)) {
+            if (stale_retry && !deadline.expired) {
+                continue;
+            }
+            report_failure(*upstream);
+            co_return proxy_error(deadline.expired ? 504 : 502);
+        }
+
+        if (relay) {
+            relay->attach(fd, config.response_timeout_ms);
+            while (!relay->complete && !relay->failed && !relay->cancelled) {
+                if (!relay->stalled) {
+                    deadline.disarm(); // A slow client is the connection's body timeout to judge
+                    co_await relay->next();
+                    continue;
+                }
+                // The upstream's socket is full: once it drains, the connection offers the rest
+                deadline.arm(fd, config.response_timeout_ms);
+                bool ready = co_await UpstreamWait{fd, true, deadline};
+                relay->stalled = false;
+                if (!ready) {
+                    relay->fail();
+                } else if (relay->wake) {
+                    relay->wake();
+                }
+            }
+            if (relay->cancelled) {
+                co_return HttpResponse(); // No one is left to answer
+            }
+            if (relay->failed) {
+                report_failure(*upstream);
+                co_return proxy_error(deadline.expired ? 504 : 502);
+            }
+            stale_retry = stale_retry && relay->relayed == 0;
+        }
+
+        deadline.arm(fd, config.response_timeout_ms);
+        buffer.clear();
+        int result = co_await read_head(fd, buffer, response_head, deadline);
+        if (result == 0 && stale_retry && !deadline.expired) {
+            continue;
+        }
+        if (result <= 0) {
+            report_failure(*upstream);
+            co_return proxy_error(deadline.expired ? 504 : 502);
+        }
+        break;
+    }
+    deadline.disarm();
+    report_success(*upstream);
+
+    HttpResponse response(response_head.status);
+    std::string_view connection;
+    for (const HttpHeader &header : response_head.headers) {
+        if (equals_ignore_case(header.name, "Connection")) {
+            connection = header.value;
+        }
+    }
+    for (const HttpHeader &header : response_head.headers) {
+        if (!hop_by_hop(header.name, connection) && !equals_ignore_case(header.name, "Content-Length") &&
+            !equals_ignore_case(header.name, "Transfer-Encoding")) {
+            response.set_header(header.name, header.value);
+        }
+    }
+    std::string_view early = std::string_view(buffer).substr(response_head.length);
+    bool keep_alive = response_head.keep_alive;
+
+    using Framing = UpstreamBody::Framing;
+    Framing framing = response_head.chunked      ? Framing::Chunked
+                      : response_head.has_length ? Framing::Length
+                                                 : Framing::UntilClose;
+
+    if (request.head_request || !status_has_body(response_head.status)) {
+        lease.release(keep_alive && early.empty());
+        if (request.head_request && status_has_body(response_head.status)) {
+            // What a GET would have been sent with
+            if (framing == Framing::Length) {
+                response.set_body_stream(nullptr, response_head.content_length);
+            } else {
+                if (framing == Framing::Chunked && !request.http10) {
+                    response.set_header("Transfer-Encoding", "chunked");
+                }
+                response.set_body_stream(nullptr);
+            }
+            response.omit_body();
+        }
+        co_return response;
+    }
+    if (framing == Framing::Length && response_head.content_length == 0) {
+        lease.release(keep_alive && early.empty());
+        co_return response;
+    }
+
+    int fd = lease.fd();
+    auto body = std::make_shared<UpstreamBody>(std::move(lease), framing, !request.streamed || request.http10,
+                                               keep_alive, response_head.content_length, early);
+    if (request.streamed) {
+        if (framing == Framing::Length) {
+            response.set_body_stream(std::move(body), response_head.content_length);
+        } else if (framing == Framing::Chunked && !request.http10) {
+            response.set_header("Transfer-Encoding", "chunked");
+            response.set_body_stream(std::move(body));
+        } else {
+            response.set_body_stream(std::move(body));
+            response.set_connection(HttpResponse::Connection::Close);
+        }
+        co_return response;
+    }
+
+    // Not streamed: read the whole body here, decoded, and answer with it
+    std::string whole;
+    char chunk[UPSTREAM_READ_SIZE];
+    while (!body->done()) {
+        ssize_t got = body->peek(chunk, sizeof(chunk));
+        if (got > 0) {
+            body->sent(static_cast<size_t>(got));
+            if (whole.size() + static_cast<size_t>(got) > config.max_buffered_body) {
+                co_return proxy_error(502);
+            }
+            whole.append(chunk, static_cast<size_t>(got));
+            continue;
+        }
+        if (got == 0) {
+            continue;
+        }
+        if (errno != ENODATA) {
+            co_return proxy_error(502);
+        }
+        deadline.arm(fd, config.response_timeout_ms);
+        if (!co_await UpstreamWait{fd, false, deadline}) {
+            co_return proxy_error(504);
+        }
+    }
+    response.set_body(std::move(whole));
+    co_return response;
+}
@@ -0,0 +1,181 @@
+#ifndef PROXY_H
+#define PROXY_H
+
+#include "coroutine.h"
+#include "http-parser.h"
+#include "router.h"
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <vector>
+
+// HttpServer::add_endpoint() with a ReverseProxy: where its routes are forwarded to
+struct ProxyConfig {
+    std::vector<std::string> upstreams; // "host:port", resolved once by the ReverseProxy
+    std::string strip_prefix;           // Removed from the front of the path before forwarding
+
+    // Keep-alive connections each worker thread holds on to per upstream between requests,
+    // and how long one may sit unused before it is closed instead of reused
+    size_t max_idle_per_worker = 32;
+    uint64_t idle_timeout_ms = 30000;
+
+    uint64_t connect_timeout_ms = 3000;
+    uint64_t response_timeout_ms = 30000; // Until the response head, and per stalled body write
+
+    // Active health checks: a GET of health_path on every upstream each health_interval_ms.
+    // An upstream that fails fail_threshold checks or requests in a row takes no requests
+    // until a check succeeds again. 0 = no checks, and no upstream is ever taken out.
+    std::string health_path = "/";
+    uint64_t health_interval_ms = 2000;
+    unsigned fail_threshold = 3;
+
+    // HTTP/2 clients: their request and the response are held whole, up to this size (502 beyond)
+    size_t max_buffered_body = 8u << 20;
+};
+
+/**
+ * @brief A request body on its way upstream as it arrives. The connection hands each piece
+ * to relay() while the proxy's coroutine waits for the response, so a large upload is never
+ * held whole. When the upstream socket is full relay() takes only what fits and the proxy
+ * waits for it to drain, then calls wake to have the connection offer the rest: the client
+ * is read no faster than the upstream accepts. Without a Scheduler (ThreadPool workers)
+ * relay() blocks instead. Both sides run on one thread.
+ */
+class BodyRelay {
+  private:
+    int fd = -1;          // Upstream socket, once attached
+    bool blocking = false;
+    uint64_t timeout_ms = 0;
+    std::coroutine_handle<> waiter;
+
+    void notify();
+
+  public:
+    bool complete = false;  // finish(): every body byte was relayed
+    bool failed = false;    // The upstream went away: the rest of the body is discarded
+    bool cancelled = false; // The connection went away
+    bool stalled = false;   // relay() took less than it was offered
+    size_t relayed = 0;
+    std::function<void()> wake; // RequestState::async_wake
+
+    // Bytes of data taken: all of it once attached and healthy, less (0 before attach())
+    // when the upstream cannot take more yet. Discarded data counts as taken.
+    size_t relay(std::string_view data);
+
+    void finish();
+    void fail() { failed = true; }
+    void cancel();
+
+    // The proxy's side: data goes to socket from now on. Blocking relays poll it for up to
+    // write_timeout_ms whenever it is full.
+    void attach(int socket, uint64_t write_timeout_ms);
+
+    // Suspends until relay(), finish() or cancel() has something for the proxy
+    struct Awaiter {
+        BodyRelay &relay;
+        bool await_ready() const noexcept {
+            return relay.complete || relay.failed || relay.cancelled || relay.stalled;
+        }
+        void await_suspend(std::coroutine_handle<> handle) noexcept { relay.waiter = handle; }
+        void await_resume() const noexcept {}
+    };
+    Awaiter next() { return Awaiter{*this}; }
+};
+
+// The connection's reference to a BodyRelay: cancels it when dropped or replaced, as
+// AsyncResponseRef does for the handler's response
+class BodyRelayRef {
+  private:
+    std::shared_ptr<BodyRelay> relay;
+
+  public:
+    BodyRelayRef() = default;
+    explicit BodyRelayRef(std::shared_ptr<BodyRelay> r) : relay(std::move(r)) {}
+    BodyRelayRef(BodyRelayRef &&other) noexcept = default;
+    BodyRelayRef &operator=(BodyRelayRef &&other) noexcept {
+        if (this != &other) {
+            reset();
+            relay = std::move(other.relay);
+        }
+        return *this;
+    }
+    ~BodyRelayRef() { reset(); }
+
+    void reset() {
+        if (relay) {
+            relay->cancel();
+            relay.reset();
+        }
+    }
+    BodyRelay *operator->() const { return relay.get(); }
+    explicit operator bool() const { return static_cast<bool>(relay); }
+};
+
+/**
+ * @brief Forwards requests to a set of HTTP/1.1 upstream servers. Each request goes to the
+ * healthy upstream with the fewest requests in flight, over a keep-alive connection from the
+ * worker thread's pool when one is idle. The response head is rewritten (hop-by-hop headers
+ * dropped) and the body is passed on as it arrives: spliced from the upstream socket through
+ * a pipe to the client without entering user space, or relayed chunk for chunk. HTTP/2
+ * clients get the response buffered instead. Upstreams are resolved and health checks started
+ * in the constructor, which throws std::runtime_error if an address does not resolve.
+ */
+class ReverseProxy {
+  public:
+    struct Upstream {
+        std::string name; // As configured
+        struct sockaddr_storage address;
+        socklen_t address_length = 0;
+        std::atomic<uint32_t> outstanding{0};
+        std::atomic<bool> healthy{true};
+        std::atomic<unsigned> failures{0};
+    };
+
+  private:
+    ProxyConfig config;
+    std::vector<std::unique_ptr<Upstream>> upstreams;
+
+    std::thread health_thread;
+    std::mutex health_mutex;
+    std::condition_variable health_wakeup;
+    bool stopping = false;
+
+    struct Exchange; // What forward() copies out of the request, defined in proxy.cc
+
+    void check_health();
+    ResponseTask exchange(Exchange request);
+
+  public:
+    explicit ReverseProxy(ProxyConfig proxy_config);
+    ~ReverseProxy();
+
+    ReverseProxy(const ReverseProxy &) = delete;
+    ReverseProxy &operator=(const ReverseProxy &) = delete;
+
+    const ProxyConfig &settings() const { return config; }
+
+    // The least loaded healthy upstream, other than avoid if there is another; nullptr when
+    // none is healthy
+    Upstream *pick(Upstream *avoid = nullptr);
+
+    // Passive health: counted towards fail_threshold, or resetting it
+    void report_failure(Upstream &upstream);
+    void report_success(Upstream &upstream);
+
+    // The exchange for request, not yet started; copies what it needs from request. A streamed
+    // exchange (HTTP/1.1) passes the response body on as it arrives, and a request body through
+    // relay. Otherwise the request body is collected by the reader handed back through
+    // body_reader and the response is read whole.
+    ResponseTask forward(const HTTPRequest &request, bool streamed, std::shared_ptr<BodyRelay> relay,
+                         std::unique_ptr<BodyReader> *body_reader);
+};
+
+#endif // PROXY_H
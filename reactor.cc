@@ -0,0 +1,488 @@
+#include "reactor.h"
+#include "log.h"
+#include "metrics.h"
+#include <algorithm>
+#include <errno.h>
+#include <stdexcept>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Accepted-but-not-yet-adopted FDs a worker can have queued before hand_off backs off
+static constexpr size_t HANDOFF_RING_CAPACITY = 4096;
+
+// Buffered input beyond this is served before reading on, so a streaming upload keeps the
+// connection's memory bounded; a read of BUFFER_SIZE past it still fits the slab block
+static constexpr size_t SERVE_THRESHOLD = BufferSlab::BLOCK_SIZE - BUFFER_SIZE;
+
+// While draining, how often the worker checks its deadline when nothing else wakes it
+static constexpr int DRAIN_POLL_MS = 100;
+
+ReactorWorker::ReactorWorker(size_t worker_id, HttpServer &owner)
+    : id(worker_id), server(owner), handoff_ring(HANDOFF_RING_CAPACITY) {
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd == -1) {
+        throw std::runtime_error("epoll_create1 failed for reactor worker");
+    }
+
+    event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (event_fd == -1) {
+        close(epoll_fd);
+        throw std::runtime_error("eventfd failed for reactor worker");
+    }
+
+    // The eventfd stays level-triggered: it is reset explicitly in drain_handoff_queue()
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.fd = event_fd;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, event_fd, &event) == -1) {
+        close(event_fd);
+        close(epoll_fd);
+        throw std::runtime_error("epoll_ctl: event_fd failed");
+    }
+}
+
+ReactorWorker::~ReactorWorker() {
+    stop();
+    for (auto &entry : connections) {
+        close(entry.first);
+    }
+    connections.clear();
+    int pending_fd;
+    while (handoff_ring.try_pop(pending_fd)) {
+        close(pending_fd);
+    }
+    if (listen_fd != -1) {
+        close(listen_fd);
+    }
+    close(event_fd);
+    close(epoll_fd);
+}
+
+void ReactorWorker::set_listener(int fd) {
+    // Level-triggered like the master's listener: accept_connections() drains it anyway
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) == -1) {
+        throw std::runtime_error("epoll_ctl: listen_fd failed");
+    }
+    listen_fd = fd;
+}
+
+void ReactorWorker::start() {
+    running = true;
+    thread = std::thread([this] { this->run(); });
+}
+
+void ReactorWorker::stop() {
+    bool expected = true;
+    if (!running.compare_exchange_strong(expected, false)) {
+        return;
+    }
+
+    // Wake the worker out of epoll_wait so it observes running == false
+    uint64_t one = 1;
+    if (write(event_fd, &one, sizeof(one)) == -1) {
+        log_errno("eventfd write failed in stop");
+    }
+
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
+
+void ReactorWorker::drain(uint64_t deadline_ms) {
+    drain_deadline_ms = std::max<uint64_t>(deadline_ms, 1);
+    uint64_t one = 1;
+    if (write(event_fd, &one, sizeof(one)) == -1) {
+        log_errno("eventfd write failed in drain");
+    }
+}
+
+void ReactorWorker::join() {
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
+
+void ReactorWorker::hand_off(std::span<const int> client_fds) {
+    for (int client_fd : client_fds) {
+        // Full means this worker is thousands of connections behind: let it catch up
+        while (!handoff_ring.try_push(std::move(client_fd))) {
+            std::this_thread::yield();
+        }
+    }
+
+    uint64_t one = 1;
+    if (write(event_fd, &one, sizeof(one)) == -1) {
+        log_errno("eventfd write failed in hand_off");
+    }
+}
+
+void ReactorWorker::drain_handoff_queue() {
+    uint64_t counter;
+    if (read(event_fd, &counter, sizeof(counter)) == -1 && errno != EAGAIN) {
+        log_errno("eventfd read failed");
+    }
+
+    // Drain after resetting the counter: a push racing with us re-signals the eventfd
+    int fd;
+    while (handoff_ring.try_pop(fd)) {
+        register_connection(fd);
+    }
+}
+
+void ReactorWorker::accept_connections() {
+    while (true) {
+        // accept4 hands back a non-blocking socket directly, saving the fcntl round trip
+        int client_fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+        if (client_fd < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                log_errno("accept error in reactor worker");
+            }
+            return;
+        }
+
+        ThreadMetrics::local().accepted.add();
+        HTTP_TRACE_ACCEPT(client_fd);
+        set_tcp_nodelay(client_fd);
+        register_connection(client_fd);
+    }
+}
+
+void ReactorWorker::register_connection(int client_fd) {
+    Connection &conn = connections[client_fd];
+    conn.fd = client_fd;
+    conn.request = RequestState(server.config.max_header_size);
+    conn.timer.node.fd = client_fd;
+    HTTP_TRACE_CONNECTION(conn.request, client_fd);
+    conn.request.connection.fd = client_fd;
+    conn.request.async_wake = [this, client_fd] { on_async_response(client_fd); };
+    if (server.tls_context && !(conn.tls = server.tls_context->accept(client_fd))) {
+        log_line(LogLevel::Error, "TLS session allocation failed for client_fd");
+        connections.erase(client_fd);
+        close(client_fd);
+        ThreadMetrics::local().closed.add();
+        return;
+    }
+    conn.request.connection.tls = conn.tls != nullptr;
+
+    // Register for both directions once: with EPOLLET, EPOLLOUT only fires on the
+    // not-writable -> writable transition, so there is no need to EPOLL_CTL_MOD later.
+    struct epoll_event event;
+    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    event.data.fd = client_fd;
+
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client_fd, &event) == -1) {
+        log_errno("epoll_ctl: client_fd failed");
+        connections.erase(client_fd);
+        close(client_fd);
+        ThreadMetrics::local().closed.add();
+        return;
+    }
+
+    // A client that connects and never sends anything is pruned like an idle one
+    conn.timer.update(timers, server.config, TimeoutPhase::Idle, false, false, 0);
+}
+
+void ReactorWorker::close_connection(int fd) {
+    auto it = connections.find(fd);
+    if (it != connections.end()) {
+        it->second.timer.cancel(timers);
+        connections.erase(it);
+    }
+    // close() removes the FD from the interest set since no other descriptor refers to it
+    close(fd);
+    ThreadMetrics::local().closed.add();
+}
+
+void ReactorWorker::expire_timers() {
+    timers.advance(monotonic_ms(), [this](TimerNode *node) {
+        auto it = connections.find(node->fd);
+        if (it == connections.end()) {
+            return;
+        }
+        Connection &conn = it->second;
+        TimeoutPhase phase = conn.timer.phase;
+        conn.timer.phase = TimeoutPhase::None;
+        // A client still in its TLS handshake cannot be sent a 408
+        bool can_respond = !conn.tls || conn.tls->established();
+        if ((phase == TimeoutPhase::Header || phase == TimeoutPhase::Body) && conn.output.empty() && can_respond) {
+            request_timeout_response().append_to(conn.output);
+            conn.close_after_write = true;
+            flush(conn);
+            return;
+        }
+        close_connection(conn.fd);
+    });
+}
+
+bool ReactorWorker::drain_step() {
+    if (listen_fd != -1) {
+        // On this thread, so the listener cannot be closed under an epoll_ctl() of our own.
+        // The process that took the socket over keeps accepting on its copy.
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, listen_fd, nullptr);
+        close(listen_fd);
+        listen_fd = -1;
+    }
+
+    // Idle between requests: nothing is lost by closing now. A connection still to send its
+    // first request gets until the deadline; any response it gets closes it.
+    std::vector<int> idle;
+    for (const auto &entry : connections) {
+        if (entry.second.timer.phase == TimeoutPhase::Idle && entry.second.requests_served > 0) {
+            idle.push_back(entry.first);
+        }
+    }
+    for (int fd : idle) {
+        close_connection(fd);
+    }
+    return connections.empty() || monotonic_ms() >= drain_deadline_ms;
+}
+
+void ReactorWorker::serve_buffered(Connection &conn) {
+    // Serve every pipelined request that is complete
+    if (!server.serve_pipelined(conn.in_buffer, conn.output, conn.request, conn.requests_served)) {
+        conn.close_after_write = true;
+    }
+}
+
+bool ReactorWorker::continue_handshake(Connection &conn) {
+    switch (conn.tls->handshake()) {
+    case TlsConnection::Handshake::Done:
+        return true;
+    case TlsConnection::Handshake::Pending:
+        // The handshake is bounded like a request head
+        conn.timer.update(timers, server.config, TimeoutPhase::Header, false, false, conn.requests_served);
+        return false;
+    default:
+        close_connection(conn.fd);
+        return false;
+    }
+}
+
+void ReactorWorker::on_readable(Connection &conn) {
+    if (conn.tls && !conn.tls->established() && !continue_handshake(conn)) {
+        return;
+    }
+    bool peer_closed = false;
+    bool read_progress = false;
+
+    // Edge-triggered: drain the socket until EAGAIN or we lose the next notification.
+    // recv() writes straight into the connection's slab block.
+    while (true) {
+        char *tail = conn.in_buffer.prepare(BUFFER_SIZE);
+        ssize_t bytes_received = conn.tls ? conn.tls->recv(tail, conn.in_buffer.writable())
+                                          : recv(conn.fd, tail, conn.in_buffer.writable(), 0);
+
+        if (bytes_received > 0) {
+            conn.in_buffer.commit(static_cast<size_t>(bytes_received));
+            ThreadMetrics::local().bytes_in.add(static_cast<uint64_t>(bytes_received));
+            HTTP_TRACE_FIRST_BYTE(conn.request);
+            read_progress = true;
+            // A large upload goes to the HTTP layer as it arrives instead of piling up here
+            if (conn.in_buffer.size() >= SERVE_THRESHOLD && !conn.close_after_write) {
+                serve_buffered(conn);
+                if (conn.close_after_write) {
+                    break;
+                }
+            }
+            // Nothing is served behind a suspended handler, and a proxied body goes no faster
+            // than its upstream takes it: leave the rest in the socket
+            if (conn.request.awaiting_response() && conn.in_buffer.size() >= SERVE_THRESHOLD) {
+                conn.read_paused = true;
+                break;
+            }
+            continue;
+        }
+        if (bytes_received == 0) {
+            peer_closed = true;
+            break;
+        }
+        if (errno == EINTR)
+            continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            break;
+
+        close_connection(conn.fd);
+        return;
+    }
+    conn.in_buffer.trim(); // Nothing arrived: the block goes back until something does
+
+    if (!conn.close_after_write) {
+        serve_buffered(conn);
+        if (peer_closed) {
+            // Whatever is left can never complete; answer what was served, then close
+            conn.close_after_write = true;
+        }
+    }
+
+    // A half-closed peer still gets its response; EPOLLOUT resumes any short write
+    flush(conn, read_progress);
+}
+
+void ReactorWorker::on_writable(Connection &conn) {
+    if (conn.tls && !conn.tls->established()) {
+        // The handshake may end here, with the first request already decrypted and buffered
+        if (continue_handshake(conn)) {
+            on_readable(conn);
+        }
+        return;
+    }
+    if (!conn.output.empty()) {
+        flush(conn);
+    }
+}
+
+bool ReactorWorker::flush(Connection &conn, bool read_progress) {
+    // Each sendmsg() gathers every queued response segment; a short write resumes mid-segment
+    bool write_progress = false;
+    while (!conn.output.empty()) {
+        ssize_t sent = conn.tls ? conn.tls->send(conn.output) : conn.output.write_to(conn.fd);
+        if (sent >= 0) {
+            ThreadMetrics::local().bytes_out.add(static_cast<uint64_t>(sent));
+            write_progress |= sent > 0;
+            continue;
+        }
+        if (errno == EINTR)
+            continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            break; // Resume on the next EPOLLOUT edge
+        if (errno == ENODATA) {
+            // A streamed body has nothing new: its source wakes the connection instead
+            HttpServer::await_body_stream(conn.output, conn.request.async_wake);
+            break;
+        }
+
+        close_connection(conn.fd);
+        return false;
+    }
+    if (conn.output.empty()) {
+        HTTP_TRACE_SENT(conn.request);
+    }
+
+    // A suspended handler still owes this connection a response
+    if (conn.output.empty() && conn.close_after_write && !conn.request.awaiting_response()) {
+        close_connection(conn.fd);
+        return false;
+    }
+
+    TimeoutPhase phase = timeout_phase(conn.request, !conn.in_buffer.empty(), !conn.output.empty());
+    conn.timer.update(timers, server.config, phase, read_progress, write_progress, conn.requests_served);
+    return true;
+}
+
+void ReactorWorker::on_async_response(int fd) {
+    auto it = connections.find(fd);
+    if (it == connections.end()) {
+        return;
+    }
+    Connection &conn = it->second;
+
+    // Not gated on close_after_write: a half-closed peer is still owed this response
+    serve_buffered(conn);
+    if (!flush(conn)) {
+        return;
+    }
+    if (conn.read_paused &&
+        (!conn.request.awaiting_response() || conn.in_buffer.size() < SERVE_THRESHOLD)) {
+        // The edge for what is left in the socket came and went while reading was paused
+        conn.read_paused = false;
+        on_readable(conn);
+    }
+}
+
+void ReactorWorker::resume_after(std::coroutine_handle<> handle, uint64_t delay_ms) {
+    sleepers.add(handle, monotonic_ms() + delay_ms);
+}
+
+void ReactorWorker::resume_when_ready(std::coroutine_handle<> handle, int fd, bool writable) {
+    struct epoll_event event;
+    event.events = (writable ? EPOLLOUT : EPOLLIN) | EPOLLONESHOT;
+    event.data.fd = fd;
+
+    // A one-shot entry left over from the last wait on this fd is still registered, only disarmed
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) == -1 &&
+        (errno != EEXIST || epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &event) == -1)) {
+        // Resume on the next turn: the read or write the coroutine retries reports the error
+        log_errno("epoll_ctl: coroutine wait failed");
+        sleepers.add(handle, 0);
+        return;
+    }
+    fd_waiters[fd] = handle;
+}
+
+void ReactorWorker::run() {
+    enter_thread();
+    Scheduler::set_current(this);
+
+    while (running) {
+        int timeout = earliest_timeout(timers.next_timeout_ms(), sleepers.next_timeout_ms(monotonic_ms()));
+        if (drain_deadline_ms != 0) {
+            timeout = earliest_timeout(timeout, DRAIN_POLL_MS);
+        }
+        int num_events = epoll_wait(epoll_fd, events, MAX_EVENTS, timeout);
+
+        if (num_events < 0) {
+            if (errno == EINTR)
+                continue;
+            log_errno("epoll_wait failed in reactor worker");
+            break;
+        }
+
+        for (int i = 0; i < num_events; i++) {
+            int current_fd = events[i].data.fd;
+
+            if (current_fd == event_fd) {
+                drain_handoff_queue();
+                continue;
+            }
+            if (current_fd == listen_fd) {
+                accept_connections();
+                continue;
+            }
+
+            auto waiter = fd_waiters.find(current_fd);
+            if (waiter != fd_waiters.end()) {
+                std::coroutine_handle<> handle = waiter->second;
+                fd_waiters.erase(waiter);
+                handle.resume();
+                continue;
+            }
+
+            auto it = connections.find(current_fd);
+            if (it == connections.end()) {
+                continue; // Closed earlier in this batch
+            }
+
+            uint32_t flags = events[i].events;
+            if (flags & EPOLLERR) {
+                close_connection(current_fd);
+                continue;
+            }
+            if (flags & (EPOLLIN | EPOLLHUP | EPOLLRDHUP)) {
+                on_readable(it->second);
+                it = connections.find(current_fd);
+                if (it == connections.end())
+                    continue;
+            }
+            if (flags & EPOLLOUT) {
+                on_writable(it->second);
+            }
+        }
+
+        sleepers.resume_due(monotonic_ms());
+        expire_timers();
+
+        if (drain_deadline_ms != 0 && drain_step()) {
+            break;
+        }
+    }
+
+    log_line(LogLevel::Info, "Reactor worker ", id, " stopped with ", connections.size(), " open connections.");
+}
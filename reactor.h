@@ -0,0 +1,113 @@
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#include "coroutine.h"
+#include "event-loop.h"
+#include "http-server.h"
+#include "ring-buffer.h"
+#include "timer-wheel.h"
+#include <atomic>
+#include <memory>
+#include <string>
+#include <sys/epoll.h>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Per-connection state. Owned and touched exclusively by one ReactorWorker.
+struct Connection {
+    int fd = -1;
+    InputBuffer in_buffer; // Holds a slab block only while input is buffered
+    RequestState request; // Resumes a request (head or body) split across reads
+    OutputQueue output;   // Responses the socket has not accepted yet
+    bool close_after_write = false;
+    bool read_paused = false; // Input left in the socket while a coroutine handler is suspended
+    size_t requests_served = 0;
+    std::unique_ptr<TlsConnection> tls; // Set when the server has a TlsContext
+
+    // Armed for the connection's current phase (idle, head, body, write); see ConnectionTimer
+    ConnectionTimer timer;
+};
+
+/**
+ * @brief One reactor thread: owns an epoll instance, an eventfd-signalled handoff
+ * queue and every connection handed to it. All socket I/O is non-blocking and
+ * edge-triggered, so a slow client only costs a map entry, not a thread. Coroutine handlers
+ * suspend onto the same loop: sleeps wait in a heap, fd waits as one-shot epoll entries.
+ */
+class ReactorWorker : public EventLoop, public Scheduler {
+  private:
+    size_t id;
+    HttpServer &server;
+
+    int epoll_fd = -1;
+    int event_fd = -1;
+    int listen_fd = -1; // ReusePort mode only: this worker's own SO_REUSEPORT listener
+    std::atomic<bool> running = false;
+    std::atomic<uint64_t> drain_deadline_ms = 0; // Set by drain(); 0 while serving normally
+    std::thread thread;
+
+    // FDs pushed by the master thread (the only producer), picked up on the next eventfd wakeup
+    SpscRing<int> handoff_ring;
+
+    std::unordered_map<int, Connection> connections;
+    TimerWheel timers;
+
+    SleepQueue sleepers;
+    std::unordered_map<int, std::coroutine_handle<>> fd_waiters; // Keyed by the awaited fd
+
+    struct epoll_event events[MAX_EVENTS];
+
+    void run();
+
+    // Moves handed-off FDs into this worker's interest set
+    void drain_handoff_queue();
+
+    // ReusePort mode: accepts until EAGAIN straight into this worker's interest set
+    void accept_connections();
+
+    void register_connection(int client_fd);
+    void close_connection(int fd);
+
+    // Handles every connection whose deadline has passed: a late head or body gets a 408,
+    // anything else is closed
+    void expire_timers();
+
+    // One draining pass: drops the listener and closes idle connections. True once the loop
+    // should end.
+    bool drain_step();
+
+    // Advances conn's TLS handshake on a readiness event; true once it is established. On
+    // failure the connection is closed.
+    bool continue_handshake(Connection &conn);
+
+    // Edge-triggered handlers: both loop until EAGAIN
+    void on_readable(Connection &conn);
+    void on_writable(Connection &conn);
+
+    // Runs the HTTP layer over whatever in_buffer holds; may set close_after_write
+    void serve_buffered(Connection &conn);
+
+    // Writes what the socket takes, then re-arms the timer for the phase the connection is now
+    // in; read_progress says input arrived since the last call. Returns false if it was closed.
+    bool flush(Connection &conn, bool read_progress = false);
+
+    // RequestState::async_wake: a suspended handler of fd's connection has its response
+    void on_async_response(int fd);
+
+  public:
+    ReactorWorker(size_t worker_id, HttpServer &owner);
+    ~ReactorWorker() override;
+
+    void set_listener(int fd) override;
+    void start() override;
+    void stop() override;
+    void drain(uint64_t deadline_ms) override;
+    void join() override;
+    void hand_off(std::span<const int> client_fds) override;
+
+    void resume_after(std::coroutine_handle<> handle, uint64_t delay_ms) override;
+    void resume_when_ready(std::coroutine_handle<> handle, int fd, bool writable) override;
+};
+
+#endif // REACTOR_H
@@ -0,0 +1,149 @@
+#include "request.h"
+#include <sys/socket.h>
+
+std::string_view RouteParams::get(std::string_view name) const {
+    for (size_t i = 0; i < count; ++i) {
+        if (items[i].first == name) {
+            return items[i].second;
+        }
+    }
+    return {};
+}
+
+bool ConnectionInfo::peer_address(sockaddr_storage &address, socklen_t &length) const {
+    if (fd < 0) {
+        return false;
+    }
+    length = sizeof(address);
+    return getpeername(fd, reinterpret_cast<sockaddr *>(&address), &length) == 0;
+}
+
+Request::Request(const HTTPRequest &request, std::string_view path, const RouteParams &params,
+                 const ConnectionInfo &connection, std::string_view body)
+    : http(request), request_path(path), route_params(params), info(connection), body_view(body) {
+    size_t question = request.path.find('?');
+    if (question != std::string_view::npos) {
+        query_string = request.path.substr(question + 1);
+    }
+}
+
+void Request::parse_query() const {
+    query_parsed = true;
+    std::string_view rest = query_string;
+    while (!rest.empty() && query_count < MAX_QUERY_PARAMS) {
+        size_t amp = rest.find('&');
+        std::string_view item = rest.substr(0, amp);
+        rest = amp == std::string_view::npos ? std::string_view() : rest.substr(amp + 1);
+        if (item.empty()) {
+            continue;
+        }
+        size_t equals = item.find('=');
+        if (equals == std::string_view::npos) {
+            query_items[query_count++] = {item, {}};
+        } else {
+            query_items[query_count++] = {item.substr(0, equals), item.substr(equals + 1)};
+        }
+    }
+}
+
+static std::string_view trim_spaces(std::string_view value) {
+    while (!value.empty() && (value.front() == ' ' || value.front() == '\t')) {
+        value.remove_prefix(1);
+    }
+    while (!value.empty() && (value.back() == ' ' || value.back() == '\t')) {
+        value.remove_suffix(1);
+    }
+    return value;
+}
+
+void Request::parse_cookies() const {
+    cookies_parsed = true;
+    // HTTP/2 clients may split the cookie-string over several Cookie fields (RFC 9113 8.2.3)
+    for (const HttpHeader &header : headers()) {
+        if (!equals_ignore_case(header.name, "Cookie")) {
+            continue;
+        }
+        std::string_view rest = header.value;
+        while (!rest.empty() && cookie_count < MAX_COOKIES) {
+            size_t semicolon = rest.find(';');
+            std::string_view item = trim_spaces(rest.substr(0, semicolon));
+            rest = semicolon == std::string_view::npos ? std::string_view() : rest.substr(semicolon + 1);
+            size_t equals = item.find('=');
+            if (equals == std::string_view::npos || equals == 0) {
+                continue;
+            }
+            std::string_view value = item.substr(equals + 1);
+            if (value.size() >= 2 && value.front() == '"' && value.back() == '"') {
+                value = value.substr(1, value.size() - 2);
+            }
+            cookie_items[cookie_count++] = {trim_spaces(item.substr(0, equals)), value};
+        }
+    }
+}
+
+std::string_view Request::query_param(std::string_view name) const {
+    if (!query_parsed) {
+        parse_query();
+    }
+    for (size_t i = 0; i < query_count; ++i) {
+        if (query_items[i].first == name) {
+            return query_items[i].second;
+        }
+    }
+    return {};
+}
+
+bool Request::has_query_param(std::string_view name) const {
+    if (!query_parsed) {
+        parse_query();
+    }
+    for (size_t i = 0; i < query_count; ++i) {
+        if (query_items[i].first == name) {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::string_view Request::cookie(std::string_view name) const {
+    if (!cookies_parsed) {
+        parse_cookies();
+    }
+    for (size_t i = 0; i < cookie_count; ++i) {
+        if (cookie_items[i].first == name) {
+            return cookie_items[i].second;
+        }
+    }
+    return {};
+}
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+std::string Request::decode(std::string_view component) {
+    std::string decoded;
+    decoded.reserve(component.size());
+    for (size_t i = 0; i < component.size(); ++i) {
+        char c = component[i];
+        if (c == '+') {
+            decoded += ' ';
+        } else if (c == '%' && i + 2 < component.size() && hex_value(component[i + 1]) >= 0 &&
+                   hex_value(component[i + 2]) >= 0) {
+            decoded += static_cast<char>(hex_value(component[i + 1]) * 16 + hex_value(component[i + 2]));
+            i += 2;
+        } else {
+            decoded += c; // Malformed escapes are kept as they are
+        }
+    }
+    return decoded;
+}
@@ -0,0 +1,112 @@
+#ifndef REQUEST_H
+#define REQUEST_H
+
+#include "http-parser.h"
+#include "http-response.h"
+#include <array>
+#include <cstddef>
+#include <functional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <sys/socket.h>
+#include <utility>
+
+// Values captured by ":name" and "*name" pattern segments, pointing into the request path
+#define MAX_ROUTE_PARAMS 8
+
+// Query parameters and cookies a Request indexes; any beyond these are not found
+#define MAX_QUERY_PARAMS 32
+#define MAX_COOKIES 32
+
+struct RouteParams {
+    std::array<std::pair<std::string_view, std::string_view>, MAX_ROUTE_PARAMS> items;
+    size_t count = 0;
+
+    // Empty view if the route has no parameter of that name
+    std::string_view get(std::string_view name) const;
+};
+
+// The connection a request arrived on, as far as handlers may care
+struct ConnectionInfo {
+    int fd = -1;
+    bool tls = false;
+    bool http2 = false;
+    size_t requests_served = 0; // On this connection, the current one included
+
+    // The client's address through getpeername(), so only pay for it when asked; false if unknown
+    bool peer_address(sockaddr_storage &address, socklen_t &length) const;
+};
+
+/**
+ * @brief What a context handler sees of one request: views into the connection's buffer,
+ * so building one copies nothing. The query string and Cookie headers are split on the first
+ * query_param() or cookie() call, into fixed tables of views; values stay percent-encoded
+ * (see decode()). Like the views it holds, a Request is only valid during the handler call.
+ */
+class Request {
+  private:
+    using Pair = std::pair<std::string_view, std::string_view>;
+
+    const HTTPRequest &http;
+    std::string_view request_path;
+    std::string_view query_string;
+    const RouteParams &route_params;
+    const ConnectionInfo &info;
+    std::string_view body_view;
+
+    mutable std::array<Pair, MAX_QUERY_PARAMS> query_items;
+    mutable size_t query_count = 0;
+    mutable bool query_parsed = false;
+
+    mutable std::array<Pair, MAX_COOKIES> cookie_items;
+    mutable size_t cookie_count = 0;
+    mutable bool cookies_parsed = false;
+
+    void parse_query() const;
+    void parse_cookies() const;
+
+  public:
+    // path is the target up to the query string; params must hold views into it
+    Request(const HTTPRequest &request, std::string_view path, const RouteParams &params,
+            const ConnectionInfo &connection, std::string_view body = {});
+
+    Request(const Request &) = delete;
+    Request &operator=(const Request &) = delete;
+
+    std::string_view method() const { return http.method; }
+    std::string_view target() const { return http.path; } // Path and query, as sent
+    std::string_view path() const { return request_path; }
+    std::string_view query() const { return query_string; } // Without the '?'
+    int version_minor() const { return http.version_minor; } // HTTP/1.<minor>; 1 for HTTP/2
+
+    // Case-insensitive; empty if the header is absent. headers() lists them in arrival order.
+    std::string_view header(std::string_view name) const { return http.header(name); }
+    bool has_header(std::string_view name) const { return http.has_header(name); }
+    std::span<const HttpHeader> headers() const { return {http.headers.data(), http.header_count}; }
+
+    // ":name" and "*name" captures of the matched route
+    std::string_view param(std::string_view name) const { return route_params.get(name); }
+
+    // First value of the name; empty if absent (has_query_param() tells an empty value apart)
+    std::string_view query_param(std::string_view name) const;
+    bool has_query_param(std::string_view name) const;
+
+    // Value of the first cookie of that name; empty if absent
+    std::string_view cookie(std::string_view name) const;
+
+    // The whole body, buffered before the handler runs (bounded by ServerConfig::max_body_size)
+    std::string_view body() const { return body_view; }
+
+    const ConnectionInfo &connection() const { return info; }
+
+    // Percent-decodes a query or form component, '+' included
+    static std::string decode(std::string_view component);
+};
+
+// Handlers with the whole request at hand. The response starts out as an empty 200: fill it in
+// place or assign another (HttpResponse(404), a ResponseTemplate's); a body set with
+// set_body_view() goes out as its own iovec, without a copy.
+using ContextHandler = std::function<void(const Request &request, HttpResponse &response)>;
+
+#endif // REQUEST_H
@@ -0,0 +1,176 @@
+#include "response-cache.h"
+#include "timer-wheel.h"
+#include <algorithm>
+#include <functional>
+
+// --- Epoch-based reclamation ---
+
+// A reader's announcement: the global epoch it entered at, or 0 outside a lookup
+struct alignas(CACHE_LINE_SIZE) ReaderEpoch {
+    std::atomic<uint64_t> epoch{0};
+
+    ReaderEpoch();
+    ~ReaderEpoch();
+};
+
+// Every thread that has looked anything up; shared by all caches
+struct EpochDomain {
+    std::atomic<uint64_t> global{1};
+    std::mutex mutex;
+    std::vector<const ReaderEpoch *> readers;
+};
+
+static EpochDomain &epoch_domain() {
+    static EpochDomain instance; // Constructed before, so destroyed after, any thread's record
+    return instance;
+}
+
+ReaderEpoch::ReaderEpoch() {
+    EpochDomain &domain = epoch_domain();
+    std::lock_guard<std::mutex> lock(domain.mutex);
+    domain.readers.push_back(this);
+}
+
+ReaderEpoch::~ReaderEpoch() {
+    EpochDomain &domain = epoch_domain();
+    std::lock_guard<std::mutex> lock(domain.mutex);
+    domain.readers.erase(std::remove(domain.readers.begin(), domain.readers.end(), this), domain.readers.end());
+}
+
+// Marks the calling thread as reading for its lifetime
+class EpochGuard {
+  private:
+    ReaderEpoch &record;
+
+  public:
+    EpochGuard() : record(local_record()) {
+        record.epoch.store(epoch_domain().global.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        // Pairs with the fence in oldest_reader_epoch(): either the writer sees this
+        // announcement, or this reader sees the table the writer swapped in
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+    ~EpochGuard() { record.epoch.store(0, std::memory_order_release); }
+
+    static ReaderEpoch &local_record() {
+        static thread_local ReaderEpoch record;
+        return record;
+    }
+};
+
+// Epoch of the oldest reader still inside a lookup, or UINT64_MAX when there is none
+static uint64_t oldest_reader_epoch() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    EpochDomain &domain = epoch_domain();
+    std::lock_guard<std::mutex> lock(domain.mutex);
+    uint64_t oldest = UINT64_MAX;
+    for (const ReaderEpoch *reader : domain.readers) {
+        uint64_t epoch = reader->epoch.load(std::memory_order_acquire);
+        if (epoch != 0) {
+            oldest = std::min(oldest, epoch);
+        }
+    }
+    return oldest;
+}
+
+// --- ResponseCache ---
+
+ResponseCache::ResponseCache(ResponseCachePolicy cache_policy) : policy(std::move(cache_policy)) {
+    for (Shard &shard : shards) {
+        shard.table.store(new Table(), std::memory_order_release);
+    }
+}
+
+ResponseCache::~ResponseCache() {
+    // Routes outlive every worker, so no reader is left by now
+    for (Shard &shard : shards) {
+        delete shard.table.load(std::memory_order_relaxed);
+        for (const Retired &retired : shard.retired) {
+            delete retired.table;
+        }
+    }
+}
+
+const std::string &ResponseCache::make_key(const HTTPRequest &request) const {
+    static thread_local std::string key;
+    key.assign(request.method);
+    key += ' ';
+    key.append(request.path);
+    for (const std::string &name : policy.vary) {
+        key += '\n';
+        key.append(request.header(name));
+    }
+    return key;
+}
+
+void ResponseCache::reclaim(Shard &shard) {
+    if (shard.retired.empty()) {
+        return;
+    }
+    uint64_t oldest = oldest_reader_epoch();
+    size_t kept = 0;
+    for (const Retired &retired : shard.retired) {
+        if (retired.epoch < oldest) {
+            delete retired.table;
+        } else {
+            shard.retired[kept++] = retired; // Still visible to a reader
+        }
+    }
+    shard.retired.resize(kept);
+}
+
+std::shared_ptr<const PreparedResponse> ResponseCache::lookup(const HTTPRequest &request) const {
+    const std::string &key = make_key(request);
+    const Shard &shard = shards[std::hash<std::string>()(key) % SHARD_COUNT];
+
+    EpochGuard guard;
+    const Table *table = shard.table.load(std::memory_order_acquire);
+    auto it = table->entries.find(key);
+    if (it == table->entries.end() || it->second.expires_ms <= monotonic_ms()) {
+        return nullptr;
+    }
+    return it->second.response;
+}
+
+std::shared_ptr<const PreparedResponse> ResponseCache::store(const HTTPRequest &request, const HttpResponse &response) {
+    if (response.status_code_value() != 200) {
+        return nullptr;
+    }
+    std::shared_ptr<const PreparedResponse> prepared = response.prepare();
+    if (!prepared || prepared->bytes.size() > policy.max_bytes / SHARD_COUNT) {
+        return nullptr;
+    }
+
+    std::string key = make_key(request);
+    Shard &shard = shards[std::hash<std::string>()(key) % SHARD_COUNT];
+    uint64_t now = monotonic_ms();
+
+    std::lock_guard<std::mutex> lock(shard.write_mutex);
+    const Table *current = shard.table.load(std::memory_order_relaxed);
+    auto next = std::make_unique<Table>();
+
+    // Copy the live entries only, so expired ones are dropped on the next write
+    for (const auto &[entry_key, entry] : current->entries) {
+        if (entry.expires_ms > now && entry_key != key) {
+            next->entries.emplace(entry_key, entry);
+            next->bytes += entry.response->bytes.size();
+        }
+    }
+    // Over budget: the oldest entries make room
+    size_t budget = policy.max_bytes / SHARD_COUNT;
+    while (next->bytes + prepared->bytes.size() > budget && !next->entries.empty()) {
+        auto oldest = std::min_element(next->entries.begin(), next->entries.end(), [](const auto &a, const auto &b) {
+            return a.second.stored_ms < b.second.stored_ms;
+        });
+        next->bytes -= oldest->second.response->bytes.size();
+        next->entries.erase(oldest);
+    }
+    next->bytes += prepared->bytes.size();
+    next->entries.emplace(std::move(key), Entry{prepared, now + policy.ttl_ms, now});
+
+    shard.table.store(next.release(), std::memory_order_release);
+    // Readers that entered before this point may still hold current
+    uint64_t epoch = epoch_domain().global.fetch_add(1, std::memory_order_acq_rel);
+    shard.retired.push_back({epoch, current});
+    reclaim(shard);
+    return prepared;
+}
@@ -0,0 +1,89 @@
+#ifndef RESPONSE_CACHE_H
+#define RESPONSE_CACHE_H
+
+#include "http-parser.h"
+#include "http-response.h"
+#include "ring-buffer.h"
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Opt-in caching of one GET route's responses (HttpServer::cache_endpoint())
+struct ResponseCachePolicy {
+    uint64_t ttl_ms = 1000;
+
+    // Serialized bytes (heads and bodies) kept for the route; the oldest entries go first
+    size_t max_bytes = 1024 * 1024;
+
+    // Request headers whose values are part of the key, on top of method and target
+    std::vector<std::string> vary;
+};
+
+/**
+ * @brief Ready-to-send responses of one route, keyed by method, target and the policy's
+ * vary headers. Only 200 responses are stored, serialized once (PreparedResponse) and
+ * queued by reference on every hit, so a hit neither runs the handler nor copies bytes.
+ *
+ * Lookups take no lock. Each shard publishes an immutable table through an atomic
+ * pointer; a miss that stores a response copies the table, changes the copy and swaps it
+ * in under the shard's mutex (read-copy-update). Replaced tables are freed once every
+ * reader that might still be looking at one has left (epoch-based reclamation), so the
+ * only shared write on a hit is the reference count of the response being queued.
+ */
+class ResponseCache {
+  private:
+    static constexpr size_t SHARD_COUNT = 8;
+
+    struct Entry {
+        std::shared_ptr<const PreparedResponse> response;
+        uint64_t expires_ms = 0;
+        uint64_t stored_ms = 0;
+    };
+
+    struct Table {
+        std::unordered_map<std::string, Entry> entries;
+        size_t bytes = 0;
+    };
+
+    struct Retired {
+        uint64_t epoch;
+        const Table *table;
+    };
+
+    struct alignas(CACHE_LINE_SIZE) Shard {
+        std::atomic<const Table *> table{nullptr};
+        std::mutex write_mutex; // Writers only
+        std::vector<Retired> retired;
+    };
+
+    ResponseCachePolicy policy;
+    std::array<Shard, SHARD_COUNT> shards;
+
+    // Built in a per-thread buffer, so a lookup allocates nothing once it has grown
+    const std::string &make_key(const HTTPRequest &request) const;
+
+    // Frees the shard's retired tables that no reader can still see. Holds write_mutex.
+    static void reclaim(Shard &shard);
+
+  public:
+    explicit ResponseCache(ResponseCachePolicy cache_policy);
+    ~ResponseCache();
+
+    ResponseCache(const ResponseCache &) = delete;
+    ResponseCache &operator=(const ResponseCache &) = delete;
+
+    // A live entry for the request, or null
+    std::shared_ptr<const PreparedResponse> lookup(const HTTPRequest &request) const;
+
+    // Keeps response for ttl_ms if it is a cacheable 200 and returns it prepared; otherwise
+    // returns null and the caller sends response itself
+    std::shared_ptr<const PreparedResponse> store(const HTTPRequest &request, const HttpResponse &response);
+};
+
+#endif // RESPONSE_CACHE_H
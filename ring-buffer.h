@@ -0,0 +1,236 @@
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// Head and tail live on separate lines so producer and consumer never false-share.
+constexpr size_t CACHE_LINE_SIZE = 64;
+
+// Busy-wait hint: lets the sibling hyperthread run and saves power while spinning.
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#endif
+}
+
+inline size_t round_up_pow2(size_t n) {
+    size_t capacity = 2;
+    while (capacity < n) {
+        capacity <<= 1;
+    }
+    return capacity;
+}
+
+/**
+ * @brief Bounded single-producer/single-consumer ring.
+ * Exactly one thread may push and exactly one (other) thread may pop. Each side caches
+ * the opposite index so the common case touches only its own cache line.
+ */
+template <class T> class SpscRing {
+  private:
+    struct Slot {
+        alignas(T) unsigned char storage[sizeof(T)];
+        T *get() { return std::launder(reinterpret_cast<T *>(storage)); }
+    };
+
+    const size_t mask;
+    Slot *slots;
+
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> head{0}; // Next slot to pop
+    size_t cached_tail = 0;                                // Consumer's view of tail
+
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> tail{0}; // Next slot to push
+    size_t cached_head = 0;                                // Producer's view of head
+
+  public:
+    explicit SpscRing(size_t capacity) : mask(round_up_pow2(capacity) - 1), slots(new Slot[mask + 1]) {}
+
+    ~SpscRing() {
+        T item;
+        while (try_pop(item)) {
+        }
+        delete[] slots;
+    }
+
+    SpscRing(const SpscRing &) = delete;
+    SpscRing &operator=(const SpscRing &) = delete;
+
+    bool try_push(T &&item) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - cached_head > mask) {
+            cached_head = head.load(std::memory_order_acquire);
+            if (t - cached_head > mask) {
+                return false; // Full
+            }
+        }
+        new (slots[t & mask].storage) T(std::move(item));
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool try_pop(T &item) {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == cached_tail) {
+            cached_tail = tail.load(std::memory_order_acquire);
+            if (h == cached_tail) {
+                return false; // Empty
+            }
+        }
+        T *slot = slots[h & mask].get();
+        item = std::move(*slot);
+        slot->~T();
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    size_t capacity() const { return mask + 1; }
+
+    // Approximate when called concurrently with push/pop
+    size_t size_approx() const {
+        return tail.load(std::memory_order_relaxed) - head.load(std::memory_order_relaxed);
+    }
+};
+
+/**
+ * @brief Bounded multi-producer/multi-consumer ring (Vyukov's sequence-number queue).
+ * Each slot carries a sequence number that tells producers and consumers whose turn it
+ * is, so a push or pop is a single CAS on the shared index plus one store.
+ */
+template <class T> class MpmcRing {
+  private:
+    struct alignas(CACHE_LINE_SIZE) Slot {
+        std::atomic<size_t> sequence;
+        alignas(T) unsigned char storage[sizeof(T)];
+        T *get() { return std::launder(reinterpret_cast<T *>(storage)); }
+    };
+
+    const size_t mask;
+    Slot *slots;
+
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> enqueue_pos{0};
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> dequeue_pos{0};
+
+  public:
+    explicit MpmcRing(size_t capacity) : mask(round_up_pow2(capacity) - 1), slots(new Slot[mask + 1]) {
+        for (size_t i = 0; i <= mask; ++i) {
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    ~MpmcRing() {
+        T item;
+        while (try_pop(item)) {
+        }
+        delete[] slots;
+    }
+
+    MpmcRing(const MpmcRing &) = delete;
+    MpmcRing &operator=(const MpmcRing &) = delete;
+
+    bool try_push(T &&item) {
+        size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+        Slot *slot;
+        while (true) {
+            slot = &slots[pos & mask];
+            size_t seq = slot->sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0) {
+                if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false; // Full
+            } else {
+                pos = enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+        new (slot->storage) T(std::move(item));
+        slot->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool try_pop(T &item) {
+        size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+        Slot *slot;
+        while (true) {
+            slot = &slots[pos & mask];
+            size_t seq = slot->sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+            if (diff == 0) {
+                if (dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false; // Empty
+            } else {
+                pos = dequeue_pos.load(std::memory_order_relaxed);
+            }
+        }
+        T *value = slot->get();
+        item = std::move(*value);
+        value->~T();
+        slot->sequence.store(pos + mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    size_t capacity() const { return mask + 1; }
+
+    // Approximate when called concurrently with push/pop
+    size_t size_approx() const {
+        size_t enq = enqueue_pos.load(std::memory_order_relaxed);
+        size_t deq = dequeue_pos.load(std::memory_order_relaxed);
+        return enq > deq ? enq - deq : 0;
+    }
+};
+
+/**
+ * @brief Spin-then-park support for ring consumers (an "eventcount").
+ * A consumer that found the ring empty calls prepare_wait(), re-checks the ring, then
+ * either cancel_wait()s or commit_wait()s on a futex. Producers call notify_one() after
+ * every push; it costs a single load when nobody is parked.
+ */
+class EventCount {
+  private:
+    alignas(CACHE_LINE_SIZE) std::atomic<uint32_t> epoch{0};
+    std::atomic<uint32_t> waiters{0};
+
+  public:
+    uint32_t prepare_wait() {
+        waiters.fetch_add(1, std::memory_order_seq_cst);
+        return epoch.load(std::memory_order_seq_cst);
+    }
+
+    void cancel_wait() { waiters.fetch_sub(1, std::memory_order_relaxed); }
+
+    void commit_wait(uint32_t key) {
+        epoch.wait(key, std::memory_order_seq_cst);
+        waiters.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    void notify_one() {
+        // Pairs with the seq_cst RMW in prepare_wait(): either the consumer sees the item on
+        // its re-check, or we see it counted as a waiter here
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiters.load(std::memory_order_relaxed) != 0) {
+            epoch.fetch_add(1, std::memory_order_seq_cst);
+            epoch.notify_one();
+        }
+    }
+
+    void notify_all() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiters.load(std::memory_order_relaxed) != 0) {
+            epoch.fetch_add(1, std::memory_order_seq_cst);
+            epoch.notify_all();
+        }
+    }
+};
+
+#endif // RING_BUFFER_H
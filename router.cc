@@ -0,0 +1,264 @@
+#include "router.h"
+#include "metrics.h"
+#include <algorithm>
+
+ContextHandler make_context_handler(RequestHandler handler, const Endpoint &endpoint) {
+    return [handler = std::move(handler), &endpoint](const Request &request, HttpResponse &response) {
+        // A literal route hands its own pattern over by reference: no copy of the path
+        if (!endpoint.dynamic) {
+            response = HttpResponse::from_string(handler(endpoint.method, endpoint.pattern));
+            return;
+        }
+        std::string path(request.path());
+        response = HttpResponse::from_string(handler(endpoint.method, path));
+    };
+}
+
+ContextHandler make_context_handler(ResponseHandler handler, const Endpoint &endpoint) {
+    return [handler = std::move(handler), &endpoint](const Request &request, HttpResponse &response) {
+        if (!endpoint.dynamic) {
+            response = handler(endpoint.method, endpoint.pattern);
+            return;
+        }
+        std::string path(request.path());
+        response = handler(endpoint.method, path);
+    };
+}
+
+// Plain functions rather than capturing lambdas: a coroutine lambda's captures live in the
+// lambda object, which is gone before the frame finishes
+static ResponseTask run_response_handler(ResponseHandler handler, std::string method, std::string path) {
+    co_return handler(method, path);
+}
+
+static ResponseTask run_request_handler(RequestHandler handler, std::string method, std::string path) {
+    co_return HttpResponse::from_string(handler(method, path));
+}
+
+AsyncHandler make_async_handler(ResponseHandler handler) {
+    return [handler = std::move(handler)](std::string method, std::string path) {
+        return run_response_handler(handler, std::move(method), std::move(path));
+    };
+}
+
+AsyncHandler make_async_handler(RequestHandler handler) {
+    return [handler = std::move(handler)](std::string method, std::string path) {
+        return run_request_handler(handler, std::move(method), std::move(path));
+    };
+}
+
+Router::Node *Router::child_for(Node &node, std::string_view segment) {
+    auto it = std::lower_bound(node.children.begin(), node.children.end(), segment,
+                               [](const auto &child, std::string_view s) { return child.first < s; });
+    if (it == node.children.end() || it->first != segment) {
+        it = node.children.emplace(it, std::string(segment), std::make_unique<Node>());
+    }
+    return it->second.get();
+}
+
+void Router::add(std::string_view method, std::string_view pattern, RequestHandler handler) {
+    auto endpoint = std::make_unique<Endpoint>();
+    endpoint->method = std::string(method);
+    endpoint->pattern = std::string(pattern);
+    endpoint->handler = make_context_handler(std::move(handler), *endpoint);
+    insert(std::move(endpoint));
+}
+
+void Router::add(std::string_view method, std::string_view pattern, ResponseHandler handler) {
+    auto endpoint = std::make_unique<Endpoint>();
+    endpoint->method = std::string(method);
+    endpoint->pattern = std::string(pattern);
+    endpoint->handler = make_context_handler(std::move(handler), *endpoint);
+    insert(std::move(endpoint));
+}
+
+void Router::add(std::string_view method, std::string_view pattern, ContextHandler handler) {
+    auto endpoint = std::make_unique<Endpoint>();
+    endpoint->method = std::string(method);
+    endpoint->pattern = std::string(pattern);
+    endpoint->handler = std::move(handler);
+    endpoint->reads_body = true;
+    insert(std::move(endpoint));
+}
+
+void Router::add_streaming(std::string_view method, std::string_view pattern, StreamingHandler handler) {
+    auto endpoint = std::make_unique<Endpoint>();
+    endpoint->method = std::string(method);
+    endpoint->pattern = std::string(pattern);
+    endpoint->streaming_handler = std::move(handler);
+    insert(std::move(endpoint));
+}
+
+void Router::add_async(std::string_view method, std::string_view pattern, AsyncHandler handler) {
+    auto endpoint = std::make_unique<Endpoint>();
+    endpoint->method = std::string(method);
+    endpoint->pattern = std::string(pattern);
+    endpoint->async_handler = std::move(handler);
+    insert(std::move(endpoint));
+}
+
+void Router::add_static_files(std::string_view method, std::string_view pattern,
+                              std::shared_ptr<const StaticFiles> files) {
+    auto endpoint = std::make_unique<Endpoint>();
+    endpoint->method = std::string(method);
+    endpoint->pattern = std::string(pattern);
+    endpoint->static_files = std::move(files);
+    insert(std::move(endpoint));
+}
+
+void Router::add_proxy(std::string_view method, std::string_view pattern, std::shared_ptr<ReverseProxy> proxy) {
+    auto endpoint = std::make_unique<Endpoint>();
+    endpoint->method = std::string(method);
+    endpoint->pattern = std::string(pattern);
+    endpoint->proxy = std::move(proxy);
+    insert(std::move(endpoint));
+}
+
+void Router::insert(std::unique_ptr<Endpoint> endpoint) {
+    std::string_view pattern = endpoint->pattern;
+
+    // Same split as match_node(): every segment follows a '/', so "/" is one empty segment
+    Node *node = &root;
+    size_t pos = pattern.empty() || pattern[0] != '/' ? 0 : 1;
+    while (pos != std::string_view::npos) {
+        size_t slash = pattern.find('/', pos);
+        std::string_view segment = pattern.substr(pos, slash == std::string_view::npos ? slash : slash - pos);
+        pos = slash == std::string_view::npos ? slash : slash + 1;
+
+        if (segment.size() > 1 && segment[0] == ':') {
+            if (!node->param_child) {
+                node->param_child = std::make_unique<Node>();
+            }
+            endpoint->dynamic = true;
+            endpoint->capture_names.emplace_back(segment.substr(1));
+            node = node->param_child.get();
+        } else if (!segment.empty() && segment[0] == '*') {
+            if (!node->wildcard_child) {
+                node->wildcard_child = std::make_unique<Node>();
+            }
+            endpoint->dynamic = true;
+            endpoint->capture_names.emplace_back(segment.substr(1));
+            node = node->wildcard_child.get();
+            break; // A wildcard swallows the rest of the path
+        } else {
+            node = child_for(*node, segment);
+        }
+    }
+
+    Endpoint *inserted = nullptr;
+    HttpMethod parsed = parse_method(endpoint->method);
+    if (parsed == HttpMethod::Other) {
+        for (const auto &existing : node->other_endpoints) {
+            if (existing->method == endpoint->method) {
+                return;
+            }
+        }
+        inserted = endpoint.get();
+        node->other_endpoints.push_back(std::move(endpoint));
+    } else {
+        std::unique_ptr<Endpoint> &slot = node->endpoints[static_cast<size_t>(parsed)];
+        if (slot) {
+            return;
+        }
+        inserted = endpoint.get();
+        slot = std::move(endpoint);
+    }
+    inserted->metrics_route = register_metric_route(inserted->method, inserted->pattern);
+    ++route_count;
+}
+
+const Endpoint *Router::endpoint_for(const Node &node, HttpMethod method, std::string_view method_name) {
+    if (method != HttpMethod::Other) {
+        return node.endpoints[static_cast<size_t>(method)].get();
+    }
+    for (const auto &endpoint : node.other_endpoints) {
+        if (endpoint->method == method_name) {
+            return endpoint.get();
+        }
+    }
+    return nullptr;
+}
+
+Endpoint *Router::find(std::string_view method, std::string_view pattern) {
+    // insert()'s walk, without creating nodes
+    Node *node = &root;
+    size_t pos = pattern.empty() || pattern[0] != '/' ? 0 : 1;
+    while (pos != std::string_view::npos && node) {
+        size_t slash = pattern.find('/', pos);
+        std::string_view segment = pattern.substr(pos, slash == std::string_view::npos ? slash : slash - pos);
+        pos = slash == std::string_view::npos ? slash : slash + 1;
+
+        if (segment.size() > 1 && segment[0] == ':') {
+            node = node->param_child.get();
+        } else if (!segment.empty() && segment[0] == '*') {
+            node = node->wildcard_child.get();
+            break;
+        } else {
+            auto it = std::lower_bound(node->children.begin(), node->children.end(), segment,
+                                       [](const auto &child, std::string_view s) { return child.first < s; });
+            node = it != node->children.end() && it->first == segment ? it->second.get() : nullptr;
+        }
+    }
+    if (!node) {
+        return nullptr;
+    }
+    Endpoint *endpoint = const_cast<Endpoint *>(endpoint_for(*node, parse_method(method), method));
+    return endpoint && endpoint->pattern == pattern ? endpoint : nullptr;
+}
+
+// pos is the index just past a '/', or npos once the whole path has been consumed
+const Endpoint *Router::match_node(const Node &node, std::string_view path, size_t pos, HttpMethod method,
+                                   std::string_view method_name, RouteParams *params) const {
+    if (pos == std::string_view::npos) {
+        return endpoint_for(node, method, method_name);
+    }
+
+    size_t slash = path.find('/', pos);
+    std::string_view segment = path.substr(pos, slash == std::string_view::npos ? slash : slash - pos);
+    size_t next = slash == std::string_view::npos ? slash : slash + 1;
+
+    auto it = std::lower_bound(node.children.begin(), node.children.end(), segment,
+                               [](const auto &child, std::string_view s) { return child.first < s; });
+    if (it != node.children.end() && it->first == segment) {
+        if (const Endpoint *endpoint = match_node(*it->second, path, next, method, method_name, params)) {
+            return endpoint;
+        }
+    }
+
+    if (node.param_child && !segment.empty()) {
+        size_t saved = params ? params->count : 0;
+        if (params && params->count < MAX_ROUTE_PARAMS) {
+            params->items[params->count++] = {{}, segment}; // Named by match() from the endpoint
+        }
+        if (const Endpoint *endpoint = match_node(*node.param_child, path, next, method, method_name, params)) {
+            return endpoint;
+        }
+        if (params) {
+            params->count = saved;
+        }
+    }
+
+    if (node.wildcard_child) {
+        if (const Endpoint *endpoint = endpoint_for(*node.wildcard_child, method, method_name)) {
+            if (params && params->count < MAX_ROUTE_PARAMS) {
+                params->items[params->count++] = {{}, path.substr(pos)};
+            }
+            return endpoint;
+        }
+    }
+    return nullptr;
+}
+
+const Endpoint *Router::match(HttpMethod method, std::string_view method_name, std::string_view path,
+                              RouteParams *params) const {
+    if (path.empty() || path[0] != '/') {
+        return nullptr; // Origin-form only; "*" and absolute-form targets have no routes
+    }
+    const Endpoint *endpoint = match_node(root, path, 1, method, method_name, params);
+    if (endpoint && params) {
+        for (size_t i = 0; i < params->count && i < endpoint->capture_names.size(); ++i) {
+            params->items[i].first = endpoint->capture_names[i];
+        }
+    }
+    return endpoint;
+}
@@ -0,0 +1,318 @@
+#ifndef ROUTER_H
+#define ROUTER_H
+
+#include "coroutine.h"
+#include "http-parser.h"
+#include "http-response.h"
+#include "request.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+class StaticFiles;
+class ResponseCache;
+class ReverseProxy;
+struct Endpoint;
+
+// Type definitions
+using RequestHandler = std::function<std::string(const std::string &, const std::string &)>;
+
+// Same arguments as RequestHandler, but the response is built from parts instead of one string
+using ResponseHandler = std::function<HttpResponse(const std::string &, const std::string &)>;
+
+// Wrap the two-string handlers as ContextHandlers (request.h) for endpoint. The method and, on a
+// literal route, the path are the endpoint's own strings, passed by reference: no copy per request.
+ContextHandler make_context_handler(RequestHandler handler, const Endpoint &endpoint);
+ContextHandler make_context_handler(ResponseHandler handler, const Endpoint &endpoint);
+
+/**
+ * @brief Receives one request body as it arrives, for endpoints added with
+ * add_streaming_endpoint(). The body is never buffered as a whole, so its size is bounded
+ * only by ServerConfig::max_body_size. A reader is used by one thread at a time.
+ */
+class BodyReader {
+  public:
+    virtual ~BodyReader() = default;
+
+    // Called for each piece of the body in order; the view is only valid during the call
+    virtual void on_data(std::string_view chunk) = 0;
+
+    // Called once the whole body is in
+    virtual HttpResponse on_complete() = 0;
+};
+
+// Called as soon as the request head is in, before any body byte. The views in request
+// are only valid during the call; copy out whatever the reader needs later.
+using StreamingHandler = std::function<std::unique_ptr<BodyReader>(const HTTPRequest &request)>;
+
+// Coroutine handlers: may co_await (sleep_for(), async_read(), ...) without holding a thread.
+// Arguments are taken by value, since the frame outlives the request buffer they came from.
+using ResponseTask = Task<HttpResponse>;
+using AsyncHandler = std::function<ResponseTask(std::string method, std::string path)>;
+
+// Wraps a blocking handler as an AsyncHandler; it still runs on (and blocks) the calling thread
+AsyncHandler make_async_handler(ResponseHandler handler);
+AsyncHandler make_async_handler(RequestHandler handler);
+
+// Captureless handlers, usable in a constexpr StaticRouteTable
+using StaticHandler = std::string (*)(const std::string &, const std::string &);
+
+// Request methods interned to a small enum; anything non-standard is Other
+enum class HttpMethod : uint8_t { Get, Head, Post, Put, Delete, Connect, Options, Trace, Patch, Other };
+constexpr size_t HTTP_METHOD_COUNT = static_cast<size_t>(HttpMethod::Other) + 1;
+
+constexpr HttpMethod parse_method(std::string_view method) {
+    switch (method.size()) {
+    case 3:
+        if (method == "GET")
+            return HttpMethod::Get;
+        if (method == "PUT")
+            return HttpMethod::Put;
+        break;
+    case 4:
+        if (method == "POST")
+            return HttpMethod::Post;
+        if (method == "HEAD")
+            return HttpMethod::Head;
+        break;
+    case 5:
+        if (method == "PATCH")
+            return HttpMethod::Patch;
+        if (method == "TRACE")
+            return HttpMethod::Trace;
+        break;
+    case 6:
+        if (method == "DELETE")
+            return HttpMethod::Delete;
+        break;
+    case 7:
+        if (method == "OPTIONS")
+            return HttpMethod::Options;
+        if (method == "CONNECT")
+            return HttpMethod::Connect;
+        break;
+    }
+    return HttpMethod::Other;
+}
+
+// A route registered at runtime through add_endpoint(), add_streaming_endpoint() or add_async_endpoint()
+struct Endpoint {
+    std::string method;
+    std::string pattern;
+    ContextHandler handler;             // add_endpoint() handlers, the two-string ones adapted
+    bool reads_body = false;            // handler wants Request::body(), so it is buffered first
+    StreamingHandler streaming_handler; // Set instead of handler for streaming endpoints
+    AsyncHandler async_handler;         // Set instead of handler for coroutine endpoints
+    std::shared_ptr<const StaticFiles> static_files; // File-serving endpoints
+    std::shared_ptr<ReverseProxy> proxy;             // Forwarded upstream
+    bool dynamic = false;               // Pattern contains :param or *wildcard segments
+    // Names of the ":name" / "*name" segments in order. Routes through the same tree node may
+    // name its capture differently, so match() labels RouteParams from the matched endpoint.
+    std::vector<std::string> capture_names;
+    uint32_t metrics_route = 0;         // Latency histogram id from register_metric_route()
+    std::shared_ptr<ResponseCache> cache; // Set by HttpServer::cache_endpoint()
+};
+
+// --- Compile-time perfect-hash route table ---
+
+struct StaticRoute {
+    HttpMethod method;
+    std::string_view path;
+    StaticHandler handler;
+};
+
+// FNV-1a over the method and path
+constexpr uint64_t route_key_hash(HttpMethod method, std::string_view path) {
+    uint64_t hash = 14695981039346656037ull;
+    hash = (hash ^ static_cast<uint8_t>(method)) * 1099511628211ull;
+    for (char c : path) {
+        hash = (hash ^ static_cast<uint8_t>(c)) * 1099511628211ull;
+    }
+    return hash;
+}
+
+// splitmix64 finaliser: re-hashes a key under a per-bucket seed
+constexpr uint64_t route_slot_hash(uint64_t key, uint64_t seed) {
+    uint64_t z = key ^ (seed * 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+/**
+ * @brief Static routes compiled into a collision-free hash table (hash-and-displace).
+ * Keys are split into buckets by their plain hash; the constructor then searches, bucket by
+ * bucket from the largest, for a seed that drops every key of the bucket into a free slot.
+ * A lookup is two hashes, one slot probe and one string compare. Built as a constexpr
+ * variable, the seed search runs entirely at compile time; duplicate routes fail the build.
+ */
+template <size_t N> class StaticRouteTable {
+  private:
+    static constexpr size_t pow2_at_least(size_t n) {
+        size_t capacity = 1;
+        while (capacity < n) {
+            capacity <<= 1;
+        }
+        return capacity;
+    }
+
+    static constexpr size_t SLOT_COUNT = pow2_at_least(2 * N + 1); // Load factor <= 0.5
+    static constexpr size_t BUCKET_COUNT = N / 2 + 1;
+    static constexpr uint32_t MAX_SEED = 1u << 20;
+
+    std::array<StaticRoute, N> routes;
+    std::array<uint32_t, BUCKET_COUNT> seeds{};
+    std::array<int32_t, SLOT_COUNT> slots{};
+
+  public:
+    constexpr explicit StaticRouteTable(const std::array<StaticRoute, N> &static_routes) : routes(static_routes) {
+        std::array<uint64_t, N> keys{};
+        std::array<size_t, BUCKET_COUNT + 1> bucket_start{};
+        for (size_t i = 0; i < N; ++i) {
+            if (routes[i].method == HttpMethod::Other) {
+                throw "static routes need a standard method";
+            }
+            keys[i] = route_key_hash(routes[i].method, routes[i].path);
+            for (size_t j = 0; j < i; ++j) {
+                if (keys[j] == keys[i] && routes[j].method == routes[i].method && routes[j].path == routes[i].path) {
+                    throw "duplicate static route";
+                }
+            }
+            ++bucket_start[keys[i] % BUCKET_COUNT + 1];
+        }
+
+        // Counting sort: members[bucket_start[b] .. bucket_start[b + 1]) are bucket b's routes
+        for (size_t bucket = 0; bucket < BUCKET_COUNT; ++bucket) {
+            bucket_start[bucket + 1] += bucket_start[bucket];
+        }
+        std::array<size_t, N> members{};
+        std::array<size_t, BUCKET_COUNT> fill_pos{};
+        for (size_t i = 0; i < N; ++i) {
+            size_t bucket = keys[i] % BUCKET_COUNT;
+            members[bucket_start[bucket] + fill_pos[bucket]++] = i;
+        }
+
+        for (int32_t &slot : slots) {
+            slot = -1;
+        }
+
+        // Place the most crowded buckets first, while the table is still empty
+        for (size_t size = N; size > 0; --size) {
+            for (size_t bucket = 0; bucket < BUCKET_COUNT; ++bucket) {
+                if (bucket_start[bucket + 1] - bucket_start[bucket] == size) {
+                    place_bucket(bucket, keys, members.data() + bucket_start[bucket], size);
+                }
+            }
+        }
+    }
+
+    constexpr const StaticRoute *find(HttpMethod method, std::string_view path) const {
+        uint64_t key = route_key_hash(method, path);
+        size_t slot = route_slot_hash(key, seeds[key % BUCKET_COUNT]) & (SLOT_COUNT - 1);
+        int32_t index = slots[slot];
+        if (index < 0 || routes[index].method != method || routes[index].path != path) {
+            return nullptr;
+        }
+        return &routes[index];
+    }
+
+    constexpr size_t size() const { return N; }
+
+  private:
+    constexpr void place_bucket(size_t bucket, const std::array<uint64_t, N> &keys, const size_t *members,
+                                size_t count) {
+        for (uint32_t seed = 1; seed < MAX_SEED; ++seed) {
+            size_t placed = 0;
+            for (; placed < count; ++placed) {
+                size_t slot = route_slot_hash(keys[members[placed]], seed) & (SLOT_COUNT - 1);
+                if (slots[slot] != -1) {
+                    break;
+                }
+                slots[slot] = static_cast<int32_t>(members[placed]);
+            }
+            if (placed == count) {
+                seeds[bucket] = seed;
+                return;
+            }
+            // Roll back this attempt's members before trying the next seed
+            for (size_t i = 0; i < placed; ++i) {
+                slots[route_slot_hash(keys[members[i]], seed) & (SLOT_COUNT - 1)] = -1;
+            }
+        }
+        throw "no perfect hash seed found";
+    }
+};
+
+/**
+ * @brief Request router: an optional compile-time table of static routes in front of a
+ * radix tree keyed on path segments.
+ * Pattern segments are literals, ":name" (exactly one non-empty segment) or, as the last
+ * segment, "*name" (the rest of the path). Literals win over parameters, parameters over
+ * wildcards, with backtracking when a more specific branch has no route for the method.
+ */
+class Router {
+  private:
+    struct Node {
+        std::vector<std::pair<std::string, std::unique_ptr<Node>>> children; // Sorted by segment
+        std::unique_ptr<Node> param_child;
+        std::unique_ptr<Node> wildcard_child;
+
+        std::array<std::unique_ptr<Endpoint>, HTTP_METHOD_COUNT> endpoints; // Indexed by HttpMethod
+        std::vector<std::unique_ptr<Endpoint>> other_endpoints;               // HttpMethod::Other
+    };
+
+    Node root;
+    size_t route_count = 0;
+
+    const void *static_table = nullptr;
+    const StaticRoute *(*static_lookup)(const void *table, HttpMethod method, std::string_view path) = nullptr;
+
+    static Node *child_for(Node &node, std::string_view segment);
+    void insert(std::unique_ptr<Endpoint> endpoint);
+    static const Endpoint *endpoint_for(const Node &node, HttpMethod method, std::string_view method_name);
+    const Endpoint *match_node(const Node &node, std::string_view path, size_t pos, HttpMethod method,
+                               std::string_view method_name, RouteParams *params) const;
+
+  public:
+    Router() = default;
+    Router(const Router &) = delete;
+    Router &operator=(const Router &) = delete;
+
+    // Registers a route; the first registration of a method + pattern wins
+    void add(std::string_view method, std::string_view pattern, RequestHandler handler);
+    void add(std::string_view method, std::string_view pattern, ResponseHandler handler);
+    void add(std::string_view method, std::string_view pattern, ContextHandler handler);
+    void add_streaming(std::string_view method, std::string_view pattern, StreamingHandler handler);
+    void add_async(std::string_view method, std::string_view pattern, AsyncHandler handler);
+    void add_static_files(std::string_view method, std::string_view pattern, std::shared_ptr<const StaticFiles> files);
+    void add_proxy(std::string_view method, std::string_view pattern, std::shared_ptr<ReverseProxy> proxy);
+
+    // path must not include the query string
+    const Endpoint *match(HttpMethod method, std::string_view method_name, std::string_view path,
+                          RouteParams *params = nullptr) const;
+
+    // Consulted before the tree; the table must outlive the router (make it static constexpr)
+    template <size_t N> void set_static_routes(const StaticRouteTable<N> &table) {
+        static_table = &table;
+        static_lookup = [](const void *t, HttpMethod method, std::string_view path) {
+            return static_cast<const StaticRouteTable<N> *>(t)->find(method, path);
+        };
+    }
+
+    const StaticRoute *match_static(HttpMethod method, std::string_view path) const {
+        return static_lookup ? static_lookup(static_table, method, path) : nullptr;
+    }
+
+    // The endpoint registered for exactly this method and pattern, or null
+    Endpoint *find(std::string_view method, std::string_view pattern);
+
+    size_t size() const { return route_count; }
+};
+
+#endif // ROUTER_H
@@ -0,0 +1,83 @@
+#include "simd-scan.h"
+#include <cstdint>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SIMD_SCAN_X86 1
+#endif
+
+using ScanFn = const char *(*)(const char *, const char *, const DelimiterSet &);
+
+static const char *scan_scalar(const char *p, const char *end, const DelimiterSet &set) {
+    for (; p < end; ++p) {
+        if (set.contains(*p)) {
+            return p;
+        }
+    }
+    return end;
+}
+
+#ifdef SIMD_SCAN_X86
+// PCMPESTRI "equal any": compares 16 input bytes against the whole set in one instruction
+__attribute__((target("sse4.2"))) static const char *scan_sse42(const char *p, const char *end,
+                                                               const DelimiterSet &set) {
+    const __m128i needle = _mm_loadu_si128(reinterpret_cast<const __m128i *>(set.bytes));
+    while (end - p >= 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        int index =
+            _mm_cmpestri(needle, set.count, chunk, 16, _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_LEAST_SIGNIFICANT);
+        if (index != 16) {
+            return p + index;
+        }
+        p += 16;
+    }
+    return scan_scalar(p, end, set);
+}
+
+// One compare per delimiter over 32 bytes; the sets used by the parser hold 2-3 bytes
+__attribute__((target("avx2"))) static const char *scan_avx2(const char *p, const char *end,
+                                                             const DelimiterSet &set) {
+    __m256i needles[DelimiterSet::MAX_DELIMITERS];
+    for (int i = 0; i < set.count; ++i) {
+        needles[i] = _mm256_set1_epi8(set.bytes[i]);
+    }
+
+    while (end - p >= 32) {
+        __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        __m256i hits = _mm256_setzero_si256();
+        for (int i = 0; i < set.count; ++i) {
+            hits = _mm256_or_si256(hits, _mm256_cmpeq_epi8(chunk, needles[i]));
+        }
+        uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(hits));
+        if (mask != 0) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 32;
+    }
+    return scan_scalar(p, end, set);
+}
+#endif
+
+static ScanFn resolve_scan(const char **name) {
+#ifdef SIMD_SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        *name = "avx2";
+        return scan_avx2;
+    }
+    if (__builtin_cpu_supports("sse4.2")) {
+        *name = "sse4.2";
+        return scan_sse42;
+    }
+#endif
+    *name = "scalar";
+    return scan_scalar;
+}
+
+static const char *scan_backend_name = nullptr;
+static const ScanFn scan_impl = resolve_scan(&scan_backend_name);
+
+const char *find_first_of(const char *begin, const char *end, const DelimiterSet &set) {
+    return scan_impl(begin, end, set);
+}
+
+const char *simd_scan_backend() { return scan_backend_name; }
@@ -0,0 +1,39 @@
+#ifndef SIMD_SCAN_H
+#define SIMD_SCAN_H
+
+#include <cstddef>
+#include <string_view>
+
+/**
+ * @brief Up to 16 delimiter bytes searched for together.
+ * Built once (constexpr) per scan site: the byte list feeds the SIMD paths, the
+ * membership table the scalar one.
+ */
+struct DelimiterSet {
+    static constexpr size_t MAX_DELIMITERS = 16;
+
+    char bytes[MAX_DELIMITERS] = {};
+    int count = 0;
+    bool member[256] = {};
+
+    constexpr DelimiterSet(std::string_view delimiters) {
+        for (char c : delimiters) {
+            if (count == static_cast<int>(MAX_DELIMITERS)) {
+                break;
+            }
+            bytes[count++] = c;
+            member[static_cast<unsigned char>(c)] = true;
+        }
+    }
+
+    bool contains(char c) const { return member[static_cast<unsigned char>(c)]; }
+};
+
+// Returns the first byte in [begin, end) that is in set, or end if there is none.
+// Dispatches once, at startup, to an AVX2, SSE4.2 or scalar implementation.
+const char *find_first_of(const char *begin, const char *end, const DelimiterSet &set);
+
+// "avx2", "sse4.2" or "scalar": the implementation find_first_of() resolved to
+const char *simd_scan_backend();
+
+#endif // SIMD_SCAN_H
@@ -0,0 +1,520 @@
+#include "static-files.h"
+#include "compression.h"
+#include <charconv>
+#include <errno.h>
+#include <fcntl.h>
+#include <iostream>
+#include <poll.h>
+#include <stdio.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static constexpr std::string_view HEADER_ACCEPT_RANGES = "Accept-Ranges: bytes\r\n";
+
+struct ContentTypeEntry {
+    std::string_view extension;
+    std::string_view header_line;
+};
+
+static constexpr ContentTypeEntry CONTENT_TYPES[] = {
+    {".html", HEADER_CONTENT_TYPE_HTML},
+    {".htm", HEADER_CONTENT_TYPE_HTML},
+    {".css", "Content-Type: text/css; charset=utf-8\r\n"},
+    {".js", "Content-Type: text/javascript; charset=utf-8\r\n"},
+    {".mjs", "Content-Type: text/javascript; charset=utf-8\r\n"},
+    {".json", HEADER_CONTENT_TYPE_JSON},
+    {".txt", "Content-Type: text/plain; charset=utf-8\r\n"},
+    {".xml", "Content-Type: application/xml\r\n"},
+    {".svg", "Content-Type: image/svg+xml\r\n"},
+    {".png", "Content-Type: image/png\r\n"},
+    {".jpg", "Content-Type: image/jpeg\r\n"},
+    {".jpeg", "Content-Type: image/jpeg\r\n"},
+    {".gif", "Content-Type: image/gif\r\n"},
+    {".webp", "Content-Type: image/webp\r\n"},
+    {".ico", "Content-Type: image/x-icon\r\n"},
+    {".wasm", "Content-Type: application/wasm\r\n"},
+    {".woff2", "Content-Type: font/woff2\r\n"},
+    {".pdf", "Content-Type: application/pdf\r\n"},
+};
+
+// The whole "Content-Type: ...\r\n" line, interned; octet-stream for unknown extensions
+std::string_view content_type_for(std::string_view path) {
+    size_t dot = path.rfind('.');
+    if (dot != std::string_view::npos && path.find('/', dot) == std::string_view::npos) {
+        std::string_view extension = path.substr(dot);
+        for (const ContentTypeEntry &entry : CONTENT_TYPES) {
+            if (equals_ignore_case(extension, entry.extension)) {
+                return entry.header_line;
+            }
+        }
+    }
+    return HEADER_CONTENT_TYPE_OCTET;
+}
+
+CachedFile::~CachedFile() {
+    if (mapping) {
+        munmap(const_cast<char *>(mapping), size);
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+// --- FileCache ---
+
+static bool is_regular_file(const std::string &path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode);
+}
+
+static std::string_view directory_of(std::string_view path) {
+    size_t slash = path.rfind('/');
+    return slash == std::string_view::npos ? std::string_view(".") : path.substr(0, slash == 0 ? 1 : slash);
+}
+
+FileCache::FileCache(size_t max_entries, size_t mmap_max_size, bool with_variants)
+    : capacity(max_entries > 0 ? max_entries : 1), mmap_threshold(mmap_max_size), probe_variants(with_variants) {
+    inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd == -1) {
+        perror("inotify_init1 (cached files are re-validated with stat instead)");
+        return;
+    }
+    wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wake_fd == -1) {
+        perror("eventfd");
+        exit(EXIT_FAILURE);
+    }
+    watcher = std::thread(&FileCache::watch_loop, this);
+}
+
+FileCache::~FileCache() {
+    if (watcher.joinable()) {
+        uint64_t one = 1;
+        if (write(wake_fd, &one, sizeof(one)) == -1) {
+            perror("eventfd write");
+        }
+        watcher.join();
+    }
+    if (wake_fd != -1) {
+        close(wake_fd);
+    }
+    if (inotify_fd != -1) {
+        close(inotify_fd);
+    }
+}
+
+std::shared_ptr<const CachedFile> FileCache::load(const std::string &path) const {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return nullptr;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return nullptr;
+    }
+
+    auto file = std::make_shared<CachedFile>();
+    file->fd = fd;
+    file->size = static_cast<size_t>(st.st_size);
+    file->dev = st.st_dev;
+    file->ino = st.st_ino;
+    file->mtime_ns = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    file->content_type = content_type_for(path);
+
+    char etag[48];
+    snprintf(etag, sizeof(etag), "\"%llx-%zx\"", static_cast<unsigned long long>(file->mtime_ns), file->size);
+    file->etag = etag;
+
+    if (file->size > 0 && file->size <= mmap_threshold) {
+        void *mapped = mmap(nullptr, file->size, PROT_READ, MAP_SHARED, fd, 0);
+        if (mapped != MAP_FAILED) {
+            file->mapping = static_cast<const char *>(mapped);
+        }
+    }
+    if (probe_variants) {
+        file->has_brotli = is_regular_file(path + ".br");
+        file->has_gzip = is_regular_file(path + ".gz");
+    }
+    return file;
+}
+
+void FileCache::watch_directory(const std::string &dir) {
+    if (inotify_fd == -1 || dir_watches.count(dir)) {
+        return;
+    }
+    int wd = inotify_add_watch(inotify_fd, dir.c_str(),
+                               IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB | IN_CREATE | IN_DELETE | IN_MOVED_FROM |
+                                   IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF);
+    if (wd == -1) {
+        return; // Files in this directory then simply stay cached until evicted
+    }
+    watched_dirs[wd] = dir;
+    dir_watches[dir] = wd;
+}
+
+void FileCache::invalidate(const std::string &path) {
+    auto it = entries.find(path);
+    if (it != entries.end()) {
+        lru.erase(it->second.lru_pos);
+        entries.erase(it);
+    }
+}
+
+std::shared_ptr<const CachedFile> FileCache::open(const std::string &path) {
+    uint64_t epoch;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = entries.find(path);
+        if (it != entries.end()) {
+            bool fresh = true;
+            if (inotify_fd == -1) {
+                const CachedFile &file = *it->second.file;
+                struct stat st;
+                fresh = stat(path.c_str(), &st) == 0 && st.st_ino == file.ino && st.st_dev == file.dev &&
+                        static_cast<size_t>(st.st_size) == file.size &&
+                        static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec == file.mtime_ns;
+            }
+            if (fresh) {
+                lru.splice(lru.begin(), lru, it->second.lru_pos);
+                return it->second.file;
+            }
+            invalidate(path);
+        }
+        watch_directory(std::string(directory_of(path)));
+        epoch = invalidations;
+    }
+
+    std::shared_ptr<const CachedFile> file = load(path);
+    if (!file) {
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (epoch != invalidations) {
+        return file; // The file may have changed while it was loading: use it once, don't cache it
+    }
+    auto [it, inserted] = entries.try_emplace(path);
+    if (!inserted) {
+        return it->second.file; // Another thread loaded it meanwhile
+    }
+    lru.push_front(path);
+    it->second.file = file;
+    it->second.lru_pos = lru.begin();
+    while (entries.size() > capacity) {
+        entries.erase(lru.back()); // Responses still sending keep their file open
+        lru.pop_back();
+    }
+    return file;
+}
+
+size_t FileCache::size() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return entries.size();
+}
+
+void FileCache::watch_loop() {
+    alignas(struct inotify_event) char buffer[4096];
+
+    while (true) {
+        struct pollfd fds[2] = {{inotify_fd, POLLIN, 0}, {wake_fd, POLLIN, 0}};
+        if (poll(fds, 2, -1) == -1) {
+            if (errno == EINTR)
+                continue;
+            perror("poll in file cache watcher");
+            return;
+        }
+        if (fds[1].revents) {
+            return;
+        }
+
+        ssize_t length = read(inotify_fd, buffer, sizeof(buffer));
+        if (length <= 0) {
+            continue;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        ++invalidations;
+        for (ssize_t pos = 0; pos < length;) {
+            const struct inotify_event *event = reinterpret_cast<const struct inotify_event *>(buffer + pos);
+            pos += sizeof(struct inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                entries.clear(); // Events were lost: nothing cached can be trusted
+                lru.clear();
+                continue;
+            }
+            auto dir = watched_dirs.find(event->wd);
+            if (dir == watched_dirs.end()) {
+                continue;
+            }
+
+            // The directory itself went away (or moved): drop everything below it
+            std::string prefix = dir->second + "/";
+            if (event->mask & (IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF)) {
+                for (auto it = entries.begin(); it != entries.end();) {
+                    if (it->first.compare(0, prefix.size(), prefix) == 0) {
+                        lru.erase(it->second.lru_pos);
+                        it = entries.erase(it);
+                    } else {
+                        ++it;
+                    }
+                }
+                if (event->mask & IN_IGNORED) {
+                    dir_watches.erase(dir->second);
+                    watched_dirs.erase(dir);
+                }
+                continue;
+            }
+            if (event->len == 0) {
+                continue;
+            }
+
+            std::string path = prefix + event->name;
+            invalidate(path);
+            // A new, changed or removed variant changes what the base entry offers
+            std::string_view name(path);
+            if (name.size() > 3 && (name.substr(name.size() - 3) == ".gz" || name.substr(name.size() - 3) == ".br")) {
+                invalidate(path.substr(0, path.size() - 3));
+            }
+        }
+    }
+}
+
+// --- StaticFiles ---
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+/**
+ * @brief Maps the request's path below the mount onto the file system.
+ * Percent-decodes it, drops empty and "." segments, and refuses ".." and NUL so no
+ * request can leave root. A trailing slash (or nothing at all) means the index file.
+ */
+static bool resolve_path(const std::string &root, std::string_view relative, const std::string &index_file,
+                         std::string &out) {
+    std::string decoded;
+    decoded.reserve(relative.size());
+    for (size_t i = 0; i < relative.size(); ++i) {
+        char c = relative[i];
+        if (c == '%') {
+            if (i + 2 >= relative.size() || hex_value(relative[i + 1]) < 0 || hex_value(relative[i + 2]) < 0) {
+                return false;
+            }
+            c = static_cast<char>(hex_value(relative[i + 1]) * 16 + hex_value(relative[i + 2]));
+            i += 2;
+        }
+        if (c == '\0') {
+            return false;
+        }
+        decoded.push_back(c);
+    }
+
+    out = root;
+    std::string_view rest(decoded);
+    bool directory = true;
+    while (!rest.empty()) {
+        size_t slash = rest.find('/');
+        std::string_view segment = rest.substr(0, slash);
+        rest = slash == std::string_view::npos ? std::string_view() : rest.substr(slash + 1);
+        directory = slash != std::string_view::npos;
+
+        if (segment.empty() || segment == ".") {
+            directory = true;
+            continue;
+        }
+        if (segment == "..") {
+            return false;
+        }
+        out.push_back('/');
+        out.append(segment);
+    }
+    if (directory) {
+        out.push_back('/');
+        out.append(index_file);
+    }
+    return true;
+}
+
+// Comma-separated list of entity tags (or "*"); weak comparison as If-None-Match requires
+static bool etag_matches(std::string_view list, std::string_view etag) {
+    while (!list.empty()) {
+        size_t comma = list.find(',');
+        std::string_view tag = list.substr(0, comma);
+        list = comma == std::string_view::npos ? std::string_view() : list.substr(comma + 1);
+
+        while (!tag.empty() && (tag.front() == ' ' || tag.front() == '\t'))
+            tag.remove_prefix(1);
+        while (!tag.empty() && (tag.back() == ' ' || tag.back() == '\t'))
+            tag.remove_suffix(1);
+        if (tag == "*") {
+            return true;
+        }
+        if (tag.substr(0, 2) == "W/") {
+            tag.remove_prefix(2);
+        }
+        if (tag == etag) {
+            return true;
+        }
+    }
+    return false;
+}
+
+enum class RangeResult { None, Satisfiable, Unsatisfiable };
+
+static bool parse_size(std::string_view digits, size_t &value) {
+    if (digits.empty()) {
+        return false;
+    }
+    auto result = std::from_chars(digits.data(), digits.data() + digits.size(), value);
+    return result.ec == std::errc() && result.ptr == digits.data() + digits.size();
+}
+
+/**
+ * @brief Parses a single "bytes=first-last", "bytes=first-" or "bytes=-suffix" range.
+ * Anything this server does not serve as a range (other units, several ranges, a
+ * malformed spec) is None, so the whole file goes out with 200, as RFC 9110 allows.
+ */
+static RangeResult parse_range(std::string_view header, size_t size, size_t &start, size_t &length) {
+    if (header.size() < 6 || !equals_ignore_case(header.substr(0, 6), "bytes=")) {
+        return RangeResult::None;
+    }
+    std::string_view spec = header.substr(6);
+    while (!spec.empty() && spec.back() == ' ')
+        spec.remove_suffix(1);
+    size_t dash = spec.find('-');
+    if (dash == std::string_view::npos || spec.find(',') != std::string_view::npos) {
+        return RangeResult::None;
+    }
+
+    std::string_view first = spec.substr(0, dash);
+    std::string_view last = spec.substr(dash + 1);
+    size_t a = 0;
+    size_t b = 0;
+    if (first.empty()) {
+        if (!parse_size(last, b)) {
+            return RangeResult::None;
+        }
+        if (b == 0 || size == 0) {
+            return RangeResult::Unsatisfiable;
+        }
+        start = size - std::min(b, size);
+        length = size - start;
+        return RangeResult::Satisfiable;
+    }
+    if (!parse_size(first, a) || (!last.empty() && (!parse_size(last, b) || b < a))) {
+        return RangeResult::None;
+    }
+    if (a >= size) {
+        return RangeResult::Unsatisfiable;
+    }
+    b = last.empty() ? size - 1 : std::min(b, size - 1);
+    start = a;
+    length = b - a + 1;
+    return RangeResult::Satisfiable;
+}
+
+StaticFiles::StaticFiles(std::string root_dir, StaticFilesConfig static_config)
+    : root(std::move(root_dir)), config(std::move(static_config)),
+      cache(config.max_open_files, config.mmap_threshold, config.precompressed) {
+    while (root.size() > 1 && root.back() == '/') {
+        root.pop_back();
+    }
+}
+
+HttpResponse StaticFiles::serve(const HTTPRequest &request, std::string_view relative_path) const {
+    std::string path;
+    if (!resolve_path(root, relative_path, config.index_file, path)) {
+        return status_response(404);
+    }
+    std::shared_ptr<const CachedFile> file = cache.open(path);
+    if (!file) {
+        return status_response(404);
+    }
+
+    std::string_view range = request.header("Range");
+    std::string_view if_range = request.header("If-Range");
+    if (!if_range.empty() && if_range != file->etag) {
+        range = {}; // The client's partial copy is stale: send it all
+    }
+
+    // Ranges refer to the identity encoding, so a ranged request never gets a variant
+    std::shared_ptr<const CachedFile> served = file;
+    std::string_view encoding_line;
+    bool has_variants = file->has_brotli || file->has_gzip;
+    if (has_variants && range.empty()) {
+        std::string_view accept_encoding = request.header("Accept-Encoding");
+        std::shared_ptr<const CachedFile> variant;
+        if (file->has_brotli && accepts_encoding(accept_encoding, "br") && (variant = cache.open(path + ".br"))) {
+            encoding_line = HEADER_ENCODING_BROTLI;
+        } else if (file->has_gzip && accepts_encoding(accept_encoding, "gzip") &&
+                   (variant = cache.open(path + ".gz"))) {
+            encoding_line = HEADER_ENCODING_GZIP;
+        }
+        if (variant) {
+            served = variant;
+        }
+    }
+
+    auto base_headers = [&](HttpResponse &response) {
+        response.set_header("ETag", served->etag);
+        if (has_variants) {
+            response.add_header_line(HEADER_VARY_ENCODING);
+        }
+    };
+
+    std::string_view if_none_match = request.header("If-None-Match");
+    if (!if_none_match.empty() && etag_matches(if_none_match, served->etag)) {
+        HttpResponse response(304);
+        base_headers(response);
+        return response;
+    }
+
+    size_t start = 0;
+    size_t length = served->size;
+    HttpResponse response(200);
+    if (!range.empty()) {
+        RangeResult result = parse_range(range, served->size, start, length);
+        if (result == RangeResult::Unsatisfiable) {
+            HttpResponse unsatisfiable(416);
+            unsatisfiable.set_header("Content-Range", "bytes */" + std::to_string(served->size));
+            return unsatisfiable;
+        }
+        if (result == RangeResult::Satisfiable) {
+            response = HttpResponse(206);
+            response.set_header("Content-Range", "bytes " + std::to_string(start) + "-" +
+                                                     std::to_string(start + length - 1) + "/" +
+                                                     std::to_string(served->size));
+        } else {
+            start = 0;
+            length = served->size;
+        }
+    }
+
+    response.add_header_line(file->content_type);
+    response.add_header_line(HEADER_ACCEPT_RANGES);
+    if (!encoding_line.empty()) {
+        response.add_header_line(encoding_line);
+    }
+    base_headers(response);
+
+    if (served->mapping) {
+        response.set_body_view(std::string_view(served->mapping + start, length), served);
+    } else {
+        response.set_body_file(served->fd, static_cast<off_t>(start), length, served);
+    }
+    if (request.method == "HEAD") {
+        response.omit_body();
+    }
+    return response;
+}
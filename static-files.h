@@ -0,0 +1,114 @@
+#ifndef STATIC_FILES_H
+#define STATIC_FILES_H
+
+#include "http-parser.h"
+#include "http-response.h"
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <sys/types.h>
+#include <thread>
+#include <unordered_map>
+
+struct StaticFilesConfig {
+    size_t max_open_files = 1024;     // Capacity of the open-file cache (LRU)
+    size_t mmap_threshold = 64 * 1024; // Files up to this size are mapped and sent from memory
+    bool precompressed = true;        // Serve "name.br" / "name.gz" next to "name" when accepted
+    std::string index_file = "index.html";
+};
+
+// One open file: descriptor, the stat fields that identify its version, and for small
+// files a read-only mapping. Immutable once cached; closed when the last user lets go.
+struct CachedFile {
+    int fd = -1;
+    size_t size = 0;
+    dev_t dev = 0;
+    ino_t ino = 0;
+    int64_t mtime_ns = 0;
+    std::string etag; // Strong: "<mtime>-<size>" in hex
+    std::string_view content_type;
+    const char *mapping = nullptr; // Whole file, when size <= mmap_threshold
+    bool has_gzip = false;         // "name.gz" existed when this entry was loaded
+    bool has_brotli = false;
+
+    CachedFile() = default;
+    CachedFile(const CachedFile &) = delete;
+    CachedFile &operator=(const CachedFile &) = delete;
+    ~CachedFile();
+};
+
+/**
+ * @brief LRU cache of open files keyed by path.
+ * open() costs a hash lookup on a hit instead of open() + fstat(). Entries are dropped when
+ * inotify reports a change to the file (or a .gz/.br variant of it) in its directory; a
+ * watcher thread drains the events. Without inotify every hit is re-validated with stat().
+ * Thread safe: ThreadPool workers and reactors share one cache.
+ */
+class FileCache {
+  private:
+    struct Entry {
+        std::shared_ptr<const CachedFile> file;
+        std::list<std::string>::iterator lru_pos;
+    };
+
+    size_t capacity;
+    size_t mmap_threshold;
+    bool probe_variants;
+
+    std::mutex mutex;
+    std::unordered_map<std::string, Entry> entries;
+    std::list<std::string> lru; // Most recently used first
+    uint64_t invalidations = 0; // Bumped per inotify batch; a load that raced one is not cached
+
+    int inotify_fd = -1;
+    int wake_fd = -1; // eventfd: stops the watcher thread
+    std::unordered_map<int, std::string> watched_dirs; // Watch descriptor -> directory
+    std::unordered_map<std::string, int> dir_watches;
+    std::thread watcher;
+
+    std::shared_ptr<const CachedFile> load(const std::string &path) const;
+    void watch_directory(const std::string &dir);
+    void invalidate(const std::string &path);
+    void watch_loop();
+
+  public:
+    FileCache(size_t max_entries, size_t mmap_max_size, bool with_variants);
+    ~FileCache();
+    FileCache(const FileCache &) = delete;
+    FileCache &operator=(const FileCache &) = delete;
+
+    // nullptr unless path is a readable regular file
+    std::shared_ptr<const CachedFile> open(const std::string &path);
+
+    size_t size();
+};
+
+/**
+ * @brief Serves a directory tree. Register it with HttpServer::add_endpoint() under a
+ * pattern whose last segment is a wildcard ("*path"); the wildcard names the file. Responses
+ * carry an ETag (answering If-None-Match with 304), honour a single "Range: bytes=" (206 /
+ * 416) and pick a precompressed variant from Accept-Encoding. Bodies are never copied in
+ * user space: small files go out from their mapping, larger ones with sendfile().
+ */
+class StaticFiles {
+  private:
+    std::string root;
+    StaticFilesConfig config;
+    mutable FileCache cache;
+
+  public:
+    explicit StaticFiles(std::string root_dir, StaticFilesConfig static_config = StaticFilesConfig());
+
+    // relative_path is the still percent-encoded part of the request path below the mount
+    HttpResponse serve(const HTTPRequest &request, std::string_view relative_path) const;
+
+    size_t cached_files() const { return cache.size(); }
+};
+
+std::string_view content_type_for(std::string_view path);
+
+#endif // STATIC_FILES_H
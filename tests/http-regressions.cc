@@ -0,0 +1,166 @@
+// Wire-level regression checks: starts the server in-process and talks raw HTTP/1.1 to it.
+// Exits non-zero if any check fails; run through ctest.
+#include "http-server.h"
+#include <arpa/inet.h>
+#include <chrono>
+#include <iostream>
+#include <netinet/in.h>
+#include <string>
+#include <string_view>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+static constexpr int BASE_PORT = 18431;
+
+static int failures = 0;
+
+static void check(bool ok, const std::string &what) {
+    std::cout << (ok ? "ok   " : "FAIL ") << what << std::endl;
+    if (!ok) {
+        ++failures;
+    }
+}
+
+static int connect_to(int port) {
+    for (int attempt = 0; attempt < 100; ++attempt) {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(static_cast<uint16_t>(port));
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0) {
+            timeval timeout{5, 0};
+            setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+            return fd;
+        }
+        close(fd);
+        std::this_thread::sleep_for(std::chrono::milliseconds(20)); // The server is still starting
+    }
+    return -1;
+}
+
+// Sends the requests in one write and reads until the server closes (the last asks it to)
+static std::string send_pipelined(int port, const std::string &requests) {
+    int fd = connect_to(port);
+    if (fd < 0) {
+        return {};
+    }
+    std::string reply;
+    if (send(fd, requests.data(), requests.size(), MSG_NOSIGNAL) == static_cast<ssize_t>(requests.size())) {
+        char buffer[4096];
+        ssize_t n;
+        while ((n = recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+            reply.append(buffer, static_cast<size_t>(n));
+        }
+    }
+    close(fd);
+    return reply;
+}
+
+// Walks the responses in order: a HEAD answer must end with its headers, whatever its
+// Content-Length says, or its body would be read as the start of the next response
+static bool responses_frame(std::string_view reply, const std::vector<bool> &head_requests) {
+    size_t pos = 0;
+    for (bool head : head_requests) {
+        if (reply.substr(pos, 9) != "HTTP/1.1 ") {
+            return false;
+        }
+        size_t header_end = reply.find("\r\n\r\n", pos);
+        if (header_end == std::string_view::npos) {
+            return false;
+        }
+        std::string_view headers = reply.substr(pos, header_end - pos);
+        pos = header_end + 4;
+        if (head) {
+            continue;
+        }
+        size_t length_at = headers.find("Content-Length: ");
+        if (length_at == std::string_view::npos) {
+            return false;
+        }
+        size_t length_end = headers.find("\r\n", length_at);
+        pos += std::stoul(std::string(headers.substr(length_at + 16, length_end - length_at - 16)));
+    }
+    return pos == reply.size();
+}
+
+static std::string legacy_text(const std::string &, const std::string &) {
+    return "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nContent-Length: 5\r\n\r\nhello";
+}
+
+static HttpResponse status_ok(const std::string &, const std::string &) {
+    return std::move(HttpResponse(200).set_body_view("Status: OK"));
+}
+
+static void run_checks(ServerMode mode, const char *name, int port) {
+    ServerConfig config;
+    config.mode = mode;
+    HttpServer server(port, 2, config);
+    server.add_endpoint("GET", "/status", status_ok);
+    server.add_endpoint("HEAD", "/legacy", legacy_text);
+    server.add_endpoint("HEAD", "/cached", status_ok);
+    server.cache_endpoint("HEAD", "/cached", ResponseCachePolicy{});
+    std::thread serving([&server] { server.start(); });
+
+    const std::string get = "GET /status HTTP/1.1\r\nHost: test\r\nConnection: close\r\n\r\n";
+    std::string prefix = std::string(name) + ": ";
+
+    check(responses_frame(send_pipelined(port, "HEAD /nope HTTP/1.1\r\nHost: test\r\n\r\n" + get), {true, false}),
+          prefix + "pipelined HEAD 404 then GET");
+    check(responses_frame(send_pipelined(port, "HEAD /legacy HTTP/1.1\r\nHost: test\r\n\r\n" + get), {true, false}),
+          prefix + "pipelined HEAD to a serialized response then GET");
+    std::string head_cached = "HEAD /cached HTTP/1.1\r\nHost: test\r\n\r\n";
+    check(responses_frame(send_pipelined(port, head_cached + head_cached + get), {true, true, false}),
+          prefix + "pipelined HEAD to a cached response (miss, hit) then GET");
+
+    server.stop();
+    serving.join();
+}
+
+// max_header_size = 0 means unlimited, not "every head is too large"
+static void run_unlimited_header_check(int port) {
+    ServerConfig config;
+    config.mode = ServerMode::Reactor;
+    config.max_header_size = 0;
+    HttpServer server(port, 1, config);
+    server.add_endpoint("GET", "/status", status_ok);
+    std::thread serving([&server] { server.start(); });
+
+    std::string big_header = "X-Padding: " + std::string(8192, 'a') + "\r\n";
+    std::string reply =
+        send_pipelined(port, "GET /status HTTP/1.1\r\nHost: test\r\n" + big_header + "Connection: close\r\n\r\n");
+    check(reply.starts_with("HTTP/1.1 200 "), "max_header_size = 0 accepts an 8 KiB head");
+
+    server.stop();
+    serving.join();
+}
+
+// Routes through one tree node may name its capture differently
+static void run_router_checks() {
+    Router router;
+    ContextHandler ignore = [](const Request &, HttpResponse &) {};
+    router.add("GET", "/users/:id", ignore);
+    router.add("GET", "/users/:uid/posts", ignore);
+    router.add("GET", "/files/*path", ignore);
+    router.add("PUT", "/files/*rest", ignore);
+
+    RouteParams params;
+    router.match(HttpMethod::Get, "GET", "/users/7/posts", &params);
+    check(params.get("uid") == "7" && params.get("id").empty(), "router: second route keeps its own :uid name");
+    params = RouteParams();
+    router.match(HttpMethod::Get, "GET", "/users/7", &params);
+    check(params.get("id") == "7", "router: first route keeps its :id name");
+    params = RouteParams();
+    router.match(HttpMethod::Put, "PUT", "/files/a/b", &params);
+    check(params.get("rest") == "a/b", "router: wildcard named per route");
+}
+
+int main() {
+    run_router_checks();
+    run_checks(ServerMode::ThreadPool, "threadpool", BASE_PORT);
+    run_checks(ServerMode::Reactor, "reactor", BASE_PORT + 1);
+    run_unlimited_header_check(BASE_PORT + 2);
+    return failures == 0 ? 0 : 1;
+}
@@ -1,25 +1,113 @@
 #include "thread-pool.h"
-#include "http-server.h"
+#include "log.h"
+#include "util.h"
 #include <iostream>
-#include <memory> // for std::packaged_task
 #include <stdexcept>
-#include <type_traits>
 
-ThreadPool::ThreadPool(size_t threads) {
+// Empty polls a worker makes before parking on the futex in QueueMode::LockFree
+static constexpr int SPIN_ITERATIONS = 2048;
+
+// WorkStealing: full find-work rounds (local, injection, steal) before parking
+static constexpr int STEAL_ROUNDS = 64;
+
+// WorkStealing: task nodes each thread keeps for reuse instead of returning them to malloc
+static constexpr size_t TASK_NODE_CACHE = 1024;
+
+// Identifies the pool and slot of the worker running on this thread
+static thread_local const ThreadPool *tls_pool = nullptr;
+static thread_local size_t tls_worker_index = 0;
+
+static uint64_t xorshift64(uint64_t &state) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+// Per-thread free list of deque nodes. A stolen node is recycled by the thief, so nodes
+// migrate between threads, but steady-state local pushes never reach the allocator.
+struct TaskNodeCache {
+    std::vector<UniqueTask *> nodes;
+
+    ~TaskNodeCache() {
+        for (UniqueTask *node : nodes) {
+            delete node;
+        }
+    }
+};
+static thread_local TaskNodeCache tls_task_nodes;
+
+static UniqueTask *acquire_task_node(UniqueTask task) {
+    std::vector<UniqueTask *> &nodes = tls_task_nodes.nodes;
+    if (nodes.empty()) {
+        return new UniqueTask(std::move(task));
+    }
+    UniqueTask *node = nodes.back();
+    nodes.pop_back();
+    *node = std::move(task);
+    return node;
+}
+
+static void release_task_node(UniqueTask *node) {
+    *node = nullptr;
+    std::vector<UniqueTask *> &nodes = tls_task_nodes.nodes;
+    if (nodes.size() < TASK_NODE_CACHE) {
+        nodes.push_back(node);
+    } else {
+        delete node;
+    }
+}
+
+// Runs a task, keeping a throwing fire-and-forget task from taking the worker down with it
+static void run_task(UniqueTask &task) {
+    try {
+        task();
+    } catch (const std::exception &e) {
+        log_line(LogLevel::Error, "Uncaught exception in ThreadPool task: ", e.what());
+    } catch (...) {
+        log_line(LogLevel::Error, "Uncaught non-standard exception in ThreadPool task");
+    }
+}
+
+ThreadPool::ThreadPool(size_t threads, QueueMode mode, size_t ring_capacity, std::vector<int> cpus)
+    : queue_mode(mode), worker_cpus(std::move(cpus)) {
     if (threads == 0) {
         threads = std::thread::hardware_concurrency();
         if (threads == 0)
             threads = 4;
     }
 
-    std::cout << "Starting thread pool with " << threads << " worker threads." << std::endl;
+    if (queue_mode != QueueMode::Locked) {
+        ring = std::make_unique<MpmcRing<UniqueTask>>(ring_capacity);
+    }
+    if (queue_mode == QueueMode::WorkStealing) {
+        for (size_t i = 0; i < threads; ++i) {
+            local_queues.push_back(std::make_unique<LocalQueue>());
+        }
+    }
+
+    const char *queue_name = queue_mode == QueueMode::LockFree       ? "lock-free ring"
+                             : queue_mode == QueueMode::WorkStealing ? "work-stealing deques"
+                                                                     : "locked queue";
+    std::cout << "Starting thread pool with " << threads << " worker threads (" << queue_name << ")"
+              << (worker_cpus.empty() ? "" : ", pinned") << "." << std::endl;
 
     for (size_t i = 0; i < threads; ++i) {
-        workers.emplace_back([this] { this->worker_loop(); });
+        workers.emplace_back([this, i] { this->worker_loop(i); });
     }
 }
 
-ThreadPool::~ThreadPool() { shutdown(); }
+ThreadPool::~ThreadPool() {
+    shutdown();
+
+    // Workers are joined; whatever is left in the local deques was never run
+    for (auto &local : local_queues) {
+        UniqueTask *task;
+        while (local->deque.pop(task)) {
+            delete task;
+        }
+    }
+}
 
 void ThreadPool::shutdown() {
     bool expected = false;
@@ -28,6 +116,7 @@ void ThreadPool::shutdown() {
     }
 
     condition.notify_all();
+    ring_waiters.notify_all();
 
     for (std::thread &worker : workers) {
         if (worker.joinable()) {
@@ -38,13 +127,32 @@ void ThreadPool::shutdown() {
     std::cout << "Thread pool shut down successfully." << std::endl;
 }
 
-void ThreadPool::worker_loop() {
+void ThreadPool::worker_loop(size_t index) {
+    tls_pool = this;
+    tls_worker_index = index;
+    if (!worker_cpus.empty()) {
+        pin_to_cpu_core(worker_cpus[index % worker_cpus.size()]);
+        prefer_local_memory();
+    }
+
+    if (queue_mode == QueueMode::WorkStealing) {
+        work_stealing_worker_loop(index);
+    } else if (queue_mode == QueueMode::LockFree) {
+        lock_free_worker_loop();
+    } else {
+        locked_worker_loop();
+    }
+}
+
+void ThreadPool::locked_worker_loop() {
     while (!stop_flag) {
-        std::function<void()> task;
+        UniqueTask task;
+        bool pass_on;
 
         {
             std::unique_lock<std::mutex> lock(queue_mutex);
 
+            bool waited = tasks.empty();
             condition.wait(lock, [this] { return stop_flag || !tasks.empty(); });
 
             if (stop_flag && tasks.empty()) {
@@ -53,33 +161,223 @@ void ThreadPool::worker_loop() {
 
             task = std::move(tasks.front());
             tasks.pop();
+            pass_on = waited && !tasks.empty();
+        }
+
+        // A batch is posted with one wakeup (post_batch()): pass it on while work is left
+        if (pass_on) {
+            condition.notify_one();
         }
 
         // Execute the task
-        task();
+        run_task(task);
     }
 }
 
-template <class F, class... Args>
-auto ThreadPool::enqueue(F &&f, Args &&...args) -> std::future<typename std::invoke_result<F, Args...>::type> {
-    using return_type = typename std::invoke_result<F, Args...>::type;
+void ThreadPool::lock_free_worker_loop() {
+    UniqueTask task;
+    bool woken = false;
 
-    auto task =
-        std::make_shared<std::packaged_task<return_type()>>(std::bind(std::forward<F>(f), std::forward<Args>(args)...));
+    while (true) {
+        // Spin first: under load the next task usually arrives within microseconds,
+        // and a futex sleep/wake round trip costs far more than that
+        bool found = ring->try_pop(task);
+        for (int i = 0; !found && i < SPIN_ITERATIONS; ++i) {
+            cpu_relax();
+            found = ring->try_pop(task);
+        }
+
+        if (!found) {
+            uint32_t key = ring_waiters.prepare_wait();
+            found = ring->try_pop(task); // Re-check: a push may have raced prepare_wait()
+            if (!found) {
+                if (stop_flag) {
+                    ring_waiters.cancel_wait();
+                    return;
+                }
+                ring_waiters.commit_wait(key);
+                woken = true;
+                continue;
+            }
+            ring_waiters.cancel_wait();
+        }
+
+        // A batch is posted with one wakeup (post_batch()): pass it on while work is left
+        if (woken) {
+            woken = false;
+            if (ring->size_approx() != 0) {
+                ring_waiters.notify_one();
+            }
+        }
+
+        // Execute the task
+        run_task(task);
+        task = nullptr;
+    }
+}
+
+long ThreadPool::current_worker_index() const { return tls_pool == this ? (long)tls_worker_index : -1; }
+
+bool ThreadPool::try_steal(size_t thief, uint64_t &rng_state, UniqueTask *&task) {
+    size_t count = local_queues.size();
+    size_t start = xorshift64(rng_state) % count;
+
+    for (size_t i = 0; i < count; ++i) {
+        size_t victim = (start + i) % count;
+        if (victim != thief && local_queues[victim]->deque.steal(task)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::work_stealing_worker_loop(size_t index) {
+    WorkStealingDeque<UniqueTask *> &local = local_queues[index]->deque;
+    uint64_t rng_state = 0x9E3779B97F4A7C15ull ^ (index + 1);
+    UniqueTask injected;
+    bool woken = false;
+
+    // Local deque first (LIFO, cache-hot), then the injection ring, then other workers
+    auto find_work = [&](UniqueTask *&task) {
+        if (local.pop(task)) {
+            return true;
+        }
+        if (ring->try_pop(injected)) {
+            task = &injected;
+            return true;
+        }
+        return try_steal(index, rng_state, task);
+    };
+
+    auto run = [&](UniqueTask *task) {
+        run_task(*task);
+        if (task == &injected) {
+            injected = nullptr;
+        } else {
+            release_task_node(task);
+        }
+    };
+
+    while (true) {
+        UniqueTask *task = nullptr;
+
+        bool found = find_work(task);
+        for (int round = 0; !found && round < STEAL_ROUNDS; ++round) {
+            cpu_relax();
+            found = find_work(task);
+        }
+
+        if (!found) {
+            uint32_t key = ring_waiters.prepare_wait();
+            found = find_work(task); // Re-check: a push may have raced prepare_wait()
+            if (!found) {
+                if (stop_flag) {
+                    ring_waiters.cancel_wait();
+                    return;
+                }
+                ring_waiters.commit_wait(key);
+                woken = true;
+                continue;
+            }
+            ring_waiters.cancel_wait();
+        }
+
+        // Only the injection ring can hold the rest of a batch: deque pushes notify each time
+        if (woken) {
+            woken = false;
+            if (ring->size_approx() != 0) {
+                ring_waiters.notify_one();
+            }
+        }
+
+        run(task);
+    }
+}
+
+void ThreadPool::push_task(UniqueTask task) {
+    if (queue_mode == QueueMode::WorkStealing) {
+        long self = current_worker_index();
+        if (self >= 0) {
+            // Sub-task from one of our own workers: keep it local, thieves balance the rest
+            local_queues[self]->deque.push(acquire_task_node(std::move(task)));
+            ring_waiters.notify_one();
+            return;
+        }
+    }
+
+    if (queue_mode != QueueMode::Locked) {
+        push_to_ring(task);
+        ring_waiters.notify_one();
+        return;
+    }
 
-    std::future<return_type> res = task->get_future();
     {
         std::unique_lock<std::mutex> lock(queue_mutex);
 
         if (stop_flag)
             throw std::runtime_error("enqueue on stopped ThreadPool");
 
-        tasks.emplace([task]() { (*task)(); });
+        tasks.emplace(std::move(task));
     }
     condition.notify_one();
-    return res;
 }
 
-// Explicitly instantiate enqueue for the common void return type (used by handle_client)
-template std::future<void>
-ThreadPool::enqueue<void (HttpServer::*)(int), HttpServer *, int &>(void (HttpServer::*&&)(int), HttpServer *&&, int &);
+void ThreadPool::push_to_ring(UniqueTask &task) {
+    if (stop_flag)
+        throw std::runtime_error("enqueue on stopped ThreadPool");
+
+    // Bounded: when every slot is taken, back off until a worker frees one. A worker
+    // of this pool must not just wait (all of them could be here), so it helps instead.
+    bool is_worker = current_worker_index() >= 0;
+    UniqueTask helped;
+    while (!ring->try_push(std::move(task))) {
+        if (stop_flag)
+            throw std::runtime_error("enqueue on stopped ThreadPool");
+        if (is_worker && ring->try_pop(helped)) {
+            run_task(helped);
+            helped = nullptr;
+        } else {
+            std::this_thread::yield();
+        }
+    }
+}
+
+void ThreadPool::post(UniqueTask task) { push_task(std::move(task)); }
+
+void ThreadPool::post_batch(std::vector<UniqueTask> &batch) {
+    if (batch.empty()) {
+        return;
+    }
+
+    if (queue_mode == QueueMode::Locked) {
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+
+            if (stop_flag)
+                throw std::runtime_error("enqueue on stopped ThreadPool");
+
+            for (UniqueTask &task : batch) {
+                tasks.emplace(std::move(task));
+            }
+        }
+        condition.notify_one();
+    } else {
+        for (UniqueTask &task : batch) {
+            push_to_ring(task);
+        }
+        ring_waiters.notify_one();
+    }
+    batch.clear();
+}
+
+size_t ThreadPool::queue_depth() {
+    if (queue_mode == QueueMode::Locked) {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        return tasks.size();
+    }
+    size_t depth = ring->size_approx();
+    for (const auto &local : local_queues) {
+        depth += local->deque.size_approx();
+    }
+    return depth;
+}
@@ -1,34 +1,113 @@
 #ifndef THREAD_POOL_H
 #define THREAD_POOL_H
 
+#include "ring-buffer.h"
+#include "unique-task.h"
+#include "work-stealing-deque.h"
 #include <atomic>
 #include <condition_variable>
 #include <functional>
 #include <future>
+#include <memory>
 #include <mutex>
 #include <queue>
 #include <thread>
 #include <vector>
 
+// Selects the task queue shared by all workers.
+enum class QueueMode {
+    Locked,       // std::queue guarded by a mutex + condition variable (fallback)
+    LockFree,     // Bounded MPMC ring; idle workers spin briefly, then park on a futex
+    WorkStealing, // Per-worker Chase-Lev deques fed by an MPMC injection ring; idle workers steal
+};
+
 class ThreadPool {
   private:
     std::vector<std::thread> workers;
-    std::queue<std::function<void()>> tasks;
+    QueueMode queue_mode;
 
+    // QueueMode::Locked
+    std::queue<UniqueTask> tasks;
     std::mutex queue_mutex;
     std::condition_variable condition;
+
+    // QueueMode::LockFree, and the injection queue in QueueMode::WorkStealing.
+    // Tasks are stored inline in the slots, so a push never allocates.
+    std::unique_ptr<MpmcRing<UniqueTask>> ring;
+    EventCount ring_waiters;
+
+    // QueueMode::WorkStealing: one deque per worker, owned by the worker at the same index.
+    // Chase-Lev slots must be trivially copyable, so they hold pointers to recycled task nodes.
+    struct alignas(CACHE_LINE_SIZE) LocalQueue {
+        WorkStealingDeque<UniqueTask *> deque;
+    };
+    std::vector<std::unique_ptr<LocalQueue>> local_queues;
+
     std::atomic<bool> stop_flag = false;
 
-    void worker_loop();
+    // Worker i runs on worker_cpus[i % size()]; empty leaves the workers unpinned
+    std::vector<int> worker_cpus;
+
+    void worker_loop(size_t index);
+    void locked_worker_loop();
+    void lock_free_worker_loop();
+    void work_stealing_worker_loop(size_t index);
+
+    // One pass over the other workers' deques, starting at a random victim
+    bool try_steal(size_t thief, uint64_t &rng_state, UniqueTask *&task);
+
+    // Index of the calling worker if it belongs to this pool, else -1
+    long current_worker_index() const;
+
+    // Hands a task to whichever queue is active and wakes a worker
+    void push_task(UniqueTask task);
+
+    // Ring-based modes: queues task, backing off while the ring is full, without waking anyone.
+    // Throws if the pool is stopped, leaving task as it was.
+    void push_to_ring(UniqueTask &task);
 
   public:
-    ThreadPool(size_t threads);
+    // ring_capacity is rounded up to a power of two and only used by the ring-based modes.
+    // With cpus, each worker pins itself before it touches any memory of its own, so its
+    // buffers land on its CPU's NUMA node.
+    ThreadPool(size_t threads, QueueMode mode = QueueMode::LockFree, size_t ring_capacity = 4096,
+               std::vector<int> cpus = {});
     ~ThreadPool();
 
+    // Fire-and-forget submission: no future, no shared state. Small callables are stored
+    // inline in the queue slot, so this path performs no heap allocation at all.
+    // An exception escaping the task is logged and swallowed.
+    void post(UniqueTask task);
+
+    // post() for a batch, with a single wakeup: a worker that leaves its wait with more work
+    // queued behind its task wakes the next one. Throws like post() once the pool is stopped;
+    // the tasks queued by then are emptied, the rest are left in tasks. Clears tasks otherwise.
+    void post_batch(std::vector<UniqueTask> &tasks);
+
+    // In WorkStealing mode a task submitted from one of this pool's own workers (e.g. a
+    // handler spawning sub-tasks) goes onto that worker's local deque and stays cache-hot;
+    // submissions from any other thread go through the injection ring.
     template <class F, class... Args>
     auto enqueue(F &&f, Args &&...args) -> std::future<typename std::invoke_result<F, Args...>::type>;
 
+    // Tasks queued and not yet picked up by a worker. Exact in Locked mode (it takes the
+    // lock); otherwise read from the queue indices without stopping anyone, so approximate.
+    size_t queue_depth();
+
     void shutdown();
 };
 
+template <class F, class... Args>
+auto ThreadPool::enqueue(F &&f, Args &&...args) -> std::future<typename std::invoke_result<F, Args...>::type> {
+    using return_type = typename std::invoke_result<F, Args...>::type;
+
+    // The packaged_task is move-only and UniqueTask accepts that, so no shared_ptr wrapper
+    std::packaged_task<return_type()> task(
+        [f = std::forward<F>(f), ... args = std::forward<Args>(args)]() mutable { return std::invoke(f, args...); });
+
+    std::future<return_type> res = task.get_future();
+    push_task(UniqueTask([task = std::move(task)]() mutable { task(); }));
+    return res;
+}
+
 #endif // THREAD_POOL_H
@@ -0,0 +1,97 @@
+#include "timer-wheel.h"
+
+TimerWheel::TimerWheel(uint64_t tick) : tick_ms(tick) {
+    for (TimerNode &head : slots) {
+        head.prev = head.next = &head;
+    }
+    current_tick = monotonic_ms() / tick_ms;
+}
+
+void TimerWheel::unlink(TimerNode *node) {
+    TimerNode *head = node->next == node->prev ? node->next : nullptr; // Last node of its slot
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    node->prev = node->next = nullptr;
+    if (head == &slots[node->slot]) {
+        occupied[node->slot / SLOTS] &= ~(uint64_t(1) << (node->slot % SLOTS));
+    }
+}
+
+void TimerWheel::link_before(TimerNode *head, TimerNode *node) {
+    node->prev = head->prev;
+    node->next = head;
+    head->prev->next = node;
+    head->prev = node;
+}
+
+void TimerWheel::insert(TimerNode *node) {
+    // Beyond the top level's reach a timer waits in its furthest slot and is re-placed on
+    // each pass until it comes within range
+    uint64_t max_delta = (uint64_t(1) << (LEVEL_BITS * LEVELS)) - 1;
+    uint64_t delta = node->expire_tick - current_tick;
+    uint64_t tick = delta > max_delta ? current_tick + max_delta : node->expire_tick;
+
+    unsigned level = 0;
+    while (level + 1 < LEVELS && (delta >> (LEVEL_BITS * (level + 1))) != 0) {
+        ++level;
+    }
+    unsigned index = (tick >> (LEVEL_BITS * level)) & (SLOTS - 1);
+    node->slot = static_cast<uint16_t>(level * SLOTS + index);
+    link_before(&slots[node->slot], node);
+    occupied[level] |= uint64_t(1) << index;
+}
+
+void TimerWheel::cascade(unsigned level, uint64_t tick) {
+    if (level >= LEVELS) {
+        return;
+    }
+    unsigned index = (tick >> (LEVEL_BITS * level)) & (SLOTS - 1);
+    if (index == 0) {
+        // This level wrapped too: refill it from the one above first
+        cascade(level + 1, tick);
+    }
+    TimerNode *head = &slots[level * SLOTS + index];
+    while (head->next != head) {
+        TimerNode *node = head->next;
+        unlink(node);
+        insert(node); // Lands in a lower level, since its tick is within this slot's span
+    }
+}
+
+void TimerWheel::schedule(TimerNode *node, uint64_t timeout_ms, uint64_t now_ms) {
+    if (node->scheduled()) {
+        unlink(node);
+    } else {
+        ++count;
+    }
+
+    // Round up so a timer never fires early; never land in a tick already processed
+    node->expire_tick = (now_ms + timeout_ms + tick_ms - 1) / tick_ms;
+    if (node->expire_tick < current_tick) {
+        node->expire_tick = current_tick;
+    }
+    insert(node);
+}
+
+void TimerWheel::cancel(TimerNode *node) {
+    if (!node->scheduled()) {
+        return;
+    }
+    unlink(node);
+    --count;
+}
+
+int TimerWheel::next_timeout_ms(uint64_t now_ms) const {
+    if (count == 0) {
+        return -1;
+    }
+
+    // The next occupied level-0 slot before the wheel wraps, or else the wrap itself, where
+    // the cascade may bring timers down
+    unsigned index = current_tick & (SLOTS - 1);
+    uint64_t ahead = occupied[0] >> index;
+    uint64_t ticks = ahead ? static_cast<uint64_t>(__builtin_ctzll(ahead)) : SLOTS - index;
+
+    uint64_t wake_ms = (current_tick + ticks) * tick_ms;
+    return wake_ms > now_ms ? static_cast<int>(wake_ms - now_ms) : 0;
+}
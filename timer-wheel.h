@@ -0,0 +1,111 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Milliseconds on the monotonic clock; the time base for every TimerWheel.
+inline uint64_t monotonic_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+// Intrusive timer entry. Embed it in the object being timed; the wheel never allocates.
+struct TimerNode {
+    TimerNode *prev = nullptr;
+    TimerNode *next = nullptr;
+    uint64_t expire_tick = 0;
+    uint16_t slot = 0; // level * TimerWheel::SLOTS + index, while scheduled
+    int fd = -1;       // Identifies the owner when the timer fires
+
+    bool scheduled() const { return next != nullptr; }
+};
+
+/**
+ * @brief Hierarchical timing wheel with O(1) schedule/cancel.
+ * Level 0 has one slot per tick; each level above covers SLOTS times the span of the one
+ * below, so four levels of 64 reach 64^4 ticks. A timer sits in the coarsest slot that
+ * still tells it apart from now and cascades one level down each time the wheel below
+ * wraps, so it is touched at most once per level however long the timeout. Each slot is a
+ * circular intrusive list with an occupancy bit, which lets next_timeout_ms() skip empty
+ * ticks instead of waking once per tick. Not thread-safe: every wheel belongs to the single
+ * event loop that drives it.
+ */
+class TimerWheel {
+  public:
+    static constexpr unsigned LEVEL_BITS = 6;
+    static constexpr unsigned SLOTS = 1u << LEVEL_BITS;
+    static constexpr unsigned LEVELS = 4;
+
+  private:
+    uint64_t tick_ms;
+    uint64_t current_tick; // Next tick advance() processes
+    TimerNode slots[LEVELS * SLOTS]; // Sentinel heads
+    uint64_t occupied[LEVELS] = {};  // Bit i: slot i of that level is non-empty
+    size_t count = 0;
+
+    void unlink(TimerNode *node);
+    void insert(TimerNode *node);
+    void cascade(unsigned level, uint64_t tick);
+    static void link_before(TimerNode *head, TimerNode *node);
+
+  public:
+    explicit TimerWheel(uint64_t tick_ms = 10);
+
+    TimerWheel(const TimerWheel &) = delete;
+    TimerWheel &operator=(const TimerWheel &) = delete;
+
+    // (Re)arms node to fire timeout_ms from now. Rescheduling an armed node is O(1).
+    void schedule(TimerNode *node, uint64_t timeout_ms, uint64_t now_ms = monotonic_ms());
+    void cancel(TimerNode *node);
+
+    bool empty() const { return count == 0; }
+
+    // epoll_wait timeout until the next tick with work (a timer or a cascade), or -1 when
+    // nothing is scheduled
+    int next_timeout_ms(uint64_t now_ms = monotonic_ms()) const;
+
+    // Fires every node due by now_ms. on_expire may freely cancel or reschedule any node.
+    template <class F> void advance(uint64_t now_ms, F &&on_expire);
+};
+
+template <class F> void TimerWheel::advance(uint64_t now_ms, F &&on_expire) {
+    uint64_t now_tick = now_ms / tick_ms;
+    if (count == 0) {
+        current_tick = now_tick + 1;
+        return;
+    }
+
+    // Collect first, fire second: callbacks may unlink neighbours in the slot being walked
+    TimerNode expired;
+    expired.prev = expired.next = &expired;
+
+    for (; current_tick <= now_tick; ++current_tick) {
+        unsigned index = current_tick & (SLOTS - 1);
+        if (index == 0) {
+            cascade(1, current_tick);
+        }
+        if (!(occupied[0] & (uint64_t(1) << index))) {
+            continue;
+        }
+        TimerNode *head = &slots[index];
+        while (head->next != head) {
+            TimerNode *node = head->next;
+            unlink(node);
+            link_before(&expired, node);
+        }
+    }
+
+    while (expired.next != &expired) {
+        TimerNode *node = expired.next;
+        node->prev->next = node->next;
+        node->next->prev = node->prev;
+        node->prev = node->next = nullptr;
+        --count;
+        on_expire(node);
+    }
+}
+
+#endif // TIMER_WHEEL_H
@@ -0,0 +1,212 @@
+#include "tls.h"
+#include "http-response.h"
+#include "metrics.h"
+#include <algorithm>
+#include <climits>
+#include <errno.h>
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+#include <stdexcept>
+#include <sys/socket.h>
+
+// Plaintext of one TLS record: the most a user-space send() encrypts per call
+static constexpr size_t MAX_RECORD_PLAINTEXT = 16384;
+
+static std::string openssl_error(const char *what) {
+    std::string message = what;
+    unsigned long code = ERR_get_error();
+    if (code != 0) {
+        char text[256];
+        ERR_error_string_n(code, text, sizeof(text));
+        message += ": ";
+        message += text;
+    }
+    ERR_clear_error();
+    return message;
+}
+
+// --- TlsContext ---
+
+TlsContext::TlsContext(const TlsConfig &config, bool http2) : offer_h2(http2) {
+    ctx = SSL_CTX_new(TLS_server_method());
+    if (!ctx) {
+        throw std::runtime_error(openssl_error("SSL_CTX_new failed"));
+    }
+    SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+
+    uint64_t options = SSL_OP_NO_RENEGOTIATION | SSL_OP_CIPHER_SERVER_PREFERENCE | SSL_OP_NO_COMPRESSION |
+                       SSL_OP_IGNORE_UNEXPECTED_EOF; // A peer closing without close_notify is just EOF
+    if (config.ktls) {
+        options |= SSL_OP_ENABLE_KTLS;
+    }
+    if (config.session_tickets == 0) {
+        options |= SSL_OP_NO_TICKET;
+    }
+    SSL_CTX_set_options(ctx, options);
+
+    // The queue's bytes are copied out per call (OutputQueue::peek()), so a retried write may
+    // come from another address; idle connections give their record buffers back
+    SSL_CTX_set_mode(ctx, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER |
+                              SSL_MODE_RELEASE_BUFFERS);
+
+    // Tickets only: the session lives in the client's ticket, so no worker ever waits on a
+    // shared session cache. The ticket keys exist once per context, so any worker resumes any ticket.
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
+    SSL_CTX_set_num_tickets(ctx, config.session_tickets);
+    SSL_CTX_set_timeout(ctx, config.ticket_lifetime_s);
+
+    if (SSL_CTX_use_certificate_chain_file(ctx, config.certificate_file.c_str()) != 1) {
+        std::string message = openssl_error(("Cannot load certificate " + config.certificate_file).c_str());
+        SSL_CTX_free(ctx);
+        throw std::runtime_error(message);
+    }
+    if (SSL_CTX_use_PrivateKey_file(ctx, config.private_key_file.c_str(), SSL_FILETYPE_PEM) != 1 ||
+        SSL_CTX_check_private_key(ctx) != 1) {
+        std::string message = openssl_error(("Cannot load private key " + config.private_key_file).c_str());
+        SSL_CTX_free(ctx);
+        throw std::runtime_error(message);
+    }
+
+    SSL_CTX_set_alpn_select_cb(ctx, &TlsContext::select_alpn, this);
+}
+
+TlsContext::~TlsContext() { SSL_CTX_free(ctx); }
+
+int TlsContext::select_alpn(ssl_st *, const unsigned char **out, unsigned char *out_length, const unsigned char *in,
+                            unsigned int in_length, void *arg) {
+    const TlsContext *context = static_cast<const TlsContext *>(arg);
+    // Wire format: length-prefixed names, in our order of preference
+    static const unsigned char with_h2[] = "\x02h2\x08http/1.1";
+    static const unsigned char without_h2[] = "\x08http/1.1";
+    const unsigned char *supported = context->offer_h2 ? with_h2 : without_h2;
+    unsigned int supported_length = context->offer_h2 ? sizeof(with_h2) - 1 : sizeof(without_h2) - 1;
+
+    unsigned char *selected = nullptr;
+    if (SSL_select_next_proto(&selected, out_length, supported, supported_length, in, in_length) !=
+        OPENSSL_NPN_NEGOTIATED) {
+        return SSL_TLSEXT_ERR_NOACK; // Nothing in common: carry on without ALPN, as HTTP/1.1
+    }
+    *out = selected;
+    return SSL_TLSEXT_ERR_OK;
+}
+
+std::unique_ptr<TlsConnection> TlsContext::accept(int fd) const {
+    SSL *ssl = SSL_new(ctx);
+    if (!ssl) {
+        ERR_clear_error();
+        return nullptr;
+    }
+    // A socket BIO rather than memory BIOs: kTLS needs OpenSSL to own the descriptor
+    if (SSL_set_fd(ssl, fd) != 1) {
+        ERR_clear_error();
+        SSL_free(ssl);
+        return nullptr;
+    }
+    SSL_set_accept_state(ssl);
+    return std::make_unique<TlsConnection>(ssl, fd);
+}
+
+// --- TlsConnection ---
+
+TlsConnection::~TlsConnection() { SSL_free(ssl); }
+
+TlsConnection::Handshake TlsConnection::handshake() {
+    ERR_clear_error();
+    int result = SSL_do_handshake(ssl);
+    if (result == 1) {
+        done = true;
+        want_write = false;
+        kernel_send = BIO_get_ktls_send(SSL_get_wbio(ssl)) > 0;
+        kernel_receive = BIO_get_ktls_recv(SSL_get_rbio(ssl)) > 0;
+
+        ThreadMetrics &metrics = ThreadMetrics::local();
+        metrics.tls_handshakes.add();
+        if (SSL_session_reused(ssl)) {
+            metrics.tls_resumed.add();
+        }
+        if (kernel_send) {
+            metrics.tls_kernel_send.add();
+        }
+        return Handshake::Done;
+    }
+    switch (SSL_get_error(ssl, result)) {
+    case SSL_ERROR_WANT_READ:
+        want_write = false;
+        return Handshake::Pending;
+    case SSL_ERROR_WANT_WRITE:
+        want_write = true;
+        return Handshake::Pending;
+    default:
+        // Scanners and clients that reject the certificate end up here: not worth a log line
+        ERR_clear_error();
+        ThreadMetrics::local().tls_handshake_errors.add();
+        return Handshake::Failed;
+    }
+}
+
+bool TlsConnection::has_buffered_input() const { return !kernel_receive && SSL_pending(ssl) > 0; }
+
+ssize_t TlsConnection::recv(char *buffer, size_t length) {
+    if (kernel_receive) {
+        // A record other than application data (an alert, typically close_notify) fails with
+        // EIO, which the caller treats as the end of the connection
+        return ::recv(fd, buffer, length, 0);
+    }
+    ERR_clear_error();
+    int result = SSL_read(ssl, buffer, static_cast<int>(std::min<size_t>(length, INT_MAX)));
+    if (result > 0) {
+        return result;
+    }
+    switch (SSL_get_error(ssl, result)) {
+    case SSL_ERROR_WANT_READ:
+    case SSL_ERROR_WANT_WRITE:
+        errno = EAGAIN;
+        return -1;
+    case SSL_ERROR_ZERO_RETURN:
+        return 0; // close_notify, or EOF with SSL_OP_IGNORE_UNEXPECTED_EOF
+    case SSL_ERROR_SYSCALL:
+        if (errno == 0) {
+            errno = ECONNRESET;
+        }
+        return -1;
+    default:
+        ERR_clear_error();
+        errno = EPROTO;
+        return -1;
+    }
+}
+
+ssize_t TlsConnection::send(OutputQueue &out) {
+    if (kernel_send) {
+        return out.write_to(fd);
+    }
+
+    // One record per call. A retry after WANT_WRITE peeks the same bytes (and perhaps more
+    // behind them), which is what OpenSSL requires of a repeated SSL_write().
+    static thread_local char plaintext[MAX_RECORD_PLAINTEXT];
+    ssize_t length = out.peek(plaintext, sizeof(plaintext));
+    if (length <= 0) {
+        return length; // -1 keeps peek()'s errno (ENODATA from a stalled body stream)
+    }
+    ERR_clear_error();
+    int result = SSL_write(ssl, plaintext, static_cast<int>(length));
+    if (result > 0) {
+        out.sent(static_cast<size_t>(result));
+        return result;
+    }
+    switch (SSL_get_error(ssl, result)) {
+    case SSL_ERROR_WANT_READ:
+    case SSL_ERROR_WANT_WRITE:
+        errno = EAGAIN;
+        return -1;
+    case SSL_ERROR_SYSCALL:
+        if (errno == 0) {
+            errno = EPIPE;
+        }
+        return -1;
+    default:
+        ERR_clear_error();
+        errno = EPROTO;
+        return -1;
+    }
+}
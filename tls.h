@@ -0,0 +1,102 @@
+#ifndef TLS_H
+#define TLS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <sys/types.h>
+
+// OpenSSL's handles, kept opaque so that only tls.cc includes its headers
+struct ssl_st;
+struct ssl_ctx_st;
+
+class OutputQueue;
+
+// ServerConfig::tls. TLS is on once a certificate is given; then every connection is TLS.
+struct TlsConfig {
+    std::string certificate_file; // PEM, leaf first, then the chain
+    std::string private_key_file; // PEM
+
+    // Hand the session keys to the kernel after the handshake (TCP_ULP "tls"), so responses
+    // keep going out with sendmsg() and sendfile() and are encrypted in the kernel. Without it,
+    // or where the kernel or the cipher does not support it, OpenSSL encrypts in user space.
+    bool ktls = true;
+
+    // Resumption through stateless session tickets: a resumed handshake skips the
+    // certificate and its signature. 0 turns tickets off.
+    unsigned session_tickets = 1;   // Issued per full TLS 1.3 handshake
+    uint32_t ticket_lifetime_s = 7200;
+
+    bool enabled() const { return !certificate_file.empty(); }
+};
+
+class TlsConnection;
+
+/**
+ * @brief The server's SSL_CTX: certificate, protocol settings and the ticket keys, shared by
+ * every worker (OpenSSL locks what little of it changes per handshake). TLS 1.2 and 1.3 only.
+ * ALPN offers "h2" when HTTP/2 is enabled, so browsers get HTTP/2 over TLS as well.
+ * The constructor throws std::runtime_error if the certificate or key cannot be loaded.
+ */
+class TlsContext {
+  private:
+    ssl_ctx_st *ctx = nullptr;
+    bool offer_h2;
+
+    static int select_alpn(ssl_st *ssl, const unsigned char **out, unsigned char *out_length,
+                           const unsigned char *in, unsigned int in_length, void *arg);
+
+  public:
+    TlsContext(const TlsConfig &config, bool http2);
+    ~TlsContext();
+
+    TlsContext(const TlsContext &) = delete;
+    TlsContext &operator=(const TlsContext &) = delete;
+
+    // Server side of a new connection on the non-blocking socket fd; nullptr if OpenSSL
+    // cannot allocate one. The handshake has not started.
+    std::unique_ptr<TlsConnection> accept(int fd) const;
+};
+
+/**
+ * @brief TLS on one non-blocking socket. handshake() is called on every readiness event until
+ * it is done; recv() and send() then stand in for recv() and OutputQueue::write_to() with the
+ * same return conventions (-1 with EAGAIN when the socket would block). With kTLS the socket
+ * carries plaintext from then on and both are the plain system calls, sendfile() included.
+ */
+class TlsConnection {
+  private:
+    ssl_st *ssl;
+    int fd;
+    bool done = false;
+    bool want_write = false;
+    bool kernel_send = false;
+    bool kernel_receive = false;
+
+  public:
+    enum class Handshake { Done, Pending, Failed };
+
+    TlsConnection(ssl_st *session, int socket_fd) : ssl(session), fd(socket_fd) {}
+    ~TlsConnection();
+
+    TlsConnection(const TlsConnection &) = delete;
+    TlsConnection &operator=(const TlsConnection &) = delete;
+
+    // Pending: wait until the socket is writable if wants_write(), readable otherwise
+    Handshake handshake();
+    bool established() const { return done; }
+    bool wants_write() const { return want_write; }
+
+    // Whether the kernel encrypts, or decrypts, this connection's records
+    bool kernel_tls_send() const { return kernel_send; }
+    bool kernel_tls_receive() const { return kernel_receive; }
+
+    // Decrypted bytes OpenSSL holds already: readable without waiting for the socket
+    bool has_buffered_input() const;
+
+    ssize_t recv(char *buffer, size_t length);
+    ssize_t send(OutputQueue &out);
+};
+
+#endif // TLS_H
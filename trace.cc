@@ -0,0 +1,91 @@
+#include "trace.h"
+
+#ifdef HTTP_TRACE
+
+#include "log.h"
+#include <atomic>
+#include <chrono>
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define HTTP_TRACE_USDT
+#endif
+
+// Descriptors with an accept time slot; connections on higher ones trace without one
+static constexpr int TRACE_MAX_FDS = 65536;
+
+static std::atomic<uint64_t> accept_times[TRACE_MAX_FDS];
+
+// The tick rate is measured against the monotonic clock since startup, so it needs no
+// calibration pause and only gets more accurate as the process runs
+static const uint64_t base_ticks = trace_ticks();
+static const uint64_t base_ns = static_cast<uint64_t>(
+    std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+        .count());
+
+static double ticks_per_ns() {
+#if defined(__x86_64__) || defined(__i386__)
+    uint64_t now_ns = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+            .count());
+    uint64_t ticks = trace_ticks();
+    if (now_ns <= base_ns + 1000000) {
+        return 1.0; // Too early to tell
+    }
+    return static_cast<double>(ticks - base_ticks) / static_cast<double>(now_ns - base_ns);
+#else
+    return 1.0; // trace_ticks() is in nanoseconds already
+#endif
+}
+
+void RequestTrace::set_target(std::string_view method, std::string_view path) {
+    target_length = 0;
+    for (std::string_view part : {method, std::string_view(" "), path}) {
+        for (char c : part) {
+            if (target_length == sizeof(target)) {
+                return;
+            }
+            target[target_length++] = c;
+        }
+    }
+}
+
+void trace_accepted(int fd) {
+    if (fd >= 0 && fd < TRACE_MAX_FDS) {
+        accept_times[fd].store(trace_ticks(), std::memory_order_relaxed);
+    }
+}
+
+uint64_t trace_accept_time(int fd) {
+    return fd >= 0 && fd < TRACE_MAX_FDS ? accept_times[fd].load(std::memory_order_relaxed) : 0;
+}
+
+void trace_export(std::vector<RequestTrace> &sent) {
+    uint64_t now = trace_ticks();
+    double rate = ticks_per_ns();
+    auto nanos = [rate](uint64_t from, uint64_t to) -> uint64_t {
+        return from != 0 && to > from ? static_cast<uint64_t>(static_cast<double>(to - from) / rate) : 0;
+    };
+
+    for (RequestTrace &trace : sent) {
+        trace.last_byte = now;
+        // A request served from bytes that came with the previous one has no read of its own
+        uint64_t first_byte = trace.first_byte != 0 ? trace.first_byte : trace.headers_parsed;
+        uint64_t start = trace.accept != 0 ? trace.accept : first_byte;
+        uint64_t accept_ns = nanos(trace.accept, first_byte);
+        uint64_t read_ns = nanos(first_byte, trace.headers_parsed);
+        uint64_t handler_ns = nanos(trace.headers_parsed, trace.handler_done);
+        uint64_t send_ns = nanos(trace.handler_done, trace.last_byte);
+        uint64_t total_ns = nanos(start, trace.last_byte);
+
+#ifdef HTTP_TRACE_USDT
+        DTRACE_PROBE7(http_server, request, trace.status, trace.route, accept_ns, read_ns, handler_ns, send_ns,
+                      total_ns);
+#endif
+        log_line(LogLevel::Access, std::string_view(trace.target, trace.target_length), " status=", trace.status,
+                 " route=", trace.route, " accept_ns=", accept_ns, " read_ns=", read_ns, " handler_ns=", handler_ns,
+                 " send_ns=", send_ns, " total_ns=", total_ns);
+    }
+    sent.clear();
+}
+
+#endif // HTTP_TRACE
@@ -0,0 +1,96 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+// Per-request phase timestamps, compiled in with -DHTTP_TRACE (CMake option HTTP_TRACE).
+// Without it every HTTP_TRACE_* macro below expands to nothing and RequestState carries no
+// trace fields, so a normal build pays neither time nor space for them.
+
+#ifdef HTTP_TRACE
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+
+// Timestamp counter reads: rdtsc where there is one (an invariant TSC on any recent x86),
+// the monotonic clock elsewhere. Converted to nanoseconds only when a trace is exported.
+inline uint64_t trace_ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<uint64_t>(now.tv_sec) * 1000000000 + static_cast<uint64_t>(now.tv_nsec);
+#endif
+}
+
+/**
+ * @brief The life of one HTTP/1.1 request in trace_ticks(). accept is set for the first
+ * request of a connection only: later ones were not waiting on it.
+ */
+struct RequestTrace {
+    uint64_t accept = 0;
+    uint64_t first_byte = 0;
+    uint64_t headers_parsed = 0;
+    uint64_t handler_done = 0;
+    uint64_t last_byte = 0;
+    int status = 0;
+    uint32_t route = 0;
+    char target[64]; // Method and path, cut to fit
+    uint8_t target_length = 0;
+
+    void set_target(std::string_view method, std::string_view path);
+};
+
+// Accept times by descriptor, so whichever thread serves the connection finds its own
+void trace_accepted(int fd);
+uint64_t trace_accept_time(int fd);
+
+// Stamps last_byte on every trace in sent, exports each one and clears the list: a USDT probe
+// (http_server:request, when built with <sys/sdt.h>) and a line in the access log
+void trace_export(std::vector<RequestTrace> &sent);
+
+#define HTTP_TRACE_ACCEPT(fd) trace_accepted(fd)
+#define HTTP_TRACE_CONNECTION(state, fd) ((state).trace_accept = trace_accept_time(fd))
+#define HTTP_TRACE_FIRST_BYTE(state)                                                                                \
+    do {                                                                                                           \
+        if ((state).trace.first_byte == 0)                                                                         \
+            (state).trace.first_byte = trace_ticks();                                                              \
+    } while (0)
+#define HTTP_TRACE_HEADERS(state, request, first_request)                                                           \
+    do {                                                                                                           \
+        (state).trace.headers_parsed = trace_ticks();                                                              \
+        (state).trace.accept = (first_request) ? (state).trace_accept : 0;                                         \
+        (state).trace.set_target((request).method, (request).path);                                                \
+    } while (0)
+#define HTTP_TRACE_HANDLER_DONE(state, status_code)                                                                \
+    do {                                                                                                           \
+        (state).trace.handler_done = trace_ticks();                                                                \
+        (state).trace.status = (status_code);                                                                      \
+        (state).trace.route = (state).route;                                                                       \
+        (state).trace_unsent.push_back((state).trace);                                                             \
+        (state).trace = RequestTrace();                                                                            \
+    } while (0)
+#define HTTP_TRACE_SENT(state)                                                                                      \
+    do {                                                                                                           \
+        if (!(state).trace_unsent.empty())                                                                         \
+            trace_export((state).trace_unsent);                                                                    \
+    } while (0)
+
+#else
+
+#define HTTP_TRACE_ACCEPT(fd) ((void)0)
+#define HTTP_TRACE_CONNECTION(state, fd) ((void)0)
+#define HTTP_TRACE_FIRST_BYTE(state) ((void)0)
+#define HTTP_TRACE_HEADERS(state, request, first_request) ((void)0)
+#define HTTP_TRACE_HANDLER_DONE(state, status_code) ((void)0)
+#define HTTP_TRACE_SENT(state) ((void)0)
+
+#endif // HTTP_TRACE
+
+#endif // TRACE_H
@@ -0,0 +1,107 @@
+#ifndef UNIQUE_TASK_H
+#define UNIQUE_TASK_H
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+/**
+ * @brief Move-only, type-erased void() callable with small-buffer optimisation.
+ * Callables up to INLINE_SIZE bytes (a few captured pointers/ints) live inside the
+ * object, so wrapping one never touches the heap; only larger ones fall back to new.
+ * Unlike std::function it accepts move-only captures and needs no copy constructor.
+ */
+class UniqueTask {
+  public:
+    static constexpr size_t INLINE_SIZE = 48;
+
+  private:
+    struct Ops {
+        void (*invoke)(void *storage);
+        void (*move)(void *dst, void *src); // Move-constructs into dst, destroys src
+        void (*destroy)(void *storage);
+    };
+
+    template <class F> static constexpr bool fits_inline =
+        sizeof(F) <= INLINE_SIZE && alignof(F) <= alignof(std::max_align_t) && std::is_nothrow_move_constructible_v<F>;
+
+    template <class F> static F *inline_ptr(void *storage) { return std::launder(reinterpret_cast<F *>(storage)); }
+    template <class F> static F *&heap_ptr(void *storage) { return *std::launder(reinterpret_cast<F **>(storage)); }
+
+    template <class F> static constexpr Ops inline_ops = {
+        [](void *storage) { (*inline_ptr<F>(storage))(); },
+        [](void *dst, void *src) {
+            new (dst) F(std::move(*inline_ptr<F>(src)));
+            inline_ptr<F>(src)->~F();
+        },
+        [](void *storage) { inline_ptr<F>(storage)->~F(); },
+    };
+
+    template <class F> static constexpr Ops heap_ops = {
+        [](void *storage) { (*heap_ptr<F>(storage))(); },
+        [](void *dst, void *src) { new (dst) F *(heap_ptr<F>(src)); },
+        [](void *storage) { delete heap_ptr<F>(storage); },
+    };
+
+    alignas(std::max_align_t) unsigned char storage[INLINE_SIZE];
+    const Ops *ops = nullptr;
+
+    void reset() {
+        if (ops) {
+            ops->destroy(storage);
+            ops = nullptr;
+        }
+    }
+
+  public:
+    UniqueTask() = default;
+    UniqueTask(std::nullptr_t) {}
+
+    template <class F, class Fn = std::decay_t<F>,
+              class = std::enable_if_t<!std::is_same_v<Fn, UniqueTask> && std::is_invocable_v<Fn &>>>
+    UniqueTask(F &&f) {
+        if constexpr (fits_inline<Fn>) {
+            new (storage) Fn(std::forward<F>(f));
+            ops = &inline_ops<Fn>;
+        } else {
+            new (storage) Fn *(new Fn(std::forward<F>(f)));
+            ops = &heap_ops<Fn>;
+        }
+    }
+
+    UniqueTask(UniqueTask &&other) noexcept : ops(other.ops) {
+        if (ops) {
+            ops->move(storage, other.storage);
+            other.ops = nullptr;
+        }
+    }
+
+    UniqueTask &operator=(UniqueTask &&other) noexcept {
+        if (this != &other) {
+            reset();
+            if (other.ops) {
+                other.ops->move(storage, other.storage);
+                ops = other.ops;
+                other.ops = nullptr;
+            }
+        }
+        return *this;
+    }
+
+    UniqueTask &operator=(std::nullptr_t) {
+        reset();
+        return *this;
+    }
+
+    UniqueTask(const UniqueTask &) = delete;
+    UniqueTask &operator=(const UniqueTask &) = delete;
+
+    ~UniqueTask() { reset(); }
+
+    explicit operator bool() const { return ops != nullptr; }
+
+    void operator()() { ops->invoke(storage); }
+};
+
+#endif // UNIQUE_TASK_H
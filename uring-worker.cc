@@ -0,0 +1,718 @@
+#include "uring-worker.h"
+#include "log.h"
+#include "metrics.h"
+#include <algorithm>
+#include <errno.h>
+#include <poll.h>
+#include <stdexcept>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+// Accepted-but-not-yet-adopted FDs a worker can have queued before hand_off backs off
+static constexpr size_t HANDOFF_RING_CAPACITY = 4096;
+
+// Receive buffers shared by all connections of one worker (4 MiB of BUFFER_SIZE buffers)
+static constexpr uint16_t RECV_BUFFER_GROUP = 0;
+static constexpr unsigned RECV_BUFFER_COUNT = 1024;
+
+// Registered file table size, further capped by RLIMIT_NOFILE. Connections beyond it
+// are served through their plain descriptor.
+static constexpr unsigned MAX_FILE_SLOTS = 8192;
+
+// While draining, how often the worker checks its deadline when nothing else wakes it
+static constexpr int DRAIN_POLL_MS = 100;
+
+UringWorker::UringWorker(size_t worker_id, HttpServer &owner)
+    : id(worker_id), server(owner), ring(owner.config.uring_entries, owner.config.uring_sqpoll),
+      buffers(ring, RECV_BUFFER_GROUP, RECV_BUFFER_COUNT, BUFFER_SIZE), handoff_ring(HANDOFF_RING_CAPACITY) {
+    // Provided-buffer rings (checked by BufferRing) date from 5.19, so multishot accept is
+    // there too; multishot recv (6.0) is probed for by its first completion
+    if (!ring.has_feature(IORING_FEAT_EXT_ARG) || !ring.has_feature(IORING_FEAT_NODROP) ||
+        !ring.supports({IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_SENDMSG, IORING_OP_READ, IORING_OP_POLL_ADD,
+                        IORING_OP_FILES_UPDATE, IORING_OP_SHUTDOWN, IORING_OP_CLOSE})) {
+        throw std::runtime_error("kernel lacks io_uring features the uring worker needs");
+    }
+
+    unsigned slots = MAX_FILE_SLOTS;
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < slots) {
+        slots = static_cast<unsigned>(limit.rlim_cur);
+    }
+    if (ring.register_files_sparse(slots) == 0) {
+        free_file_slots.reserve(slots);
+        for (unsigned slot = slots; slot > 0; --slot) {
+            free_file_slots.push_back(static_cast<int>(slot - 1));
+        }
+    }
+
+    // Blocking on purpose: io_uring fails a READ of an O_NONBLOCK file with EAGAIN instead of
+    // waiting for it to become readable
+    event_fd = eventfd(0, EFD_CLOEXEC);
+    if (event_fd == -1) {
+        throw std::runtime_error("eventfd failed for uring worker");
+    }
+}
+
+UringWorker::~UringWorker() {
+    stop();
+    for (auto &conn : connections) {
+        if (conn->fd != -1) {
+            shutdown(conn->fd, SHUT_RDWR);
+            close(conn->fd);
+        }
+    }
+    int pending_fd;
+    while (handoff_ring.try_pop(pending_fd)) {
+        close(pending_fd);
+    }
+    if (listen_fd != -1) {
+        close(listen_fd);
+    }
+    close(event_fd);
+    // The ring is the first member and so destroyed last; closing it cancels what is in flight
+}
+
+void UringWorker::set_listener(int fd) { listen_fd = fd; }
+
+void UringWorker::start() {
+    running = true;
+    thread = std::thread([this] { this->run(); });
+}
+
+void UringWorker::stop() {
+    bool expected = true;
+    if (!running.compare_exchange_strong(expected, false)) {
+        return;
+    }
+
+    // Completes the pending eventfd READ, so the worker observes running == false
+    uint64_t one = 1;
+    if (write(event_fd, &one, sizeof(one)) == -1) {
+        log_errno("eventfd write failed in stop");
+    }
+
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
+
+void UringWorker::drain(uint64_t deadline_ms) {
+    drain_deadline_ms = std::max<uint64_t>(deadline_ms, 1);
+    uint64_t one = 1;
+    if (write(event_fd, &one, sizeof(one)) == -1) {
+        log_errno("eventfd write failed in drain");
+    }
+}
+
+void UringWorker::join() {
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
+
+void UringWorker::hand_off(std::span<const int> client_fds) {
+    for (int client_fd : client_fds) {
+        // Full means this worker is thousands of connections behind: let it catch up
+        while (!handoff_ring.try_push(std::move(client_fd))) {
+            std::this_thread::yield();
+        }
+    }
+
+    uint64_t one = 1;
+    if (write(event_fd, &one, sizeof(one)) == -1) {
+        log_errno("eventfd write failed in hand_off");
+    }
+}
+
+uint64_t UringWorker::tag(Op op, uint32_t index, uint32_t generation) {
+    // op:8 | generation:24 | index:32
+    return static_cast<uint64_t>(op) << 56 | static_cast<uint64_t>(generation & 0xffffff) << 32 | index;
+}
+
+UringConnection *UringWorker::lookup(uint64_t user_data) {
+    uint32_t index = static_cast<uint32_t>(user_data);
+    uint32_t generation = static_cast<uint32_t>(user_data >> 32) & 0xffffff;
+    if (index >= connections.size()) {
+        return nullptr;
+    }
+    UringConnection *conn = connections[index].get();
+    return (conn->generation & 0xffffff) == generation ? conn : nullptr;
+}
+
+void UringWorker::set_target(struct io_uring_sqe *sqe, const UringConnection &conn) const {
+    if (conn.file_slot >= 0) {
+        sqe->fd = conn.file_slot;
+        sqe->flags |= IOSQE_FIXED_FILE;
+    } else {
+        sqe->fd = conn.fd;
+    }
+}
+
+bool UringWorker::arm_accept() {
+    struct io_uring_sqe *sqe = ring.get_sqe();
+    if (!sqe) {
+        return false;
+    }
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listen_fd;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    sqe->ioprio = multishot_accept ? IORING_ACCEPT_MULTISHOT : 0;
+    sqe->user_data = tag(Op::Accept, 0, 0);
+    return true;
+}
+
+bool UringWorker::arm_wake() {
+    struct io_uring_sqe *sqe = ring.get_sqe();
+    if (!sqe) {
+        return false;
+    }
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = event_fd;
+    sqe->addr = reinterpret_cast<uint64_t>(&wake_counter);
+    sqe->len = sizeof(wake_counter);
+    sqe->off = -1ULL; // No file position: the eventfd is a counter
+    sqe->user_data = tag(Op::Wake, 0, 0);
+    return true;
+}
+
+bool UringWorker::arm_recv(UringConnection &conn) {
+    struct io_uring_sqe *sqe = ring.get_sqe();
+    if (!sqe) {
+        return false;
+    }
+    // No length and no buffer: each completion brings its own buffer from the group
+    sqe->opcode = IORING_OP_RECV;
+    set_target(sqe, conn);
+    sqe->flags |= IOSQE_BUFFER_SELECT;
+    sqe->buf_group = buffers.group_id();
+    sqe->ioprio = multishot_recv ? IORING_RECV_MULTISHOT : 0;
+    sqe->user_data = tag(Op::Recv, conn.id, conn.generation);
+    conn.recv_armed = true;
+    return true;
+}
+
+bool UringWorker::arm_poll_out(UringConnection &conn) {
+    struct io_uring_sqe *sqe = ring.get_sqe();
+    if (!sqe) {
+        return false;
+    }
+    sqe->opcode = IORING_OP_POLL_ADD;
+    set_target(sqe, conn);
+    sqe->poll32_events = POLLOUT;
+    sqe->user_data = tag(Op::PollOut, conn.id, conn.generation);
+    conn.poll_in_flight = true;
+    return true;
+}
+
+void UringWorker::drain_handoff_queue() {
+    int fd;
+    while (handoff_ring.try_pop(fd)) {
+        register_connection(fd);
+    }
+}
+
+void UringWorker::register_connection(int client_fd) {
+    uint32_t index;
+    if (!free_connections.empty()) {
+        index = free_connections.back();
+        free_connections.pop_back();
+    } else {
+        index = static_cast<uint32_t>(connections.size());
+        connections.push_back(std::make_unique<UringConnection>());
+        connections.back()->id = index;
+    }
+    ++open_connections;
+
+    UringConnection &conn = *connections[index];
+    conn.fd = client_fd;
+    conn.open = true;
+    conn.request = RequestState(server.config.max_header_size);
+    conn.timer.node.fd = static_cast<int>(index);
+    HTTP_TRACE_CONNECTION(conn.request, client_fd);
+    conn.request.connection.fd = client_fd;
+    conn.request.async_wake = [this, index] { on_async_response(*connections[index]); };
+
+    if (!ring.reserve(2)) {
+        close_connection(conn);
+        return;
+    }
+    if (!free_file_slots.empty()) {
+        // Linked, so the recv below only starts once its slot is filled in. Only a failure
+        // posts a completion; the recv is then cancelled and re-armed on the plain fd.
+        conn.file_slot = free_file_slots.back();
+        free_file_slots.pop_back();
+        struct io_uring_sqe *sqe = ring.get_sqe();
+        sqe->opcode = IORING_OP_FILES_UPDATE;
+        sqe->fd = -1;
+        sqe->addr = reinterpret_cast<uint64_t>(&conn.fd);
+        sqe->len = 1;
+        sqe->off = static_cast<unsigned>(conn.file_slot);
+        sqe->flags = IOSQE_IO_LINK | IOSQE_CQE_SKIP_SUCCESS;
+        sqe->user_data = tag(Op::FilesUpdate, index, conn.generation);
+    }
+    arm_recv(conn);
+
+    // A client that connects and never sends anything is pruned like an idle one
+    conn.timer.update(timers, server.config, TimeoutPhase::Idle, false, false, 0);
+}
+
+void UringWorker::close_connection(UringConnection &conn) {
+    if (!conn.open) {
+        return;
+    }
+    conn.open = false;
+    conn.timer.cancel(timers);
+
+    if (conn.send_in_flight) {
+        // The kernel may still read from iov: keep the connection until the send completes,
+        // which the shutdown makes happen promptly
+        conn.release_on_send = true;
+        if (conn.fd != -1) {
+            shutdown(conn.fd, SHUT_RDWR);
+        }
+        return;
+    }
+    release(conn);
+}
+
+bool UringWorker::queue_teardown(UringConnection &conn) {
+    if (!ring.reserve(2)) {
+        return false;
+    }
+
+    // Shutdown first: it ends the multishot recv, which holds its own reference to the
+    // socket, and sends the FIN whoever else still holds one. Hard links run each step
+    // whatever the previous one returned.
+    struct io_uring_sqe *sqe = ring.get_sqe();
+    sqe->opcode = IORING_OP_SHUTDOWN;
+    set_target(sqe, conn);
+    sqe->len = SHUT_RDWR;
+    sqe->flags |= IOSQE_IO_HARDLINK | IOSQE_CQE_SKIP_SUCCESS;
+    sqe->user_data = tag(Op::Shutdown, conn.id, conn.generation);
+
+    sqe = ring.get_sqe();
+    sqe->opcode = IORING_OP_CLOSE;
+    if (conn.file_slot >= 0) {
+        // The slot is reusable once this completes. The plain descriptor can go right away:
+        // the table's reference keeps the socket alive for the linked operations.
+        sqe->file_index = static_cast<unsigned>(conn.file_slot) + 1;
+        sqe->user_data = tag(Op::CloseSlot, static_cast<uint32_t>(conn.file_slot), 0);
+        if (conn.fd != -1) {
+            close(conn.fd);
+            conn.fd = -1;
+        }
+    } else {
+        sqe->fd = conn.fd;
+        sqe->flags |= IOSQE_CQE_SKIP_SUCCESS;
+        sqe->user_data = tag(Op::Close, conn.id, conn.generation);
+        conn.fd = -1;
+    }
+    return true;
+}
+
+void UringWorker::release(UringConnection &conn) {
+    if (!queue_teardown(conn)) {
+        // No room in the SQ: do it synchronously
+        if (conn.fd != -1) {
+            shutdown(conn.fd, SHUT_RDWR);
+            close(conn.fd);
+        }
+        if (conn.file_slot >= 0) {
+            ring.update_file(static_cast<unsigned>(conn.file_slot), -1);
+            free_file_slots.push_back(conn.file_slot);
+        }
+    }
+    recycle(conn);
+}
+
+void UringWorker::recycle(UringConnection &conn) {
+    ++conn.generation;
+    conn.fd = -1;
+    conn.file_slot = -1;
+    conn.open = false;
+    conn.in_buffer.clear();
+    conn.request = RequestState();
+    conn.output.clear();
+    conn.close_after_write = false;
+    conn.peer_closed = false;
+    conn.requests_served = 0;
+    conn.recv_armed = false;
+    conn.send_in_flight = false;
+    conn.poll_in_flight = false;
+    conn.release_on_send = false;
+    conn.teardown_linked = false;
+    conn.send_length = 0;
+    free_connections.push_back(conn.id);
+    --open_connections;
+    ThreadMetrics::local().closed.add();
+}
+
+void UringWorker::expire_timers() {
+    timers.advance(monotonic_ms(), [this](TimerNode *node) {
+        UringConnection &conn = *connections[static_cast<uint32_t>(node->fd)];
+        TimeoutPhase phase = conn.timer.phase;
+        conn.timer.phase = TimeoutPhase::None;
+        if ((phase == TimeoutPhase::Header || phase == TimeoutPhase::Body) && conn.output.empty()) {
+            request_timeout_response().append_to(conn.output);
+            conn.close_after_write = true;
+            flush(conn);
+            return;
+        }
+        // A stalled send is cut short by the shutdown and then releases the connection
+        close_connection(conn);
+    });
+}
+
+bool UringWorker::drain_step() {
+    if (listen_fd != -1) {
+        // The multishot accept holds its own reference to the socket, so closing our
+        // descriptor alone would not stop it: cancel it first. No completion on success.
+        struct io_uring_sqe *sqe = ring.get_sqe();
+        if (!sqe) {
+            return false; // Next pass
+        }
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = -1;
+        sqe->addr = tag(Op::Accept, 0, 0);
+        sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+        sqe->user_data = tag(Op::None, 0, 0);
+        close(listen_fd);
+        listen_fd = -1;
+    }
+
+    // Idle between requests: nothing is lost by closing now. A connection still to send its
+    // first request gets until the deadline; any response it gets closes it.
+    for (auto &conn : connections) {
+        if (conn->open && conn->timer.phase == TimeoutPhase::Idle && conn->requests_served > 0) {
+            close_connection(*conn);
+        }
+    }
+    if (open_connections == 0 || monotonic_ms() >= drain_deadline_ms) {
+        ring.submit(); // The teardowns queued above
+        return true;
+    }
+    return false;
+}
+
+void UringWorker::serve_buffered(UringConnection &conn) {
+    // Serve every pipelined request that is complete
+    if (!server.serve_pipelined(conn.in_buffer, conn.output, conn.request, conn.requests_served)) {
+        conn.close_after_write = true;
+    }
+}
+
+void UringWorker::on_completion(const struct io_uring_cqe &cqe) {
+    Op op = static_cast<Op>(cqe.user_data >> 56);
+    switch (op) {
+    case Op::Accept:
+        if (cqe.res >= 0) {
+            ThreadMetrics::local().accepted.add();
+            HTTP_TRACE_ACCEPT(cqe.res);
+            set_tcp_nodelay(cqe.res);
+            register_connection(cqe.res);
+        } else if (cqe.res == -EINVAL && multishot_accept) {
+            multishot_accept = false; // Re-armed as a one-shot accept below
+        } else if (cqe.res != -ECANCELED) {
+            log_line(LogLevel::Error, "accept error in uring worker: ", strerror(-cqe.res));
+        }
+        if (!(cqe.flags & IORING_CQE_F_MORE) && running && listen_fd != -1 && !arm_accept()) {
+            log_line(LogLevel::Error, "uring worker ", id, " could not re-arm accept");
+        }
+        return;
+    case Op::Wake:
+        drain_handoff_queue();
+        if (running && !arm_wake()) {
+            log_line(LogLevel::Error, "uring worker ", id, " could not re-arm its eventfd");
+        }
+        return;
+    case Op::CloseSlot:
+        free_file_slots.push_back(static_cast<int>(static_cast<uint32_t>(cqe.user_data)));
+        return;
+    case Op::Await: {
+        uint32_t index = static_cast<uint32_t>(cqe.user_data);
+        std::coroutine_handle<> handle = fd_waiters[index];
+        fd_waiters[index] = nullptr;
+        free_waiters.push_back(index);
+        handle.resume(); // Errors surface in the read or write the coroutine retries
+        return;
+    }
+    case Op::None:
+    case Op::Shutdown:
+    case Op::Close:
+        return; // Only failures get here; the socket is on its way out either way
+    default:
+        break;
+    }
+
+    UringConnection *conn = lookup(cqe.user_data);
+    switch (op) {
+    case Op::Recv:
+        on_recv(conn, cqe);
+        break;
+    case Op::Send:
+        if (conn) {
+            on_send(*conn, cqe.res);
+        }
+        break;
+    case Op::PollOut:
+        if (conn && conn->open) {
+            conn->poll_in_flight = false;
+            flush(*conn);
+        }
+        break;
+    case Op::FilesUpdate:
+        // The slot was not filled in: fall back to the plain descriptor
+        if (conn && conn->file_slot >= 0) {
+            free_file_slots.push_back(conn->file_slot);
+            conn->file_slot = -1;
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+void UringWorker::on_recv(UringConnection *conn, const struct io_uring_cqe &cqe) {
+    bool has_buffer = (cqe.flags & IORING_CQE_F_BUFFER) != 0;
+    uint16_t buffer_id = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+
+    if (!conn || !conn->open) {
+        if (has_buffer) {
+            buffers.recycle(buffer_id);
+        }
+        return;
+    }
+    if (!(cqe.flags & IORING_CQE_F_MORE)) {
+        conn->recv_armed = false;
+    }
+
+    if (cqe.res > 0) {
+        ThreadMetrics::local().bytes_in.add(static_cast<uint64_t>(cqe.res));
+        // Copied out into the connection's slab block so the buffer can go straight back:
+        // pipelined requests and bodies span buffers, and the parser wants one contiguous view
+        if (has_buffer && !conn->close_after_write) {
+            conn->in_buffer.append(buffers.data(buffer_id), static_cast<size_t>(cqe.res));
+            HTTP_TRACE_FIRST_BYTE(conn->request);
+        }
+        if (has_buffer) {
+            buffers.recycle(buffer_id);
+        }
+        if (!conn->close_after_write) {
+            serve_buffered(*conn);
+        }
+    } else if (cqe.res == 0) {
+        // Whatever is left can never complete; answer what was served, then close
+        conn->peer_closed = true;
+        conn->close_after_write = true;
+    } else if (cqe.res == -EINVAL && multishot_recv) {
+        multishot_recv = false; // Re-armed one-shot below
+    } else if (cqe.res != -ENOBUFS && cqe.res != -ECANCELED) {
+        // ENOBUFS: every buffer was in use; ECANCELED: the linked slot update failed
+        close_connection(*conn);
+        return;
+    }
+
+    if (!flush(*conn, cqe.res > 0)) {
+        return;
+    }
+    if (!conn->recv_armed && !conn->peer_closed && !arm_recv(*conn)) {
+        close_connection(*conn);
+    }
+}
+
+void UringWorker::on_send(UringConnection &conn, int result) {
+    conn.send_in_flight = false;
+    if (result > 0) {
+        ThreadMetrics::local().bytes_out.add(static_cast<uint64_t>(result));
+    }
+    if (conn.teardown_linked) {
+        if (result > 0) {
+            HTTP_TRACE_SENT(conn.request);
+        }
+        // Shutdown and close were queued behind this send and run whatever it returned
+        recycle(conn);
+        return;
+    }
+    if (conn.release_on_send) {
+        release(conn);
+        return;
+    }
+    if (result < 0) {
+        conn.output.sent(0);
+        close_connection(conn);
+        return;
+    }
+
+    conn.output.sent(static_cast<size_t>(result));
+    if (conn.output.empty()) {
+        HTTP_TRACE_SENT(conn.request);
+    }
+    flush(conn, false, result > 0);
+}
+
+bool UringWorker::flush(UringConnection &conn, bool read_progress, bool write_progress) {
+    if (!send_output(conn, write_progress)) {
+        return false;
+    }
+    // A MSG_WAITALL send reports progress only once it completes, so under the Write phase a
+    // trickling reader has write_timeout_ms for each whole send
+    TimeoutPhase phase = timeout_phase(conn.request, !conn.in_buffer.empty(), !conn.output.empty());
+    conn.timer.update(timers, server.config, phase, read_progress, write_progress, conn.requests_served);
+    return true;
+}
+
+bool UringWorker::send_output(UringConnection &conn, bool &write_progress) {
+    while (!conn.output.empty()) {
+        if (conn.send_in_flight || conn.poll_in_flight) {
+            return true; // Resumed by that completion
+        }
+
+        bool before_file;
+        size_t count = conn.output.gather(conn.iov, OutputQueue::MAX_IOV, before_file);
+        if (count > 0) {
+            return submit_send(conn, count, before_file);
+        }
+
+        // A file segment: sendfile() is synchronous, the ring only waits for room
+        ssize_t sent = conn.output.write_to(conn.fd);
+        if (sent >= 0) {
+            ThreadMetrics::local().bytes_out.add(static_cast<uint64_t>(sent));
+            write_progress |= sent > 0;
+            continue;
+        }
+        if (errno == EINTR)
+            continue;
+        if ((errno == EAGAIN || errno == EWOULDBLOCK) && arm_poll_out(conn))
+            return true;
+        if (errno == ENODATA) {
+            // A streamed body has nothing new: its source wakes the connection instead
+            HttpServer::await_body_stream(conn.output, conn.request.async_wake);
+            return true;
+        }
+
+        close_connection(conn);
+        return false;
+    }
+
+    // A suspended handler still owes this connection a response
+    if (conn.close_after_write && !conn.request.awaiting_response()) {
+        close_connection(conn);
+        return false;
+    }
+    return true;
+}
+
+bool UringWorker::submit_send(UringConnection &conn, size_t iov_count, bool before_file) {
+    size_t length = 0;
+    for (size_t i = 0; i < iov_count; ++i) {
+        length += conn.iov[i].iov_len;
+    }
+
+    // The last bytes of a connection that closes after them: shutdown and close are linked
+    // behind the send, so no completion has to come back before the socket goes
+    bool last = conn.close_after_write && !conn.request.awaiting_response() && !before_file &&
+                length == conn.output.size();
+    if (!ring.reserve(last ? 3 : 1)) {
+        conn.output.sent(0);
+        close_connection(conn);
+        return false;
+    }
+
+    memset(&conn.message, 0, sizeof(conn.message));
+    conn.message.msg_iov = conn.iov;
+    conn.message.msg_iovlen = iov_count;
+
+    struct io_uring_sqe *sqe = ring.get_sqe();
+    sqe->opcode = IORING_OP_SENDMSG;
+    set_target(sqe, conn);
+    sqe->addr = reinterpret_cast<uint64_t>(&conn.message);
+    sqe->len = 1;
+    // MSG_WAITALL: the kernel retries a short send itself, so one completion covers it all
+    sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL | (before_file ? MSG_MORE : 0);
+    sqe->user_data = tag(Op::Send, conn.id, conn.generation);
+    conn.send_in_flight = true;
+    conn.send_length = length;
+
+    if (last) {
+        sqe->flags |= IOSQE_IO_HARDLINK;
+        queue_teardown(conn);
+        conn.teardown_linked = true;
+        conn.open = false;
+        conn.timer.cancel(timers);
+        return false;
+    }
+    return true;
+}
+
+void UringWorker::on_async_response(UringConnection &conn) {
+    if (!conn.open) {
+        return;
+    }
+    // Not gated on close_after_write: a half-closed peer is still owed this response
+    serve_buffered(conn);
+    flush(conn);
+}
+
+void UringWorker::resume_after(std::coroutine_handle<> handle, uint64_t delay_ms) {
+    sleepers.add(handle, monotonic_ms() + delay_ms);
+}
+
+void UringWorker::resume_when_ready(std::coroutine_handle<> handle, int fd, bool writable) {
+    struct io_uring_sqe *sqe = ring.get_sqe();
+    if (!sqe) {
+        // Resume on the next turn: the read or write the coroutine retries will tell
+        sleepers.add(handle, 0);
+        return;
+    }
+
+    uint32_t index;
+    if (!free_waiters.empty()) {
+        index = free_waiters.back();
+        free_waiters.pop_back();
+    } else {
+        index = static_cast<uint32_t>(fd_waiters.size());
+        fd_waiters.emplace_back();
+    }
+    fd_waiters[index] = handle;
+
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = writable ? POLLOUT : POLLIN;
+    sqe->user_data = tag(Op::Await, index, 0);
+}
+
+void UringWorker::run() {
+    enter_thread();
+    ring.register_ring_fd(); // Optional, and only valid on this thread
+    Scheduler::set_current(this);
+    if (!arm_wake() || (listen_fd != -1 && !arm_accept())) {
+        log_line(LogLevel::Error, "uring worker ", id, " could not arm its first operations");
+        return;
+    }
+
+    while (running) {
+        // One enter both submits everything queued by the last batch and waits for the next
+        int timeout = earliest_timeout(timers.next_timeout_ms(), sleepers.next_timeout_ms(monotonic_ms()));
+        if (drain_deadline_ms != 0) {
+            timeout = earliest_timeout(timeout, DRAIN_POLL_MS);
+        }
+        if (ring.submit_and_wait(timeout) < 0 && errno != ETIME && errno != EINTR &&
+            errno != EAGAIN && errno != EBUSY) {
+            log_errno("io_uring_enter failed in uring worker");
+            break;
+        }
+
+        ring.for_each_completion([this](const struct io_uring_cqe &cqe) { on_completion(cqe); });
+
+        sleepers.resume_due(monotonic_ms());
+        expire_timers();
+
+        if (drain_deadline_ms != 0 && drain_step()) {
+            break;
+        }
+    }
+
+    log_line(LogLevel::Info, "Uring worker ", id, " stopped with ", open_connections, " open connections.");
+}
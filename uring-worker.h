@@ -0,0 +1,154 @@
+#ifndef URING_WORKER_H
+#define URING_WORKER_H
+
+#include "coroutine.h"
+#include "event-loop.h"
+#include "http-server.h"
+#include "io-uring.h"
+#include "ring-buffer.h"
+#include "timer-wheel.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <thread>
+#include <vector>
+
+// Per-connection state of a UringWorker. Besides what the epoll Connection holds it
+// tracks the operations in flight, since their completions can outlive the connection.
+struct UringConnection {
+    uint32_t id = 0; // Index in UringWorker::connections, reused once released
+    int fd = -1;
+    int file_slot = -1;      // Index in the registered file table, or -1 when it was full
+    uint32_t generation = 0; // Bumped on release; completions tagged with an older one are stale
+    bool open = false;
+
+    InputBuffer in_buffer; // Holds a slab block only while input is buffered
+    RequestState request;
+    OutputQueue output;
+    bool close_after_write = false;
+    bool peer_closed = false;
+    size_t requests_served = 0;
+    ConnectionTimer timer;
+
+    bool recv_armed = false;       // A multishot recv is posting completions
+    bool send_in_flight = false;   // The kernel owns iov/message until the send completes
+    bool poll_in_flight = false;   // Waiting for room before the next sendfile()
+    bool release_on_send = false;  // Closed while sending: released by the send completion
+    bool teardown_linked = false;  // The send in flight is linked to shutdown + close
+
+    struct iovec iov[OutputQueue::MAX_IOV];
+    struct msghdr message;
+    size_t send_length = 0;
+};
+
+/**
+ * @brief A reactor thread on io_uring instead of epoll.
+ * Readiness is never polled for: a multishot accept (ReusePort mode) and one multishot recv
+ * per connection, filling buffers from a shared provided-buffer ring, keep posting
+ * completions until cancelled. Responses go out as MSG_WAITALL sendmsg SQEs; a response
+ * that ends the connection is linked to its shutdown and close, so tearing down costs no
+ * extra round trip. Sockets are entered into the registered file table, so the kernel
+ * takes no file reference per operation. Everything queued while handling one batch of
+ * completions is submitted by the single io_uring_enter() that waits for the next; with
+ * SQPOLL not even that. File bodies still go out with sendfile(), waiting for room with
+ * a POLL_ADD, and so do coroutine handlers waiting on a descriptor.
+ */
+class UringWorker : public EventLoop, public Scheduler {
+  private:
+    enum class Op : uint8_t { None, Accept, Wake, Recv, Send, PollOut, FilesUpdate, Shutdown, Close, CloseSlot, Await };
+
+    size_t id;
+    HttpServer &server;
+
+    IoUring ring;
+    BufferRing buffers;
+
+    int event_fd = -1;
+    uint64_t wake_counter = 0; // Read target of the eventfd READ
+    int listen_fd = -1;        // ReusePort mode only
+    std::atomic<bool> running = false;
+    std::atomic<uint64_t> drain_deadline_ms = 0; // Set by drain(); 0 while serving normally
+    std::thread thread;
+
+    SpscRing<int> handoff_ring;
+
+    std::vector<std::unique_ptr<UringConnection>> connections; // Indexed by connection id
+    std::vector<uint32_t> free_connections;
+    std::vector<int> free_file_slots;
+    size_t open_connections = 0;
+    TimerWheel timers;
+
+    SleepQueue sleepers;
+    std::vector<std::coroutine_handle<>> fd_waiters; // Indexed by the Op::Await tag
+    std::vector<uint32_t> free_waiters;
+
+    // Cleared when the kernel turns down IORING_ACCEPT_MULTISHOT / IORING_RECV_MULTISHOT
+    bool multishot_accept = true;
+    bool multishot_recv = true;
+
+    static uint64_t tag(Op op, uint32_t index, uint32_t generation);
+    UringConnection *lookup(uint64_t user_data);
+
+    void run();
+    void on_completion(const struct io_uring_cqe &cqe);
+
+    bool arm_accept();
+    bool arm_wake();
+    bool arm_recv(UringConnection &conn);
+    bool arm_poll_out(UringConnection &conn);
+    void set_target(struct io_uring_sqe *sqe, const UringConnection &conn) const;
+
+    void drain_handoff_queue();
+    void register_connection(int client_fd);
+
+    // Cancels the idle timer and releases conn, or defers that to the send in flight
+    void close_connection(UringConnection &conn);
+
+    // Queues shutdown + close of the socket. Returns false if the SQ had no room.
+    bool queue_teardown(UringConnection &conn);
+
+    // Tears conn down and makes its id reusable; no send may be in flight
+    void release(UringConnection &conn);
+    void recycle(UringConnection &conn);
+
+    // A late head or body gets a 408; any other expired connection is closed
+    void expire_timers();
+
+    // One draining pass: cancels the accept, closes idle connections. True once the loop
+    // should end.
+    bool drain_step();
+
+    void on_recv(UringConnection *conn, const struct io_uring_cqe &cqe);
+    void on_send(UringConnection &conn, int result);
+
+    void serve_buffered(UringConnection &conn);
+
+    // Starts the next send if none is in flight, then re-arms the timer for the connection's
+    // phase; the flags report progress since the last call. Returns false if it was closed.
+    bool flush(UringConnection &conn, bool read_progress = false, bool write_progress = false);
+    bool send_output(UringConnection &conn, bool &write_progress);
+    bool submit_send(UringConnection &conn, size_t iov_count, bool before_file);
+
+    // RequestState::async_wake: a suspended handler of conn has its response
+    void on_async_response(UringConnection &conn);
+
+  public:
+    // Throws std::runtime_error when io_uring (or a feature this worker needs) is unavailable
+    UringWorker(size_t worker_id, HttpServer &owner);
+    ~UringWorker() override;
+
+    void set_listener(int fd) override;
+    void start() override;
+    void stop() override;
+    void drain(uint64_t deadline_ms) override;
+    void join() override;
+    void hand_off(std::span<const int> client_fds) override;
+
+    void resume_after(std::coroutine_handle<> handle, uint64_t delay_ms) override;
+    void resume_when_ready(std::coroutine_handle<> handle, int fd, bool writable) override;
+};
+
+#endif // URING_WORKER_H
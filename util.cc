@@ -1,4 +1,6 @@
 
+#include "util.h"
+#include <algorithm>
 #include <arpa/inet.h>
 #include <asm-generic/socket.h>
 #include <errno.h>
@@ -6,8 +8,11 @@
 #include <netinet/in.h>
 #include <sched.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string>
 #include <sys/epoll.h>
 #include <sys/resource.h>
+#include <sys/syscall.h>
 #include <sys/time.h>
 #include <sys/uio.h>
 #include <unistd.h>
@@ -37,3 +42,92 @@ void set_priority(int priority) {
         printf("Priority set to highest possible (-20 nice value).\n");
     }
 }
+
+#ifndef MPOL_LOCAL
+#define MPOL_LOCAL 4 // linux/mempolicy.h; numaif.h (libnuma) is not needed for one syscall
+#endif
+
+void prefer_local_memory() {
+    // EPERM in locked-down containers and ENOSYS without CONFIG_NUMA: the default policy,
+    // local allocation, is what applies then anyway
+    if (syscall(SYS_set_mempolicy, MPOL_LOCAL, nullptr, 0) == -1 && errno != EPERM && errno != ENOSYS) {
+        perror("set_mempolicy");
+    }
+}
+
+// Parses a sysfs CPU list such as "0-3,8-11" into ids
+static std::vector<int> parse_cpu_list(const std::string &list) {
+    std::vector<int> ids;
+    size_t pos = 0;
+    while (pos < list.size()) {
+        size_t end = list.find(',', pos);
+        if (end == std::string::npos) {
+            end = list.size();
+        }
+        std::string range = list.substr(pos, end - pos);
+        size_t dash = range.find('-');
+        int first = atoi(range.c_str());
+        int last = dash == std::string::npos ? first : atoi(range.c_str() + dash + 1);
+        for (int id = first; id <= last && !range.empty(); ++id) {
+            ids.push_back(id);
+        }
+        pos = end + 1;
+    }
+    return ids;
+}
+
+static std::string read_line(const std::string &path) {
+    std::string line;
+    FILE *file = fopen(path.c_str(), "r");
+    if (!file) {
+        return line;
+    }
+    char buffer[4096];
+    if (fgets(buffer, sizeof(buffer), file)) {
+        line = buffer;
+        while (!line.empty() && (line.back() == '\n' || line.back() == ' ')) {
+            line.pop_back();
+        }
+    }
+    fclose(file);
+    return line;
+}
+
+static CpuTopology detect_topology() {
+    CpuTopology topology;
+
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    if (sched_getaffinity(0, sizeof(mask), &mask) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &mask)) {
+                topology.cpus.push_back(cpu);
+            }
+        }
+    }
+    if (topology.cpus.empty()) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        for (long cpu = 0; cpu < (online > 0 ? online : 1); ++cpu) {
+            topology.cpus.push_back(static_cast<int>(cpu));
+        }
+    }
+    topology.cpu_nodes.assign(static_cast<size_t>(topology.cpus.back()) + 1, 0);
+
+    // Node directories can be sparse (node0, node2): walk up to the highest possible one
+    std::vector<int> nodes = parse_cpu_list(read_line("/sys/devices/system/node/possible"));
+    for (int node : nodes) {
+        std::string list = read_line("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+        for (int cpu : parse_cpu_list(list)) {
+            if (cpu >= 0 && static_cast<size_t>(cpu) < topology.cpu_nodes.size()) {
+                topology.cpu_nodes[cpu] = node;
+            }
+        }
+        topology.node_count = std::max(topology.node_count, node + 1);
+    }
+    return topology;
+}
+
+const CpuTopology &CpuTopology::system() {
+    static const CpuTopology topology = detect_topology();
+    return topology;
+}
@@ -0,0 +1,37 @@
+#ifndef UTIL_H
+#define UTIL_H
+
+#include <cstddef>
+#include <vector>
+
+// Restricts the calling thread to one CPU; logs and carries on unpinned on failure
+void pin_to_cpu_core(int core_id);
+
+void set_priority(int priority);
+
+// Makes the calling thread's future allocations come from the node it runs on, whatever
+// policy the process inherited (numactl --interleave, say). Pages already touched stay put.
+void prefer_local_memory();
+
+/**
+ * @brief The CPUs this process may run on and the NUMA node of each, read once from
+ * sched_getaffinity() and /sys/devices/system/node. A machine (or container) without that
+ * directory is treated as one node.
+ */
+struct CpuTopology {
+    std::vector<int> cpus;      // Usable CPUs (the affinity mask), ascending
+    std::vector<int> cpu_nodes; // Node of each CPU id, indexed by CPU id
+    int node_count = 1;
+
+    // 0 for a CPU the topology does not know about
+    int node_of(int cpu) const {
+        return cpu >= 0 && static_cast<size_t>(cpu) < cpu_nodes.size() ? cpu_nodes[cpu] : 0;
+    }
+
+    // The CPU worker index runs on when workers are spread one per CPU, wrapping around
+    int cpu_for_worker(size_t index) const { return cpus[index % cpus.size()]; }
+
+    static const CpuTopology &system();
+};
+
+#endif // UTIL_H
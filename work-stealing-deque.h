@@ -0,0 +1,124 @@
+#ifndef WORK_STEALING_DEQUE_H
+#define WORK_STEALING_DEQUE_H
+
+#include "ring-buffer.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+/**
+ * @brief Chase-Lev work-stealing deque (Le, Pop, Cohen & Zappa Nardelli's C11 formulation).
+ * The owning worker pushes and pops at the bottom (LIFO, cache-hot); any other thread may
+ * steal from the top (FIFO). T must be trivially copyable, so tasks are stored by pointer.
+ * The buffer grows on demand; retired buffers are kept until destruction because a
+ * concurrent thief may still be reading from one.
+ */
+template <class T> class WorkStealingDeque {
+    static_assert(std::is_trivially_copyable_v<T>, "WorkStealingDeque stores T with relaxed atomics");
+
+  private:
+    struct Buffer {
+        const int64_t mask;
+        std::unique_ptr<std::atomic<T>[]> items;
+
+        explicit Buffer(int64_t capacity) : mask(capacity - 1), items(new std::atomic<T>[capacity]) {}
+
+        int64_t capacity() const { return mask + 1; }
+        T load(int64_t i) const { return items[i & mask].load(std::memory_order_relaxed); }
+        void store(int64_t i, T item) { items[i & mask].store(item, std::memory_order_relaxed); }
+    };
+
+    alignas(CACHE_LINE_SIZE) std::atomic<int64_t> top{0};
+    alignas(CACHE_LINE_SIZE) std::atomic<int64_t> bottom{0};
+    std::atomic<Buffer *> buffer;
+    std::vector<std::unique_ptr<Buffer>> buffers; // Owner-only; includes the live one
+
+    Buffer *grow(Buffer *old, int64_t b, int64_t t) {
+        auto bigger = std::make_unique<Buffer>(old->capacity() * 2);
+        for (int64_t i = t; i < b; ++i) {
+            bigger->store(i, old->load(i));
+        }
+        Buffer *raw = bigger.get();
+        buffers.push_back(std::move(bigger));
+        buffer.store(raw, std::memory_order_release);
+        return raw;
+    }
+
+  public:
+    explicit WorkStealingDeque(size_t capacity = 256) {
+        buffers.push_back(std::make_unique<Buffer>((int64_t)round_up_pow2(capacity)));
+        buffer.store(buffers.back().get(), std::memory_order_relaxed);
+    }
+
+    WorkStealingDeque(const WorkStealingDeque &) = delete;
+    WorkStealingDeque &operator=(const WorkStealingDeque &) = delete;
+
+    // Owner only
+    void push(T item) {
+        int64_t b = bottom.load(std::memory_order_relaxed);
+        int64_t t = top.load(std::memory_order_acquire);
+        Buffer *a = buffer.load(std::memory_order_relaxed);
+        if (b - t > a->capacity() - 1) {
+            a = grow(a, b, t);
+        }
+        a->store(b, item);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom.store(b + 1, std::memory_order_relaxed);
+    }
+
+    // Owner only: newest item first
+    bool pop(T &item) {
+        int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+        Buffer *a = buffer.load(std::memory_order_relaxed);
+        bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top.load(std::memory_order_relaxed);
+
+        if (t > b) {
+            bottom.store(b + 1, std::memory_order_relaxed); // Empty
+            return false;
+        }
+
+        item = a->load(b);
+        if (t == b) {
+            // Last item: race the thieves for it
+            bool won = top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return won;
+        }
+        return true;
+    }
+
+    // Any thread: oldest item first. A false return may also mean a lost race.
+    bool steal(T &item) {
+        int64_t t = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = bottom.load(std::memory_order_acquire);
+
+        if (t >= b) {
+            return false;
+        }
+
+        Buffer *a = buffer.load(std::memory_order_acquire);
+        T candidate = a->load(t);
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            return false;
+        }
+        item = candidate;
+        return true;
+    }
+
+    bool empty_approx() const {
+        return bottom.load(std::memory_order_relaxed) <= top.load(std::memory_order_relaxed);
+    }
+
+    size_t size_approx() const {
+        int64_t size = bottom.load(std::memory_order_relaxed) - top.load(std::memory_order_relaxed);
+        return size > 0 ? static_cast<size_t>(size) : 0;
+    }
+};
+
+#endif // WORK_STEALING_DEQUE_H